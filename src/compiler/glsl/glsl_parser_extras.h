@@ -736,16 +736,29 @@ extern bool _mesa_glsl_process_extension(const char *name, YYLTYPE *name_locp,
 /*
  * These definitions apply to C and C++
  */
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+struct glsl_opt_stats;
+
 extern int glcpp_preprocess(void *ctx, const char **shader, char **info_log,
                       const struct gl_extensions *extensions, struct gl_context *gl_ctx);
 
 extern void _mesa_destroy_shader_compiler(void);
 extern void _mesa_destroy_shader_compiler_caches(void);
 
+/**
+ * Statistics of the common optimization loop (see opt_common.cpp), gathered
+ * into \c gl_context::OptStats when it is not NULL.
+ */
+extern struct glsl_opt_stats *_mesa_glsl_opt_stats_create(void);
+extern void _mesa_glsl_opt_stats_destroy(struct glsl_opt_stats *stats);
+extern void _mesa_glsl_opt_stats_print(FILE *fp,
+                                       const struct glsl_opt_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1045,6 +1045,9 @@ link_assign_uniform_locations(struct gl_shader_program *prog,
    ralloc_free(prog->UniformStorage);
    prog->UniformStorage = NULL;
    prog->NumUniformStorage = 0;
+   prog->UniformDataSlots = NULL;
+   prog->UniformDataDefaults = NULL;
+   prog->NumUniformDataSlots = 0;
 
    if (prog->UniformHash != NULL) {
       prog->UniformHash->clear();
@@ -1281,8 +1284,19 @@ link_assign_uniform_locations(struct gl_shader_program *prog,
    prog->NumUniformStorage = num_uniforms;
    prog->NumHiddenUniforms = hidden_uniforms;
    prog->UniformStorage = uniforms;
+   prog->NumUniformDataSlots = num_data_slots;
+   prog->UniformDataSlots = data;
 
    link_set_uniform_initializers(prog, boolean_true);
 
+   /* Remember the link-time values so that a program restored from a
+    * binary can start from them rather than from whatever the application
+    * set with glUniform*() before glGetProgramBinary().
+    */
+   prog->UniformDataDefaults =
+      ralloc_array(uniforms, union gl_constant_value, num_data_slots);
+   memcpy(prog->UniformDataDefaults, data,
+          sizeof(union gl_constant_value) * num_data_slots);
+
    return;
 }
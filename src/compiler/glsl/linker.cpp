@@ -3978,7 +3978,7 @@ link_assign_subroutine_types(struct gl_shader_program *prog)
    }
 }
 
-static void
+void
 split_ubos_and_ssbos(void *mem_ctx,
                      struct gl_uniform_block *blocks,
                      unsigned num_blocks,
@@ -4390,10 +4390,9 @@ link_shaders(struct gl_context *ctx, struct gl_shader_program *prog)
          lower_tess_level(prog->_LinkedShaders[i]);
       }
 
-      while (do_common_optimization(prog->_LinkedShaders[i]->ir, true, false,
-                                    &ctx->Const.ShaderCompilerOptions[i],
-                                    ctx->Const.NativeIntegers))
-	 ;
+      do_common_optimization_loop(prog->_LinkedShaders[i]->ir, true, false,
+                                  &ctx->Const.ShaderCompilerOptions[i],
+                                  ctx->Const.NativeIntegers, ctx->OptStats);
 
       lower_const_arrays_to_uniforms(prog->_LinkedShaders[i]->ir);
    }
@@ -51,6 +51,17 @@ extern bool
 link_uniform_blocks_are_compatible(const gl_uniform_block *a,
 				   const gl_uniform_block *b);
 
+extern void
+split_ubos_and_ssbos(void *mem_ctx,
+                     struct gl_uniform_block *blocks,
+                     unsigned num_blocks,
+                     struct gl_uniform_block ***ubos,
+                     unsigned *num_ubos,
+                     unsigned **ubo_interface_block_indices,
+                     struct gl_uniform_block ***ssbos,
+                     unsigned *num_ssbos,
+                     unsigned **ssbo_interface_block_indices);
+
 extern unsigned
 link_uniform_blocks(void *mem_ctx,
                     struct gl_context *ctx,
@@ -257,12 +257,14 @@ int dump_ast = 0;
 int dump_hir = 0;
 int dump_lir = 0;
 int do_link = 0;
+int opt_stats = 0;
 
 const struct option compiler_opts[] = {
    { "dump-ast", no_argument, &dump_ast, 1 },
    { "dump-hir", no_argument, &dump_hir, 1 },
    { "dump-lir", no_argument, &dump_lir, 1 },
    { "link",     no_argument, &do_link,  1 },
+   { "opt-stats", no_argument, &opt_stats, 1 },
    { "version",  required_argument, NULL, 'v' },
    { NULL, 0, NULL, 0 }
 };
@@ -346,6 +348,9 @@ main(int argc, char **argv)
 
    initialize_context(ctx, (glsl_es) ? API_OPENGLES2 : API_OPENGL_COMPAT);
 
+   if (opt_stats)
+      ctx->OptStats = _mesa_glsl_opt_stats_create();
+
    struct gl_shader_program *whole_program;
 
    whole_program = rzalloc (NULL, struct gl_shader_program);
@@ -424,6 +429,12 @@ main(int argc, char **argv)
    delete whole_program->FragDataIndexBindings;
 
    ralloc_free(whole_program);
+
+   if (ctx->OptStats) {
+      _mesa_glsl_opt_stats_print(stdout, ctx->OptStats);
+      _mesa_glsl_opt_stats_destroy(ctx->OptStats);
+   }
+
    _mesa_glsl_release_types();
    _mesa_glsl_release_builtin_functions();
 
@@ -0,0 +1,598 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file opt_common.cpp
+ *
+ * The set of common optimization passes run at compile and link time.
+ *
+ * \c do_common_optimization runs every pass once over the whole shader.
+ * \c do_common_optimization_loop runs the passes until none of them makes
+ * progress, but only re-runs a pass where it could make progress: a pass
+ * that made no progress is not run again until something it looks at has
+ * changed.  Passes that only look at one function at a time are tracked
+ * per \c ir_function, everything else is tracked for the shader as a whole.
+ */
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "ir.h"
+#include "ir_optimization.h"
+#include "glsl_parser_extras.h"
+#include "loop_analysis.h"
+#include "main/macros.h"
+#include "util/hash_table.h"
+#include "util/ralloc.h"
+
+namespace {
+
+struct common_opt_params {
+   bool linked;
+   bool uniform_locations_assigned;
+   const struct gl_shader_compiler_options *options;
+   bool native_integers;
+};
+
+enum common_opt_flags {
+   /** Only run on linked shaders. */
+   OPT_LINKED = 1 << 0,
+   /** Only run on unlinked shaders. */
+   OPT_UNLINKED = 1 << 1,
+   /** Only run if the driver prefers AOS code. */
+   OPT_AOS = 1 << 2,
+   /**
+    * The pass looks at each function on its own, so running it on a list
+    * holding a single \c ir_function gives the same result as running it on
+    * the whole shader.
+    */
+   OPT_FUNCTION_LOCAL = 1 << 3,
+};
+
+struct common_opt_pass {
+   const char *name;
+   bool (*run)(exec_list *ir, const common_opt_params *params);
+   unsigned flags;
+};
+
+#define OPT_WRAP(NAME, ...)                                             \
+   static bool                                                          \
+   opt_##NAME(exec_list *ir, const common_opt_params *params)           \
+   {                                                                    \
+      (void) params;                                                    \
+      return NAME(__VA_ARGS__);                                         \
+   }
+
+OPT_WRAP(lower_instructions, ir, SUB_TO_ADD_NEG)
+OPT_WRAP(do_function_inlining, ir)
+OPT_WRAP(do_dead_functions, ir)
+OPT_WRAP(do_structure_splitting, ir)
+OPT_WRAP(do_if_simplification, ir)
+OPT_WRAP(opt_flatten_nested_if_blocks, ir)
+OPT_WRAP(opt_conditional_discard, ir)
+OPT_WRAP(do_copy_propagation, ir)
+OPT_WRAP(do_copy_propagation_elements, ir)
+OPT_WRAP(opt_flip_matrices, ir)
+OPT_WRAP(do_vectorize, ir)
+OPT_WRAP(do_dead_code, ir, params->uniform_locations_assigned)
+OPT_WRAP(do_dead_code_unlinked, ir)
+OPT_WRAP(do_dead_code_local, ir)
+OPT_WRAP(do_tree_grafting, ir)
+OPT_WRAP(do_constant_propagation, ir)
+OPT_WRAP(do_constant_variable, ir)
+OPT_WRAP(do_constant_variable_unlinked, ir)
+OPT_WRAP(do_constant_folding, ir)
+OPT_WRAP(do_minmax_prune, ir)
+OPT_WRAP(do_rebalance_tree, ir)
+OPT_WRAP(do_algebraic, ir, params->native_integers, params->options)
+OPT_WRAP(do_lower_jumps, ir)
+OPT_WRAP(do_vec_index_to_swizzle, ir)
+OPT_WRAP(lower_vector_insert, ir, false)
+OPT_WRAP(do_swizzle_swizzle, ir)
+OPT_WRAP(do_noop_swizzle, ir)
+OPT_WRAP(optimize_split_arrays, ir, params->linked)
+OPT_WRAP(optimize_redundant_jumps, ir)
+
+#undef OPT_WRAP
+
+static bool
+opt_unroll_loops(exec_list *ir, const common_opt_params *params)
+{
+   bool progress = false;
+
+   loop_state *ls = analyze_loop_variables(ir);
+   if (ls->loop_found) {
+      progress = set_loop_controls(ir, ls);
+      progress = unroll_loops(ir, ls, params->options) || progress;
+   }
+   delete ls;
+
+   return progress;
+}
+
+#define PASS(NAME, FLAGS) { #NAME, opt_##NAME, FLAGS }
+
+/**
+ * The passes in the order they are run.
+ *
+ * Passes that look at global variables, at more than one function or at
+ * the list of functions itself must not be marked \c OPT_FUNCTION_LOCAL.
+ */
+static const common_opt_pass common_opt_passes[] = {
+   PASS(lower_instructions,            OPT_FUNCTION_LOCAL),
+   PASS(do_function_inlining,          OPT_LINKED),
+   PASS(do_dead_functions,             OPT_LINKED),
+   PASS(do_structure_splitting,        OPT_LINKED),
+   PASS(do_if_simplification,          OPT_FUNCTION_LOCAL),
+   PASS(opt_flatten_nested_if_blocks,  OPT_FUNCTION_LOCAL),
+   PASS(opt_conditional_discard,       OPT_FUNCTION_LOCAL),
+   PASS(do_copy_propagation,           OPT_FUNCTION_LOCAL),
+   PASS(do_copy_propagation_elements,  OPT_FUNCTION_LOCAL),
+   PASS(opt_flip_matrices,             OPT_UNLINKED | OPT_AOS),
+   PASS(do_vectorize,                  OPT_LINKED | OPT_AOS),
+   PASS(do_dead_code,                  OPT_LINKED),
+   PASS(do_dead_code_unlinked,         OPT_UNLINKED | OPT_FUNCTION_LOCAL),
+   PASS(do_dead_code_local,            OPT_FUNCTION_LOCAL),
+   PASS(do_tree_grafting,              OPT_FUNCTION_LOCAL),
+   PASS(do_constant_propagation,       OPT_FUNCTION_LOCAL),
+   PASS(do_constant_variable,          OPT_LINKED),
+   PASS(do_constant_variable_unlinked, OPT_UNLINKED | OPT_FUNCTION_LOCAL),
+   PASS(do_constant_folding,           OPT_FUNCTION_LOCAL),
+   PASS(do_minmax_prune,               OPT_FUNCTION_LOCAL),
+   PASS(do_rebalance_tree,             OPT_FUNCTION_LOCAL),
+   PASS(do_algebraic,                  OPT_FUNCTION_LOCAL),
+   PASS(do_lower_jumps,                OPT_FUNCTION_LOCAL),
+   PASS(do_vec_index_to_swizzle,       OPT_FUNCTION_LOCAL),
+   PASS(lower_vector_insert,           OPT_FUNCTION_LOCAL),
+   PASS(do_swizzle_swizzle,            OPT_FUNCTION_LOCAL),
+   PASS(do_noop_swizzle,               OPT_FUNCTION_LOCAL),
+   PASS(optimize_split_arrays,         0),
+   PASS(optimize_redundant_jumps,      OPT_FUNCTION_LOCAL),
+   PASS(unroll_loops,                  OPT_FUNCTION_LOCAL),
+};
+
+#undef PASS
+
+#define NUM_COMMON_OPT_PASSES ARRAY_SIZE(common_opt_passes)
+
+static bool
+pass_enabled(const common_opt_pass *pass, const common_opt_params *params)
+{
+   if ((pass->flags & OPT_LINKED) && !params->linked)
+      return false;
+   if ((pass->flags & OPT_UNLINKED) && params->linked)
+      return false;
+   if ((pass->flags & OPT_AOS) && !params->options->OptimizeForAOS)
+      return false;
+   return true;
+}
+
+} /* anonymous namespace */
+
+/**
+ * Counters collected by \c do_common_optimization_loop.
+ */
+struct glsl_opt_stats {
+   /** Number of calls to \c do_common_optimization_loop. */
+   unsigned loops;
+   /** Number of rounds over the pass list, summed over all loops. */
+   unsigned rounds;
+   /** Largest number of rounds a single loop needed. */
+   unsigned max_rounds;
+
+   struct {
+      /** Times the pass was run, once per function for local passes. */
+      unsigned runs;
+      /** Runs that made progress. */
+      unsigned progress;
+      /** Runs the worklist skipped because nothing had changed. */
+      unsigned skipped;
+      /** Time spent in the pass. */
+      uint64_t time_ns;
+   } pass[NUM_COMMON_OPT_PASSES];
+};
+
+static int64_t
+get_time_ns(void)
+{
+#if defined(_WIN32)
+   return (int64_t) clock() * (INT64_C(1000000000) / CLOCKS_PER_SEC);
+#else
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+#endif
+}
+
+namespace {
+
+/**
+ * Per function state of the worklist.
+ *
+ * \c serial is bumped whenever a pass changes the function, and
+ * \c clean[i] records the serial at which pass \c i last ran on the function
+ * without making progress.  The pass is only run again once the two differ.
+ */
+struct function_state {
+   unsigned serial;
+   unsigned clean[NUM_COMMON_OPT_PASSES];
+};
+
+class common_opt_worklist {
+public:
+   common_opt_worklist(exec_list *ir, const common_opt_params *params,
+                       glsl_opt_stats *stats);
+   ~common_opt_worklist();
+
+   bool run_round();
+
+private:
+   bool run_pass(unsigned i, exec_list *list);
+   bool run_global(unsigned i);
+   bool run_local(unsigned i);
+   bool has_global_code() const;
+   function_state *get_state(ir_function *f);
+   void invalidate_all();
+
+   exec_list *ir;
+   const common_opt_params *params;
+   glsl_opt_stats *stats;
+
+   void *mem_ctx;
+   /** ir_function -> function_state */
+   struct hash_table *functions;
+
+   /** Bumped on any progress anywhere in the shader. */
+   unsigned serial;
+   /**
+    * Value of \c serial when a pass not tracked per function last made
+    * progress.  Any state older than this is stale.
+    */
+   unsigned barrier;
+
+   /** As \c function_state::clean, for passes run on the whole shader. */
+   unsigned global_clean[NUM_COMMON_OPT_PASSES];
+
+   /**
+    * As \c function_state, for instructions outside of any function (the
+    * initializers of globals in unlinked shaders).
+    */
+   function_state top_level;
+};
+
+common_opt_worklist::common_opt_worklist(exec_list *ir,
+                                         const common_opt_params *params,
+                                         glsl_opt_stats *stats)
+   : ir(ir), params(params), stats(stats), serial(1), barrier(1)
+{
+   mem_ctx = ralloc_context(NULL);
+   functions = _mesa_hash_table_create(mem_ctx, _mesa_hash_pointer,
+                                       _mesa_key_pointer_equal);
+   memset(global_clean, 0, sizeof(global_clean));
+   memset(&top_level, 0, sizeof(top_level));
+   top_level.serial = serial;
+}
+
+common_opt_worklist::~common_opt_worklist()
+{
+   ralloc_free(mem_ctx);
+}
+
+bool
+common_opt_worklist::run_pass(unsigned i, exec_list *list)
+{
+   const common_opt_pass *pass = &common_opt_passes[i];
+
+   if (stats == NULL)
+      return pass->run(list, params);
+
+   const int64_t start = get_time_ns();
+   const bool progress = pass->run(list, params);
+
+   stats->pass[i].time_ns += get_time_ns() - start;
+   stats->pass[i].runs++;
+   if (progress)
+      stats->pass[i].progress++;
+
+   return progress;
+}
+
+/**
+ * Forget everything known about the shader, after a pass that may have
+ * changed any part of it made progress.
+ */
+void
+common_opt_worklist::invalidate_all()
+{
+   barrier = ++serial;
+   top_level.serial = barrier;
+}
+
+function_state *
+common_opt_worklist::get_state(ir_function *f)
+{
+   function_state *state;
+   struct hash_entry *entry = _mesa_hash_table_search(functions, f);
+
+   if (entry != NULL) {
+      state = (function_state *) entry->data;
+   } else {
+      state = rzalloc(mem_ctx, function_state);
+      _mesa_hash_table_insert(functions, f, state);
+   }
+
+   if (state->serial < barrier)
+      state->serial = barrier;
+
+   return state;
+}
+
+bool
+common_opt_worklist::has_global_code() const
+{
+   foreach_in_list(ir_instruction, inst, ir) {
+      if (inst->ir_type != ir_type_function &&
+          inst->ir_type != ir_type_variable)
+         return true;
+   }
+
+   return false;
+}
+
+bool
+common_opt_worklist::run_global(unsigned i)
+{
+   if (global_clean[i] == serial) {
+      if (stats)
+         stats->pass[i].skipped++;
+      return false;
+   }
+
+   if (run_pass(i, ir)) {
+      invalidate_all();
+      return true;
+   }
+
+   global_clean[i] = serial;
+   return false;
+}
+
+bool
+common_opt_worklist::run_local(unsigned i)
+{
+   /* Code outside of functions can only be reached by running the pass on
+    * the whole shader.  Do that until the pass stops making progress there.
+    */
+   if (top_level.clean[i] != top_level.serial && has_global_code()) {
+      if (run_pass(i, ir)) {
+         invalidate_all();
+         return true;
+      }
+
+      top_level.clean[i] = top_level.serial;
+      foreach_in_list(ir_instruction, inst, ir) {
+         ir_function *f = inst->as_function();
+         if (f != NULL) {
+            function_state *state = get_state(f);
+            state->clean[i] = state->serial;
+         }
+      }
+      return false;
+   }
+
+   bool progress = false;
+
+   foreach_in_list(ir_instruction, inst, ir) {
+      ir_function *f = inst->as_function();
+      if (f == NULL)
+         continue;
+
+      function_state *state = get_state(f);
+      if (state->clean[i] == state->serial) {
+         if (stats)
+            stats->pass[i].skipped++;
+         continue;
+      }
+
+      /* Move the function to a list of its own for the duration of the
+       * pass, then put it back where it was.  Function local passes never
+       * remove or replace the ir_function itself.
+       */
+      exec_node *const prev = f->prev;
+      exec_list single;
+
+      f->remove();
+      single.push_tail(f);
+
+      const bool f_progress = run_pass(i, &single);
+
+      assert(single.get_head() == f && single.get_tail() == f);
+      f->remove();
+      prev->insert_after(f);
+
+      if (f_progress) {
+         state->serial = ++serial;
+         progress = true;
+      } else {
+         state->clean[i] = state->serial;
+      }
+   }
+
+   return progress;
+}
+
+bool
+common_opt_worklist::run_round()
+{
+   bool progress = false;
+
+   for (unsigned i = 0; i < NUM_COMMON_OPT_PASSES; i++) {
+      const common_opt_pass *pass = &common_opt_passes[i];
+
+      if (!pass_enabled(pass, params))
+         continue;
+
+      if (pass->flags & OPT_FUNCTION_LOCAL)
+         progress = run_local(i) || progress;
+      else
+         progress = run_global(i) || progress;
+   }
+
+   return progress;
+}
+
+} /* anonymous namespace */
+
+/**
+ * Do the set of common optimizations passes
+ *
+ * \param ir                          List of instructions to be optimized
+ * \param linked                      Is the shader linked?  This enables
+ *                                    optimizations passes that remove code at
+ *                                    global scope and could cause linking to
+ *                                    fail.
+ * \param uniform_locations_assigned  Have locations already been assigned for
+ *                                    uniforms?  This prevents the declarations
+ *                                    of unused uniforms from being removed.
+ *                                    The setting of this flag only matters if
+ *                                    \c linked is \c true.
+ * \param max_unroll_iterations       Maximum number of loop iterations to be
+ *                                    unrolled.  Setting to 0 disables loop
+ *                                    unrolling.
+ * \param options                     The driver's preferred shader options.
+ */
+bool
+do_common_optimization(exec_list *ir, bool linked,
+		       bool uniform_locations_assigned,
+                       const struct gl_shader_compiler_options *options,
+                       bool native_integers)
+{
+   const bool debug = false;
+   const common_opt_params params = {
+      linked, uniform_locations_assigned, options, native_integers
+   };
+   bool progress = false;
+
+   for (unsigned i = 0; i < NUM_COMMON_OPT_PASSES; i++) {
+      const common_opt_pass *pass = &common_opt_passes[i];
+
+      if (!pass_enabled(pass, &params))
+         continue;
+
+      if (debug) {
+         fprintf(stderr, "START GLSL optimization %s\n", pass->name);
+         const bool opt_progress = pass->run(ir, &params);
+         progress = opt_progress || progress;
+         if (opt_progress)
+            _mesa_print_ir(stderr, ir, NULL);
+         fprintf(stderr, "GLSL optimization %s: %s progress\n",
+                 pass->name, opt_progress ? "made" : "no");
+      } else {
+         progress = pass->run(ir, &params) || progress;
+      }
+   }
+
+   return progress;
+}
+
+/**
+ * Run the common optimization passes until they stop making progress.
+ *
+ * This gives the same result as calling \c do_common_optimization until it
+ * returns false, but skips passes that are known to have nothing to do.
+ *
+ * \param stats  If not NULL, pass run counts and timings are added to it.
+ *
+ * \return true if any pass made progress.
+ */
+bool
+do_common_optimization_loop(exec_list *ir, bool linked,
+                            bool uniform_locations_assigned,
+                            const struct gl_shader_compiler_options *options,
+                            bool native_integers,
+                            struct glsl_opt_stats *stats)
+{
+   const common_opt_params params = {
+      linked, uniform_locations_assigned, options, native_integers
+   };
+   common_opt_worklist worklist(ir, &params, stats);
+   bool progress_ever = false;
+   unsigned rounds = 0;
+
+   while (worklist.run_round()) {
+      progress_ever = true;
+      rounds++;
+   }
+   rounds++;
+
+   if (stats) {
+      stats->loops++;
+      stats->rounds += rounds;
+      stats->max_rounds = MAX2(stats->max_rounds, rounds);
+   }
+
+   return progress_ever;
+}
+
+extern "C" {
+
+struct glsl_opt_stats *
+_mesa_glsl_opt_stats_create(void)
+{
+   return (struct glsl_opt_stats *) calloc(1, sizeof(struct glsl_opt_stats));
+}
+
+void
+_mesa_glsl_opt_stats_destroy(struct glsl_opt_stats *stats)
+{
+   free(stats);
+}
+
+void
+_mesa_glsl_opt_stats_print(FILE *fp, const struct glsl_opt_stats *stats)
+{
+   uint64_t total_ns = 0;
+
+   fprintf(fp, "GLSL optimizer: %u loops, %u rounds, at most %u in a loop\n",
+           stats->loops, stats->rounds, stats->max_rounds);
+   fprintf(fp, "  %-30s %8s %8s %8s %10s\n",
+           "pass", "runs", "progress", "skipped", "time (ms)");
+
+   for (unsigned i = 0; i < NUM_COMMON_OPT_PASSES; i++) {
+      if (stats->pass[i].runs == 0 && stats->pass[i].skipped == 0)
+         continue;
+
+      fprintf(fp, "  %-30s %8u %8u %8u %10.3f\n",
+              common_opt_passes[i].name, stats->pass[i].runs,
+              stats->pass[i].progress, stats->pass[i].skipped,
+              stats->pass[i].time_ns / 1e6);
+      total_ns += stats->pass[i].time_ns;
+   }
+
+   fprintf(fp, "  %-30s %8s %8s %8s %10.3f\n", "total", "", "", "",
+           total_ns / 1e6);
+}
+
+} /* extern "C" */
@@ -0,0 +1,1197 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file serialize.cpp
+ *
+ * Serialization of the results of linking a GLSL program.
+ *
+ * Everything in a linked \c gl_shader_program that the API and the drivers
+ * look at after linking is written to a blob: uniform storage, the uniform
+ * and subroutine location remap tables, buffer blocks, atomic buffers,
+ * transform feedback outputs, the resource list used by the
+ * ARB_program_interface_query entry points and the per-stage linked
+ * \c gl_shader data.  Pointers between these structures are written as
+ * indices and rebuilt on the way back in.
+ *
+ * The GLSL IR is not serialized.  A program restored from a blob has no
+ * IR attached to its linked shaders, so it cannot be fed back to the
+ * compiler; the driver is expected to restore its own code for each stage.
+ */
+
+#include "main/core.h"
+#include "main/shaderobj.h"
+#include "program/hash_table.h"
+#include "ir.h"
+#include "ir_uniform.h"
+#include "linker.h"
+#include "blob.h"
+#include "serialize.h"
+#include "util/ralloc.h"
+
+/**
+ * \name Special values stored in place of an index into an array.
+ */
+/*@{*/
+#define SERIALIZED_NULL     0xffffffffu
+#define SERIALIZED_INACTIVE 0xfffffffeu
+/*@}*/
+
+enum {
+   /* glsl_base_type values go below this. */
+   TYPE_TAG_NULL = 0xff,
+};
+
+static void
+write_string(struct blob *blob, const char *str)
+{
+   blob_write_uint32(blob, str != NULL);
+   if (str)
+      blob_write_string(blob, str);
+}
+
+static char *
+read_string(void *mem_ctx, struct blob_reader *blob)
+{
+   if (!blob_read_uint32(blob))
+      return NULL;
+
+   const char *str = blob_read_string(blob);
+   return str ? ralloc_strdup(mem_ctx, str) : NULL;
+}
+
+static char *
+read_required_string(void *mem_ctx, struct blob_reader *blob)
+{
+   const char *str = blob_read_string(blob);
+   return str ? ralloc_strdup(mem_ctx, str) : NULL;
+}
+
+static void
+write_array(struct blob *blob, const void *data, size_t size)
+{
+   if (size)
+      blob_write_bytes(blob, data, size);
+}
+
+static void
+read_array(struct blob_reader *blob, void *data, size_t size)
+{
+   /* blob_copy_bytes() flags a zero-sized read at the very end of the
+    * buffer as an overrun.
+    */
+   if (size)
+      blob_copy_bytes(blob, (uint8_t *) data, size);
+}
+
+/**
+ * Read an element count and check that the remaining data could possibly
+ * hold that many elements of at least \c min_size bytes each, so that a
+ * corrupted count cannot make us allocate unbounded amounts of memory.
+ */
+static unsigned
+read_count(struct blob_reader *blob, size_t min_size)
+{
+   unsigned count = blob_read_uint32(blob);
+
+   if (blob->overrun ||
+       (size_t) (blob->end - blob->current) / MAX2(min_size, 1) < count) {
+      blob->overrun = true;
+      return 0;
+   }
+
+   return count;
+}
+
+
+void
+encode_type_to_blob(struct blob *blob, const glsl_type *type)
+{
+   if (type == NULL) {
+      blob_write_uint32(blob, TYPE_TAG_NULL);
+      return;
+   }
+
+   blob_write_uint32(blob, type->base_type);
+
+   switch (type->base_type) {
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_BOOL:
+      blob_write_uint32(blob, type->vector_elements);
+      blob_write_uint32(blob, type->matrix_columns);
+      return;
+   case GLSL_TYPE_SAMPLER:
+      blob_write_uint32(blob, type->sampler_dimensionality);
+      blob_write_uint32(blob, type->sampler_shadow);
+      blob_write_uint32(blob, type->sampler_array);
+      blob_write_uint32(blob, type->sampler_type);
+      return;
+   case GLSL_TYPE_IMAGE:
+      blob_write_uint32(blob, type->sampler_dimensionality);
+      blob_write_uint32(blob, type->sampler_array);
+      blob_write_uint32(blob, type->sampler_type);
+      return;
+   case GLSL_TYPE_SUBROUTINE:
+      blob_write_string(blob, type->name);
+      return;
+   case GLSL_TYPE_ARRAY:
+      blob_write_uint32(blob, type->length);
+      encode_type_to_blob(blob, type->fields.array);
+      return;
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE:
+      blob_write_string(blob, type->name);
+      blob_write_uint32(blob, type->length);
+      blob_write_uint32(blob, type->interface_packing);
+      for (unsigned i = 0; i < type->length; i++) {
+         const glsl_struct_field *f = &type->fields.structure[i];
+
+         encode_type_to_blob(blob, f->type);
+         blob_write_string(blob, f->name);
+         blob_write_uint32(blob, f->location);
+         blob_write_uint32(blob, f->interpolation |
+                                 f->centroid << 2 |
+                                 f->sample << 3 |
+                                 f->matrix_layout << 4 |
+                                 f->patch << 6 |
+                                 f->precision << 7 |
+                                 f->image_read_only << 9 |
+                                 f->image_write_only << 10 |
+                                 f->image_coherent << 11 |
+                                 f->image_volatile << 12 |
+                                 f->image_restrict << 13);
+      }
+      return;
+   case GLSL_TYPE_ATOMIC_UINT:
+   case GLSL_TYPE_VOID:
+   case GLSL_TYPE_ERROR:
+      return;
+   }
+
+   unreachable("unknown glsl_base_type");
+}
+
+const glsl_type *
+decode_type_from_blob(struct blob_reader *blob)
+{
+   const uint32_t base_type = blob_read_uint32(blob);
+
+   if (blob->overrun)
+      return glsl_type::error_type;
+
+   switch (base_type) {
+   case TYPE_TAG_NULL:
+      return NULL;
+   case GLSL_TYPE_UINT:
+   case GLSL_TYPE_INT:
+   case GLSL_TYPE_FLOAT:
+   case GLSL_TYPE_DOUBLE:
+   case GLSL_TYPE_BOOL: {
+      unsigned rows = blob_read_uint32(blob);
+      unsigned columns = blob_read_uint32(blob);
+      return glsl_type::get_instance(base_type, rows, columns);
+   }
+   case GLSL_TYPE_SAMPLER: {
+      unsigned dim = blob_read_uint32(blob);
+      bool shadow = blob_read_uint32(blob);
+      bool array = blob_read_uint32(blob);
+      unsigned type = blob_read_uint32(blob);
+      return glsl_type::get_sampler_instance((enum glsl_sampler_dim) dim,
+                                             shadow, array,
+                                             (glsl_base_type) type);
+   }
+   case GLSL_TYPE_IMAGE: {
+      unsigned dim = blob_read_uint32(blob);
+      bool array = blob_read_uint32(blob);
+      unsigned type = blob_read_uint32(blob);
+      return glsl_type::get_image_instance((enum glsl_sampler_dim) dim,
+                                           array, (glsl_base_type) type);
+   }
+   case GLSL_TYPE_ATOMIC_UINT:
+      return glsl_type::atomic_uint_type;
+   case GLSL_TYPE_VOID:
+      return glsl_type::void_type;
+   case GLSL_TYPE_ERROR:
+      return glsl_type::error_type;
+   case GLSL_TYPE_SUBROUTINE: {
+      const char *name = blob_read_string(blob);
+      if (name == NULL)
+         return glsl_type::error_type;
+      return glsl_type::get_subroutine_instance(name);
+   }
+   case GLSL_TYPE_ARRAY: {
+      unsigned length = blob_read_uint32(blob);
+      const glsl_type *element = decode_type_from_blob(blob);
+      if (element == NULL || element->is_error())
+         return glsl_type::error_type;
+      return glsl_type::get_array_instance(element, length);
+   }
+   case GLSL_TYPE_STRUCT:
+   case GLSL_TYPE_INTERFACE: {
+      const char *name = blob_read_string(blob);
+      unsigned num_fields = read_count(blob, 4 * sizeof(uint32_t));
+      unsigned packing = blob_read_uint32(blob);
+
+      if (name == NULL || blob->overrun)
+         return glsl_type::error_type;
+
+      glsl_struct_field *fields =
+         ralloc_array(NULL, glsl_struct_field, MAX2(num_fields, 1));
+      const glsl_type *type = glsl_type::error_type;
+
+      for (unsigned i = 0; i < num_fields; i++) {
+         glsl_struct_field *f = &fields[i];
+
+         f->type = decode_type_from_blob(blob);
+         f->name = blob_read_string(blob);
+         f->location = blob_read_uint32(blob);
+
+         const uint32_t bits = blob_read_uint32(blob);
+         f->interpolation = bits & 0x3;
+         f->centroid = (bits >> 2) & 0x1;
+         f->sample = (bits >> 3) & 0x1;
+         f->matrix_layout = (bits >> 4) & 0x3;
+         f->patch = (bits >> 6) & 0x1;
+         f->precision = (bits >> 7) & 0x3;
+         f->image_read_only = (bits >> 9) & 0x1;
+         f->image_write_only = (bits >> 10) & 0x1;
+         f->image_coherent = (bits >> 11) & 0x1;
+         f->image_volatile = (bits >> 12) & 0x1;
+         f->image_restrict = (bits >> 13) & 0x1;
+
+         if (f->type == NULL || f->type->is_error() || f->name == NULL)
+            goto done;
+      }
+
+      if (base_type == GLSL_TYPE_STRUCT) {
+         type = glsl_type::get_record_instance(fields, num_fields, name);
+      } else {
+         type = glsl_type::get_interface_instance(fields, num_fields,
+                                                  (enum glsl_interface_packing) packing,
+                                                  name);
+      }
+
+   done:
+      ralloc_free(fields);
+      return type;
+   }
+   }
+
+   blob->overrun = true;
+   return glsl_type::error_type;
+}
+
+static bool
+read_type(struct blob_reader *blob, const glsl_type **type)
+{
+   *type = decode_type_from_blob(blob);
+   return *type != NULL && !(*type)->is_error() && !blob->overrun;
+}
+
+
+/**
+ * \name Helpers turning pointers into the program's arrays into indices.
+ */
+/*@{*/
+static uint32_t
+uniform_index(const struct gl_shader_program *prog,
+              const struct gl_uniform_storage *uni)
+{
+   if (uni == NULL)
+      return SERIALIZED_NULL;
+   if (uni == INACTIVE_UNIFORM_EXPLICIT_LOCATION)
+      return SERIALIZED_INACTIVE;
+
+   assert(uni >= prog->UniformStorage &&
+          uni < prog->UniformStorage + prog->NumUniformStorage);
+   return uni - prog->UniformStorage;
+}
+
+static bool
+uniform_from_index(const struct gl_shader_program *prog, uint32_t index,
+                   struct gl_uniform_storage **uni)
+{
+   if (index == SERIALIZED_NULL)
+      *uni = NULL;
+   else if (index == SERIALIZED_INACTIVE)
+      *uni = INACTIVE_UNIFORM_EXPLICIT_LOCATION;
+   else if (index < prog->NumUniformStorage)
+      *uni = &prog->UniformStorage[index];
+   else
+      return false;
+
+   return true;
+}
+/*@}*/
+
+static void
+write_remap_table(struct blob *blob, const struct gl_shader_program *prog,
+                  struct gl_uniform_storage **table, unsigned num_entries)
+{
+   blob_write_uint32(blob, num_entries);
+   for (unsigned i = 0; i < num_entries; i++)
+      blob_write_uint32(blob, uniform_index(prog, table[i]));
+}
+
+static bool
+read_remap_table(struct blob_reader *blob, void *mem_ctx,
+                 const struct gl_shader_program *prog,
+                 struct gl_uniform_storage ***table, unsigned *num_entries)
+{
+   *num_entries = read_count(blob, sizeof(uint32_t));
+   *table = NULL;
+
+   if (*num_entries == 0)
+      return !blob->overrun;
+
+   *table = ralloc_array(mem_ctx, struct gl_uniform_storage *, *num_entries);
+   for (unsigned i = 0; i < *num_entries; i++) {
+      if (!uniform_from_index(prog, blob_read_uint32(blob), &(*table)[i]))
+         return false;
+   }
+
+   return !blob->overrun;
+}
+
+
+static void
+write_uniform_storage(struct blob *blob, struct gl_shader_program *prog)
+{
+   blob_write_uint32(blob, prog->NumUniformStorage);
+   blob_write_uint32(blob, prog->NumHiddenUniforms);
+   blob_write_uint32(blob, prog->NumUniformDataSlots);
+
+   /* Uniforms restart from their link-time values, as after glLinkProgram. */
+   write_array(blob, prog->UniformDataDefaults,
+               sizeof(union gl_constant_value) * prog->NumUniformDataSlots);
+
+   for (unsigned i = 0; i < prog->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *uni = &prog->UniformStorage[i];
+
+      blob_write_string(blob, uni->name);
+      encode_type_to_blob(blob, uni->type);
+      blob_write_uint32(blob, uni->array_elements);
+      blob_write_uint32(blob, uni->initialized);
+
+      for (unsigned j = 0; j < MESA_SHADER_STAGES; j++) {
+         blob_write_uint32(blob, uni->opaque[j].index);
+         blob_write_uint32(blob, uni->opaque[j].active);
+      }
+
+      if (uni->storage == NULL)
+         blob_write_uint32(blob, SERIALIZED_NULL);
+      else
+         blob_write_uint32(blob, uni->storage - prog->UniformDataSlots);
+
+      blob_write_uint32(blob, uni->block_index);
+      blob_write_uint32(blob, uni->offset);
+      blob_write_uint32(blob, uni->matrix_stride);
+      blob_write_uint32(blob, uni->array_stride);
+      blob_write_uint32(blob, uni->row_major);
+      blob_write_uint32(blob, uni->hidden);
+      blob_write_uint32(blob, uni->builtin);
+      blob_write_uint32(blob, uni->is_shader_storage);
+      blob_write_uint32(blob, uni->atomic_buffer_index);
+      blob_write_uint32(blob, uni->remap_location);
+      blob_write_uint32(blob, uni->num_compatible_subroutines);
+      blob_write_uint32(blob, uni->top_level_array_size);
+      blob_write_uint32(blob, uni->top_level_array_stride);
+   }
+
+   write_remap_table(blob, prog, prog->UniformRemapTable,
+                     prog->NumUniformRemapTable);
+}
+
+static bool
+read_uniform_storage(struct blob_reader *blob, struct gl_shader_program *prog)
+{
+   const unsigned num_uniforms = read_count(blob, 4 * sizeof(uint32_t));
+   const unsigned num_hidden = blob_read_uint32(blob);
+   const unsigned num_slots =
+      read_count(blob, sizeof(union gl_constant_value));
+
+   if (blob->overrun || num_hidden > num_uniforms)
+      return false;
+
+   prog->UniformHash = new string_to_uint_map;
+
+   if (num_uniforms == 0)
+      return read_remap_table(blob, prog, prog, &prog->UniformRemapTable,
+                              &prog->NumUniformRemapTable);
+
+   struct gl_uniform_storage *uniforms =
+      rzalloc_array(prog, struct gl_uniform_storage, num_uniforms);
+   union gl_constant_value *data =
+      rzalloc_array(uniforms, union gl_constant_value, MAX2(num_slots, 1));
+   union gl_constant_value *defaults =
+      ralloc_array(uniforms, union gl_constant_value, MAX2(num_slots, 1));
+
+   prog->UniformStorage = uniforms;
+   prog->NumUniformStorage = num_uniforms;
+   prog->NumHiddenUniforms = num_hidden;
+   prog->UniformDataSlots = data;
+   prog->UniformDataDefaults = defaults;
+   prog->NumUniformDataSlots = num_slots;
+
+   read_array(blob, defaults, sizeof(union gl_constant_value) * num_slots);
+   if (num_slots)
+      memcpy(data, defaults, sizeof(union gl_constant_value) * num_slots);
+
+   for (unsigned i = 0; i < num_uniforms; i++) {
+      struct gl_uniform_storage *uni = &uniforms[i];
+
+      uni->name = read_required_string(uniforms, blob);
+      if (uni->name == NULL || !read_type(blob, &uni->type))
+         return false;
+
+      uni->array_elements = blob_read_uint32(blob);
+      uni->initialized = blob_read_uint32(blob);
+
+      for (unsigned j = 0; j < MESA_SHADER_STAGES; j++) {
+         uni->opaque[j].index = blob_read_uint32(blob);
+         uni->opaque[j].active = blob_read_uint32(blob);
+      }
+
+      const uint32_t slot = blob_read_uint32(blob);
+      if (slot != SERIALIZED_NULL) {
+         const unsigned slots_per_element =
+            uni->type->is_sampler() ? 1 : uni->type->component_slots();
+         const unsigned elements =
+            MAX2(uni->array_elements, 1) * slots_per_element;
+         if (slot > num_slots || num_slots - slot < elements)
+            return false;
+         uni->storage = &data[slot];
+      }
+
+      uni->block_index = blob_read_uint32(blob);
+      uni->offset = blob_read_uint32(blob);
+      uni->matrix_stride = blob_read_uint32(blob);
+      uni->array_stride = blob_read_uint32(blob);
+      uni->row_major = blob_read_uint32(blob);
+      uni->hidden = blob_read_uint32(blob);
+      uni->builtin = blob_read_uint32(blob);
+      uni->is_shader_storage = blob_read_uint32(blob);
+      uni->atomic_buffer_index = blob_read_uint32(blob);
+      uni->remap_location = blob_read_uint32(blob);
+      uni->num_compatible_subroutines = blob_read_uint32(blob);
+      uni->top_level_array_size = blob_read_uint32(blob);
+      uni->top_level_array_stride = blob_read_uint32(blob);
+
+      /* The linker enters every uniform storage entry, and nothing else,
+       * in the hash.
+       */
+      prog->UniformHash->put(i, uni->name);
+   }
+
+   return read_remap_table(blob, prog, prog, &prog->UniformRemapTable,
+                           &prog->NumUniformRemapTable) &&
+          !blob->overrun;
+}
+
+
+static void
+write_buffer_blocks(struct blob *blob, const struct gl_uniform_block *blocks,
+                    unsigned num_blocks)
+{
+   blob_write_uint32(blob, num_blocks);
+
+   for (unsigned i = 0; i < num_blocks; i++) {
+      const struct gl_uniform_block *b = &blocks[i];
+
+      blob_write_string(blob, b->Name);
+      blob_write_uint32(blob, b->NumUniforms);
+      blob_write_uint32(blob, b->Binding);
+      blob_write_uint32(blob, b->UniformBufferSize);
+      blob_write_uint32(blob, b->IsShaderStorage);
+      blob_write_uint32(blob, b->_Packing);
+
+      for (unsigned j = 0; j < b->NumUniforms; j++) {
+         const struct gl_uniform_buffer_variable *v = &b->Uniforms[j];
+
+         blob_write_string(blob, v->Name);
+         /* IndexName usually just aliases Name. */
+         if (v->IndexName == v->Name)
+            write_string(blob, NULL);
+         else
+            write_string(blob, v->IndexName);
+         encode_type_to_blob(blob, v->Type);
+         blob_write_uint32(blob, v->Offset);
+         blob_write_uint32(blob, v->RowMajor);
+      }
+   }
+}
+
+
+static bool
+read_buffer_blocks(struct blob_reader *blob, void *mem_ctx,
+                   struct gl_uniform_block **blocks_out,
+                   unsigned *num_blocks_out)
+{
+   const unsigned num_blocks = read_count(blob, 6 * sizeof(uint32_t));
+
+   *blocks_out = NULL;
+   *num_blocks_out = 0;
+
+   if (num_blocks == 0)
+      return !blob->overrun;
+
+   struct gl_uniform_block *blocks =
+      rzalloc_array(mem_ctx, struct gl_uniform_block, num_blocks);
+
+   *blocks_out = blocks;
+   *num_blocks_out = num_blocks;
+
+   for (unsigned i = 0; i < num_blocks; i++) {
+      struct gl_uniform_block *b = &blocks[i];
+
+      b->Name = read_required_string(blocks, blob);
+      b->NumUniforms = read_count(blob, 4 * sizeof(uint32_t));
+      b->Binding = blob_read_uint32(blob);
+      b->UniformBufferSize = blob_read_uint32(blob);
+      b->IsShaderStorage = blob_read_uint32(blob);
+      b->_Packing = (enum gl_uniform_block_packing) blob_read_uint32(blob);
+
+      if (b->Name == NULL || blob->overrun)
+         return false;
+
+      b->Uniforms = rzalloc_array(blocks, struct gl_uniform_buffer_variable,
+                                  MAX2(b->NumUniforms, 1));
+
+      for (unsigned j = 0; j < b->NumUniforms; j++) {
+         struct gl_uniform_buffer_variable *v = &b->Uniforms[j];
+
+         v->Name = read_required_string(blocks, blob);
+         v->IndexName = read_string(blocks, blob);
+         if (v->IndexName == NULL)
+            v->IndexName = v->Name;
+
+         if (v->Name == NULL || !read_type(blob, &v->Type))
+            return false;
+
+         v->Offset = blob_read_uint32(blob);
+         v->RowMajor = blob_read_uint32(blob);
+      }
+   }
+
+   return !blob->overrun;
+}
+
+
+static void
+write_atomic_buffers(struct blob *blob, const struct gl_shader_program *prog)
+{
+   blob_write_uint32(blob, prog->NumAtomicBuffers);
+
+   for (unsigned i = 0; i < prog->NumAtomicBuffers; i++) {
+      const struct gl_active_atomic_buffer *ab = &prog->AtomicBuffers[i];
+
+      blob_write_uint32(blob, ab->NumUniforms);
+      for (unsigned j = 0; j < ab->NumUniforms; j++)
+         blob_write_uint32(blob, ab->Uniforms[j]);
+      blob_write_uint32(blob, ab->Binding);
+      blob_write_uint32(blob, ab->MinimumSize);
+      for (unsigned j = 0; j < MESA_SHADER_STAGES; j++)
+         blob_write_uint32(blob, ab->StageReferences[j]);
+   }
+}
+
+static bool
+read_atomic_buffers(struct blob_reader *blob, struct gl_shader_program *prog)
+{
+   const unsigned num_buffers = read_count(blob, 3 * sizeof(uint32_t));
+
+   if (num_buffers == 0)
+      return !blob->overrun;
+
+   prog->AtomicBuffers =
+      rzalloc_array(prog, struct gl_active_atomic_buffer, num_buffers);
+   prog->NumAtomicBuffers = num_buffers;
+
+   for (unsigned i = 0; i < num_buffers; i++) {
+      struct gl_active_atomic_buffer *ab = &prog->AtomicBuffers[i];
+
+      ab->NumUniforms = read_count(blob, sizeof(uint32_t));
+      ab->Uniforms = rzalloc_array(prog->AtomicBuffers, GLuint,
+                                   MAX2(ab->NumUniforms, 1));
+      for (unsigned j = 0; j < ab->NumUniforms; j++) {
+         ab->Uniforms[j] = blob_read_uint32(blob);
+         if (ab->Uniforms[j] >= prog->NumUniformStorage)
+            return false;
+      }
+      ab->Binding = blob_read_uint32(blob);
+      ab->MinimumSize = blob_read_uint32(blob);
+      for (unsigned j = 0; j < MESA_SHADER_STAGES; j++)
+         ab->StageReferences[j] = blob_read_uint32(blob);
+   }
+
+   return !blob->overrun;
+}
+
+
+static void
+write_xfb_info(struct blob *blob, const struct gl_transform_feedback_info *info)
+{
+   blob_write_uint32(blob, info->NumOutputs);
+   blob_write_uint32(blob, info->NumBuffers);
+   write_array(blob, info->Outputs,
+               sizeof(struct gl_transform_feedback_output) * info->NumOutputs);
+
+   blob_write_uint32(blob, info->NumVarying);
+   for (int i = 0; i < info->NumVarying; i++) {
+      blob_write_string(blob, info->Varyings[i].Name);
+      blob_write_uint32(blob, info->Varyings[i].Type);
+      blob_write_uint32(blob, info->Varyings[i].Size);
+   }
+
+   write_array(blob, info->BufferStride, sizeof(info->BufferStride));
+   write_array(blob, info->BufferStream, sizeof(info->BufferStream));
+}
+
+static bool
+read_xfb_info(struct blob_reader *blob, struct gl_shader_program *prog)
+{
+   struct gl_transform_feedback_info *info = &prog->LinkedTransformFeedback;
+
+   ralloc_free(info->Varyings);
+   ralloc_free(info->Outputs);
+   memset(info, 0, sizeof(*info));
+
+   info->NumOutputs =
+      read_count(blob, sizeof(struct gl_transform_feedback_output));
+   info->NumBuffers = blob_read_uint32(blob);
+   info->Outputs = rzalloc_array(prog, struct gl_transform_feedback_output,
+                                 info->NumOutputs);
+   read_array(blob, info->Outputs,
+              sizeof(struct gl_transform_feedback_output) * info->NumOutputs);
+
+   info->NumVarying = read_count(blob, 3 * sizeof(uint32_t));
+   info->Varyings = rzalloc_array(prog,
+                                  struct gl_transform_feedback_varying_info,
+                                  info->NumVarying);
+   for (int i = 0; i < info->NumVarying; i++) {
+      info->Varyings[i].Name = read_required_string(prog, blob);
+      info->Varyings[i].Type = blob_read_uint32(blob);
+      info->Varyings[i].Size = blob_read_uint32(blob);
+
+      if (info->Varyings[i].Name == NULL)
+         return false;
+   }
+
+   read_array(blob, info->BufferStride, sizeof(info->BufferStride));
+   read_array(blob, info->BufferStream, sizeof(info->BufferStream));
+
+   return !blob->overrun && info->NumBuffers <= MAX_FEEDBACK_BUFFERS;
+}
+
+
+static void
+write_linked_shader(struct blob *blob, const struct gl_shader_program *prog,
+                    const struct gl_shader *sh)
+{
+   blob_write_uint32(blob, sh->Version);
+   blob_write_uint32(blob, sh->IsES);
+
+   blob_write_uint32(blob, sh->num_samplers);
+   blob_write_uint32(blob, sh->active_samplers);
+   blob_write_uint32(blob, sh->shadow_samplers);
+   write_array(blob, sh->SamplerTargets, sizeof(sh->SamplerTargets));
+   blob_write_uint32(blob, sh->num_uniform_components);
+   blob_write_uint32(blob, sh->num_combined_uniform_components);
+
+   write_buffer_blocks(blob, sh->BufferInterfaceBlocks,
+                       sh->NumBufferInterfaceBlocks);
+
+   blob_write_uint32(blob, sh->uses_builtin_functions);
+   blob_write_uint32(blob, sh->uses_gl_fragcoord);
+   blob_write_uint32(blob, sh->redeclares_gl_fragcoord);
+   blob_write_uint32(blob, sh->ARB_fragment_coord_conventions_enable);
+   blob_write_uint32(blob, sh->origin_upper_left);
+   blob_write_uint32(blob, sh->pixel_center_integer);
+   blob_write_uint32(blob, sh->EarlyFragmentTests);
+   write_array(blob, &sh->TessCtrl, sizeof(sh->TessCtrl));
+   write_array(blob, &sh->TessEval, sizeof(sh->TessEval));
+   write_array(blob, &sh->Geom, sizeof(sh->Geom));
+   write_array(blob, &sh->Comp, sizeof(sh->Comp));
+
+   blob_write_uint32(blob, sh->NumImages);
+   write_array(blob, sh->ImageAccess, sizeof(sh->ImageAccess));
+
+   blob_write_uint32(blob, sh->NumAtomicBuffers);
+   for (unsigned i = 0; i < sh->NumAtomicBuffers; i++)
+      blob_write_uint32(blob, sh->AtomicBuffers[i] - prog->AtomicBuffers);
+
+   blob_write_uint32(blob, sh->NumSubroutineUniformTypes);
+   write_remap_table(blob, prog, sh->SubroutineUniformRemapTable,
+                     sh->NumSubroutineUniformRemapTable);
+
+   blob_write_uint32(blob, sh->NumSubroutineFunctions);
+   for (unsigned i = 0; i < sh->NumSubroutineFunctions; i++) {
+      const struct gl_subroutine_function *fn = &sh->SubroutineFunctions[i];
+
+      blob_write_string(blob, fn->name);
+      blob_write_uint32(blob, fn->index);
+      blob_write_uint32(blob, fn->num_compat_types);
+      for (int j = 0; j < fn->num_compat_types; j++)
+         encode_type_to_blob(blob, fn->types[j]);
+   }
+}
+
+static bool
+read_linked_shader(struct blob_reader *blob, struct gl_shader_program *prog,
+                   struct gl_shader *sh)
+{
+   sh->Version = blob_read_uint32(blob);
+   sh->IsES = blob_read_uint32(blob);
+
+   sh->num_samplers = blob_read_uint32(blob);
+   sh->active_samplers = blob_read_uint32(blob);
+   sh->shadow_samplers = blob_read_uint32(blob);
+   read_array(blob, sh->SamplerTargets, sizeof(sh->SamplerTargets));
+   sh->num_uniform_components = blob_read_uint32(blob);
+   sh->num_combined_uniform_components = blob_read_uint32(blob);
+
+   if (!read_buffer_blocks(blob, sh, &sh->BufferInterfaceBlocks,
+                           &sh->NumBufferInterfaceBlocks))
+      return false;
+
+   split_ubos_and_ssbos(sh,
+                        sh->BufferInterfaceBlocks,
+                        sh->NumBufferInterfaceBlocks,
+                        &sh->UniformBlocks,
+                        &sh->NumUniformBlocks,
+                        NULL,
+                        &sh->ShaderStorageBlocks,
+                        &sh->NumShaderStorageBlocks,
+                        NULL);
+
+   sh->uses_builtin_functions = blob_read_uint32(blob);
+   sh->uses_gl_fragcoord = blob_read_uint32(blob);
+   sh->redeclares_gl_fragcoord = blob_read_uint32(blob);
+   sh->ARB_fragment_coord_conventions_enable = blob_read_uint32(blob);
+   sh->origin_upper_left = blob_read_uint32(blob);
+   sh->pixel_center_integer = blob_read_uint32(blob);
+   sh->EarlyFragmentTests = blob_read_uint32(blob);
+   read_array(blob, &sh->TessCtrl, sizeof(sh->TessCtrl));
+   read_array(blob, &sh->TessEval, sizeof(sh->TessEval));
+   read_array(blob, &sh->Geom, sizeof(sh->Geom));
+   read_array(blob, &sh->Comp, sizeof(sh->Comp));
+
+   sh->NumImages = blob_read_uint32(blob);
+   read_array(blob, sh->ImageAccess, sizeof(sh->ImageAccess));
+
+   sh->NumAtomicBuffers = read_count(blob, sizeof(uint32_t));
+   if (sh->NumAtomicBuffers > 0) {
+      sh->AtomicBuffers = rzalloc_array(sh, gl_active_atomic_buffer *,
+                                        sh->NumAtomicBuffers);
+      for (unsigned i = 0; i < sh->NumAtomicBuffers; i++) {
+         const uint32_t index = blob_read_uint32(blob);
+         if (index >= prog->NumAtomicBuffers)
+            return false;
+         sh->AtomicBuffers[i] = &prog->AtomicBuffers[index];
+      }
+   }
+
+   sh->NumSubroutineUniformTypes = blob_read_uint32(blob);
+   if (!read_remap_table(blob, sh, prog, &sh->SubroutineUniformRemapTable,
+                         &sh->NumSubroutineUniformRemapTable))
+      return false;
+
+   sh->NumSubroutineFunctions = read_count(blob, 3 * sizeof(uint32_t));
+   if (sh->NumSubroutineFunctions > 0) {
+      sh->SubroutineFunctions =
+         rzalloc_array(sh, struct gl_subroutine_function,
+                       sh->NumSubroutineFunctions);
+   }
+   for (unsigned i = 0; i < sh->NumSubroutineFunctions; i++) {
+      struct gl_subroutine_function *fn = &sh->SubroutineFunctions[i];
+
+      fn->name = read_required_string(sh, blob);
+      fn->index = blob_read_uint32(blob);
+      fn->num_compat_types = read_count(blob, sizeof(uint32_t));
+      if (fn->name == NULL || blob->overrun)
+         return false;
+
+      fn->types = ralloc_array(sh, const struct glsl_type *,
+                               MAX2(fn->num_compat_types, 1));
+      for (int j = 0; j < fn->num_compat_types; j++) {
+         if (!read_type(blob, &fn->types[j]))
+            return false;
+      }
+   }
+
+   return !blob->overrun && sh->NumImages <= MAX_IMAGE_UNIFORMS;
+}
+
+
+/**
+ * Write what \c gl_program_resource::Data points at.  For everything but
+ * program inputs and outputs this is an element of one of the arrays
+ * serialized above, so only its index is written.
+ */
+static void
+write_resource_data(struct blob *blob, const struct gl_shader_program *prog,
+                    const struct gl_program_resource *res)
+{
+   switch (res->Type) {
+   case GL_PROGRAM_INPUT:
+   case GL_PROGRAM_OUTPUT: {
+      const struct gl_shader_variable *var =
+         (const struct gl_shader_variable *) res->Data;
+
+      encode_type_to_blob(blob, var->type);
+      blob_write_string(blob, var->name);
+      blob_write_uint32(blob, var->location);
+      blob_write_uint32(blob, var->index);
+      blob_write_uint32(blob, var->patch);
+      blob_write_uint32(blob, var->mode);
+      break;
+   }
+   case GL_TRANSFORM_FEEDBACK_VARYING:
+      blob_write_uint32(blob,
+                        (const struct gl_transform_feedback_varying_info *)
+                        res->Data - prog->LinkedTransformFeedback.Varyings);
+      break;
+   case GL_UNIFORM:
+   case GL_BUFFER_VARIABLE:
+   case GL_VERTEX_SUBROUTINE_UNIFORM:
+   case GL_GEOMETRY_SUBROUTINE_UNIFORM:
+   case GL_FRAGMENT_SUBROUTINE_UNIFORM:
+   case GL_COMPUTE_SUBROUTINE_UNIFORM:
+   case GL_TESS_CONTROL_SUBROUTINE_UNIFORM:
+   case GL_TESS_EVALUATION_SUBROUTINE_UNIFORM:
+      blob_write_uint32(blob,
+                        uniform_index(prog, (const struct gl_uniform_storage *)
+                                            res->Data));
+      break;
+   case GL_UNIFORM_BLOCK:
+   case GL_SHADER_STORAGE_BLOCK:
+      blob_write_uint32(blob, (const struct gl_uniform_block *) res->Data -
+                              prog->BufferInterfaceBlocks);
+      break;
+   case GL_ATOMIC_COUNTER_BUFFER:
+      blob_write_uint32(blob, (const struct gl_active_atomic_buffer *)
+                              res->Data - prog->AtomicBuffers);
+      break;
+   case GL_VERTEX_SUBROUTINE:
+   case GL_GEOMETRY_SUBROUTINE:
+   case GL_FRAGMENT_SUBROUTINE:
+   case GL_COMPUTE_SUBROUTINE:
+   case GL_TESS_CONTROL_SUBROUTINE:
+   case GL_TESS_EVALUATION_SUBROUTINE: {
+      const gl_shader *sh =
+         prog->_LinkedShaders[_mesa_shader_stage_from_subroutine(res->Type)];
+
+      blob_write_uint32(blob, (const struct gl_subroutine_function *)
+                              res->Data - sh->SubroutineFunctions);
+      break;
+   }
+   default:
+      unreachable("unknown program resource type");
+   }
+}
+
+static bool
+read_resource_data(struct blob_reader *blob, struct gl_shader_program *prog,
+                   struct gl_program_resource *res)
+{
+   uint32_t index;
+
+   switch (res->Type) {
+   case GL_PROGRAM_INPUT:
+   case GL_PROGRAM_OUTPUT: {
+      struct gl_shader_variable *var =
+         rzalloc(prog, struct gl_shader_variable);
+
+      if (!read_type(blob, &var->type))
+         return false;
+      var->name = read_required_string(prog, blob);
+      var->location = blob_read_uint32(blob);
+      var->index = blob_read_uint32(blob);
+      var->patch = blob_read_uint32(blob);
+      var->mode = blob_read_uint32(blob);
+
+      res->Data = var;
+      return var->name != NULL;
+   }
+   case GL_TRANSFORM_FEEDBACK_VARYING:
+      index = blob_read_uint32(blob);
+      if (index >= (unsigned) prog->LinkedTransformFeedback.NumVarying)
+         return false;
+      res->Data = &prog->LinkedTransformFeedback.Varyings[index];
+      return true;
+   case GL_UNIFORM:
+   case GL_BUFFER_VARIABLE:
+   case GL_VERTEX_SUBROUTINE_UNIFORM:
+   case GL_GEOMETRY_SUBROUTINE_UNIFORM:
+   case GL_FRAGMENT_SUBROUTINE_UNIFORM:
+   case GL_COMPUTE_SUBROUTINE_UNIFORM:
+   case GL_TESS_CONTROL_SUBROUTINE_UNIFORM:
+   case GL_TESS_EVALUATION_SUBROUTINE_UNIFORM:
+      index = blob_read_uint32(blob);
+      if (index >= prog->NumUniformStorage)
+         return false;
+      res->Data = &prog->UniformStorage[index];
+      return true;
+   case GL_UNIFORM_BLOCK:
+   case GL_SHADER_STORAGE_BLOCK:
+      index = blob_read_uint32(blob);
+      if (index >= prog->NumBufferInterfaceBlocks)
+         return false;
+      res->Data = &prog->BufferInterfaceBlocks[index];
+      return true;
+   case GL_ATOMIC_COUNTER_BUFFER:
+      index = blob_read_uint32(blob);
+      if (index >= prog->NumAtomicBuffers)
+         return false;
+      res->Data = &prog->AtomicBuffers[index];
+      return true;
+   case GL_VERTEX_SUBROUTINE:
+   case GL_GEOMETRY_SUBROUTINE:
+   case GL_FRAGMENT_SUBROUTINE:
+   case GL_COMPUTE_SUBROUTINE:
+   case GL_TESS_CONTROL_SUBROUTINE:
+   case GL_TESS_EVALUATION_SUBROUTINE: {
+      const gl_shader *sh =
+         prog->_LinkedShaders[_mesa_shader_stage_from_subroutine(res->Type)];
+
+      index = blob_read_uint32(blob);
+      if (sh == NULL || index >= sh->NumSubroutineFunctions)
+         return false;
+      res->Data = &sh->SubroutineFunctions[index];
+      return true;
+   }
+   default:
+      return false;
+   }
+}
+
+static void
+write_resource_list(struct blob *blob, const struct gl_shader_program *prog)
+{
+   blob_write_uint32(blob, prog->NumProgramResourceList);
+
+   for (unsigned i = 0; i < prog->NumProgramResourceList; i++) {
+      const struct gl_program_resource *res = &prog->ProgramResourceList[i];
+
+      blob_write_uint32(blob, res->Type);
+      blob_write_uint32(blob, res->StageReferences);
+      write_resource_data(blob, prog, res);
+   }
+}
+
+static bool
+read_resource_list(struct blob_reader *blob, struct gl_shader_program *prog)
+{
+   const unsigned num_resources = read_count(blob, 3 * sizeof(uint32_t));
+
+   if (num_resources == 0)
+      return !blob->overrun;
+
+   prog->ProgramResourceList =
+      rzalloc_array(prog, struct gl_program_resource, num_resources);
+   prog->NumProgramResourceList = num_resources;
+
+   for (unsigned i = 0; i < num_resources; i++) {
+      struct gl_program_resource *res = &prog->ProgramResourceList[i];
+
+      res->Type = blob_read_uint32(blob);
+      res->StageReferences = blob_read_uint32(blob);
+      if (blob->overrun || !read_resource_data(blob, prog, res))
+         return false;
+   }
+
+   return !blob->overrun;
+}
+
+
+/**
+ * Point the sampler and image units of each stage back at the values in
+ * the (just reset) uniform storage, as link_set_uniform_initializers()
+ * does at link time.
+ */
+static void
+reset_opaque_units(struct gl_shader_program *prog)
+{
+   for (unsigned i = 0; i < prog->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *uni = &prog->UniformStorage[i];
+      const unsigned elements = MAX2(uni->array_elements, 1);
+
+      if (uni->storage == NULL ||
+          (!uni->type->is_sampler() && !uni->type->is_image()))
+         continue;
+
+      for (unsigned s = 0; s < MESA_SHADER_STAGES; s++) {
+         struct gl_shader *sh = prog->_LinkedShaders[s];
+
+         if (sh == NULL || !uni->opaque[s].active)
+            continue;
+
+         for (unsigned j = 0; j < elements; j++) {
+            const unsigned index = uni->opaque[s].index + j;
+
+            if (uni->type->is_sampler()) {
+               if (index < ARRAY_SIZE(sh->SamplerUnits))
+                  sh->SamplerUnits[index] = uni->storage[j].i;
+            } else {
+               if (index < ARRAY_SIZE(sh->ImageUnits))
+                  sh->ImageUnits[index] = uni->storage[j].i;
+            }
+         }
+      }
+   }
+}
+
+
+static const GLenum shader_types[MESA_SHADER_STAGES] = {
+   GL_VERTEX_SHADER,
+   GL_TESS_CONTROL_SHADER,
+   GL_TESS_EVALUATION_SHADER,
+   GL_GEOMETRY_SHADER,
+   GL_FRAGMENT_SHADER,
+   GL_COMPUTE_SHADER,
+};
+
+extern "C" void
+serialize_glsl_program(struct blob *blob, struct gl_context *ctx,
+                       struct gl_shader_program *prog)
+{
+   (void) ctx;
+
+   assert(prog->LinkStatus);
+
+   blob_write_uint32(blob, prog->Version);
+   blob_write_uint32(blob, prog->IsES);
+   blob_write_uint32(blob, prog->SeparateShader);
+   blob_write_uint32(blob, prog->ARB_fragment_coord_conventions_enable);
+   blob_write_uint32(blob, prog->FragDepthLayout);
+   blob_write_uint32(blob, prog->LastClipDistanceArraySize);
+   write_array(blob, &prog->TessCtrl, sizeof(prog->TessCtrl));
+   write_array(blob, &prog->TessEval, sizeof(prog->TessEval));
+   write_array(blob, &prog->Geom, sizeof(prog->Geom));
+   write_array(blob, &prog->Vert, sizeof(prog->Vert));
+   write_array(blob, &prog->Comp, sizeof(prog->Comp));
+
+   write_uniform_storage(blob, prog);
+
+   write_buffer_blocks(blob, prog->BufferInterfaceBlocks,
+                       prog->NumBufferInterfaceBlocks);
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      const int *stage_index = prog->InterfaceBlockStageIndex[i];
+
+      blob_write_uint32(blob, stage_index != NULL);
+      if (stage_index) {
+         write_array(blob, stage_index,
+                     sizeof(int) * prog->NumBufferInterfaceBlocks);
+      }
+   }
+
+   write_atomic_buffers(blob, prog);
+   write_xfb_info(blob, &prog->LinkedTransformFeedback);
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      const struct gl_shader *sh = prog->_LinkedShaders[i];
+
+      blob_write_uint32(blob, sh != NULL);
+      if (sh)
+         write_linked_shader(blob, prog, sh);
+   }
+
+   write_resource_list(blob, prog);
+}
+
+extern "C" bool
+deserialize_glsl_program(struct blob_reader *blob, struct gl_context *ctx,
+                         struct gl_shader_program *prog)
+{
+   prog->Version = blob_read_uint32(blob);
+   prog->IsES = blob_read_uint32(blob);
+   prog->SeparateShader = blob_read_uint32(blob);
+   prog->ARB_fragment_coord_conventions_enable = blob_read_uint32(blob);
+   prog->FragDepthLayout = (enum gl_frag_depth_layout) blob_read_uint32(blob);
+   prog->LastClipDistanceArraySize = blob_read_uint32(blob);
+   read_array(blob, &prog->TessCtrl, sizeof(prog->TessCtrl));
+   read_array(blob, &prog->TessEval, sizeof(prog->TessEval));
+   read_array(blob, &prog->Geom, sizeof(prog->Geom));
+   read_array(blob, &prog->Vert, sizeof(prog->Vert));
+   read_array(blob, &prog->Comp, sizeof(prog->Comp));
+
+   if (blob->overrun || !read_uniform_storage(blob, prog))
+      return false;
+
+   if (!read_buffer_blocks(blob, prog, &prog->BufferInterfaceBlocks,
+                           &prog->NumBufferInterfaceBlocks))
+      return false;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (!blob_read_uint32(blob))
+         continue;
+
+      prog->InterfaceBlockStageIndex[i] =
+         ralloc_array(prog, int, MAX2(prog->NumBufferInterfaceBlocks, 1));
+      read_array(blob, prog->InterfaceBlockStageIndex[i],
+                 sizeof(int) * prog->NumBufferInterfaceBlocks);
+   }
+
+   ralloc_free(prog->UniformBlocks);
+   ralloc_free(prog->ShaderStorageBlocks);
+   ralloc_free(prog->UboInterfaceBlockIndex);
+   ralloc_free(prog->SsboInterfaceBlockIndex);
+   split_ubos_and_ssbos(prog,
+                        prog->BufferInterfaceBlocks,
+                        prog->NumBufferInterfaceBlocks,
+                        &prog->UniformBlocks,
+                        &prog->NumUniformBlocks,
+                        &prog->UboInterfaceBlockIndex,
+                        &prog->ShaderStorageBlocks,
+                        &prog->NumShaderStorageBlocks,
+                        &prog->SsboInterfaceBlockIndex);
+
+   if (!read_atomic_buffers(blob, prog) ||
+       !read_xfb_info(blob, prog))
+      return false;
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      assert(prog->_LinkedShaders[i] == NULL);
+
+      if (!blob_read_uint32(blob))
+         continue;
+
+      struct gl_shader *sh = ctx->Driver.NewShader(NULL, 0, shader_types[i]);
+      if (sh == NULL)
+         return false;
+
+      prog->_LinkedShaders[i] = sh;
+      if (!read_linked_shader(blob, prog, sh))
+         return false;
+   }
+
+   if (!read_resource_list(blob, prog))
+      return false;
+
+   reset_opaque_units(prog);
+
+   return true;
+}
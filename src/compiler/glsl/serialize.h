@@ -0,0 +1,80 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#pragma once
+#ifndef GLSL_SERIALIZE_H
+#define GLSL_SERIALIZE_H
+
+#include <stdbool.h>
+
+struct blob;
+struct blob_reader;
+struct gl_context;
+struct gl_shader_program;
+
+#ifdef __cplusplus
+struct glsl_type;
+
+/**
+ * Write a description of \c type that \c decode_type_from_blob can turn
+ * back into the same (interned) glsl_type.
+ */
+void
+encode_type_to_blob(struct blob *blob, const glsl_type *type);
+
+const glsl_type *
+decode_type_from_blob(struct blob_reader *blob);
+
+extern "C" {
+#endif
+
+/**
+ * Serialize everything the GLSL linker stored in \c prog: uniform storage
+ * and the location remap tables, uniform/storage blocks, atomic buffers,
+ * transform feedback outputs, the program resource list and the linked
+ * per-stage \c gl_shader state.
+ *
+ * Neither the GLSL IR nor the per-stage \c gl_program objects are written;
+ * those are the business of the caller (see main/program_binary.c).
+ */
+void
+serialize_glsl_program(struct blob *blob, struct gl_context *ctx,
+                       struct gl_shader_program *prog);
+
+/**
+ * Restore what \c serialize_glsl_program wrote into \c prog.
+ *
+ * \c prog must have been cleared of any previous link results.  Linked
+ * shaders are created with \c ctx->Driver.NewShader and have no IR.
+ *
+ * \return false if the data is truncated or malformed.
+ */
+bool
+deserialize_glsl_program(struct blob_reader *blob, struct gl_context *ctx,
+                         struct gl_shader_program *prog);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* GLSL_SERIALIZE_H */
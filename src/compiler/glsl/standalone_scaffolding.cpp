@@ -100,6 +100,9 @@ _mesa_clear_shader_program_data(struct gl_shader_program *shProg)
 
    shProg->NumUniformStorage = 0;
    shProg->UniformStorage = NULL;
+   shProg->NumUniformDataSlots = 0;
+   shProg->UniformDataSlots = NULL;
+   shProg->UniformDataDefaults = NULL;
    shProg->NumUniformRemapTable = 0;
    shProg->UniformRemapTable = NULL;
    shProg->UniformHash = NULL;
@@ -0,0 +1,240 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include <string>
+#include "main/compiler.h"
+#include "main/mtypes.h"
+#include "main/macros.h"
+#include "util/ralloc.h"
+#include "program/hash_table.h"
+#include "ir.h"
+#include "ir_optimization.h"
+#include "glsl_symbol_table.h"
+
+/**
+ * \file opt_common_test.cpp
+ *
+ * Test that do_common_optimization_loop produces the same IR as calling
+ * do_common_optimization until it makes no progress.
+ *
+ * The shader is main() calling a selection of built-in functions, plus
+ * copies of those functions, so that both the per-function worklist and
+ * the whole-shader passes get something to do.
+ */
+
+static const char *const builtin_names[] = {
+   "sin", "pow", "smoothstep", "refract", "inverse", "determinant",
+   "outerProduct", "faceforward", "packHalf2x16", "unpackHalf2x16",
+   "ldexp", "bitfieldReverse", "findMSB", "atan", "asinh", "acos", "mix",
+   "clamp", "step", "normalize", "reflect", "length", "distance", "cross",
+   "matrixCompMult", "transpose", "lessThan", "any", "all", "not",
+   "roundEven", "round", "fma", "packSnorm4x8", "unpackUnorm4x8", "atanh",
+   "tanh", "mod", "sign", "dot", "equal", "frexp", "modf", "uaddCarry",
+   "bitCount", "findLSB", "bitfieldExtract", "bitfieldInsert", "trunc",
+   "fract",
+};
+
+class common_optimization_loop : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void build_shader();
+   void check(bool linked, bool aos);
+
+   void *mem_ctx;
+   exec_list *ir;
+};
+
+void
+common_optimization_loop::SetUp()
+{
+   mem_ctx = ralloc_context(NULL);
+   ir = new(mem_ctx) exec_list;
+
+   _mesa_glsl_initialize_builtin_functions();
+   build_shader();
+}
+
+void
+common_optimization_loop::TearDown()
+{
+   ralloc_free(mem_ctx);
+   mem_ctx = NULL;
+
+   _mesa_glsl_release_builtin_functions();
+}
+
+/**
+ * Copy each built-in into the shader and call every signature that only
+ * takes inputs, storing the result in a shader output.
+ */
+void
+common_optimization_loop::build_shader()
+{
+   gl_shader *builtins = _mesa_glsl_get_builtin_function_shader();
+   struct hash_table *ht =
+      hash_table_ctor(0, hash_table_pointer_hash, hash_table_pointer_compare);
+   ir_function *main_f = new(mem_ctx) ir_function("main");
+   ir_function_signature *main_sig =
+      new(mem_ctx) ir_function_signature(glsl_type::void_type);
+   unsigned n = 0;
+
+   main_sig->is_defined = true;
+   main_f->add_signature(main_sig);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(builtin_names); i++) {
+      ir_function *builtin =
+         builtins->symbols->get_function(builtin_names[i]);
+
+      ASSERT_TRUE(builtin != NULL) << builtin_names[i];
+
+      ir_function *f = builtin->clone(mem_ctx, ht);
+      ir->push_tail(f);
+
+      foreach_in_list(ir_function_signature, sig, &f->signatures) {
+         bool inputs_only = true;
+
+         foreach_in_list(ir_variable, param, &sig->parameters) {
+            if (param->data.mode != ir_var_function_in &&
+                param->data.mode != ir_var_const_in)
+               inputs_only = false;
+         }
+
+         if (!sig->is_defined || !inputs_only || sig->return_type->is_void())
+            continue;
+
+         exec_list actual;
+         foreach_in_list(ir_variable, param, &sig->parameters) {
+            ir_variable *u =
+               new(mem_ctx) ir_variable(param->type,
+                                        ralloc_asprintf(mem_ctx, "u%u", n++),
+                                        ir_var_uniform);
+            ir->push_head(u);
+            actual.push_tail(new(mem_ctx) ir_dereference_variable(u));
+         }
+
+         ir_variable *tmp =
+            new(mem_ctx) ir_variable(sig->return_type, "tmp",
+                                     ir_var_temporary);
+         ir_variable *out =
+            new(mem_ctx) ir_variable(sig->return_type,
+                                     ralloc_asprintf(mem_ctx, "o%u", n++),
+                                     ir_var_shader_out);
+         ir->push_head(out);
+
+         main_sig->body.push_tail(tmp);
+         main_sig->body.push_tail(
+            new(mem_ctx) ir_call(sig,
+                                 new(mem_ctx) ir_dereference_variable(tmp),
+                                 &actual));
+         main_sig->body.push_tail(
+            new(mem_ctx) ir_assignment(
+               new(mem_ctx) ir_dereference_variable(out),
+               new(mem_ctx) ir_dereference_variable(tmp)));
+      }
+   }
+
+   ir->push_tail(main_f);
+
+   hash_table_dtor(ht);
+}
+
+/**
+ * Print \c ir, without the numbers the printer adds to tell apart
+ * variables of the same name, which come from a global counter.
+ */
+static std::string
+print_ir(exec_list *ir)
+{
+   FILE *f = tmpfile();
+   std::string text;
+   bool in_suffix = false;
+   int c;
+
+   if (f == NULL)
+      return text;
+
+   _mesa_print_ir(f, ir, NULL);
+   rewind(f);
+
+   while ((c = fgetc(f)) != EOF) {
+      if (c == '@') {
+         in_suffix = true;
+         continue;
+      }
+      if (in_suffix && c >= '0' && c <= '9')
+         continue;
+      in_suffix = false;
+      text += (char) c;
+   }
+
+   fclose(f);
+   return text;
+}
+
+void
+common_optimization_loop::check(bool linked, bool aos)
+{
+   struct gl_shader_compiler_options options;
+   void *ctx = ralloc_context(NULL);
+   exec_list *old_ir = new(ctx) exec_list;
+   exec_list *new_ir = new(ctx) exec_list;
+
+   memset(&options, 0, sizeof(options));
+   options.MaxUnrollIterations = 32;
+   options.MaxIfDepth = UINT_MAX;
+   options.OptimizeForAOS = aos;
+
+   clone_ir_list(ctx, old_ir, ir);
+   clone_ir_list(ctx, new_ir, ir);
+
+   while (do_common_optimization(old_ir, linked, false, &options, true))
+      ;
+
+   EXPECT_TRUE(do_common_optimization_loop(new_ir, linked, false, &options,
+                                           true, NULL));
+   validate_ir_tree(new_ir);
+
+   /* Both must have reached the same fixed point. */
+   EXPECT_EQ(print_ir(old_ir), print_ir(new_ir));
+   EXPECT_FALSE(do_common_optimization(new_ir, linked, false, &options,
+                                       true));
+
+   ralloc_free(ctx);
+}
+
+TEST_F(common_optimization_loop, unlinked)
+{
+   check(false, false);
+}
+
+TEST_F(common_optimization_loop, linked)
+{
+   check(true, false);
+}
+
+TEST_F(common_optimization_loop, linked_aos)
+{
+   check(true, true);
+}
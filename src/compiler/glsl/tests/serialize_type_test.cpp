@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "main/compiler.h"
+#include "main/mtypes.h"
+#include "main/macros.h"
+#include "util/ralloc.h"
+#include "ir.h"
+#include "blob.h"
+#include "serialize.h"
+
+/**
+ * \file serialize_type_test.cpp
+ *
+ * Test that glsl_types written with encode_type_to_blob are read back as
+ * the very same (interned) type.
+ */
+
+static void
+check_round_trip(const glsl_type *type)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   encode_type_to_blob(blob, type);
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   EXPECT_EQ(type, decode_type_from_blob(&reader));
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.end, reader.current);
+
+   ralloc_free(blob);
+}
+
+TEST(serialize_type, builtin)
+{
+   check_round_trip(glsl_type::void_type);
+   check_round_trip(glsl_type::error_type);
+   check_round_trip(glsl_type::bool_type);
+   check_round_trip(glsl_type::ivec3_type);
+   check_round_trip(glsl_type::uvec2_type);
+   check_round_trip(glsl_type::vec4_type);
+   check_round_trip(glsl_type::mat3x2_type);
+   check_round_trip(glsl_type::dmat4_type);
+   check_round_trip(glsl_type::atomic_uint_type);
+}
+
+TEST(serialize_type, opaque)
+{
+   check_round_trip(glsl_type::sampler2DShadow_type);
+   check_round_trip(glsl_type::isamplerCubeArray_type);
+   check_round_trip(glsl_type::usampler2DMSArray_type);
+   check_round_trip(glsl_type::samplerExternalOES_type);
+   check_round_trip(glsl_type::image2D_type);
+   check_round_trip(glsl_type::iimage2DArray_type);
+   check_round_trip(glsl_type::uimageBuffer_type);
+}
+
+TEST(serialize_type, array)
+{
+   const glsl_type *const a =
+      glsl_type::get_array_instance(glsl_type::vec2_type, 7);
+
+   check_round_trip(a);
+   check_round_trip(glsl_type::get_array_instance(a, 3));
+   check_round_trip(glsl_type::get_array_instance(glsl_type::float_type, 0));
+}
+
+TEST(serialize_type, record)
+{
+   static const glsl_struct_field f[] = {
+      glsl_struct_field(glsl_type::vec4_type, "v"),
+      glsl_struct_field(glsl_type::get_array_instance(glsl_type::int_type, 2),
+                        "i"),
+   };
+
+   check_round_trip(glsl_type::get_record_instance(f, ARRAY_SIZE(f), "s"));
+}
+
+TEST(serialize_type, interface)
+{
+   glsl_struct_field f[] = {
+      glsl_struct_field(glsl_type::mat4_type, "m"),
+      glsl_struct_field(glsl_type::uint_type, "u"),
+   };
+
+   f[0].matrix_layout = GLSL_MATRIX_LAYOUT_ROW_MAJOR;
+   f[1].location = 3;
+
+   check_round_trip(
+      glsl_type::get_interface_instance(f, ARRAY_SIZE(f),
+                                        GLSL_INTERFACE_PACKING_STD430,
+                                        "block"));
+}
+
+TEST(serialize_type, subroutine)
+{
+   check_round_trip(glsl_type::get_subroutine_instance("sub"));
+}
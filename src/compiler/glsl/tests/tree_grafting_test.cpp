@@ -0,0 +1,137 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+#include <gtest/gtest.h>
+#include "main/compiler.h"
+#include "main/mtypes.h"
+#include "main/macros.h"
+#include "util/ralloc.h"
+#include "ir.h"
+#include "ir_builder.h"
+#include "ir_hierarchical_visitor.h"
+#include "ir_optimization.h"
+
+/**
+ * \file tree_grafting_test.cpp
+ *
+ * Test that passes built on ir_hierarchical_visitor see a visit_stop
+ * returned from deep inside an expression tree.
+ */
+
+using namespace ir_builder;
+
+class tree_grafting : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void *mem_ctx;
+   exec_list ir;
+   ir_variable *a;
+   ir_variable *b;
+   ir_variable *t;
+   ir_variable *r;
+};
+
+void
+tree_grafting::SetUp()
+{
+   this->mem_ctx = ralloc_context(NULL);
+   this->ir.make_empty();
+
+   a = new(mem_ctx) ir_variable(glsl_type::float_type, "a", ir_var_uniform);
+   b = new(mem_ctx) ir_variable(glsl_type::float_type, "b", ir_var_uniform);
+   t = new(mem_ctx) ir_variable(glsl_type::float_type, "t",
+                                ir_var_temporary);
+   r = new(mem_ctx) ir_variable(glsl_type::float_type, "r", ir_var_auto);
+
+   ir.push_tail(a);
+   ir.push_tail(b);
+   ir.push_tail(t);
+   ir.push_tail(r);
+}
+
+void
+tree_grafting::TearDown()
+{
+   ralloc_free(this->mem_ctx);
+   this->mem_ctx = NULL;
+}
+
+/**
+ * Counts the expressions it enters, and stops at the first one whose
+ * operands are all variable dereferences.
+ */
+class stop_at_leaf_expression : public ir_hierarchical_visitor {
+public:
+   stop_at_leaf_expression() : entered(0)
+   {
+   }
+
+   virtual ir_visitor_status visit_enter(ir_expression *ir)
+   {
+      entered++;
+      for (unsigned i = 0; i < ir->get_num_operands(); i++) {
+         if (ir->operands[i]->as_dereference_variable() == NULL)
+            return visit_continue;
+      }
+      return visit_stop;
+   }
+
+   unsigned entered;
+};
+
+TEST_F(tree_grafting, expression_propagates_stop)
+{
+   /* (a + (b + a)) + (a + b): the visitor stops in (b + a), so it never
+    * gets to (a + b).
+    */
+   ir_expression *expr =
+      add(add(a, add(b, a)), add(a, b));
+   stop_at_leaf_expression v;
+
+   EXPECT_EQ(visit_stop, expr->accept(&v));
+   EXPECT_EQ(3u, v.entered);
+}
+
+TEST_F(tree_grafting, graft_into_nested_expression)
+{
+   /* t = a * b;
+    * r = a + (b + t);
+    *
+    * t is grafted into the inner addition, which must count as progress.
+    */
+   ir.push_tail(assign(t, mul(a, b)));
+   ir.push_tail(assign(r, add(a, add(b, t))));
+
+   EXPECT_TRUE(do_tree_grafting(&ir));
+
+   unsigned num_assignments = 0;
+   foreach_in_list(ir_instruction, inst, &ir) {
+      if (inst->as_assignment())
+         num_assignments++;
+   }
+   EXPECT_EQ(1u, num_assignments);
+
+   /* Nothing left to do. */
+   EXPECT_FALSE(do_tree_grafting(&ir));
+}
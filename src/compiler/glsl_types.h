@@ -250,6 +250,13 @@ struct glsl_type {
                                                 bool array,
                                                 glsl_base_type type);
 
+   /**
+    * Get the instance of an image type
+    */
+   static const glsl_type *get_image_instance(enum glsl_sampler_dim dim,
+                                              bool array,
+                                              glsl_base_type type);
+
 
    /**
     * Get the instance of an array type
@@ -31,60 +31,200 @@
 #include "util/u_debug.h"
 
 #include "util/u_memory.h"
+#include "util/u_math.h"
 
 #include "cso_cache.h"
 #include "cso_hash.h"
 
 
+DEBUG_GET_ONCE_BOOL_OPTION(cso_cache_stats, "CSO_CACHE_STATS", FALSE)
+
+
+/** Marks a slot whose state was removed, so that probing continues past it */
+#define CSO_TOMBSTONE ((void *)(uintptr_t)1)
+
+#define CSO_TABLE_MIN_SIZE 16
+
+
+struct cso_slot {
+   unsigned hash_key;
+   void *state;      /**< NULL if empty, CSO_TOMBSTONE if removed */
+};
+
+
+/**
+ * Open addressed table with linear probing.  The size is always a power
+ * of two and the table is kept at most half full (counting tombstones),
+ * so probe sequences stay short.
+ */
+struct cso_table {
+   struct cso_slot *slots;
+   unsigned size;
+   unsigned count;   /**< number of live states */
+   unsigned used;    /**< number of live states plus tombstones */
+
+   struct cso_cache_stats stats;
+};
+
+
 struct cso_cache {
-   struct cso_hash *hashes[CSO_CACHE_MAX];
+   struct cso_table tables[CSO_CACHE_MAX];
    int    max_size;
 
    cso_sanitize_callback sanitize_cb;
    void                 *sanitize_data;
 };
 
-#if 1
-static unsigned hash_key(const void *key, unsigned key_size)
+
+/**
+ * 32-bit MurmurHash3 over the words of the key.
+ *
+ * The templates are mostly small enums and bitfields, which a plain XOR of
+ * the words folded onto a handful of values, leaving long chains of
+ * candidates to memcmp against.
+ */
+static inline unsigned
+hash_key(const void *key, unsigned key_size)
 {
-   unsigned *ikey = (unsigned *)key;
-   unsigned hash = 0, i;
+   const uint32_t *ikey = (const uint32_t *)key;
+   uint32_t hash = 0;
+   unsigned i;
 
    assert(key_size % 4 == 0);
 
-   /* I'm sure this can be improved on:
-    */
-   for (i = 0; i < key_size/4; i++)
-      hash ^= ikey[i];
+   for (i = 0; i < key_size / 4; i++) {
+      uint32_t k = ikey[i];
+
+      k *= 0xcc9e2d51;
+      k = (k << 15) | (k >> 17);
+      k *= 0x1b873593;
+
+      hash ^= k;
+      hash = (hash << 13) | (hash >> 19);
+      hash = hash * 5 + 0xe6546b64;
+   }
+
+   hash ^= key_size;
+   hash ^= hash >> 16;
+   hash *= 0x85ebca6b;
+   hash ^= hash >> 13;
+   hash *= 0xc2b2ae35;
+   hash ^= hash >> 16;
 
    return hash;
 }
-#else
-static unsigned hash_key(const unsigned char *p, int n)
+
+unsigned cso_construct_key(void *item, int item_size)
+{
+   return hash_key((item), item_size);
+}
+
+static inline struct cso_table *
+_cso_table_for_type(struct cso_cache *sc, enum cso_cache_type type)
+{
+   assert(type < CSO_CACHE_MAX);
+   return &sc->tables[type];
+}
+
+static inline boolean
+slot_is_live(const struct cso_slot *slot)
+{
+   return slot->state && slot->state != CSO_TOMBSTONE;
+}
+
+/**
+ * Reallocate the table with the given size and reinsert all the live
+ * states, dropping the tombstones.
+ */
+static boolean
+table_resize(struct cso_table *table, unsigned size)
 {
-   unsigned h = 0;
-   unsigned g;
-
-   while (n--) {
-      h = (h << 4) + *p++;
-      if ((g = (h & 0xf0000000)) != 0)
-         h ^= g >> 23;
-      h &= ~g;
+   struct cso_slot *old_slots = table->slots;
+   unsigned old_size = table->size;
+   struct cso_slot *slots;
+   unsigned i;
+
+   slots = CALLOC(size, sizeof *slots);
+   if (!slots)
+      return FALSE;
+
+   for (i = 0; i < old_size; i++) {
+      const struct cso_slot *old = &old_slots[i];
+      if (slot_is_live(old)) {
+         unsigned pos = old->hash_key & (size - 1);
+         while (slots[pos].state)
+            pos = (pos + 1) & (size - 1);
+         slots[pos] = *old;
+      }
    }
-   return h;
+
+   FREE(old_slots);
+   table->slots = slots;
+   table->size = size;
+   table->used = table->count;
+
+   return TRUE;
 }
-#endif
 
-unsigned cso_construct_key(void *item, int item_size)
+static void *
+table_find(struct cso_table *table, unsigned hash_key,
+           const void *templ, unsigned size)
 {
-   return hash_key((item), item_size);
+   unsigned mask = table->size - 1;
+   unsigned pos;
+
+   table->stats.lookups++;
+
+   if (!table->size)
+      goto miss;
+
+   for (pos = hash_key & mask; table->slots[pos].state; pos = (pos + 1) & mask) {
+      struct cso_slot *slot = &table->slots[pos];
+
+      if (slot->state != CSO_TOMBSTONE && slot->hash_key == hash_key) {
+         if (!memcmp(slot->state, templ, size)) {
+            table->stats.hits++;
+            return slot->state;
+         }
+         table->stats.collisions++;
+      }
+      table->stats.probes++;
+   }
+
+miss:
+   table->stats.misses++;
+   return NULL;
 }
 
-static inline struct cso_hash *_cso_hash_for_type(struct cso_cache *sc, enum cso_cache_type type)
+static boolean
+table_insert(struct cso_table *table, unsigned hash_key, void *state)
 {
-   struct cso_hash *hash;
-   hash = sc->hashes[type];
-   return hash;
+   unsigned mask, pos;
+
+   /* Keep the load (including tombstones) under one half.  If most of the
+    * used slots are tombstones a same size rehash is enough.
+    */
+   if ((table->used + 1) * 2 > table->size) {
+      unsigned size = MAX2(table->size, CSO_TABLE_MIN_SIZE);
+      while ((table->count + 1) * 4 > size)
+         size *= 2;
+      if (!table_resize(table, size))
+         return FALSE;
+   }
+
+   mask = table->size - 1;
+   for (pos = hash_key & mask; slot_is_live(&table->slots[pos]);
+        pos = (pos + 1) & mask)
+      ;
+
+   if (!table->slots[pos].state)
+      table->used++;
+   table->slots[pos].hash_key = hash_key;
+   table->slots[pos].state = state;
+   table->count++;
+   table->stats.inserts++;
+
+   return TRUE;
 }
 
 static void delete_blend_state(void *state, void *data)
@@ -152,54 +292,39 @@ static inline void delete_cso(void *state, enum cso_cache_type type)
 }
 
 
-static inline void sanitize_hash(struct cso_cache *sc,
-                                 struct cso_hash *hash,
-                                 enum cso_cache_type type,
-                                 int max_size)
+static inline void sanitize_table(struct cso_cache *sc,
+                                  enum cso_cache_type type,
+                                  int max_size)
 {
    if (sc->sanitize_cb)
-      sc->sanitize_cb(hash, type, max_size, sc->sanitize_data);
+      sc->sanitize_cb(sc, type, max_size, sc->sanitize_data);
+}
+
+
+static boolean evict_cb(void *state, enum cso_cache_type type,
+                        void *user_data)
+{
+   delete_cso(state, type);
+   return TRUE;
 }
 
 
-static inline void sanitize_cb(struct cso_hash *hash, enum cso_cache_type type,
+static inline void sanitize_cb(struct cso_cache *sc, enum cso_cache_type type,
                                int max_size, void *user_data)
 {
-   /* if we're approach the maximum size, remove fourth of the entries
-    * otherwise every subsequent call will go through the same */
-   int hash_size = cso_hash_size(hash);
-   int max_entries = (max_size > hash_size) ? max_size : hash_size;
-   int to_remove =  (max_size < max_entries) * max_entries/4;
-   if (hash_size > max_size)
-      to_remove += hash_size - max_size;
-   while (to_remove) {
-      /*remove elements until we're good */
-      /*fixme: currently we pick the nodes to remove at random*/
-      struct cso_hash_iter iter = cso_hash_first_node(hash);
-      void  *cso = cso_hash_take(hash, cso_hash_iter_key(iter));
-      delete_cso(cso, type);
-      --to_remove;
-   }
+   cso_cache_evict(sc, type, cso_cache_num_to_evict(sc, type, max_size),
+                   evict_cb, NULL);
 }
 
-struct cso_hash_iter
+boolean
 cso_insert_state(struct cso_cache *sc,
                  unsigned hash_key, enum cso_cache_type type,
                  void *state)
 {
-   struct cso_hash *hash = _cso_hash_for_type(sc, type);
-   sanitize_hash(sc, hash, type, sc->max_size);
+   struct cso_table *table = _cso_table_for_type(sc, type);
+   sanitize_table(sc, type, sc->max_size);
 
-   return cso_hash_insert(hash, hash_key, state);
-}
-
-struct cso_hash_iter
-cso_find_state(struct cso_cache *sc,
-               unsigned hash_key, enum cso_cache_type type)
-{
-   struct cso_hash *hash = _cso_hash_for_type(sc, type);
-
-   return cso_hash_find(hash, hash_key);
+   return table_insert(table, hash_key, state);
 }
 
 
@@ -217,42 +342,108 @@ void *cso_hash_find_data_from_template( struct cso_hash *hash,
          return iter_data;
       }
       iter = cso_hash_iter_next(iter);
+      /* States with the same key are adjacent, past them there is no
+       * point in comparing the rest of the table.
+       */
+      if (!cso_hash_iter_is_null(iter) &&
+          cso_hash_iter_key(iter) != hash_key)
+         break;
    }
    return NULL;
 }
 
 
-struct cso_hash_iter cso_find_state_template(struct cso_cache *sc,
-                                             unsigned hash_key, enum cso_cache_type type,
-                                             void *templ, unsigned size)
+void *cso_find_state_template(struct cso_cache *sc,
+                              unsigned hash_key, enum cso_cache_type type,
+                              void *templ, unsigned size)
 {
-   struct cso_hash_iter iter = cso_find_state(sc, hash_key, type);
-   while (!cso_hash_iter_is_null(iter)) {
-      void *iter_data = cso_hash_iter_data(iter);
-      if (!memcmp(iter_data, templ, size))
-         return iter;
-      iter = cso_hash_iter_next(iter);
+   struct cso_table *table = _cso_table_for_type(sc, type);
+   return table_find(table, hash_key, templ, size);
+}
+
+unsigned cso_cache_size(struct cso_cache *sc, enum cso_cache_type type)
+{
+   return _cso_table_for_type(sc, type)->count;
+}
+
+/**
+ * Number of states to evict from the table of the given type to make room
+ * for one more.  When we're approaching the maximum size a fourth of the
+ * entries are removed, otherwise every subsequent insert would go through
+ * the same.
+ */
+unsigned cso_cache_num_to_evict(struct cso_cache *sc,
+                                enum cso_cache_type type,
+                                int max_size)
+{
+   int size = cso_cache_size(sc, type);
+   int max_entries = (max_size > size) ? max_size : size;
+   int to_remove = (max_size < max_entries) * max_entries/4;
+   if (size > max_size)
+      to_remove += size - max_size;
+   return to_remove;
+}
+
+unsigned cso_cache_evict(struct cso_cache *sc, enum cso_cache_type type,
+                         unsigned count, cso_evict_callback func,
+                         void *user_data)
+{
+   struct cso_table *table = _cso_table_for_type(sc, type);
+   unsigned removed = 0;
+   unsigned i;
+
+   /*fixme: currently we pick the states to remove at random*/
+   for (i = 0; i < table->size && removed < count; i++) {
+      struct cso_slot *slot = &table->slots[i];
+      if (slot_is_live(slot) && func(slot->state, type, user_data)) {
+         slot->state = CSO_TOMBSTONE;
+         table->count--;
+         removed++;
+      }
    }
-   return iter;
+
+   table->stats.evictions += removed;
+   return removed;
+}
+
+void cso_cache_get_stats(struct cso_cache *sc, enum cso_cache_type type,
+                         struct cso_cache_stats *stats)
+{
+   *stats = _cso_table_for_type(sc, type)->stats;
 }
 
-void * cso_take_state(struct cso_cache *sc,
-                      unsigned hash_key, enum cso_cache_type type)
+static void cso_cache_print_stats(struct cso_cache *sc)
 {
-   struct cso_hash *hash = _cso_hash_for_type(sc, type);
-   return cso_hash_take(hash, hash_key);
+   static const char *names[CSO_CACHE_MAX] = {
+      "rasterizer",
+      "blend",
+      "depth_stencil_alpha",
+      "sampler",
+      "velements",
+   };
+   unsigned i;
+
+   debug_printf("cso_cache %p:\n", (void *)sc);
+   for (i = 0; i < CSO_CACHE_MAX; i++) {
+      const struct cso_table *table = &sc->tables[i];
+      const struct cso_cache_stats *stats = &table->stats;
+
+      debug_printf("  %-20s %u states, %u slots, %u lookups, %u hits, "
+                   "%u misses, %u inserts, %u evictions, %u collisions, "
+                   "%u probes\n",
+                   names[i], table->count, table->size, stats->lookups,
+                   stats->hits, stats->misses, stats->inserts,
+                   stats->evictions, stats->collisions, stats->probes);
+   }
 }
 
 struct cso_cache *cso_cache_create(void)
 {
-   struct cso_cache *sc = MALLOC_STRUCT(cso_cache);
-   int i;
+   struct cso_cache *sc = CALLOC_STRUCT(cso_cache);
    if (!sc)
       return NULL;
 
    sc->max_size           = 4096;
-   for (i = 0; i < CSO_CACHE_MAX; i++)
-      sc->hashes[i] = cso_hash_create();
 
    sc->sanitize_cb        = sanitize_cb;
    sc->sanitize_data      = 0;
@@ -263,16 +454,12 @@ struct cso_cache *cso_cache_create(void)
 void cso_for_each_state(struct cso_cache *sc, enum cso_cache_type type,
                         cso_state_callback func, void *user_data)
 {
-   struct cso_hash *hash = _cso_hash_for_type(sc, type);
-   struct cso_hash_iter iter;
+   struct cso_table *table = _cso_table_for_type(sc, type);
+   unsigned i;
 
-   iter = cso_hash_first_node(hash);
-   while (!cso_hash_iter_is_null(iter)) {
-      void *state = cso_hash_iter_data(iter);
-      iter = cso_hash_iter_next(iter);
-      if (state) {
-         func(state, user_data);
-      }
+   for (i = 0; i < table->size; i++) {
+      if (slot_is_live(&table->slots[i]))
+         func(table->slots[i].state, user_data);
    }
 }
 
@@ -284,6 +471,9 @@ void cso_cache_delete(struct cso_cache *sc)
    if (!sc)
       return;
 
+   if (debug_get_option_cso_cache_stats())
+      cso_cache_print_stats(sc);
+
    /* delete driver data */
    cso_for_each_state(sc, CSO_BLEND, delete_blend_state, 0);
    cso_for_each_state(sc, CSO_DEPTH_STENCIL_ALPHA, delete_depth_stencil_state, 0);
@@ -292,7 +482,7 @@ void cso_cache_delete(struct cso_cache *sc)
    cso_for_each_state(sc, CSO_VELEMENTS, delete_velements, 0);
 
    for (i = 0; i < CSO_CACHE_MAX; i++)
-      cso_hash_delete(sc->hashes[i]);
+      FREE(sc->tables[i].slots);
 
    FREE(sc);
 }
@@ -304,7 +494,7 @@ void cso_set_maximum_cache_size(struct cso_cache *sc, int number)
    sc->max_size = number;
 
    for (i = 0; i < CSO_CACHE_MAX; i++)
-      sanitize_hash(sc, sc->hashes[i], i, sc->max_size);
+      sanitize_table(sc, i, sc->max_size);
 }
 
 int cso_maximum_cache_size(const struct cso_cache *sc)
@@ -76,10 +76,6 @@
 #include "pipe/p_context.h"
 #include "pipe/p_state.h"
 
-/* cso_hash.h is necessary for cso_hash_iter, as MSVC requires structures
- * returned by value to be fully defined */
-#include "cso_hash.h"
-
 
 #ifdef	__cplusplus
 extern "C" {
@@ -96,12 +92,28 @@ enum cso_cache_type {
 
 typedef void (*cso_state_callback)(void *ctx, void *obj);
 
-typedef void (*cso_sanitize_callback)(struct cso_hash *hash,
+struct cso_cache;
+
+typedef void (*cso_sanitize_callback)(struct cso_cache *sc,
                                       enum cso_cache_type type,
                                       int max_size,
                                       void *user_data);
 
-struct cso_cache;
+/** Returns TRUE if the state was deleted and can be removed from the cache */
+typedef boolean (*cso_evict_callback)(void *state,
+                                      enum cso_cache_type type,
+                                      void *user_data);
+
+/** Per state type counters, dumped at destruction with CSO_CACHE_STATS=1 */
+struct cso_cache_stats {
+   unsigned lookups;
+   unsigned hits;
+   unsigned misses;
+   unsigned inserts;
+   unsigned evictions;
+   unsigned collisions;  /**< same hash key but different template */
+   unsigned probes;      /**< slots stepped over while looking up */
+};
 
 struct cso_blend {
    struct pipe_blend_state state;
@@ -152,18 +164,25 @@ void cso_cache_set_sanitize_callback(struct cso_cache *sc,
                                      cso_sanitize_callback cb,
                                      void *user_data);
 
-struct cso_hash_iter cso_insert_state(struct cso_cache *sc,
-                                      unsigned hash_key, enum cso_cache_type type,
-                                      void *state);
-struct cso_hash_iter cso_find_state(struct cso_cache *sc,
-                                    unsigned hash_key, enum cso_cache_type type);
-struct cso_hash_iter cso_find_state_template(struct cso_cache *sc,
-                                             unsigned hash_key, enum cso_cache_type type,
-                                             void *templ, unsigned size);
+boolean cso_insert_state(struct cso_cache *sc,
+                         unsigned hash_key, enum cso_cache_type type,
+                         void *state);
+void *cso_find_state_template(struct cso_cache *sc,
+                              unsigned hash_key, enum cso_cache_type type,
+                              void *templ, unsigned size);
 void cso_for_each_state(struct cso_cache *sc, enum cso_cache_type type,
                         cso_state_callback func, void *user_data);
-void * cso_take_state(struct cso_cache *sc, unsigned hash_key,
-                      enum cso_cache_type type);
+
+unsigned cso_cache_size(struct cso_cache *sc, enum cso_cache_type type);
+unsigned cso_cache_num_to_evict(struct cso_cache *sc,
+                                enum cso_cache_type type,
+                                int max_size);
+unsigned cso_cache_evict(struct cso_cache *sc, enum cso_cache_type type,
+                         unsigned count, cso_evict_callback func,
+                         void *user_data);
+
+void cso_cache_get_stats(struct cso_cache *sc, enum cso_cache_type type,
+                         struct cso_cache_stats *stats);
 
 void cso_set_maximum_cache_size(struct cso_cache *sc, int number);
 int cso_maximum_cache_size(const struct cso_cache *sc);
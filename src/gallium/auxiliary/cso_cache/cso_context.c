@@ -46,7 +46,6 @@
 
 #include "cso_cache/cso_context.h"
 #include "cso_cache/cso_cache.h"
-#include "cso_cache/cso_hash.h"
 #include "cso_context.h"
 
 
@@ -205,29 +204,22 @@ static inline boolean delete_cso(struct cso_context *ctx,
    return FALSE;
 }
 
+static boolean
+evict_cso(void *state, enum cso_cache_type type, void *user_data)
+{
+   struct cso_context *ctx = (struct cso_context *)user_data;
+   return delete_cso(ctx, state, type);
+}
+
 static inline void
-sanitize_hash(struct cso_hash *hash, enum cso_cache_type type,
+sanitize_hash(struct cso_cache *sc, enum cso_cache_type type,
               int max_size, void *user_data)
 {
-   struct cso_context *ctx = (struct cso_context *)user_data;
-   /* if we're approach the maximum size, remove fourth of the entries
-    * otherwise every subsequent call will go through the same */
-   int hash_size = cso_hash_size(hash);
-   int max_entries = (max_size > hash_size) ? max_size : hash_size;
-   int to_remove =  (max_size < max_entries) * max_entries/4;
-   struct cso_hash_iter iter = cso_hash_first_node(hash);
-   if (hash_size > max_size)
-      to_remove += hash_size - max_size;
-   while (to_remove) {
-      /*remove elements until we're good */
-      /*fixme: currently we pick the nodes to remove at random*/
-      void *cso = cso_hash_iter_data(iter);
-      if (delete_cso(ctx, cso, type)) {
-         iter = cso_hash_erase(hash, iter);
-         --to_remove;
-      } else
-         iter = cso_hash_iter_next(iter);
-   }
+   /* States currently bound are skipped by delete_cso(), so fewer than
+    * requested may end up being evicted.
+    */
+   cso_cache_evict(sc, type, cso_cache_num_to_evict(sc, type, max_size),
+                   evict_cso, user_data);
 }
 
 static void cso_init_vbuf(struct cso_context *cso)
@@ -385,17 +377,17 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
                               const struct pipe_blend_state *templ)
 {
    unsigned key_size, hash_key;
-   struct cso_hash_iter iter;
+   void *found;
    void *handle;
 
    key_size = templ->independent_blend_enable ?
       sizeof(struct pipe_blend_state) :
       (char *)&(templ->rt[1]) - (char *)templ;
    hash_key = cso_construct_key((void*)templ, key_size);
-   iter = cso_find_state_template(ctx->cache, hash_key, CSO_BLEND,
-                                  (void*)templ, key_size);
+   found = cso_find_state_template(ctx->cache, hash_key, CSO_BLEND,
+                                   (void*)templ, key_size);
 
-   if (cso_hash_iter_is_null(iter)) {
+   if (!found) {
       struct cso_blend *cso = MALLOC(sizeof(struct cso_blend));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
@@ -406,8 +398,7 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
       cso->delete_state = (cso_state_callback)ctx->pipe->delete_blend_state;
       cso->context = ctx->pipe;
 
-      iter = cso_insert_state(ctx->cache, hash_key, CSO_BLEND, cso);
-      if (cso_hash_iter_is_null(iter)) {
+      if (!cso_insert_state(ctx->cache, hash_key, CSO_BLEND, cso)) {
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
@@ -415,7 +406,7 @@ enum pipe_error cso_set_blend(struct cso_context *ctx,
       handle = cso->data;
    }
    else {
-      handle = ((struct cso_blend *)cso_hash_iter_data(iter))->data;
+      handle = ((struct cso_blend *)found)->data;
    }
 
    if (ctx->blend != handle) {
@@ -448,13 +439,13 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
 {
    unsigned key_size = sizeof(struct pipe_depth_stencil_alpha_state);
    unsigned hash_key = cso_construct_key((void*)templ, key_size);
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key,
-                                                       CSO_DEPTH_STENCIL_ALPHA,
-                                                       (void*)templ, key_size);
+   void *found = cso_find_state_template(ctx->cache,
+                                         hash_key,
+                                         CSO_DEPTH_STENCIL_ALPHA,
+                                         (void*)templ, key_size);
    void *handle;
 
-   if (cso_hash_iter_is_null(iter)) {
+   if (!found) {
       struct cso_depth_stencil_alpha *cso =
          MALLOC(sizeof(struct cso_depth_stencil_alpha));
       if (!cso)
@@ -467,9 +458,8 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
          (cso_state_callback)ctx->pipe->delete_depth_stencil_alpha_state;
       cso->context = ctx->pipe;
 
-      iter = cso_insert_state(ctx->cache, hash_key,
-                              CSO_DEPTH_STENCIL_ALPHA, cso);
-      if (cso_hash_iter_is_null(iter)) {
+      if (!cso_insert_state(ctx->cache, hash_key,
+                            CSO_DEPTH_STENCIL_ALPHA, cso)) {
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
@@ -478,7 +468,7 @@ cso_set_depth_stencil_alpha(struct cso_context *ctx,
    }
    else {
       handle = ((struct cso_depth_stencil_alpha *)
-                cso_hash_iter_data(iter))->data;
+                found)->data;
    }
 
    if (ctx->depth_stencil != handle) {
@@ -511,13 +501,13 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
 {
    unsigned key_size = sizeof(struct pipe_rasterizer_state);
    unsigned hash_key = cso_construct_key((void*)templ, key_size);
-   struct cso_hash_iter iter = cso_find_state_template(ctx->cache,
-                                                       hash_key,
-                                                       CSO_RASTERIZER,
-                                                       (void*)templ, key_size);
+   void *found = cso_find_state_template(ctx->cache,
+                                         hash_key,
+                                         CSO_RASTERIZER,
+                                         (void*)templ, key_size);
    void *handle = NULL;
 
-   if (cso_hash_iter_is_null(iter)) {
+   if (!found) {
       struct cso_rasterizer *cso = MALLOC(sizeof(struct cso_rasterizer));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
@@ -528,8 +518,7 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
          (cso_state_callback)ctx->pipe->delete_rasterizer_state;
       cso->context = ctx->pipe;
 
-      iter = cso_insert_state(ctx->cache, hash_key, CSO_RASTERIZER, cso);
-      if (cso_hash_iter_is_null(iter)) {
+      if (!cso_insert_state(ctx->cache, hash_key, CSO_RASTERIZER, cso)) {
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
@@ -537,7 +526,7 @@ enum pipe_error cso_set_rasterizer(struct cso_context *ctx,
       handle = cso->data;
    }
    else {
-      handle = ((struct cso_rasterizer *)cso_hash_iter_data(iter))->data;
+      handle = ((struct cso_rasterizer *)found)->data;
    }
 
    if (ctx->rasterizer != handle) {
@@ -914,7 +903,7 @@ cso_set_vertex_elements(struct cso_context *ctx,
 {
    struct u_vbuf *vbuf = ctx->vbuf;
    unsigned key_size, hash_key;
-   struct cso_hash_iter iter;
+   void *found;
    void *handle;
    struct cso_velems_state velems_state;
 
@@ -933,10 +922,10 @@ cso_set_vertex_elements(struct cso_context *ctx,
    memcpy(velems_state.velems, states,
           sizeof(struct pipe_vertex_element) * count);
    hash_key = cso_construct_key((void*)&velems_state, key_size);
-   iter = cso_find_state_template(ctx->cache, hash_key, CSO_VELEMENTS,
-                                  (void*)&velems_state, key_size);
+   found = cso_find_state_template(ctx->cache, hash_key, CSO_VELEMENTS,
+                                   (void*)&velems_state, key_size);
 
-   if (cso_hash_iter_is_null(iter)) {
+   if (!found) {
       struct cso_velements *cso = MALLOC(sizeof(struct cso_velements));
       if (!cso)
          return PIPE_ERROR_OUT_OF_MEMORY;
@@ -948,8 +937,7 @@ cso_set_vertex_elements(struct cso_context *ctx,
          (cso_state_callback) ctx->pipe->delete_vertex_elements_state;
       cso->context = ctx->pipe;
 
-      iter = cso_insert_state(ctx->cache, hash_key, CSO_VELEMENTS, cso);
-      if (cso_hash_iter_is_null(iter)) {
+      if (!cso_insert_state(ctx->cache, hash_key, CSO_VELEMENTS, cso)) {
          FREE(cso);
          return PIPE_ERROR_OUT_OF_MEMORY;
       }
@@ -957,7 +945,7 @@ cso_set_vertex_elements(struct cso_context *ctx,
       handle = cso->data;
    }
    else {
-      handle = ((struct cso_velements *)cso_hash_iter_data(iter))->data;
+      handle = ((struct cso_velements *)found)->data;
    }
 
    if (ctx->velements != handle) {
@@ -1078,12 +1066,12 @@ cso_single_sampler(struct cso_context *ctx, unsigned shader_stage,
    if (templ) {
       unsigned key_size = sizeof(struct pipe_sampler_state);
       unsigned hash_key = cso_construct_key((void*)templ, key_size);
-      struct cso_hash_iter iter =
+      void *found =
          cso_find_state_template(ctx->cache,
                                  hash_key, CSO_SAMPLER,
                                  (void *) templ, key_size);
 
-      if (cso_hash_iter_is_null(iter)) {
+      if (!found) {
          struct cso_sampler *cso = MALLOC(sizeof(struct cso_sampler));
          if (!cso)
             return PIPE_ERROR_OUT_OF_MEMORY;
@@ -1094,8 +1082,7 @@ cso_single_sampler(struct cso_context *ctx, unsigned shader_stage,
             (cso_state_callback) ctx->pipe->delete_sampler_state;
          cso->context = ctx->pipe;
 
-         iter = cso_insert_state(ctx->cache, hash_key, CSO_SAMPLER, cso);
-         if (cso_hash_iter_is_null(iter)) {
+         if (!cso_insert_state(ctx->cache, hash_key, CSO_SAMPLER, cso)) {
             FREE(cso);
             return PIPE_ERROR_OUT_OF_MEMORY;
          }
@@ -1103,7 +1090,7 @@ cso_single_sampler(struct cso_context *ctx, unsigned shader_stage,
          handle = cso->data;
       }
       else {
-         handle = ((struct cso_sampler *)cso_hash_iter_data(iter))->data;
+         handle = ((struct cso_sampler *)found)->data;
       }
    }
 
@@ -86,6 +86,12 @@ struct cso_hash_iter cso_hash_insert(struct cso_hash *hash, unsigned key,
 struct cso_hash_iter cso_hash_erase(struct cso_hash *hash, struct cso_hash_iter iter);
 
 void  *cso_hash_take(struct cso_hash *hash, unsigned key);
+/**
+ * Removes the node holding exactly \a data among the nodes with \a key.
+ * Returns TRUE if such a node was found.
+ */
+boolean cso_hash_erase_data(struct cso_hash *hash, unsigned key,
+                            const void *data);
 
 
 
@@ -44,6 +44,7 @@
 #include "draw_prim_assembler.h"
 #include "draw_vs.h"
 #include "draw_gs.h"
+#include "draw_threads.h"
 
 #if HAVE_LLVM
 #include "gallivm/lp_bld_init.h"
@@ -183,6 +184,7 @@ void draw_new_instance(struct draw_context *draw)
 {
    draw_geometry_shader_new_instance(draw->gs.geometry_shader);
    draw_prim_assembler_new_instance(draw->ia);
+   draw->pt.vcache_serial++;
 }
 
 
@@ -237,6 +239,31 @@ void draw_flush( struct draw_context *draw )
 }
 
 
+/**
+ * Let vertex shading of large draws use num_threads threads besides the
+ * calling one (LLVM path only).  Zero keeps everything on the calling
+ * thread.  DRAW_NUM_THREADS overrides the driver's choice.
+ */
+void
+draw_set_num_threads(struct draw_context *draw, unsigned num_threads)
+{
+   num_threads = debug_get_num_option("DRAW_NUM_THREADS", num_threads);
+   num_threads = MIN2(num_threads, DRAW_MAX_THREADS);
+
+   if (draw->pt.threads &&
+       draw_thread_pool_num_threads(draw->pt.threads) == num_threads)
+      return;
+
+   if (draw->pt.threads) {
+      draw_thread_pool_destroy(draw->pt.threads);
+      draw->pt.threads = NULL;
+   }
+
+   if (num_threads)
+      draw->pt.threads = draw_thread_pool_create(num_threads);
+}
+
+
 /**
  * Specify the depth stencil format for the draw pipeline. This function
  * determines the Minimum Resolvable Depth factor for polygon offset.
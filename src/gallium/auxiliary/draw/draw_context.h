@@ -273,6 +273,9 @@ void draw_set_driver_clipping( struct draw_context *draw,
 void draw_set_force_passthrough( struct draw_context *draw, 
                                  boolean enable );
 
+void draw_set_num_threads(struct draw_context *draw,
+                          unsigned num_threads);
+
 
 /*******************************************************************************
  * Draw statistics
@@ -33,6 +33,7 @@
 #include "draw_llvm.h"
 #endif
 
+#include "cso_cache/cso_hash.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_exec.h"
 
@@ -740,6 +741,12 @@ draw_create_geometry_shader(struct draw_context *draw,
       gs = &llvm_gs->base;
 
       make_empty_list(&llvm_gs->variants);
+
+      llvm_gs->variants_hash = cso_hash_create();
+      if (!llvm_gs->variants_hash) {
+         FREE(llvm_gs);
+         return NULL;
+      }
    } else
 #endif
    {
@@ -753,6 +760,10 @@ draw_create_geometry_shader(struct draw_context *draw,
    gs->state = *state;
    gs->state.tokens = tgsi_dup_tokens(state->tokens);
    if (!gs->state.tokens) {
+#ifdef HAVE_LLVM
+      if (llvm_gs)
+         cso_hash_delete(llvm_gs->variants_hash);
+#endif
       FREE(gs);
       return NULL;
    }
@@ -889,6 +900,8 @@ void draw_delete_geometry_shader(struct draw_context *draw,
       }
 
       assert(shader->variants_cached == 0);
+      assert(cso_hash_size(shader->variants_hash) == 0);
+      cso_hash_delete(shader->variants_hash);
 
       if (dgs->llvm_prim_lengths) {
          unsigned i;
@@ -44,10 +44,13 @@
 #include "gallivm/lp_bld_printf.h"
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_type.h"
 #include "gallivm/lp_bld_pack.h"
 #include "gallivm/lp_bld_format.h"
 
+#include "cso_cache/cso_hash.h"
+
 #include "tgsi/tgsi_exec.h"
 #include "tgsi/tgsi_dump.h"
 
@@ -562,10 +565,43 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 
    variant->gallivm = gallivm_create(module_name, llvm->context);
 
-   create_jit_types(variant);
-
    memcpy(&variant->key, key, shader->variant_key_size);
 
+   variant->list_item_global.base = variant;
+   variant->list_item_local.base = variant;
+
+   /* The vertex header layout depends on num_inputs too */
+   {
+      char cache_key[DRAW_LLVM_MAX_VARIANT_KEY_SIZE + sizeof num_inputs];
+
+      memcpy(cache_key, key, shader->variant_key_size);
+      memcpy(cache_key + shader->variant_key_size, &num_inputs,
+             sizeof num_inputs);
+
+      if (gallivm_cache_lookup(variant->gallivm, shader->base.state.tokens,
+                               cache_key,
+                               shader->variant_key_size + sizeof num_inputs)) {
+         /* Functions are cached in the order they are jitted below */
+         variant->jit_func = (draw_jit_vert_func)
+               gallivm_cached_function(variant->gallivm, 0);
+         variant->jit_func_elts = (draw_jit_vert_func_elts)
+               gallivm_cached_function(variant->gallivm, 1);
+
+         if (variant->jit_func && variant->jit_func_elts) {
+            gallivm_free_ir(variant->gallivm);
+
+            shader->variants_created++;
+            return variant;
+         }
+
+         /* Unusable cache entry, compile the variant in a fresh module */
+         gallivm_destroy(variant->gallivm);
+         variant->gallivm = gallivm_create(module_name, llvm->context);
+      }
+   }
+
+   create_jit_types(variant);
+
    if (gallivm_debug & (GALLIVM_DEBUG_TGSI | GALLIVM_DEBUG_IR)) {
       tgsi_dump(llvm->draw->vs.vertex_shader->state.tokens, 0);
       draw_llvm_dump_variant_key(&variant->key);
@@ -588,10 +624,7 @@ draw_llvm_create_variant(struct draw_llvm *llvm,
 
    gallivm_free_ir(variant->gallivm);
 
-   variant->list_item_global.base = variant;
-   variant->list_item_local.base = variant;
    /*variant->no = */shader->variants_created++;
-   variant->list_item_global.base = variant;
 
    return variant;
 }
@@ -628,7 +661,7 @@ generate_vs(struct draw_llvm_variant *variant,
                      NULL,
                      draw_sampler,
                      &llvm->draw->vs.vertex_shader->info,
-                     NULL);
+                     NULL, NULL);
 
    {
       LLVMValueRef out;
@@ -771,7 +804,8 @@ convert_to_soa(struct gallivm_state *gallivm,
    debug_assert(TGSI_NUM_CHANNELS == 4);
    debug_assert((soa_type.length % TGSI_NUM_CHANNELS) == 0);
 
-   aos_channel_type.length >>= 1;
+   /* each source vector is one vertex's attribute */
+   aos_channel_type.length = TGSI_NUM_CHANNELS;
 
    for (i = 0; i < num_attribs; ++i) {
       LLVMValueRef aos_channels[TGSI_NUM_CHANNELS];
@@ -2045,6 +2079,8 @@ draw_llvm_destroy_variant(struct draw_llvm_variant *variant)
 
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
+   cso_hash_erase_data(variant->shader->variants_hash, variant->hash_key,
+                       variant);
    remove_from_list(&variant->list_item_global);
    llvm->nr_variants--;
    FREE(variant);
@@ -2237,7 +2273,8 @@ draw_gs_llvm_generate(struct draw_llvm *llvm,
                      NULL,
                      sampler,
                      &llvm->draw->gs.geometry_shader->info,
-                     (const struct lp_build_tgsi_gs_iface *)&gs_iface);
+                     (const struct lp_build_tgsi_gs_iface *)&gs_iface,
+                     NULL);
 
    sampler->destroy(sampler);
 
@@ -2308,6 +2345,8 @@ draw_gs_llvm_destroy_variant(struct draw_gs_llvm_variant *variant)
 
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
+   cso_hash_erase_data(variant->shader->variants_hash, variant->hash_key,
+                       variant);
    remove_from_list(&variant->list_item_global);
    llvm->nr_gs_variants--;
    FREE(variant);
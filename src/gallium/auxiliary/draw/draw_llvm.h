@@ -40,6 +40,7 @@
 #include "util/simple_list.h"
 
 
+struct cso_hash;
 struct draw_llvm;
 struct llvm_vertex_shader;
 struct llvm_geometry_shader;
@@ -403,6 +404,9 @@ struct draw_llvm_variant
    struct draw_llvm_variant_list_item list_item_global;
    struct draw_llvm_variant_list_item list_item_local;
 
+   /* Hash of the key, see llvm_vertex_shader::variants_hash */
+   unsigned hash_key;
+
    /* key is variable-sized, must be last */
    struct draw_llvm_variant_key key;
 };
@@ -429,6 +433,9 @@ struct draw_gs_llvm_variant
    struct draw_gs_llvm_variant_list_item list_item_global;
    struct draw_gs_llvm_variant_list_item list_item_local;
 
+   /* Hash of the key, see llvm_geometry_shader::variants_hash */
+   unsigned hash_key;
+
    /* key is variable-sized, must be last */
    struct draw_gs_llvm_variant_key key;
 };
@@ -438,6 +445,8 @@ struct llvm_vertex_shader {
 
    unsigned variant_key_size;
    struct draw_llvm_variant_list_item variants;
+   /* Variants indexed by hash_key, for fast lookup */
+   struct cso_hash *variants_hash;
    unsigned variants_created;
    unsigned variants_cached;
 };
@@ -447,6 +456,8 @@ struct llvm_geometry_shader {
 
    unsigned variant_key_size;
    struct draw_gs_llvm_variant_list_item variants;
+   /* Variants indexed by hash_key, for fast lookup */
+   struct cso_hash *variants_hash;
    unsigned variants_created;
    unsigned variants_cached;
 };
@@ -34,6 +34,24 @@
 #include "draw/draw_pipe.h"
 #include "util/u_debug.h"
 #include "util/u_math.h"
+#include "util/u_sse.h"
+
+
+/** Triangles of a list are culled up front in chunks of this many */
+#define PRECULL_CHUNK 256
+
+
+/**
+ * What can be rejected before a triangle list enters the pipeline,
+ * without changing what the clip and cull stages would do.
+ */
+struct precull {
+   boolean frustum;     /**< clip stage drops triangles outside one plane */
+   boolean face;        /**< cull stage drops zero-area / culled faces */
+   unsigned cull_ccw;   /**< ~0 if counter-clockwise triangles are culled */
+   unsigned cull_cw;    /**< ~0 if clockwise triangles are culled */
+   unsigned pos;
+};
 
 
 
@@ -211,6 +229,165 @@ static void do_triangle( struct draw_context *draw,
 
 
 
+static boolean
+precull_setup(struct draw_context *draw, struct precull *pc)
+{
+   const struct pipe_rasterizer_state *rast = draw->rasterizer;
+   const unsigned front_face_ccw = rast->front_ccw ? PIPE_FACE_FRONT :
+                                                     PIPE_FACE_BACK;
+   const unsigned front_face_cw = rast->front_ccw ? PIPE_FACE_BACK :
+                                                    PIPE_FACE_FRONT;
+
+   /* same conditions as validate_pipeline() */
+   pc->frustum = draw->clip_xy || draw->clip_z || draw->clip_user;
+   pc->face = draw_pipe_need_cull(draw);
+   pc->cull_ccw = (rast->cull_face & front_face_ccw) ? ~0 : 0;
+   pc->cull_cw = (rast->cull_face & front_face_cw) ? ~0 : 0;
+   pc->pos = draw_current_shader_position_output(draw);
+
+   return pc->frustum || pc->face;
+}
+
+
+/**
+ * Return a bitmask of which of the first n (at most 4) triangles the
+ * clip or cull stage would drop.  Triangles that need real clipping
+ * are never rejected here, they go down the regular stages.
+ */
+static inline unsigned
+precull_batch(const struct precull *pc,
+              const struct vertex_header *v[4][3],
+              unsigned n)
+{
+   float x[3][4], y[3][4];
+   unsigned reject = 0, face_test = 0;
+   unsigned nonzero, negative;
+   unsigned i, j;
+
+   for (i = 0; i < 4; i++) {
+      if (i < n) {
+         const unsigned m0 = v[i][0]->clipmask;
+         const unsigned m1 = v[i][1]->clipmask;
+         const unsigned m2 = v[i][2]->clipmask;
+
+         if (pc->frustum && (m0 & m1 & m2))
+            reject |= 1 << i;
+         else if (pc->face && (!pc->frustum || !(m0 | m1 | m2)))
+            face_test |= 1 << i;
+      }
+      for (j = 0; j < 3; j++) {
+         const float *p = (face_test & (1 << i)) ?
+                          v[i][j]->data[pc->pos] : NULL;
+         x[j][i] = p ? p[0] : 0.0f;
+         y[j][i] = p ? p[1] : 0.0f;
+      }
+   }
+
+   if (!face_test)
+      return reject;
+
+   /* det = cross(v0 - v2, v1 - v2).z, exactly as cull_tri() does */
+#if defined(PIPE_ARCH_SSE)
+   {
+      const __m128 x2 = _mm_loadu_ps(x[2]);
+      const __m128 y2 = _mm_loadu_ps(y[2]);
+      const __m128 ex = _mm_sub_ps(_mm_loadu_ps(x[0]), x2);
+      const __m128 ey = _mm_sub_ps(_mm_loadu_ps(y[0]), y2);
+      const __m128 fx = _mm_sub_ps(_mm_loadu_ps(x[1]), x2);
+      const __m128 fy = _mm_sub_ps(_mm_loadu_ps(y[1]), y2);
+      const __m128 det = _mm_sub_ps(_mm_mul_ps(ex, fy), _mm_mul_ps(ey, fx));
+      const __m128 zero = _mm_setzero_ps();
+
+      nonzero = _mm_movemask_ps(_mm_cmpneq_ps(det, zero));
+      negative = _mm_movemask_ps(_mm_cmplt_ps(det, zero));
+   }
+#else
+   nonzero = negative = 0;
+   for (i = 0; i < 4; i++) {
+      const float ex = x[0][i] - x[2][i];
+      const float ey = y[0][i] - y[2][i];
+      const float fx = x[1][i] - x[2][i];
+      const float fy = y[1][i] - y[2][i];
+      const float det = ex * fy - ey * fx;
+
+      if (det != 0)
+         nonzero |= 1 << i;
+      if (det < 0)
+         negative |= 1 << i;
+   }
+#endif
+
+   /* det < 0 means counter-clockwise, zero area is always dropped */
+   reject |= face_test & (~nonzero |
+                          (negative & pc->cull_ccw) |
+                          (nonzero & ~negative & pc->cull_cw));
+
+   return reject;
+}
+
+
+/**
+ * Run a triangle list through the pipeline, leaving out the triangles
+ * the clip and cull stages would drop anyway.  The list is indexed by
+ * elts, or linear if elts is NULL.
+ */
+static void
+pipe_run_triangles_culled(struct draw_context *draw,
+                          const struct precull *pc,
+                          unsigned prim_flags,
+                          struct vertex_header *vertices,
+                          unsigned stride,
+                          const ushort *elts,
+                          unsigned count,
+                          unsigned max_index)
+{
+   const char *verts = (const char *) vertices;
+   const unsigned num_tris = count / 3;
+   const struct vertex_header *v[4][3];
+   ushort idx[4][3];
+   ushort out[PRECULL_CHUNK * 3];
+   unsigned num_out = 0;
+   unsigned t, i, j, n, reject;
+
+   for (t = 0; t < num_tris; t += 4) {
+      n = MIN2(num_tris - t, 4);
+
+      for (i = 0; i < n; i++) {
+         for (j = 0; j < 3; j++) {
+            const unsigned k = (t + i) * 3 + j;
+            idx[i][j] = elts ? MIN2(elts[k], max_index) : k;
+            v[i][j] = (const struct vertex_header *)
+               (verts + stride * idx[i][j]);
+         }
+      }
+      for (; i < 4; i++) {
+         for (j = 0; j < 3; j++)
+            v[i][j] = v[0][j];
+      }
+
+      reject = precull_batch(pc, v, n);
+
+      if (num_out + 4 * 3 > ARRAY_SIZE(out)) {
+         pipe_run_elts(draw, PIPE_PRIM_TRIANGLES, prim_flags,
+                       vertices, stride, out, num_out, max_index);
+         num_out = 0;
+      }
+
+      for (i = 0; i < n; i++) {
+         if (!(reject & (1 << i))) {
+            out[num_out++] = idx[i][0];
+            out[num_out++] = idx[i][1];
+            out[num_out++] = idx[i][2];
+         }
+      }
+   }
+
+   if (num_out)
+      pipe_run_elts(draw, PIPE_PRIM_TRIANGLES, prim_flags,
+                    vertices, stride, out, num_out, max_index);
+}
+
+
 /**
  * Code to run the pipeline on a fairly arbitrary collection of vertices.
  * For drawing indexed primitives.
@@ -227,6 +404,9 @@ void draw_pipeline_run( struct draw_context *draw,
                         const struct draw_vertex_info *vert_info,
                         const struct draw_prim_info *prim_info)
 {
+   struct precull pc;
+   const boolean precull = prim_info->prim == PIPE_PRIM_TRIANGLES &&
+                           precull_setup(draw, &pc);
    unsigned i, start;
 
    draw->pipeline.verts = (char *)vert_info->verts;
@@ -258,14 +438,23 @@ void draw_pipeline_run( struct draw_context *draw,
       }
 #endif
 
-      pipe_run_elts(draw,
-                    prim_info->prim,
-                    prim_info->flags,
-                    vert_info->verts,
-                    vert_info->stride,
-                    prim_info->elts + start,
-                    count,
-                    vert_info->count - 1);
+      if (precull)
+         pipe_run_triangles_culled(draw, &pc,
+                                   prim_info->flags,
+                                   vert_info->verts,
+                                   vert_info->stride,
+                                   prim_info->elts + start,
+                                   count,
+                                   vert_info->count - 1);
+      else
+         pipe_run_elts(draw,
+                       prim_info->prim,
+                       prim_info->flags,
+                       vert_info->verts,
+                       vert_info->stride,
+                       prim_info->elts + start,
+                       count,
+                       vert_info->count - 1);
    }
 
    draw->pipeline.verts = NULL;
@@ -314,6 +503,9 @@ void draw_pipeline_run_linear( struct draw_context *draw,
                                const struct draw_vertex_info *vert_info,
                                const struct draw_prim_info *prim_info)
 {
+   struct precull pc;
+   const boolean precull = prim_info->prim == PIPE_PRIM_TRIANGLES &&
+                           precull_setup(draw, &pc);
    unsigned i, start;
 
    for (start = i = 0;
@@ -330,12 +522,22 @@ void draw_pipeline_run_linear( struct draw_context *draw,
 
       assert(count <= vert_info->count);
 
-      pipe_run_linear(draw,
-                      prim_info->prim,
-                      prim_info->flags,
-                      (struct vertex_header*)verts,
-                      vert_info->stride,
-                      count);
+      /* the culled list is indexed with ushorts */
+      if (precull && count <= 0x10000)
+         pipe_run_triangles_culled(draw, &pc,
+                                   prim_info->flags,
+                                   (struct vertex_header*)verts,
+                                   vert_info->stride,
+                                   NULL,
+                                   count,
+                                   count - 1);
+      else
+         pipe_run_linear(draw,
+                         prim_info->prim,
+                         prim_info->flags,
+                         (struct vertex_header*)verts,
+                         vert_info->stride,
+                         count);
    }
 
    draw->pipeline.verts = NULL;
@@ -139,6 +139,27 @@ draw_need_pipeline(const struct draw_context *draw,
 
 
 
+/**
+ * Whether the pipeline needs the cull stage: for culling, or because a
+ * later stage uses the determinant it computes (unfilled, offset and
+ * twoside).
+ */
+boolean
+draw_pipe_need_cull(const struct draw_context *draw)
+{
+   const struct pipe_rasterizer_state *rast = draw->rasterizer;
+
+   return (rast->fill_front != PIPE_POLYGON_MODE_FILL ||
+           rast->fill_back != PIPE_POLYGON_MODE_FILL ||
+           rast->offset_point ||
+           rast->offset_line ||
+           rast->offset_tri ||
+           rast->light_twoside ||
+           rast->cull_face != PIPE_FACE_NONE ||
+           draw_current_shader_num_written_culldistances(draw));
+}
+
+
 /**
  * Rebuild the rendering pipeline.
  */
@@ -146,7 +167,6 @@ static struct draw_stage *validate_pipeline( struct draw_stage *stage )
 {
    struct draw_context *draw = stage->draw;
    struct draw_stage *next = draw->pipeline.rasterize;
-   boolean need_det = FALSE;
    boolean precalc_flat = FALSE;
    boolean wide_lines, wide_points;
    const struct pipe_rasterizer_state *rast = draw->rasterizer;
@@ -218,7 +238,6 @@ static struct draw_stage *validate_pipeline( struct draw_stage *stage )
       draw->pipeline.unfilled->next = next;
       next = draw->pipeline.unfilled;
       precalc_flat = TRUE;		/* only needed for triangles really */
-      need_det = TRUE;
    }
 
    if (precalc_flat) {
@@ -235,13 +254,11 @@ static struct draw_stage *validate_pipeline( struct draw_stage *stage )
        rast->offset_tri) {
       draw->pipeline.offset->next = next;
       next = draw->pipeline.offset;
-      need_det = TRUE;
    }
 
    if (rast->light_twoside) {
       draw->pipeline.twoside->next = next;
       next = draw->pipeline.twoside;
-      need_det = TRUE;
    }
 
    /* Always run the cull stage as we calculate determinant there
@@ -251,8 +268,7 @@ static struct draw_stage *validate_pipeline( struct draw_stage *stage )
     * to less work emitting vertices, smaller vertex buffers, etc.
     * It's difficult to say whether this will be true in general.
     */
-   if (need_det || rast->cull_face != PIPE_FACE_NONE ||
-       draw_current_shader_num_written_culldistances(draw)) {
+   if (draw_pipe_need_cull(draw)) {
       draw->pipeline.cull->next = next;
       next = draw->pipeline.cull;
    }
@@ -69,6 +69,7 @@ struct tgsi_sampler;
 struct draw_pt_front_end;
 struct draw_assembler;
 struct draw_llvm;
+struct draw_thread_pool;
 
 
 /**
@@ -210,6 +211,22 @@ struct draw_context
 
       boolean test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       boolean no_fse;           /* disable FSE even when it is correct */
+
+      /** Threads sharing the vertex shading of large segments, or NULL */
+      struct draw_thread_pool *threads;
+
+      /**
+       * Bumped for every new draw instance.  Post-transform vertex caches
+       * may only be reused while this stays the same.
+       */
+      unsigned vcache_serial;
+
+      /** DRAW_VCACHE_STATS: vertex shader invocations per unique index */
+      struct {
+         boolean enabled;
+         uint64_t vs_invocations;
+         uint64_t unique_indices;
+      } vcache_stats;
    } pt;
 
    struct {
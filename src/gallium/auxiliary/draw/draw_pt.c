@@ -34,17 +34,21 @@
 #include "draw/draw_gs.h"
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
+#include "draw/draw_threads.h"
 #include "draw/draw_vbuf.h"
 #include "draw/draw_vs.h"
 #include "tgsi/tgsi_dump.h"
 #include "util/u_math.h"
+#include "util/u_memory.h"
 #include "util/u_prim.h"
 #include "util/u_format.h"
 #include "util/u_draw.h"
+#include "util/bitset.h"
 
 
 DEBUG_GET_ONCE_BOOL_OPTION(draw_fse, "DRAW_FSE", FALSE)
 DEBUG_GET_ONCE_BOOL_OPTION(draw_no_fse, "DRAW_NO_FSE", FALSE)
+DEBUG_GET_ONCE_BOOL_OPTION(draw_vcache_stats, "DRAW_VCACHE_STATS", FALSE)
 
 /* Overall we split things into:
  *     - frontend -- prepare fetch_elts, draw_elts - eg vsplit
@@ -174,6 +178,7 @@ boolean draw_pt_init( struct draw_context *draw )
 {
    draw->pt.test_fse = debug_get_option_draw_fse();
    draw->pt.no_fse = debug_get_option_draw_no_fse();
+   draw->pt.vcache_stats.enabled = debug_get_option_draw_vcache_stats();
 
    draw->pt.front.vsplit = draw_pt_vsplit(draw);
    if (!draw->pt.front.vsplit)
@@ -226,6 +231,21 @@ void draw_pt_destroy( struct draw_context *draw )
       draw->pt.front.vsplit->destroy( draw->pt.front.vsplit );
       draw->pt.front.vsplit = NULL;
    }
+
+   if (draw->pt.threads) {
+      draw_thread_pool_destroy(draw->pt.threads);
+      draw->pt.threads = NULL;
+   }
+
+   if (draw->pt.vcache_stats.enabled &&
+       draw->pt.vcache_stats.unique_indices) {
+      debug_printf("draw: %llu vertex shader invocations for %llu unique "
+                   "indices (%.3f per index)\n",
+                   (unsigned long long) draw->pt.vcache_stats.vs_invocations,
+                   (unsigned long long) draw->pt.vcache_stats.unique_indices,
+                   (double) draw->pt.vcache_stats.vs_invocations /
+                   draw->pt.vcache_stats.unique_indices);
+   }
 }
 
 
@@ -423,6 +443,68 @@ draw_pt_arrays_restart(struct draw_context *draw,
 }
 
 
+/** Largest index range draw_vcache_count_unique() will look at */
+#define VCACHE_STATS_MAX_RANGE (1 << 24)
+
+
+/**
+ * Count the distinct indices of an indexed draw, for DRAW_VCACHE_STATS.
+ * Draws spanning a huge index range are ignored.
+ */
+static void
+draw_vcache_count_unique(struct draw_context *draw,
+                         const struct pipe_draw_info *info)
+{
+   const unsigned elt_max = draw->pt.user.eltMax;
+   const unsigned end = info->start < elt_max ?
+      info->start + MIN2(info->count, elt_max - info->start) : info->start;
+   unsigned min_index = ~0u, max_index = 0;
+   unsigned i, idx, range, unique = 0;
+   BITSET_WORD *seen;
+
+#define DRAW_VCACHE_ELT(i)                                              \
+   (draw->pt.user.eltSize == 1 ? ((const ubyte *) draw->pt.user.elts)[i] : \
+    draw->pt.user.eltSize == 2 ? ((const ushort *) draw->pt.user.elts)[i] : \
+    ((const uint *) draw->pt.user.elts)[i])
+
+   for (i = info->start; i < end; i++) {
+      idx = DRAW_VCACHE_ELT(i);
+      if (info->primitive_restart && idx == info->restart_index)
+         continue;
+      min_index = MIN2(min_index, idx);
+      max_index = MAX2(max_index, idx);
+   }
+   if (min_index > max_index)
+      return;
+
+   range = max_index - min_index;
+   if (range >= VCACHE_STATS_MAX_RANGE)
+      return;
+
+   seen = CALLOC(BITSET_WORDS(range + 1), sizeof(BITSET_WORD));
+   if (!seen)
+      return;
+
+   for (i = info->start; i < end; i++) {
+      idx = DRAW_VCACHE_ELT(i);
+      if (info->primitive_restart && idx == info->restart_index)
+         continue;
+      idx -= min_index;
+      if (!BITSET_TEST(seen, idx)) {
+         BITSET_SET(seen, idx);
+         unique++;
+      }
+   }
+
+#undef DRAW_VCACHE_ELT
+
+   FREE(seen);
+
+   draw->pt.vcache_stats.unique_indices +=
+      (uint64_t) unique * info->instance_count;
+}
+
+
 /**
  * Resolve true values within pipe_draw_info.
  * If we're rendering from transform feedback/stream output
@@ -539,6 +621,9 @@ draw_vbo(struct draw_context *draw,
    draw->pt.max_index = index_limit - 1;
    draw->start_index = info->start;
 
+   if (draw->pt.vcache_stats.enabled && info->indexed)
+      draw_vcache_count_unique(draw, info);
+
    /*
     * TODO: We could use draw->pt.max_index to further narrow
     * the min_index/max_index hints given by the state tracker.
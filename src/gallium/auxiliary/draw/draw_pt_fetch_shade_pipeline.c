@@ -262,6 +262,9 @@ fetch_pipeline_generic(struct draw_pt_middle_end *middle,
          u_decomposed_prims_for_vertices(prim_info->prim, fetch_info->count);
       draw->statistics.vs_invocations += fetch_info->count;
    }
+   if (draw->pt.vcache_stats.enabled && draw->pt.user.eltSize) {
+      draw->pt.vcache_stats.vs_invocations += fetch_info->count;
+   }
 
    /* Fetch into our vertex buffer.
     */
@@ -28,6 +28,8 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/u_prim.h"
+#include "util/u_hash.h"
+#include "cso_cache/cso_hash.h"
 #include "draw/draw_context.h"
 #include "draw/draw_gs.h"
 #include "draw/draw_vbuf.h"
@@ -36,9 +38,43 @@
 #include "draw/draw_prim_assembler.h"
 #include "draw/draw_vs.h"
 #include "draw/draw_llvm.h"
+#include "draw/draw_threads.h"
 #include "gallivm/lp_bld_init.h"
 
 
+/** Smallest number of vertices worth shading on another thread */
+#define LLVM_SHADE_MIN_CHUNK 256
+
+/** Post-transform vertex cache size in bytes, and its associativity */
+#define LLVM_VCACHE_SIZE (256 * 1024)
+#define LLVM_VCACHE_WAYS 4
+#define LLVM_VCACHE_MIN_ENTRIES 64
+#define LLVM_VCACHE_MAX_ENTRIES 4096
+
+
+/**
+ * Shaded vertices of an indexed draw, keyed by fetch element.  Unlike the
+ * vsplit cache, which only dedups within a segment, this one lives as long
+ * as the draw instance, so neighbouring segments share vertices.
+ */
+struct llvm_vcache {
+   unsigned num_sets;      /**< power of two, 0 if the cache is disabled */
+   unsigned vertex_size;
+   unsigned serial;        /**< draw->pt.vcache_serial of the contents */
+
+   unsigned *elts;         /**< fetch element of each entry */
+   ubyte *valid;           /**< number of used ways per set */
+   ubyte *next;            /**< way to replace next (FIFO) per set */
+   ubyte *verts;           /**< shaded vertex of each entry */
+
+   /* per segment scratch, kept to avoid allocating on every segment */
+   unsigned max_count;     /**< number of elements the arrays below hold */
+   unsigned *miss_elts;    /**< fetch elements to shade */
+   unsigned *miss_pos;     /**< where each of them goes in the segment */
+   unsigned *hit_entry;    /**< cache entry of each element, ~0 if none */
+};
+
+
 struct llvm_middle_end {
    struct draw_pt_middle_end base;
    struct draw_context *draw;
@@ -56,6 +92,8 @@ struct llvm_middle_end {
 
    struct draw_llvm *llvm;
    struct draw_llvm_variant *current_variant;
+
+   struct llvm_vcache vcache;
 };
 
 
@@ -67,6 +105,78 @@ llvm_middle_end(struct draw_pt_middle_end *middle)
 }
 
 
+static void
+llvm_vcache_destroy(struct llvm_vcache *cache)
+{
+   FREE(cache->elts);
+   FREE(cache->valid);
+   FREE(cache->next);
+   align_free(cache->verts);
+   FREE(cache->miss_elts);
+   memset(cache, 0, sizeof *cache);
+}
+
+
+/**
+ * (Re)size the vertex cache for vertices of vertex_size bytes.  The number
+ * of entries is chosen so the cache stays around LLVM_VCACHE_SIZE bytes.
+ */
+static void
+llvm_vcache_prepare(struct llvm_middle_end *fpme)
+{
+   struct llvm_vcache *cache = &fpme->vcache;
+   unsigned num_entries;
+
+   if (cache->vertex_size == fpme->vertex_size)
+      return;
+
+   llvm_vcache_destroy(cache);
+
+   num_entries = 1 << util_logbase2(MAX2(LLVM_VCACHE_SIZE / fpme->vertex_size,
+                                         1));
+   num_entries = CLAMP(num_entries,
+                       LLVM_VCACHE_MIN_ENTRIES, LLVM_VCACHE_MAX_ENTRIES);
+
+   cache->vertex_size = fpme->vertex_size;
+   cache->serial = fpme->draw->pt.vcache_serial;
+   cache->elts = MALLOC(num_entries * sizeof(unsigned));
+   cache->valid = CALLOC(num_entries / LLVM_VCACHE_WAYS, sizeof(ubyte));
+   cache->next = CALLOC(num_entries / LLVM_VCACHE_WAYS, sizeof(ubyte));
+   cache->verts = align_malloc(num_entries * fpme->vertex_size, 16);
+
+   if (!cache->elts || !cache->valid || !cache->next || !cache->verts) {
+      llvm_vcache_destroy(cache);
+      return;
+   }
+
+   cache->num_sets = num_entries / LLVM_VCACHE_WAYS;
+}
+
+
+/**
+ * Make sure the per segment arrays hold count elements.
+ */
+static boolean
+llvm_vcache_reserve(struct llvm_vcache *cache, unsigned count)
+{
+   unsigned *elts;
+
+   if (count <= cache->max_count)
+      return TRUE;
+
+   elts = MALLOC(3 * count * sizeof(unsigned));
+   if (!elts)
+      return FALSE;
+
+   FREE(cache->miss_elts);
+   cache->max_count = count;
+   cache->miss_elts = elts;
+   cache->miss_pos = elts + count;
+   cache->hit_entry = elts + 2 * count;
+   return TRUE;
+}
+
+
 static void
 llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
 {
@@ -74,21 +184,25 @@ llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
    struct draw_geometry_shader *gs = draw->gs.geometry_shader;
    struct draw_gs_llvm_variant_key *key;
    struct draw_gs_llvm_variant *variant = NULL;
-   struct draw_gs_llvm_variant_list_item *li;
    struct llvm_geometry_shader *shader = llvm_geometry_shader(gs);
    char store[DRAW_GS_LLVM_MAX_VARIANT_KEY_SIZE];
+   struct cso_hash_iter iter;
+   unsigned hash_key;
    unsigned i;
 
    key = draw_gs_llvm_make_variant_key(fpme->llvm, store);
 
-   /* Search shader's list of variants for the key */
-   li = first_elem(&shader->variants);
-   while (!at_end(&shader->variants, li)) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-         variant = li->base;
+   /* Search shader's variants for the key */
+   hash_key = util_hash_crc32(key, shader->variant_key_size);
+   iter = cso_hash_find(shader->variants_hash, hash_key);
+   while (!cso_hash_iter_is_null(iter) &&
+          cso_hash_iter_key(iter) == hash_key) {
+      struct draw_gs_llvm_variant *v = cso_hash_iter_data(iter);
+      if (memcmp(&v->key, key, shader->variant_key_size) == 0) {
+         variant = v;
          break;
       }
-      li = next_elem(li);
+      iter = cso_hash_iter_next(iter);
    }
 
    if (variant) {
@@ -121,6 +235,8 @@ llvm_middle_end_prepare_gs(struct llvm_middle_end *fpme)
       variant = draw_gs_llvm_create_variant(fpme->llvm, gs->info.num_outputs, key);
 
       if (variant) {
+         variant->hash_key = hash_key;
+         cso_hash_insert(shader->variants_hash, hash_key, variant);
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&fpme->llvm->gs_variants_list,
                         &variant->list_item_global);
@@ -151,6 +267,9 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       u_assembled_prim(in_prim);
    unsigned point_clip = draw->rasterizer->fill_front == PIPE_POLYGON_MODE_POINT ||
                          out_prim == PIPE_PRIM_POINTS;
+   /* let vsplit use its larger segments when shading is threaded */
+   const unsigned min_vertices = draw->pt.threads ?
+      DRAW_THREADED_SEGMENT_SIZE : 4096;
    unsigned nr;
 
    fpme->input_prim = in_prim;
@@ -172,11 +291,11 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
       draw_pt_emit_prepare( fpme->emit, out_prim,
                             max_vertices );
 
-      *max_vertices = MAX2( *max_vertices, 4096 );
+      *max_vertices = MAX2( *max_vertices, min_vertices );
    }
    else {
       /* limit max fetches by limiting max_vertices */
-      *max_vertices = 4096;
+      *max_vertices = min_vertices;
    }
 
    /* Get the number of float[4] attributes per vertex.
@@ -194,25 +313,31 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
    /* return even number */
    *max_vertices = *max_vertices & ~1;
 
+   llvm_vcache_prepare(fpme);
+
    /* Find/create the vertex shader variant */
    {
       struct draw_llvm_variant_key *key;
       struct draw_llvm_variant *variant = NULL;
-      struct draw_llvm_variant_list_item *li;
       struct llvm_vertex_shader *shader = llvm_vertex_shader(vs);
       char store[DRAW_LLVM_MAX_VARIANT_KEY_SIZE];
+      struct cso_hash_iter iter;
+      unsigned hash_key;
       unsigned i;
 
       key = draw_llvm_make_variant_key(fpme->llvm, store);
 
-      /* Search shader's list of variants for the key */
-      li = first_elem(&shader->variants);
-      while (!at_end(&shader->variants, li)) {
-         if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
-            variant = li->base;
+      /* Search shader's variants for the key */
+      hash_key = util_hash_crc32(key, shader->variant_key_size);
+      iter = cso_hash_find(shader->variants_hash, hash_key);
+      while (!cso_hash_iter_is_null(iter) &&
+             cso_hash_iter_key(iter) == hash_key) {
+         struct draw_llvm_variant *v = cso_hash_iter_data(iter);
+         if (memcmp(&v->key, key, shader->variant_key_size) == 0) {
+            variant = v;
             break;
          }
-         li = next_elem(li);
+         iter = cso_hash_iter_next(iter);
       }
 
       if (variant) {
@@ -245,6 +370,8 @@ llvm_middle_end_prepare( struct draw_pt_middle_end *middle,
          variant = draw_llvm_create_variant(fpme->llvm, nr, key);
 
          if (variant) {
+            variant->hash_key = hash_key;
+            cso_hash_insert(shader->variants_hash, hash_key, variant);
             insert_at_head(&shader->variants, &variant->list_item_local);
             insert_at_head(&fpme->llvm->vs_variants_list,
                            &variant->list_item_global);
@@ -336,6 +463,238 @@ emit(struct pt_emit *emit,
 }
 
 
+/**
+ * Fetch and shade count vertices, starting at vertex first of the fetch.
+ * Returns non-zero if any vertex needs clipping.
+ */
+static int
+llvm_middle_end_shade_range(struct llvm_middle_end *fpme,
+                            const struct draw_fetch_info *fetch_info,
+                            unsigned first, unsigned count,
+                            struct vertex_header *verts)
+{
+   struct draw_context *draw = fpme->draw;
+
+   if (fetch_info->linear)
+      return fpme->current_variant->jit_func( &fpme->llvm->jit_context,
+                                       verts,
+                                       draw->pt.user.vbuffer,
+                                       fetch_info->start + first,
+                                       count,
+                                       fpme->vertex_size,
+                                       draw->pt.vertex_buffer,
+                                       draw->instance_id,
+                                       draw->start_index,
+                                       draw->start_instance);
+   else
+      return fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
+                                            verts,
+                                            draw->pt.user.vbuffer,
+                                            fetch_info->elts + first,
+                                            draw->pt.user.eltMax - first,
+                                            count,
+                                            fpme->vertex_size,
+                                            draw->pt.vertex_buffer,
+                                            draw->instance_id,
+                                            draw->pt.user.eltBias,
+                                            draw->start_instance);
+}
+
+
+/**
+ * Vertex shading of a segment split into chunks, one job per chunk.
+ */
+struct llvm_shade_job
+{
+   struct llvm_middle_end *fpme;
+   const struct draw_fetch_info *fetch_info;
+   struct vertex_header *verts;
+   unsigned chunk_size;
+   int clipped[DRAW_MAX_THREADS + 1];
+};
+
+
+static void
+llvm_shade_job_run(void *data, unsigned job)
+{
+   struct llvm_shade_job *shade = (struct llvm_shade_job *) data;
+   unsigned first = job * shade->chunk_size;
+   unsigned count = MIN2(shade->chunk_size,
+                         shade->fetch_info->count - first);
+   struct vertex_header *verts = (struct vertex_header *)
+      ((char *) shade->verts + first * shade->fpme->vertex_size);
+
+   shade->clipped[job] = llvm_middle_end_shade_range(shade->fpme,
+                                                     shade->fetch_info,
+                                                     first, count, verts);
+}
+
+
+/**
+ * Run fetch and vertex shader for all vertices of the fetch, spread over
+ * the draw threads if the segment is large enough.  All later stages
+ * stay on the calling thread, so primitive order is unaffected.
+ */
+static int
+llvm_middle_end_shade(struct llvm_middle_end *fpme,
+                      const struct draw_fetch_info *fetch_info,
+                      struct vertex_header *verts)
+{
+   struct draw_context *draw = fpme->draw;
+   /* the shader writes whole SIMD vectors of vertices */
+   const unsigned vector_length = lp_native_vector_width / 32;
+   struct llvm_shade_job shade;
+   unsigned num_jobs, i;
+   int clipped = 0;
+
+   /*
+    * With elements the shader flags positions past eltMax as overflowed,
+    * keep it simple and don't split those.
+    */
+   if (!draw->pt.threads ||
+       fetch_info->count < 2 * LLVM_SHADE_MIN_CHUNK ||
+       (!fetch_info->linear && draw->pt.user.eltMax < fetch_info->count))
+      return llvm_middle_end_shade_range(fpme, fetch_info,
+                                         0, fetch_info->count, verts);
+
+   num_jobs = MIN2(fetch_info->count / LLVM_SHADE_MIN_CHUNK,
+                   draw_thread_pool_num_threads(draw->pt.threads) + 1);
+
+   /*
+    * Chunks must be multiples of the vector length, so that no chunk
+    * writes the vertices of the next one.
+    */
+   shade.fpme = fpme;
+   shade.fetch_info = fetch_info;
+   shade.verts = verts;
+   shade.chunk_size = align(DIV_ROUND_UP(fetch_info->count, num_jobs),
+                            vector_length);
+   num_jobs = DIV_ROUND_UP(fetch_info->count, shade.chunk_size);
+
+   draw_thread_pool_run(draw->pt.threads, llvm_shade_job_run, &shade,
+                        num_jobs);
+
+   for (i = 0; i < num_jobs; i++)
+      clipped |= shade.clipped[i];
+
+   return clipped;
+}
+
+
+/**
+ * Like llvm_middle_end_shade(), but take the vertices found in the vertex
+ * cache from there and only shade the others.  The number of vertices
+ * actually shaded is returned in num_shaded.
+ *
+ * The misses are shaded into the front of verts and then moved to their
+ * place, so no other vertex buffer is needed.
+ */
+static int
+llvm_middle_end_shade_cached(struct llvm_middle_end *fpme,
+                             const struct draw_fetch_info *fetch_info,
+                             struct vertex_header *verts,
+                             unsigned *num_shaded)
+{
+   struct llvm_vcache *cache = &fpme->vcache;
+   const unsigned vertex_size = fpme->vertex_size;
+   const unsigned count = fetch_info->count;
+   const unsigned set_mask = cache->num_sets - 1;
+   struct draw_fetch_info miss_info;
+   unsigned num_miss = 0;
+   unsigned i, way;
+   int clipped = 0;
+
+   if (!llvm_vcache_reserve(cache, count)) {
+      *num_shaded = count;
+      return llvm_middle_end_shade(fpme, fetch_info, verts);
+   }
+
+   if (cache->serial != fpme->draw->pt.vcache_serial) {
+      memset(cache->valid, 0, cache->num_sets);
+      memset(cache->next, 0, cache->num_sets);
+      cache->serial = fpme->draw->pt.vcache_serial;
+   }
+
+   for (i = 0; i < count; i++) {
+      const unsigned elt = fetch_info->elts[i];
+      const unsigned set = elt & set_mask;
+      const unsigned *set_elts = &cache->elts[set * LLVM_VCACHE_WAYS];
+
+      for (way = 0; way < cache->valid[set]; way++) {
+         if (set_elts[way] == elt)
+            break;
+      }
+
+      if (way < cache->valid[set]) {
+         const unsigned entry = set * LLVM_VCACHE_WAYS + way;
+         const struct vertex_header *vh = (const struct vertex_header *)
+            (cache->verts + entry * vertex_size);
+
+         cache->hit_entry[i] = entry;
+         /* same as what the shader reports, see clipmask_booli32() */
+         clipped |= vh->clipmask != 0 || !vh->edgeflag;
+      }
+      else {
+         cache->hit_entry[i] = ~0u;
+         cache->miss_elts[num_miss] = elt;
+         cache->miss_pos[num_miss] = i;
+         num_miss++;
+      }
+   }
+
+   *num_shaded = num_miss;
+
+   if (num_miss) {
+      miss_info.linear = FALSE;
+      miss_info.start = 0;
+      miss_info.elts = cache->miss_elts;
+      miss_info.count = num_miss;
+
+      clipped |= llvm_middle_end_shade(fpme, &miss_info, verts);
+
+      /*
+       * Every miss goes at or after its shaded position, so moving them
+       * from the last one down doesn't overwrite any still to be moved.
+       */
+      for (i = num_miss; i-- > 0; ) {
+         if (cache->miss_pos[i] != i) {
+            memcpy((char *) verts + cache->miss_pos[i] * vertex_size,
+                   (const char *) verts + i * vertex_size, vertex_size);
+         }
+      }
+   }
+
+   /* the hits before inserting the misses, which may evict them */
+   for (i = 0; i < count; i++) {
+      if (cache->hit_entry[i] != ~0u) {
+         memcpy((char *) verts + i * vertex_size,
+                cache->verts + cache->hit_entry[i] * vertex_size,
+                vertex_size);
+      }
+   }
+
+   for (i = 0; i < num_miss; i++) {
+      const unsigned elt = cache->miss_elts[i];
+      const unsigned set = elt & set_mask;
+
+      /* insert, replacing the oldest way of a full set */
+      if (cache->valid[set] < LLVM_VCACHE_WAYS) {
+         way = cache->valid[set]++;
+      }
+      else {
+         way = cache->next[set];
+         cache->next[set] = (way + 1) % LLVM_VCACHE_WAYS;
+      }
+      cache->elts[set * LLVM_VCACHE_WAYS + way] = elt;
+      memcpy(cache->verts + (set * LLVM_VCACHE_WAYS + way) * vertex_size,
+             (const char *) verts + cache->miss_pos[i] * vertex_size,
+             vertex_size);
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -354,6 +713,7 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
    boolean free_prim_info = FALSE;
    unsigned opt = fpme->opt;
    unsigned clipped = 0;
+   unsigned num_shaded;
 
    llvm_vert_info.count = fetch_info->count;
    llvm_vert_info.vertex_size = fpme->vertex_size;
@@ -370,32 +730,29 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
       draw->statistics.ia_vertices += prim_info->count;
       draw->statistics.ia_primitives +=
          u_decomposed_prims_for_vertices(prim_info->prim, prim_info->count);
-      draw->statistics.vs_invocations += fetch_info->count;
    }
 
-   if (fetch_info->linear)
-      clipped = fpme->current_variant->jit_func( &fpme->llvm->jit_context,
-                                       llvm_vert_info.verts,
-                                       draw->pt.user.vbuffer,
-                                       fetch_info->start,
-                                       fetch_info->count,
-                                       fpme->vertex_size,
-                                       draw->pt.vertex_buffer,
-                                       draw->instance_id,
-                                       draw->start_index,
-                                       draw->start_instance);
-   else
-      clipped = fpme->current_variant->jit_func_elts( &fpme->llvm->jit_context,
-                                            llvm_vert_info.verts,
-                                            draw->pt.user.vbuffer,
-                                            fetch_info->elts,
-                                            draw->pt.user.eltMax,
-                                            fetch_info->count,
-                                            fpme->vertex_size,
-                                            draw->pt.vertex_buffer,
-                                            draw->instance_id,
-                                            draw->pt.user.eltBias,
-                                            draw->start_instance);
+   /*
+    * The cache needs the elements in range of eltMax, as the shader
+    * would flag the ones beyond as overflowed by their position.
+    */
+   if (!fetch_info->linear && fpme->vcache.num_sets &&
+       draw->pt.user.eltMax >= fetch_info->count) {
+      clipped = llvm_middle_end_shade_cached(fpme, fetch_info,
+                                             llvm_vert_info.verts,
+                                             &num_shaded);
+   }
+   else {
+      clipped = llvm_middle_end_shade(fpme, fetch_info, llvm_vert_info.verts);
+      num_shaded = fetch_info->count;
+   }
+
+   if (draw->collect_statistics) {
+      draw->statistics.vs_invocations += num_shaded;
+   }
+   if (draw->pt.vcache_stats.enabled && draw->pt.user.eltSize) {
+      draw->pt.vcache_stats.vs_invocations += num_shaded;
+   }
 
    /* Finished with fetch and vs:
     */
@@ -598,6 +955,8 @@ llvm_middle_end_destroy(struct draw_pt_middle_end *middle)
    if (fpme->post_vs)
       draw_pt_post_vs_destroy( fpme->post_vs );
 
+   llvm_vcache_destroy(&fpme->vcache);
+
    FREE(middle);
 }
 
@@ -29,9 +29,12 @@
 #include "draw/draw_context.h"
 #include "draw/draw_private.h"
 #include "draw/draw_pt.h"
+#include "draw/draw_threads.h"
 
 #define SEGMENT_SIZE 1024
-#define MAP_SIZE     256
+#define MAX_SEGMENT_SIZE DRAW_THREADED_SEGMENT_SIZE
+#define MAP_SETS     256
+#define MAP_WAYS     4
 
 /* The largest possible index withing an index buffer */
 #define MAX_ELT_IDX 0xffffffff
@@ -48,15 +51,16 @@ struct vsplit_frontend {
    ushort segment_size;
 
    /* buffers for splitting */
-   unsigned fetch_elts[SEGMENT_SIZE];
-   ushort draw_elts[SEGMENT_SIZE];
-   ushort identity_draw_elts[SEGMENT_SIZE];
+   unsigned fetch_elts[MAX_SEGMENT_SIZE];
+   ushort draw_elts[MAX_SEGMENT_SIZE];
+   ushort identity_draw_elts[MAX_SEGMENT_SIZE];
 
    struct {
-      /* map a fetch element to a draw element */
-      unsigned fetches[MAP_SIZE];
-      ushort draws[MAP_SIZE];
-      boolean has_max_fetch;
+      /* map a fetch element to a draw element, 4-way set associative */
+      unsigned fetches[MAP_SETS][MAP_WAYS];
+      ushort draws[MAP_SETS][MAP_WAYS];
+      ubyte valid[MAP_SETS];    /**< number of used ways per set */
+      ubyte next[MAP_SETS];     /**< way to replace next (FIFO) */
 
       ushort num_fetch_elts;
       ushort num_draw_elts;
@@ -67,8 +71,8 @@ struct vsplit_frontend {
 static void
 vsplit_clear_cache(struct vsplit_frontend *vsplit)
 {
-   memset(vsplit->cache.fetches, 0xff, sizeof(vsplit->cache.fetches));
-   vsplit->cache.has_max_fetch = FALSE;
+   memset(vsplit->cache.valid, 0, sizeof(vsplit->cache.valid));
+   memset(vsplit->cache.next, 0, sizeof(vsplit->cache.next));
    vsplit->cache.num_fetch_elts = 0;
    vsplit->cache.num_draw_elts = 0;
 }
@@ -87,23 +91,37 @@ vsplit_flush_cache(struct vsplit_frontend *vsplit, unsigned flags)
 static inline void
 vsplit_add_cache(struct vsplit_frontend *vsplit, unsigned fetch, unsigned ofbias)
 {
-   unsigned hash;
-
-   hash = fetch % MAP_SIZE;
-
-   /* If the value isn't in the cache or it's an overflow due to the
-    * element bias */
-   if (vsplit->cache.fetches[hash] != fetch || ofbias) {
-      /* update cache */
-      vsplit->cache.fetches[hash] = fetch;
-      vsplit->cache.draws[hash] = vsplit->cache.num_fetch_elts;
+   const unsigned set = fetch % MAP_SETS;
+   unsigned way;
+
+   /* An overflow due to the element bias always gets its own fetch */
+   if (!ofbias) {
+      for (way = 0; way < vsplit->cache.valid[set]; way++) {
+         if (vsplit->cache.fetches[set][way] == fetch) {
+            vsplit->draw_elts[vsplit->cache.num_draw_elts++] =
+               vsplit->cache.draws[set][way];
+            return;
+         }
+      }
+   }
 
-      /* add fetch */
-      assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
-      vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+   /* update cache, replacing the oldest way of a full set */
+   if (vsplit->cache.valid[set] < MAP_WAYS) {
+      way = vsplit->cache.valid[set]++;
+   }
+   else {
+      way = vsplit->cache.next[set];
+      vsplit->cache.next[set] = (way + 1) % MAP_WAYS;
    }
+   vsplit->cache.fetches[set][way] = fetch;
+   vsplit->cache.draws[set][way] = vsplit->cache.num_fetch_elts;
 
-   vsplit->draw_elts[vsplit->cache.num_draw_elts++] = vsplit->cache.draws[hash];
+   /* add fetch */
+   assert(vsplit->cache.num_fetch_elts < vsplit->segment_size);
+   vsplit->fetch_elts[vsplit->cache.num_fetch_elts++] = fetch;
+
+   vsplit->draw_elts[vsplit->cache.num_draw_elts++] =
+      vsplit->cache.draws[set][way];
 }
 
 /**
@@ -198,16 +216,7 @@ vsplit_add_cache_uint(struct vsplit_frontend *vsplit, const uint *elts,
                       unsigned start, unsigned fetch, int elt_bias)
 {
    struct draw_context *draw = vsplit->draw;
-   unsigned raw_elem_idx = start + fetch + elt_bias;
    VSPLIT_CREATE_IDX(elts, start, fetch, elt_bias);
-
-   /* special care for DRAW_MAX_FETCH_IDX */
-   if (raw_elem_idx == DRAW_MAX_FETCH_IDX && !vsplit->cache.has_max_fetch) {
-      unsigned hash = fetch % MAP_SIZE;
-      vsplit->cache.fetches[hash] = raw_elem_idx - 1; /* force update */
-      vsplit->cache.has_max_fetch = TRUE;
-   }
-
    vsplit_add_cache(vsplit, elt_idx, ofbias);
 }
 
@@ -262,7 +271,17 @@ static void vsplit_prepare(struct draw_pt_front_end *frontend,
    vsplit->middle = middle;
    middle->prepare(middle, vsplit->prim, opt, &vsplit->max_vertices);
 
-   vsplit->segment_size = MIN2(SEGMENT_SIZE, vsplit->max_vertices);
+   /*
+    * The middle end spreads vertex shading over the draw threads, but
+    * waits for them at the end of every segment and runs the later stages
+    * itself, so use larger segments then.  Not with a geometry shader,
+    * whose output is allocated for the worst case of the whole segment.
+    */
+   if (vsplit->draw->pt.threads && !vsplit->draw->gs.geometry_shader)
+      vsplit->segment_size = MIN2(DRAW_THREADED_SEGMENT_SIZE,
+                                  vsplit->max_vertices);
+   else
+      vsplit->segment_size = MIN2(SEGMENT_SIZE, vsplit->max_vertices);
 }
 
 
@@ -297,7 +316,7 @@ struct draw_pt_front_end *draw_pt_vsplit(struct draw_context *draw)
    vsplit->base.destroy = vsplit_destroy;
    vsplit->draw = draw;
 
-   for (i = 0; i < SEGMENT_SIZE; i++)
+   for (i = 0; i < MAX_SEGMENT_SIZE; i++)
       vsplit->identity_draw_elts[i] = i;
 
    return &vsplit->base;
@@ -0,0 +1,197 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "os/os_thread.h"
+#include "draw_threads.h"
+
+
+struct draw_thread_pool
+{
+   pipe_mutex mutex;
+   pipe_condvar work_cond;   /**< signalled when a batch is started */
+   pipe_condvar done_cond;   /**< signalled when a batch completes */
+   boolean exit;
+
+   /** The current batch; jobs are handed out in order */
+   draw_thread_func func;
+   void *data;
+   unsigned num_jobs;
+   unsigned next_job;
+   unsigned jobs_done;
+
+   /** Floating point state of the calling thread (denorm handling) */
+   unsigned fpstate;
+
+   unsigned num_threads;
+   pipe_thread threads[DRAW_MAX_THREADS];
+};
+
+
+/**
+ * Run jobs of the current batch until there are none left.
+ * Called with the pool mutex held, returns with it held.
+ */
+static void
+run_jobs(struct draw_thread_pool *pool)
+{
+   while (pool->next_job < pool->num_jobs) {
+      unsigned job = pool->next_job++;
+
+      pipe_mutex_unlock(pool->mutex);
+      pool->func(pool->data, job);
+      pipe_mutex_lock(pool->mutex);
+
+      if (++pool->jobs_done == pool->num_jobs)
+         pipe_condvar_broadcast(pool->done_cond);
+   }
+}
+
+
+static PIPE_THREAD_ROUTINE( draw_thread_function, init_data )
+{
+   struct draw_thread_pool *pool = (struct draw_thread_pool *) init_data;
+
+   pipe_thread_setname("draw");
+
+   pipe_mutex_lock(pool->mutex);
+
+   while (1) {
+      while (pool->next_job >= pool->num_jobs && !pool->exit)
+         pipe_condvar_wait(pool->work_cond, pool->mutex);
+
+      if (pool->exit)
+         break;
+
+      /* shaders must see the same denorm handling as on the caller */
+      util_fpstate_set(pool->fpstate);
+
+      run_jobs(pool);
+   }
+
+   pipe_mutex_unlock(pool->mutex);
+
+   return 0;
+}
+
+
+struct draw_thread_pool *
+draw_thread_pool_create(unsigned num_threads)
+{
+   struct draw_thread_pool *pool;
+   unsigned i;
+
+   assert(num_threads > 0);
+
+   pool = CALLOC_STRUCT(draw_thread_pool);
+   if (!pool)
+      return NULL;
+
+   pipe_mutex_init(pool->mutex);
+   pipe_condvar_init(pool->work_cond);
+   pipe_condvar_init(pool->done_cond);
+
+   num_threads = MIN2(num_threads, DRAW_MAX_THREADS);
+   for (i = 0; i < num_threads; i++) {
+      pool->threads[i] = pipe_thread_create(draw_thread_function, pool);
+      if (!pool->threads[i])
+         break;
+   }
+   pool->num_threads = i;
+
+   if (!pool->num_threads) {
+      draw_thread_pool_destroy(pool);
+      return NULL;
+   }
+
+   return pool;
+}
+
+
+void
+draw_thread_pool_destroy(struct draw_thread_pool *pool)
+{
+   unsigned i;
+
+   pipe_mutex_lock(pool->mutex);
+   pool->exit = TRUE;
+   pipe_condvar_broadcast(pool->work_cond);
+   pipe_mutex_unlock(pool->mutex);
+
+   for (i = 0; i < pool->num_threads; i++) {
+      pipe_thread_wait(pool->threads[i]);
+   }
+
+   pipe_condvar_destroy(pool->done_cond);
+   pipe_condvar_destroy(pool->work_cond);
+   pipe_mutex_destroy(pool->mutex);
+   FREE(pool);
+}
+
+
+/**
+ * Number of threads of the pool, not counting the calling thread.
+ */
+unsigned
+draw_thread_pool_num_threads(const struct draw_thread_pool *pool)
+{
+   return pool->num_threads;
+}
+
+
+/**
+ * Run func(data, job) for jobs 0 to num_jobs - 1 on the pool threads and
+ * the calling thread, and wait for all of them to complete.  Jobs of a
+ * batch must be independent of each other.
+ */
+void
+draw_thread_pool_run(struct draw_thread_pool *pool,
+                     draw_thread_func func, void *data,
+                     unsigned num_jobs)
+{
+   pipe_mutex_lock(pool->mutex);
+
+   pool->func = func;
+   pool->data = data;
+   pool->num_jobs = num_jobs;
+   pool->next_job = 0;
+   pool->jobs_done = 0;
+   pool->fpstate = util_fpstate_get();
+
+   if (num_jobs > 1)
+      pipe_condvar_broadcast(pool->work_cond);
+
+   run_jobs(pool);
+
+   while (pool->jobs_done < pool->num_jobs)
+      pipe_condvar_wait(pool->done_cond, pool->mutex);
+
+   pipe_mutex_unlock(pool->mutex);
+}
@@ -0,0 +1,75 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * A small pool of threads which draw uses to run independent parts of
+ * large draw calls, such as vertex shading of the chunks of a segment,
+ * in parallel with the calling thread.
+ */
+
+#ifndef DRAW_THREADS_H
+#define DRAW_THREADS_H
+
+#include "pipe/p_compiler.h"
+
+
+/** Maximum number of threads besides the calling one */
+#define DRAW_MAX_THREADS 16
+
+/**
+ * Vertices per segment of draws split for the threads.  Each segment ends
+ * with a wait for all threads, so this is much larger than what is used
+ * without threads.  It must fit the ushort draw elements.
+ */
+#define DRAW_THREADED_SEGMENT_SIZE (16 * 1024)
+
+
+struct draw_thread_pool;
+
+/**
+ * Function running job number \p job of a batch.
+ */
+typedef void (*draw_thread_func)(void *data, unsigned job);
+
+
+struct draw_thread_pool *
+draw_thread_pool_create(unsigned num_threads);
+
+void
+draw_thread_pool_destroy(struct draw_thread_pool *pool);
+
+unsigned
+draw_thread_pool_num_threads(const struct draw_thread_pool *pool);
+
+void
+draw_thread_pool_run(struct draw_thread_pool *pool,
+                     draw_thread_func func, void *data,
+                     unsigned num_jobs);
+
+
+#endif /* DRAW_THREADS_H */
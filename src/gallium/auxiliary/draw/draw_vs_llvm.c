@@ -35,6 +35,7 @@
 #include "draw_vs.h"
 #include "draw_llvm.h"
 
+#include "cso_cache/cso_hash.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_scan.h"
 
@@ -75,6 +76,8 @@ vs_llvm_delete( struct draw_vertex_shader *dvs )
    }
 
    assert(shader->variants_cached == 0);
+   assert(cso_hash_size(shader->variants_hash) == 0);
+   cso_hash_delete(shader->variants_hash);
    FREE((void*) dvs->state.tokens);
    FREE( dvs );
 }
@@ -113,5 +116,12 @@ draw_create_vs_llvm(struct draw_context *draw,
 
    make_empty_list(&vs->variants);
 
+   vs->variants_hash = cso_hash_create();
+   if (!vs->variants_hash) {
+      FREE((void*) vs->base.state.tokens);
+      FREE(vs);
+      return NULL;
+   }
+
    return &vs->base;
 }
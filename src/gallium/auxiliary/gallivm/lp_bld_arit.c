@@ -1651,7 +1651,8 @@ arch_rounding_available(const struct lp_type type)
 {
    if ((util_cpu_caps.has_sse4_1 &&
        (type.length == 1 || type.width*type.length == 128)) ||
-       (util_cpu_caps.has_avx && type.width*type.length == 256))
+       (util_cpu_caps.has_avx && type.width*type.length == 256) ||
+       (util_cpu_caps.has_avx512f && type.width*type.length == 512))
       return TRUE;
    else if ((util_cpu_caps.has_altivec &&
             (type.width == 32 && type.length == 4)))
@@ -1851,12 +1852,58 @@ lp_build_round_altivec(struct lp_build_context *bld,
    return lp_build_intrinsic_unary(builder, intrinsic, bld->vec_type, a);
 }
 
+/**
+ * AVX-512 has no rounding intrinsics stable across LLVM versions, but the
+ * generic ones get lowered to VRNDSCALEPS/PD.
+ */
+static inline LLVMValueRef
+lp_build_round_avx512(struct lp_build_context *bld,
+                      LLVMValueRef a,
+                      enum lp_build_round_mode mode)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   const struct lp_type type = bld->type;
+   const char *op;
+   char intrinsic[32];
+
+   assert(type.floating);
+   assert(type.width * type.length == 512);
+   assert(util_cpu_caps.has_avx512f);
+
+   switch (mode) {
+   case LP_BUILD_ROUND_NEAREST:
+      /* rounds to even in the default MXCSR mode, like ROUNDPS */
+      op = "nearbyint";
+      break;
+   case LP_BUILD_ROUND_FLOOR:
+      op = "floor";
+      break;
+   case LP_BUILD_ROUND_CEIL:
+      op = "ceil";
+      break;
+   case LP_BUILD_ROUND_TRUNCATE:
+      op = "trunc";
+      break;
+   default:
+      assert(0);
+      return bld->undef;
+   }
+
+   util_snprintf(intrinsic, sizeof intrinsic, "llvm.%s.v%uf%u",
+                 op, type.length, type.width);
+
+   return lp_build_intrinsic_unary(builder, intrinsic, bld->vec_type, a);
+}
+
+
 static inline LLVMValueRef
 lp_build_round_arch(struct lp_build_context *bld,
                     LLVMValueRef a,
                     enum lp_build_round_mode mode)
 {
-   if (util_cpu_caps.has_sse4_1)
+   if (bld->type.width * bld->type.length == 512)
+     return lp_build_round_avx512(bld, a, mode);
+   else if (util_cpu_caps.has_sse4_1)
      return lp_build_round_sse41(bld, a, mode);
    else /* (util_cpu_caps.has_altivec) */
      return lp_build_round_altivec(bld, a, mode);
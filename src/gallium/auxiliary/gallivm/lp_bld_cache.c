@@ -0,0 +1,709 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of JIT-compiled object code.
+ *
+ * Entries are files named after the hex SHA-1 of the cache key, in the
+ * directory given by GALLIVM_CACHE_DIR.  Each holds a small header
+ * (struct cache_file_header) followed by the relocatable object code
+ * MCJIT produced for the module.
+ *
+ * The total size is bounded by GALLIVM_CACHE_SIZE (in MB).  Entries are
+ * touched on every hit, and when the limit is exceeded the least recently
+ * used ones, by modification time, are removed.  Files are written to a
+ * temporary name and renamed into place, so that several processes can
+ * share the same directory.
+ */
+
+#include "pipe/p_config.h"
+#include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "util/u_cpu_detect.h"
+#include "util/mesa-sha1.h"
+#include "os/os_thread.h"
+#include "tgsi/tgsi_parse.h"
+
+#include "lp_bld_debug.h"
+#include "lp_bld_init.h"
+#include "lp_bld_type.h"
+#include "lp_bld_cache.h"
+
+#if defined(PIPE_OS_UNIX) && defined(HAVE_SHA1) && defined(HAVE_DLADDR) && \
+    HAVE_LLVM >= 0x0306
+#define GALLIVM_HAVE_CACHE 1
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <utime.h>
+#else
+#define GALLIVM_HAVE_CACHE 0
+#endif
+
+
+#define CACHE_FILE_MAGIC   0x4d564c47   /* "GLVM" */
+#define CACHE_FILE_VERSION 1
+
+struct cache_file_header
+{
+   uint32_t magic;
+   uint32_t version;
+   unsigned char key[20];
+   uint32_t num_functions;
+   uint32_t nr_instrs;
+   uint32_t object_size;
+   char function_names[GALLIVM_CACHE_MAX_FUNCTIONS][GALLIVM_CACHE_MAX_NAME];
+};
+
+
+static struct gallivm_cache_stats cache_stats;
+
+pipe_static_mutex(cache_mutex);
+
+DEBUG_GET_ONCE_BOOL_OPTION(cache_print_stats, "GALLIVM_CACHE_STATS", FALSE)
+
+
+#if GALLIVM_HAVE_CACHE
+
+static boolean cache_initialized = FALSE;
+static char *cache_dir = NULL;
+static uint64_t cache_max_size;
+static uint64_t cache_size;
+static unsigned char cache_build_id[20];
+
+
+static boolean
+is_cache_file_name(const char *name)
+{
+   unsigned i;
+
+   for (i = 0; i < 40; i++) {
+      char c = name[i];
+      if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')))
+         return FALSE;
+   }
+   return name[40] == '\0';
+}
+
+
+struct cache_file
+{
+   char name[41];
+   time_t mtime;
+   off_t size;
+};
+
+
+static int
+compare_cache_file_mtime(const void *a, const void *b)
+{
+   const struct cache_file *fa = (const struct cache_file *) a;
+   const struct cache_file *fb = (const struct cache_file *) b;
+
+   if (fa->mtime < fb->mtime)
+      return -1;
+   if (fa->mtime > fb->mtime)
+      return 1;
+   return 0;
+}
+
+
+/**
+ * Scan the cache directory, recomputing its total size, and if it exceeds
+ * the limit remove the least recently used entries until it's at 3/4 of
+ * the limit.  Other processes may be using the same directory, so the
+ * size tracked in cache_size is only a hint between scans.
+ * Called with cache_mutex held.
+ */
+static void
+cache_scan_and_evict(boolean evict)
+{
+   struct cache_file *files = NULL;
+   unsigned num_files = 0, max_files = 0;
+   struct dirent *ent;
+   DIR *dir;
+   char path[PATH_MAX];
+   unsigned i;
+
+   dir = opendir(cache_dir);
+   if (!dir)
+      return;
+
+   cache_size = 0;
+
+   while ((ent = readdir(dir)) != NULL) {
+      struct stat st;
+
+      if (!is_cache_file_name(ent->d_name))
+         continue;
+
+      util_snprintf(path, sizeof path, "%s/%s", cache_dir, ent->d_name);
+      if (stat(path, &st) != 0)
+         continue;
+
+      cache_size += st.st_size;
+
+      if (!evict)
+         continue;
+
+      if (num_files == max_files) {
+         unsigned new_max = max_files ? max_files * 2 : 256;
+         struct cache_file *new_files =
+            REALLOC(files, max_files * sizeof *files, new_max * sizeof *files);
+         if (!new_files)
+            break;
+         files = new_files;
+         max_files = new_max;
+      }
+
+      memcpy(files[num_files].name, ent->d_name, sizeof files[num_files].name);
+      files[num_files].mtime = st.st_mtime;
+      files[num_files].size = st.st_size;
+      num_files++;
+   }
+
+   closedir(dir);
+
+   if (evict && cache_size > cache_max_size) {
+      qsort(files, num_files, sizeof *files, compare_cache_file_mtime);
+
+      for (i = 0; i < num_files && cache_size > cache_max_size / 4 * 3; i++) {
+         util_snprintf(path, sizeof path, "%s/%s", cache_dir, files[i].name);
+         if (unlink(path) == 0) {
+            cache_size -= files[i].size;
+            cache_stats.evictions++;
+         }
+      }
+   }
+
+   FREE(files);
+}
+
+
+/**
+ * Identify the build of the code generator: the Mesa version, and the
+ * modification time and size of the library this code lives in, so that
+ * rebuilding any part of it invalidates the cached objects.
+ */
+static boolean
+compute_build_id(unsigned char result[20])
+{
+   struct mesa_sha1 *ctx;
+   Dl_info info;
+   struct stat st;
+   int64_t file_id[2];
+
+   if (!dladdr((void *) compute_build_id, &info) || !info.dli_fname ||
+       stat(info.dli_fname, &st) != 0)
+      return FALSE;
+
+   ctx = _mesa_sha1_init();
+   if (!ctx)
+      return FALSE;
+
+#ifdef PACKAGE_VERSION
+   _mesa_sha1_update(ctx, PACKAGE_VERSION, strlen(PACKAGE_VERSION));
+#endif
+   file_id[0] = st.st_mtime;
+   file_id[1] = st.st_size;
+   _mesa_sha1_update(ctx, file_id, sizeof file_id);
+
+   _mesa_sha1_final(ctx, result);
+   return TRUE;
+}
+
+
+/**
+ * Called with cache_mutex held.
+ */
+static boolean
+cache_init(void)
+{
+   const char *dir;
+
+   if (cache_initialized)
+      return cache_dir != NULL;
+
+   cache_initialized = TRUE;
+
+   dir = debug_get_option("GALLIVM_CACHE_DIR", NULL);
+   if (!dir || !*dir)
+      return FALSE;
+
+   if (!compute_build_id(cache_build_id)) {
+      debug_printf("gallivm: can't identify the build, cache disabled\n");
+      return FALSE;
+   }
+
+   if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+      debug_printf("gallivm: can't create cache directory %s\n", dir);
+      return FALSE;
+   }
+
+   cache_dir = strdup(dir);
+   if (!cache_dir)
+      return FALSE;
+
+   cache_max_size = (uint64_t) debug_get_num_option("GALLIVM_CACHE_SIZE", 256)
+                    * 1024 * 1024;
+
+   cache_scan_and_evict(FALSE);
+
+   return TRUE;
+}
+
+
+static void
+cache_file_path(char *path, size_t size, const unsigned char key[20])
+{
+   char hex[41];
+
+   _mesa_sha1_format(hex, key);
+   util_snprintf(path, size, "%s/%s", cache_dir, hex);
+}
+
+
+/**
+ * Read a cache entry.  Returns a MALLOC'ed buffer, or NULL.
+ */
+static void *
+cache_read(const unsigned char key[20], size_t *size)
+{
+   char path[PATH_MAX];
+   struct stat st;
+   void *data = NULL;
+   ssize_t ret;
+   int fd;
+
+   cache_file_path(path, sizeof path, key);
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0)
+      return NULL;
+
+   if (fstat(fd, &st) != 0 || st.st_size <= 0)
+      goto done;
+
+   data = MALLOC(st.st_size);
+   if (!data)
+      goto done;
+
+   ret = read(fd, data, st.st_size);
+   if (ret != st.st_size) {
+      FREE(data);
+      data = NULL;
+      goto done;
+   }
+
+   *size = st.st_size;
+
+   /* Mark as recently used */
+   utime(path, NULL);
+
+done:
+   close(fd);
+   return data;
+}
+
+
+static void
+cache_remove(const unsigned char key[20])
+{
+   char path[PATH_MAX];
+
+   cache_file_path(path, sizeof path, key);
+   unlink(path);
+}
+
+
+static void
+cache_write(const unsigned char key[20],
+            const void *header, size_t header_size,
+            const void *data, size_t data_size)
+{
+   char path[PATH_MAX], tmp_path[PATH_MAX];
+   boolean ok;
+   int fd;
+
+   cache_file_path(path, sizeof path, key);
+   util_snprintf(tmp_path, sizeof tmp_path, "%s.%d.tmp", path, (int) getpid());
+
+   fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0)
+      return;
+
+   ok = write(fd, header, header_size) == (ssize_t) header_size &&
+        write(fd, data, data_size) == (ssize_t) data_size;
+
+   if (close(fd) != 0)
+      ok = FALSE;
+
+   if (!ok || rename(tmp_path, path) != 0) {
+      unlink(tmp_path);
+      return;
+   }
+
+   cache_stats.stores++;
+   cache_size += header_size + data_size;
+
+   if (cache_size > cache_max_size)
+      cache_scan_and_evict(TRUE);
+}
+
+
+
+/**
+ * Compute the cache key of a module.  Besides the caller's key this
+ * covers everything else affecting code generation: the build of this
+ * library, the LLVM version, the host CPU and its features, the vector
+ * width and the debug flags.
+ */
+static void
+compute_cache_key(unsigned char result[20],
+                  const struct tgsi_token *tokens,
+                  const void *key, unsigned key_size)
+{
+   struct mesa_sha1 *ctx;
+   struct util_cpu_caps caps;
+   char cpu_name[64];
+   unsigned header[5];
+
+   ctx = _mesa_sha1_init();
+   if (!ctx) {
+      memset(result, 0, 20);
+      return;
+   }
+
+   _mesa_sha1_update(ctx, cache_build_id, sizeof cache_build_id);
+
+   header[0] = HAVE_LLVM;
+   header[1] = MESA_LLVM_VERSION_PATCH;
+   header[2] = lp_native_vector_width;
+   header[3] = gallivm_debug;
+   header[4] = sizeof(void *);
+   _mesa_sha1_update(ctx, header, sizeof header);
+
+   /* The CPU count doesn't affect code generation */
+   caps = util_cpu_caps;
+   caps.nr_cpus = 0;
+   _mesa_sha1_update(ctx, &caps, sizeof caps);
+
+   lp_build_host_cpu_name(cpu_name, sizeof cpu_name);
+   _mesa_sha1_update(ctx, cpu_name, strlen(cpu_name));
+
+   if (tokens) {
+      _mesa_sha1_update(ctx, tokens,
+                        tgsi_num_tokens(tokens) * sizeof(struct tgsi_token));
+   }
+
+   _mesa_sha1_update(ctx, key, key_size);
+
+   _mesa_sha1_final(ctx, result);
+}
+
+#endif /* GALLIVM_HAVE_CACHE */
+
+
+/**
+ * Look up the module in the persistent cache.
+ *
+ * Must be called on a freshly created gallivm, before generating any IR.
+ * \param tokens  the shader tokens, or NULL if the code only depends on key
+ * \param key  the variant key
+ * \return TRUE if the module's code was loaded from the cache, in which
+ * case gallivm_cached_function() must be used instead of generating IR.
+ */
+boolean
+gallivm_cache_lookup(struct gallivm_state *gallivm,
+                     const struct tgsi_token *tokens,
+                     const void *key, unsigned key_size)
+{
+#if GALLIVM_HAVE_CACHE
+   struct gallivm_cache_entry *entry;
+   const struct cache_file_header *header;
+   void *data, *object;
+   size_t size = 0;
+   unsigned i;
+   boolean enabled;
+
+   assert(!gallivm->cache);
+   assert(!gallivm->compiled);
+
+   pipe_mutex_lock(cache_mutex);
+   enabled = cache_init();
+   pipe_mutex_unlock(cache_mutex);
+
+   if (!enabled)
+      return FALSE;
+
+   entry = CALLOC_STRUCT(gallivm_cache_entry);
+   if (!entry)
+      return FALSE;
+
+   compute_cache_key(entry->key, tokens, key, key_size);
+   gallivm->cache = entry;
+
+   pipe_mutex_lock(cache_mutex);
+   data = cache_read(entry->key, &size);
+   pipe_mutex_unlock(cache_mutex);
+
+   object = NULL;
+   header = (const struct cache_file_header *) data;
+   if (data &&
+       size >= sizeof *header &&
+       header->magic == CACHE_FILE_MAGIC &&
+       header->version == CACHE_FILE_VERSION &&
+       memcmp(header->key, entry->key, sizeof entry->key) == 0 &&
+       header->num_functions > 0 &&
+       header->num_functions <= GALLIVM_CACHE_MAX_FUNCTIONS &&
+       header->object_size == size - sizeof *header) {
+      object = lp_build_parse_cached_object(header + 1, header->object_size);
+   }
+
+   if (!object) {
+      pipe_mutex_lock(cache_mutex);
+      if (data) {
+         /* Stale or corrupt */
+         cache_remove(entry->key);
+      }
+      cache_stats.misses++;
+      pipe_mutex_unlock(cache_mutex);
+      FREE(data);
+      return FALSE;
+   }
+
+   entry->hit = TRUE;
+   entry->nr_instrs = header->nr_instrs;
+   entry->num_functions = header->num_functions;
+   for (i = 0; i < entry->num_functions; i++) {
+      memcpy(entry->function_names[i], header->function_names[i],
+             GALLIVM_CACHE_MAX_NAME);
+      entry->function_names[i][GALLIVM_CACHE_MAX_NAME - 1] = '\0';
+   }
+   FREE(data);
+
+   /* Create the execution engine for the (empty) module, and add the
+    * cached object to it.
+    */
+   gallivm_compile_module(gallivm);
+   lp_build_add_cached_object(gallivm->engine, object);
+
+   pipe_mutex_lock(cache_mutex);
+   cache_stats.hits++;
+   pipe_mutex_unlock(cache_mutex);
+
+   return TRUE;
+#else
+   return FALSE;
+#endif
+}
+
+
+/**
+ * Get the address of a function loaded from the cache.
+ * \param index  the order in which the function was originally passed to
+ *               gallivm_jit_function()
+ * \return the function, or NULL if the cached object turned out to be
+ * unusable, in which case the entry is dropped and the caller must compile
+ * the module in a new gallivm.
+ */
+func_pointer
+gallivm_cached_function(struct gallivm_state *gallivm, unsigned index)
+{
+#if GALLIVM_HAVE_CACHE
+   struct gallivm_cache_entry *entry = gallivm->cache;
+   uint64_t addr;
+
+   assert(entry && entry->hit);
+   if (index >= entry->num_functions)
+      return NULL;
+
+   addr = LLVMGetFunctionAddress(gallivm->engine,
+                                 entry->function_names[index]);
+   if (!addr) {
+      /* The object doesn't define the function it was stored with */
+      pipe_mutex_lock(cache_mutex);
+      cache_remove(entry->key);
+      pipe_mutex_unlock(cache_mutex);
+      return NULL;
+   }
+
+   return pointer_to_func((void *) (uintptr_t) addr);
+#else
+   assert(0);
+   return NULL;
+#endif
+}
+
+
+/**
+ * IR instruction count of a module loaded from the cache, for accounting.
+ */
+unsigned
+gallivm_cached_nr_instrs(const struct gallivm_state *gallivm)
+{
+   return gallivm->cache ? gallivm->cache->nr_instrs : 0;
+}
+
+
+void
+gallivm_cache_get_stats(struct gallivm_cache_stats *stats)
+{
+   pipe_mutex_lock(cache_mutex);
+   *stats = cache_stats;
+   pipe_mutex_unlock(cache_mutex);
+}
+
+
+/**
+ * Print the statistics to stderr if GALLIVM_CACHE_STATS is set.  Unlike
+ * LP_DEBUG=counters this also works in release builds.
+ */
+void
+gallivm_cache_print_stats(void)
+{
+   struct gallivm_cache_stats stats;
+
+   if (!debug_get_option_cache_print_stats())
+      return;
+
+   gallivm_cache_get_stats(&stats);
+
+   _debug_printf("gallivm: cache %u hits, %u misses, %u stores, "
+                 "%u evictions, %u uncacheable\n",
+                 stats.hits, stats.misses, stats.stores,
+                 stats.evictions, stats.uncacheable);
+}
+
+
+/**
+ * Record a function looked up with gallivm_jit_function(), so it can be
+ * found again when the module is loaded from the cache.
+ */
+void
+gallivm_cache_add_function(struct gallivm_state *gallivm,
+                           LLVMValueRef func)
+{
+   struct gallivm_cache_entry *entry = gallivm->cache;
+   const char *name = LLVMGetValueName(func);
+
+   if (entry->hit)
+      return;
+
+   if (entry->num_functions >= GALLIVM_CACHE_MAX_FUNCTIONS ||
+       strlen(name) >= GALLIVM_CACHE_MAX_NAME) {
+      /* Can't be described in the cache file */
+      gallivm->cache_unsafe = TRUE;
+      return;
+   }
+
+   util_snprintf(entry->function_names[entry->num_functions],
+                 GALLIVM_CACHE_MAX_NAME, "%s", name);
+   entry->num_functions++;
+}
+
+
+/**
+ * Write a freshly compiled module to the cache.  Called before the IR is
+ * freed, once all the functions have been looked up.
+ */
+void
+gallivm_cache_store(struct gallivm_state *gallivm)
+{
+#if GALLIVM_HAVE_CACHE
+   struct gallivm_cache_entry *entry = gallivm->cache;
+   struct cache_file_header header;
+   unsigned i;
+
+   if (entry->hit ||
+       gallivm->no_opt ||
+       !gallivm->compiled ||
+       !gallivm->module ||
+       !entry->num_functions ||
+       !entry->code.data) {
+      return;
+   }
+
+   if (gallivm->cache_unsafe) {
+      pipe_mutex_lock(cache_mutex);
+      cache_stats.uncacheable++;
+      pipe_mutex_unlock(cache_mutex);
+      return;
+   }
+
+   memset(&header, 0, sizeof header);
+   header.magic = CACHE_FILE_MAGIC;
+   header.version = CACHE_FILE_VERSION;
+   memcpy(header.key, entry->key, sizeof header.key);
+   header.num_functions = entry->num_functions;
+   header.nr_instrs = lp_build_count_ir_module(gallivm->module);
+   header.object_size = entry->code.data_size;
+   for (i = 0; i < entry->num_functions; i++) {
+      memcpy(header.function_names[i], entry->function_names[i],
+             GALLIVM_CACHE_MAX_NAME);
+   }
+
+   pipe_mutex_lock(cache_mutex);
+   cache_write(entry->key, &header, sizeof header,
+               entry->code.data, entry->code.data_size);
+   pipe_mutex_unlock(cache_mutex);
+
+   /* Only store once */
+   FREE(entry->code.data);
+   entry->code.data = NULL;
+   entry->code.data_size = 0;
+#endif
+}
+
+
+/**
+ * Free the cache state of a gallivm.  Must be done after the execution
+ * engine has been disposed of.
+ */
+void
+gallivm_cache_destroy(struct gallivm_state *gallivm)
+{
+   struct gallivm_cache_entry *entry = gallivm->cache;
+
+   if (!entry)
+      return;
+
+   assert(!gallivm->engine);
+
+   lp_free_objcache(entry->code.jit_obj_cache);
+   FREE(entry->code.data);
+   FREE(entry);
+   gallivm->cache = NULL;
+}
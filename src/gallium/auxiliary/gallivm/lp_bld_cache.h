@@ -0,0 +1,128 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Persistent on-disk cache of JIT-compiled object code.
+ *
+ * A module whose contents are fully determined by its TGSI tokens and
+ * variant key can be looked up with gallivm_cache_lookup() before any IR
+ * is generated.  On a hit the cached object code is loaded straight into
+ * the execution engine and its functions are retrieved, in the order
+ * they were originally passed to gallivm_jit_function(), with
+ * gallivm_cached_function().  On a miss the caller generates and compiles
+ * the module as usual, and the resulting object code is written to the
+ * cache when the IR is freed.
+ *
+ * The cache is enabled by setting GALLIVM_CACHE_DIR.  It is only available
+ * on Unix-like systems with dladdr(), when built with SHA-1 support and
+ * MCJIT.  Setting GALLIVM_CACHE_STATS prints its hit and miss counts when
+ * the driver's screen is destroyed.
+ */
+
+#ifndef LP_BLD_CACHE_H
+#define LP_BLD_CACHE_H
+
+
+#include "pipe/p_compiler.h"
+#include "util/u_pointer.h"
+#include "lp_bld.h"
+#include "lp_bld_misc.h"
+
+
+#define GALLIVM_CACHE_MAX_FUNCTIONS 4
+#define GALLIVM_CACHE_MAX_NAME 64
+
+
+struct gallivm_state;
+struct tgsi_token;
+
+
+/**
+ * Per-module cache state, hung off gallivm_state::cache.
+ */
+struct gallivm_cache_entry
+{
+   unsigned char key[20];
+
+   /** Loaded from the cache, rather than compiled */
+   boolean hit;
+
+   /** Jitted functions, in the order they were looked up */
+   unsigned num_functions;
+   char function_names[GALLIVM_CACHE_MAX_FUNCTIONS][GALLIVM_CACHE_MAX_NAME];
+
+   /** IR instruction count of the original module */
+   unsigned nr_instrs;
+
+   /** Object code captured from the JIT on a miss */
+   struct lp_cached_code code;
+};
+
+
+struct gallivm_cache_stats
+{
+   unsigned hits;
+   unsigned misses;
+   unsigned stores;
+   unsigned evictions;
+   unsigned uncacheable;   /**< modules embedding process addresses */
+};
+
+
+boolean
+gallivm_cache_lookup(struct gallivm_state *gallivm,
+                     const struct tgsi_token *tokens,
+                     const void *key, unsigned key_size);
+
+func_pointer
+gallivm_cached_function(struct gallivm_state *gallivm, unsigned index);
+
+unsigned
+gallivm_cached_nr_instrs(const struct gallivm_state *gallivm);
+
+void
+gallivm_cache_get_stats(struct gallivm_cache_stats *stats);
+
+void
+gallivm_cache_print_stats(void);
+
+
+/* Used by lp_bld_init.c */
+
+void
+gallivm_cache_add_function(struct gallivm_state *gallivm,
+                           LLVMValueRef func);
+
+void
+gallivm_cache_store(struct gallivm_state *gallivm);
+
+void
+gallivm_cache_destroy(struct gallivm_state *gallivm);
+
+
+#endif /* !LP_BLD_CACHE_H */
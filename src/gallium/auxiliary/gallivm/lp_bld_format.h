@@ -175,6 +175,33 @@ lp_build_fetch_cached_texels(struct gallivm_state *gallivm,
                              LLVMValueRef cache);
 
 
+/*
+ * Block compressed formats
+ */
+
+boolean
+lp_build_format_compressed_supported(const struct util_format_description *format_desc);
+
+void
+lp_build_fetch_compressed_rgba_soa(struct gallivm_state *gallivm,
+                                   const struct util_format_description *format_desc,
+                                   struct lp_type type,
+                                   LLVMValueRef base_ptr,
+                                   LLVMValueRef offset,
+                                   LLVMValueRef i,
+                                   LLVMValueRef j,
+                                   LLVMValueRef rgba_out[4]);
+
+LLVMValueRef
+lp_build_fetch_compressed_rgba_aos(struct gallivm_state *gallivm,
+                                   const struct util_format_description *format_desc,
+                                   struct lp_type type,
+                                   LLVMValueRef base_ptr,
+                                   LLVMValueRef offset,
+                                   LLVMValueRef i,
+                                   LLVMValueRef j);
+
+
 /*
  * special float formats
  */
@@ -531,6 +531,15 @@ lp_build_fetch_rgba_aos(struct gallivm_state *gallivm,
        return tmp;
    }
 
+   /*
+    * Block compressed formats (s3tc when there's no cache)
+    */
+
+   if (lp_build_format_compressed_supported(format_desc)) {
+      return lp_build_fetch_compressed_rgba_aos(gallivm, format_desc, type,
+                                                base_ptr, offset, i, j);
+   }
+
    /*
     * Fallback to util_format_description::fetch_rgba_8unorm().
     */
@@ -0,0 +1,802 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Block compressed format decoding: S3TC (DXT1/3/5), RGTC, LATC and ETC1.
+ *
+ * Each vector element decodes the texel (i, j) of its own block with
+ * integer arithmetic, so a whole vector of texels is fetched without
+ * calling back into the util_format fetch functions.  Results match those
+ * of the util_format (and libtxc_dxtn) decoders exactly, except for the
+ * sRGB formats whose linearization is done with lp_build_srgb_to_linear().
+ */
+
+
+#include "util/u_format.h"
+#include "util/u_math.h"
+
+#include "lp_bld_type.h"
+#include "lp_bld_const.h"
+#include "lp_bld_conv.h"
+#include "lp_bld_arit.h"
+#include "lp_bld_bitarit.h"
+#include "lp_bld_logic.h"
+#include "lp_bld_swizzle.h"
+#include "lp_bld_gather.h"
+#include "lp_bld_format.h"
+#include "lp_bld_init.h"
+
+
+/**
+ * ETC1 modifier table magnitudes, small ones in the first row and large
+ * ones in the second, indexed by the table codeword.
+ */
+static const int32_t etc1_modifiers[2][8] = {
+   {  2,  5,  9, 13, 18, 24,  33,  47 },
+   {  8, 17, 29, 42, 60, 80, 106, 183 }
+};
+
+
+boolean
+lp_build_format_compressed_supported(const struct util_format_description *format_desc)
+{
+   switch (format_desc->format) {
+   case PIPE_FORMAT_DXT1_RGB:
+   case PIPE_FORMAT_DXT1_RGBA:
+   case PIPE_FORMAT_DXT3_RGBA:
+   case PIPE_FORMAT_DXT5_RGBA:
+   case PIPE_FORMAT_DXT1_SRGB:
+   case PIPE_FORMAT_DXT1_SRGBA:
+   case PIPE_FORMAT_DXT3_SRGBA:
+   case PIPE_FORMAT_DXT5_SRGBA:
+   case PIPE_FORMAT_RGTC1_UNORM:
+   case PIPE_FORMAT_RGTC1_SNORM:
+   case PIPE_FORMAT_RGTC2_UNORM:
+   case PIPE_FORMAT_RGTC2_SNORM:
+   case PIPE_FORMAT_LATC1_UNORM:
+   case PIPE_FORMAT_LATC1_SNORM:
+   case PIPE_FORMAT_LATC2_UNORM:
+   case PIPE_FORMAT_LATC2_SNORM:
+   case PIPE_FORMAT_ETC1_RGB8:
+      return TRUE;
+   default:
+      return FALSE;
+   }
+}
+
+
+static boolean
+format_is_snorm(const struct util_format_description *format_desc)
+{
+   return format_desc->format == PIPE_FORMAT_RGTC1_SNORM ||
+          format_desc->format == PIPE_FORMAT_RGTC2_SNORM ||
+          format_desc->format == PIPE_FORMAT_LATC1_SNORM ||
+          format_desc->format == PIPE_FORMAT_LATC2_SNORM;
+}
+
+
+static LLVMValueRef
+bswap32(struct lp_build_context *bld, LLVMValueRef x)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMValueRef res, tmp;
+
+   res = lp_build_shl_imm(bld, x, 24);
+   tmp = lp_build_shl_imm(bld, x, 8);
+   tmp = lp_build_and(bld, tmp, lp_build_const_int_vec(gallivm, bld->type, 0xff0000));
+   res = lp_build_or(bld, res, tmp);
+   tmp = lp_build_shr_imm(bld, x, 8);
+   tmp = lp_build_and(bld, tmp, lp_build_const_int_vec(gallivm, bld->type, 0xff00));
+   res = lp_build_or(bld, res, tmp);
+   tmp = lp_build_shr_imm(bld, x, 24);
+   return lp_build_or(bld, res, tmp);
+}
+
+
+/**
+ * Gather the 32 bit word at byte_offset of every block.
+ * \param big_endian  whether the word is stored big endian in memory
+ */
+static LLVMValueRef
+load_word(struct lp_build_context *bld,
+          LLVMValueRef base_ptr,
+          LLVMValueRef offset,
+          unsigned byte_offset,
+          boolean big_endian)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMValueRef word;
+
+   if (byte_offset) {
+      offset = LLVMBuildAdd(gallivm->builder, offset,
+                            lp_build_const_int_vec(gallivm, bld->type,
+                                                   byte_offset), "");
+   }
+
+   word = lp_build_gather(gallivm, bld->type.length, 32, 32, TRUE,
+                          base_ptr, offset, FALSE);
+
+#ifdef PIPE_ARCH_LITTLE_ENDIAN
+   if (big_endian) {
+      word = bswap32(bld, word);
+   }
+#else
+   if (!big_endian) {
+      word = bswap32(bld, word);
+   }
+#endif
+
+   return word;
+}
+
+
+/**
+ * (x >> shift) & mask
+ */
+static LLVMValueRef
+extract_bits(struct lp_build_context *bld,
+             LLVMValueRef x,
+             unsigned shift,
+             unsigned mask)
+{
+   if (shift) {
+      x = lp_build_shr_imm(bld, x, shift);
+   }
+   return lp_build_and(bld, x,
+                       lp_build_const_int_vec(bld->gallivm, bld->type, mask));
+}
+
+
+/**
+ * Divide values in [0, max_val] by a small constant with a multiply and a
+ * shift.  The multiplier is the smallest one which is exact over the range.
+ */
+static LLVMValueRef
+udiv_imm(struct lp_build_context *bld,
+         LLVMValueRef x,
+         unsigned divisor,
+         unsigned max_val)
+{
+   unsigned shift, mul;
+
+   for (shift = 0; shift < 31; ++shift) {
+      mul = ((1U << shift) + divisor - 1) / divisor;
+      if ((uint64_t)(mul * divisor - (1U << shift)) * max_val < (1U << shift)) {
+         break;
+      }
+   }
+   assert(shift < 31);
+   assert((uint64_t)max_val * mul <= 0x7fffffff);
+
+   x = LLVMBuildMul(bld->gallivm->builder, x,
+                    lp_build_const_int_vec(bld->gallivm, bld->type, mul), "");
+   return lp_build_shr_imm(bld, x, shift);
+}
+
+
+/**
+ * As udiv_imm() for values in [-max_val, max_val], rounding towards zero
+ * like C integer division does.
+ */
+static LLVMValueRef
+sdiv_imm(struct lp_build_context *bld,
+         struct lp_build_context *sbld,
+         LLVMValueRef x,
+         unsigned divisor,
+         unsigned max_val)
+{
+   LLVMValueRef negative, res;
+
+   negative = lp_build_cmp(sbld, PIPE_FUNC_LESS, x, sbld->zero);
+   res = lp_build_select(sbld, negative, lp_build_negate(sbld, x), x);
+   res = udiv_imm(bld, res, divisor, max_val);
+   return lp_build_select(sbld, negative, lp_build_negate(sbld, res), res);
+}
+
+
+static LLVMValueRef
+code_is(struct lp_build_context *bld, LLVMValueRef code, unsigned value)
+{
+   return lp_build_cmp(bld, PIPE_FUNC_EQUAL, code,
+                       lp_build_const_int_vec(bld->gallivm, bld->type, value));
+}
+
+
+/**
+ * Decode one texel of the 8 byte RGTC/LATC channel block (which is also
+ * the DXT5 alpha block).
+ *
+ * \param lo, hi  the two little endian words of the block
+ * \param texel  the texel index, j * 4 + i
+ * \param is_signed  whether this is a SNORM block
+ * \return the texel value, in [0, 255] or [-128, 127]
+ */
+static LLVMValueRef
+decode_channel_block(struct lp_build_context *bld,
+                     struct lp_build_context *sbld,
+                     boolean is_signed,
+                     LLVMValueRef lo,
+                     LLVMValueRef hi,
+                     LLVMValueRef texel)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *cmp_bld = is_signed ? sbld : bld;
+   LLVMValueRef a0, a1, delta, weight;
+   LLVMValueRef indices, use_hi, shift, code;
+   LLVMValueRef interp7, interp5, res;
+
+   if (is_signed) {
+      LLVMValueRef c24 = lp_build_const_int_vec(gallivm, bld->type, 24);
+      a0 = LLVMBuildAShr(builder, lp_build_shl_imm(bld, lo, 24), c24, "");
+      a1 = LLVMBuildAShr(builder, lp_build_shl_imm(bld, lo, 16), c24, "");
+   }
+   else {
+      a0 = extract_bits(bld, lo, 0, 0xff);
+      a1 = extract_bits(bld, lo, 8, 0xff);
+   }
+
+   /*
+    * The 3 bit codes start at bit 16 of the block.  Those of the first
+    * eight texels are all in the lower 32 bits of the index bits, those of
+    * the last eight are all in the upper block word.
+    */
+   indices = lp_build_or(bld, lp_build_shr_imm(bld, lo, 16),
+                         lp_build_shl_imm(bld, hi, 16));
+   use_hi = lp_build_cmp(bld, PIPE_FUNC_GEQUAL, texel,
+                         lp_build_const_int_vec(gallivm, bld->type, 8));
+   indices = lp_build_select(bld, use_hi, hi, indices);
+   shift = LLVMBuildMul(builder, texel,
+                        lp_build_const_int_vec(gallivm, bld->type, 3), "");
+   shift = LLVMBuildSub(builder, shift,
+                        lp_build_and(bld, use_hi,
+                                     lp_build_const_int_vec(gallivm, bld->type, 16)), "");
+   code = LLVMBuildLShr(builder, indices, shift, "");
+   code = lp_build_and(bld, code, lp_build_const_int_vec(gallivm, bld->type, 7));
+
+   /*
+    * Codes 2..7 interpolate a0*(7-w) + a1*w over 7 with w = code - 1 when
+    * a0 > a1.  Otherwise codes 2..5 interpolate a0*(5-w) + a1*w over 5, and
+    * codes 6 and 7 are the minimum and maximum.
+    */
+   delta = LLVMBuildSub(builder, a1, a0, "");
+   weight = LLVMBuildSub(builder, code, bld->one, "");
+   delta = LLVMBuildMul(builder, delta, weight, "");
+   interp7 = LLVMBuildAdd(builder, delta, lp_build_mul_imm(bld, a0, 7), "");
+   interp5 = LLVMBuildAdd(builder, delta, lp_build_mul_imm(bld, a0, 5), "");
+
+   if (is_signed) {
+      interp7 = sdiv_imm(bld, sbld, interp7, 7, 7 * 128);
+      interp5 = sdiv_imm(bld, sbld, interp5, 5, 5 * 128);
+   }
+   else {
+      interp7 = udiv_imm(bld, interp7, 7, 7 * 255);
+      interp5 = udiv_imm(bld, interp5, 5, 5 * 255);
+   }
+
+   res = lp_build_select(bld, code_is(bld, code, 7),
+                         lp_build_const_int_vec(gallivm, bld->type,
+                                                is_signed ? 127 : 255),
+                         interp5);
+   res = lp_build_select(bld, code_is(bld, code, 6),
+                         lp_build_const_int_vec(gallivm, bld->type,
+                                                is_signed ? -128 : 0),
+                         res);
+   res = lp_build_select(bld, lp_build_cmp(cmp_bld, PIPE_FUNC_GREATER, a0, a1),
+                         interp7, res);
+   res = lp_build_select(bld, code_is(bld, code, 1), a1, res);
+   res = lp_build_select(bld, code_is(bld, code, 0), a0, res);
+
+   return res;
+}
+
+
+/**
+ * Expand the 5 or 6 bit field of a 565 color to 8 bits.
+ */
+static LLVMValueRef
+expand_565(struct lp_build_context *bld,
+           LLVMValueRef color,
+           unsigned shift,
+           unsigned bits)
+{
+   LLVMValueRef x = extract_bits(bld, color, shift, (1 << bits) - 1);
+
+   return lp_build_or(bld, lp_build_shl_imm(bld, x, 8 - bits),
+                      lp_build_shr_imm(bld, x, 2 * bits - 8));
+}
+
+
+/**
+ * Decode one texel of the 8 byte DXT color block.
+ *
+ * \param dxt1  whether the block may use the 3 color mode, where code 3 is
+ *              transparent black
+ * \param rgba  receives r, g, b, and a for dxt1
+ */
+static void
+decode_color_block(struct lp_build_context *bld,
+                   boolean dxt1,
+                   LLVMValueRef lo,
+                   LLVMValueRef hi,
+                   LLVMValueRef texel,
+                   LLVMValueRef rgba[4])
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   static const unsigned shifts[3] = { 11, 5, 0 };
+   static const unsigned bits[3] = { 5, 6, 5 };
+   LLVMValueRef c0, c1, code, four_color = NULL;
+   LLVMValueRef is0, is1, is2;
+   unsigned chan;
+
+   c0 = extract_bits(bld, lo, 0, 0xffff);
+   c1 = lp_build_shr_imm(bld, lo, 16);
+
+   code = LLVMBuildLShr(builder, hi, lp_build_shl_imm(bld, texel, 1), "");
+   code = lp_build_and(bld, code, lp_build_const_int_vec(gallivm, bld->type, 3));
+
+   is0 = code_is(bld, code, 0);
+   is1 = code_is(bld, code, 1);
+   is2 = code_is(bld, code, 2);
+
+   if (dxt1) {
+      four_color = lp_build_cmp(bld, PIPE_FUNC_GREATER, c0, c1);
+   }
+
+   for (chan = 0; chan < 3; ++chan) {
+      LLVMValueRef e0 = expand_565(bld, c0, shifts[chan], bits[chan]);
+      LLVMValueRef e1 = expand_565(bld, c1, shifts[chan], bits[chan]);
+      LLVMValueRef sum = LLVMBuildAdd(builder, e0, e1, "");
+      LLVMValueRef v2, v3, res;
+
+      v2 = udiv_imm(bld, LLVMBuildAdd(builder, sum, e0, ""), 3, 3 * 255);
+      v3 = udiv_imm(bld, LLVMBuildAdd(builder, sum, e1, ""), 3, 3 * 255);
+
+      if (dxt1) {
+         v2 = lp_build_select(bld, four_color, v2, lp_build_shr_imm(bld, sum, 1));
+         v3 = lp_build_select(bld, four_color, v3, bld->zero);
+      }
+
+      res = lp_build_select(bld, is2, v2, v3);
+      res = lp_build_select(bld, is1, e1, res);
+      rgba[chan] = lp_build_select(bld, is0, e0, res);
+   }
+
+   if (dxt1) {
+      LLVMValueRef transparent = lp_build_andnot(bld, code_is(bld, code, 3),
+                                                 four_color);
+      rgba[3] = lp_build_select(bld, transparent, bld->zero,
+                                lp_build_const_int_vec(gallivm, bld->type, 255));
+   }
+}
+
+
+/**
+ * Decode one texel of the 4 bit per texel explicit DXT3 alpha block.
+ */
+static LLVMValueRef
+decode_dxt3_alpha(struct lp_build_context *bld,
+                  LLVMValueRef lo,
+                  LLVMValueRef hi,
+                  LLVMValueRef texel)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMValueRef use_hi, shift, alpha;
+
+   use_hi = lp_build_cmp(bld, PIPE_FUNC_GEQUAL, texel,
+                         lp_build_const_int_vec(gallivm, bld->type, 8));
+   shift = lp_build_and(bld, texel, lp_build_const_int_vec(gallivm, bld->type, 7));
+   shift = lp_build_shl_imm(bld, shift, 2);
+
+   alpha = lp_build_select(bld, use_hi, hi, lo);
+   alpha = LLVMBuildLShr(gallivm->builder, alpha, shift, "");
+   alpha = lp_build_and(bld, alpha, lp_build_const_int_vec(gallivm, bld->type, 0xf));
+
+   return lp_build_or(bld, alpha, lp_build_shl_imm(bld, alpha, 4));
+}
+
+
+/**
+ * Gather the ETC1 modifier magnitude for each element.
+ */
+static LLVMValueRef
+etc1_modifier_magnitude(struct lp_build_context *bld,
+                        LLVMValueRef table,
+                        LLVMValueRef large)
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMTypeRef i32t = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef array_type = LLVMArrayType(i32t, 16);
+   LLVMValueRef values[16];
+   LLVMValueRef table_ptr, index;
+   unsigned k;
+
+   table_ptr = LLVMGetNamedGlobal(gallivm->module, "etc1_modifiers");
+   if (!table_ptr) {
+      for (k = 0; k < 16; ++k) {
+         values[k] = lp_build_const_int32(gallivm, etc1_modifiers[k / 8][k % 8]);
+      }
+
+      table_ptr = LLVMAddGlobal(gallivm->module, array_type, "etc1_modifiers");
+      LLVMSetInitializer(table_ptr, LLVMConstArray(i32t, values, 16));
+      LLVMSetGlobalConstant(table_ptr, TRUE);
+      LLVMSetLinkage(table_ptr, LLVMPrivateLinkage);
+   }
+   table_ptr = LLVMBuildBitCast(gallivm->builder, table_ptr,
+                                LLVMPointerType(LLVMInt8TypeInContext(gallivm->context), 0), "");
+
+   /* byte offset of etc1_modifiers[large][table] */
+   index = lp_build_or(bld, table, lp_build_shl_imm(bld, large, 3));
+   index = lp_build_shl_imm(bld, index, 2);
+
+   return lp_build_gather(gallivm, bld->type.length, 32, 32, TRUE,
+                          table_ptr, index, FALSE);
+}
+
+
+/**
+ * Decode one texel of an ETC1 block, see texcompress_etc_tmp.h.
+ */
+static void
+decode_etc1_block(struct lp_build_context *bld,
+                  struct lp_build_context *sbld,
+                  LLVMValueRef header,
+                  LLVMValueRef pixel_indices,
+                  LLVMValueRef i,
+                  LLVMValueRef j,
+                  LLVMValueRef rgb[3])
+{
+   struct gallivm_state *gallivm = bld->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef two = lp_build_const_int_vec(gallivm, bld->type, 2);
+   LLVMValueRef flags, diff_mode, flipped, second;
+   LLVMValueRef table, bit, idx, modifier;
+   unsigned chan;
+
+   /* the header is bytes 0..3 of the block, with byte 3 holding the flags */
+   flags = extract_bits(bld, header, 0, 0xff);
+   diff_mode = lp_build_cmp(bld, PIPE_FUNC_NOTEQUAL,
+                            lp_build_and(bld, flags, two), bld->zero);
+   flipped = lp_build_cmp(bld, PIPE_FUNC_NOTEQUAL,
+                          lp_build_and(bld, flags, bld->one), bld->zero);
+
+   /* which of the two sub-blocks the texel belongs to */
+   second = lp_build_select(bld, flipped,
+                            lp_build_cmp(bld, PIPE_FUNC_GEQUAL, j, two),
+                            lp_build_cmp(bld, PIPE_FUNC_GEQUAL, i, two));
+
+   table = lp_build_select(bld, second,
+                           extract_bits(bld, flags, 2, 0x7),
+                           extract_bits(bld, flags, 5, 0x7));
+
+   /* 2 bit index, with its msb in the upper and its lsb in the lower half */
+   bit = LLVMBuildAdd(builder, j, lp_build_shl_imm(bld, i, 2), "");
+   idx = LLVMBuildLShr(builder, pixel_indices, bit, "");
+   idx = lp_build_and(bld, idx, lp_build_const_int_vec(gallivm, bld->type, 0x10001));
+
+   modifier = etc1_modifier_magnitude(bld, table,
+                                      lp_build_and(bld, idx, bld->one));
+   modifier = lp_build_select(bld,
+                              lp_build_cmp(bld, PIPE_FUNC_NOTEQUAL,
+                                           lp_build_shr_imm(bld, idx, 16),
+                                           bld->zero),
+                              LLVMBuildNeg(builder, modifier, ""),
+                              modifier);
+
+   for (chan = 0; chan < 3; ++chan) {
+      LLVMValueRef src = extract_bits(bld, header, 24 - 8 * chan, 0xff);
+      LLVMValueRef diff_hi, diff_lo, ind_hi, ind_lo, base, delta, res;
+
+      /* differential mode: 5 bit base and 3 bit signed delta */
+      diff_hi = lp_build_or(bld,
+                            lp_build_and(bld, src,
+                                         lp_build_const_int_vec(gallivm, bld->type, 0xf8)),
+                            lp_build_shr_imm(bld, src, 5));
+      delta = lp_build_and(bld, src, lp_build_const_int_vec(gallivm, bld->type, 0x7));
+      delta = LLVMBuildSub(builder,
+                           lp_build_xor(bld, delta,
+                                        lp_build_const_int_vec(gallivm, bld->type, 0x4)),
+                           lp_build_const_int_vec(gallivm, bld->type, 0x4), "");
+      diff_lo = LLVMBuildAdd(builder, lp_build_shr_imm(bld, src, 3), delta, "");
+      diff_lo = lp_build_and(bld, diff_lo, lp_build_const_int_vec(gallivm, bld->type, 0xff));
+      diff_lo = lp_build_or(bld, lp_build_shl_imm(bld, diff_lo, 3),
+                            lp_build_shr_imm(bld, diff_lo, 2));
+      diff_lo = lp_build_and(bld, diff_lo, lp_build_const_int_vec(gallivm, bld->type, 0xff));
+
+      /* individual mode: two 4 bit bases */
+      ind_hi = lp_build_or(bld,
+                           lp_build_and(bld, src,
+                                        lp_build_const_int_vec(gallivm, bld->type, 0xf0)),
+                           lp_build_shr_imm(bld, src, 4));
+      ind_lo = lp_build_and(bld, src, lp_build_const_int_vec(gallivm, bld->type, 0xf));
+      ind_lo = lp_build_mul_imm(bld, ind_lo, 17);
+
+      base = lp_build_select(bld, diff_mode,
+                             lp_build_select(bld, second, diff_lo, diff_hi),
+                             lp_build_select(bld, second, ind_lo, ind_hi));
+
+      res = LLVMBuildAdd(builder, base, modifier, "");
+      rgb[chan] = lp_build_clamp(sbld, res, sbld->zero,
+                                 lp_build_const_int_vec(gallivm, sbld->type, 255));
+   }
+}
+
+
+/**
+ * Decode the (i, j) texel of each block into unswizzled integer channels,
+ * in [0, 255], or in [-128, 127] for the SNORM formats.
+ */
+static void
+decode_compressed_soa(struct gallivm_state *gallivm,
+                      const struct util_format_description *format_desc,
+                      unsigned n,
+                      LLVMValueRef base_ptr,
+                      LLVMValueRef offset,
+                      LLVMValueRef i,
+                      LLVMValueRef j,
+                      LLVMValueRef chans[4])
+{
+   struct lp_type type, stype;
+   struct lp_build_context bld, sbld;
+   boolean is_signed = format_is_snorm(format_desc);
+   LLVMValueRef texel, lo, hi;
+
+   memset(&type, 0, sizeof type);
+   type.width = 32;
+   type.length = n;
+   stype = type;
+   stype.sign = TRUE;
+
+   lp_build_context_init(&bld, gallivm, type);
+   lp_build_context_init(&sbld, gallivm, stype);
+
+   assert(lp_check_value(type, offset));
+
+   texel = LLVMBuildAdd(gallivm->builder, lp_build_shl_imm(&bld, j, 2), i, "");
+
+   chans[0] = chans[1] = chans[2] = chans[3] = bld.zero;
+
+   switch (format_desc->format) {
+   case PIPE_FORMAT_DXT1_RGB:
+   case PIPE_FORMAT_DXT1_SRGB:
+   case PIPE_FORMAT_DXT1_RGBA:
+   case PIPE_FORMAT_DXT1_SRGBA:
+      lo = load_word(&bld, base_ptr, offset, 0, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 4, FALSE);
+      decode_color_block(&bld, TRUE, lo, hi, texel, chans);
+      break;
+   case PIPE_FORMAT_DXT3_RGBA:
+   case PIPE_FORMAT_DXT3_SRGBA:
+      lo = load_word(&bld, base_ptr, offset, 0, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 4, FALSE);
+      chans[3] = decode_dxt3_alpha(&bld, lo, hi, texel);
+      lo = load_word(&bld, base_ptr, offset, 8, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 12, FALSE);
+      decode_color_block(&bld, FALSE, lo, hi, texel, chans);
+      break;
+   case PIPE_FORMAT_DXT5_RGBA:
+   case PIPE_FORMAT_DXT5_SRGBA:
+      lo = load_word(&bld, base_ptr, offset, 0, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 4, FALSE);
+      chans[3] = decode_channel_block(&bld, &sbld, FALSE, lo, hi, texel);
+      lo = load_word(&bld, base_ptr, offset, 8, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 12, FALSE);
+      decode_color_block(&bld, FALSE, lo, hi, texel, chans);
+      break;
+   case PIPE_FORMAT_RGTC2_UNORM:
+   case PIPE_FORMAT_RGTC2_SNORM:
+   case PIPE_FORMAT_LATC2_UNORM:
+   case PIPE_FORMAT_LATC2_SNORM:
+      lo = load_word(&bld, base_ptr, offset, 8, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 12, FALSE);
+      chans[1] = decode_channel_block(&bld, &sbld, is_signed, lo, hi, texel);
+      /* fall through */
+   case PIPE_FORMAT_RGTC1_UNORM:
+   case PIPE_FORMAT_RGTC1_SNORM:
+   case PIPE_FORMAT_LATC1_UNORM:
+   case PIPE_FORMAT_LATC1_SNORM:
+      lo = load_word(&bld, base_ptr, offset, 0, FALSE);
+      hi = load_word(&bld, base_ptr, offset, 4, FALSE);
+      chans[0] = decode_channel_block(&bld, &sbld, is_signed, lo, hi, texel);
+      break;
+   case PIPE_FORMAT_ETC1_RGB8:
+      lo = load_word(&bld, base_ptr, offset, 0, TRUE);
+      hi = load_word(&bld, base_ptr, offset, 4, TRUE);
+      decode_etc1_block(&bld, &sbld, lo, hi, i, j, chans);
+      break;
+   default:
+      assert(0);
+      break;
+   }
+}
+
+
+/**
+ * Fetch texels of a block compressed format as SoA floats.
+ *
+ * \param type  the float type of the result, one texel per element
+ * \param offset, i, j  as for lp_build_fetch_rgba_soa()
+ */
+void
+lp_build_fetch_compressed_rgba_soa(struct gallivm_state *gallivm,
+                                   const struct util_format_description *format_desc,
+                                   struct lp_type type,
+                                   LLVMValueRef base_ptr,
+                                   LLVMValueRef offset,
+                                   LLVMValueRef i,
+                                   LLVMValueRef j,
+                                   LLVMValueRef rgba_out[4])
+{
+   struct lp_build_context bld;
+   struct lp_type int_type;
+   boolean is_signed = format_is_snorm(format_desc);
+   LLVMValueRef chans[4];
+   unsigned chan;
+
+   assert(type.floating && type.width == 32);
+   assert(lp_build_format_compressed_supported(format_desc));
+
+   lp_build_context_init(&bld, gallivm, type);
+   int_type = lp_int_type(type);
+
+   decode_compressed_soa(gallivm, format_desc, type.length,
+                         base_ptr, offset, i, j, chans);
+
+   for (chan = 0; chan < 4; ++chan) {
+      LLVMValueRef x = chans[chan];
+
+      if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB && chan < 3) {
+         chans[chan] = lp_build_srgb_to_linear(gallivm, int_type, 8, x);
+         continue;
+      }
+
+      if (is_signed) {
+         /* -128 and -127 both map to -1.0 */
+         struct lp_build_context int_bld;
+         lp_build_context_init(&int_bld, gallivm, int_type);
+         x = lp_build_max(&int_bld, x,
+                          lp_build_const_int_vec(gallivm, int_type, -127));
+      }
+
+      x = lp_build_int_to_float(&bld, x);
+      chans[chan] = lp_build_mul(&bld, x,
+                                 lp_build_const_vec(gallivm, type,
+                                                    is_signed ? 1.0/127.0 : 1.0/255.0));
+   }
+
+   lp_build_format_swizzle_soa(format_desc, &bld, chans, rgba_out);
+}
+
+
+/**
+ * Fetch texels of a block compressed format as AoS.
+ *
+ * \param type  the AoS type of the result, with 4 channels per texel
+ * \param offset, i, j  as for lp_build_fetch_rgba_aos()
+ */
+LLVMValueRef
+lp_build_fetch_compressed_rgba_aos(struct gallivm_state *gallivm,
+                                   const struct util_format_description *format_desc,
+                                   struct lp_type type,
+                                   LLVMValueRef base_ptr,
+                                   LLVMValueRef offset,
+                                   LLVMValueRef i,
+                                   LLVMValueRef j)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   const unsigned num_pixels = type.length / 4;
+   LLVMValueRef res;
+
+   assert(lp_build_format_compressed_supported(format_desc));
+
+   if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_RGB &&
+       !format_is_snorm(format_desc)) {
+      /*
+       * Pack the 8 bit channels and convert from <4n x unorm8>.
+       */
+      struct lp_type int_type, tmp_type;
+      struct lp_build_context bld;
+      LLVMValueRef chans[4];
+      unsigned chan;
+
+      memset(&int_type, 0, sizeof int_type);
+      int_type.width = 32;
+      int_type.length = num_pixels;
+      lp_build_context_init(&bld, gallivm, int_type);
+
+      decode_compressed_soa(gallivm, format_desc, num_pixels,
+                            base_ptr, offset, i, j, chans);
+
+      res = NULL;
+      for (chan = 0; chan < 4; ++chan) {
+         enum util_format_swizzle swizzle = format_desc->swizzle[chan];
+         LLVMValueRef x;
+#ifdef PIPE_ARCH_LITTLE_ENDIAN
+         unsigned shift = chan * 8;
+#else
+         unsigned shift = 24 - chan * 8;
+#endif
+
+         if (swizzle <= UTIL_FORMAT_SWIZZLE_W) {
+            x = chans[swizzle];
+         }
+         else if (swizzle == UTIL_FORMAT_SWIZZLE_1) {
+            x = lp_build_const_int_vec(gallivm, int_type, 255);
+         }
+         else {
+            continue;
+         }
+
+         x = lp_build_shl_imm(&bld, x, shift);
+         res = res ? lp_build_or(&bld, res, x) : x;
+      }
+
+      memset(&tmp_type, 0, sizeof tmp_type);
+      tmp_type.width = 8;
+      tmp_type.length = num_pixels * 4;
+      tmp_type.norm = TRUE;
+
+      res = LLVMBuildBitCast(builder, res, lp_build_vec_type(gallivm, tmp_type), "");
+
+      lp_build_conv(gallivm, tmp_type, type, &res, 1, &res, 1);
+   }
+   else {
+      /*
+       * Decode to SoA floats and transpose, a texel at a time.
+       */
+      struct lp_type float_type = lp_type_float_vec(32, 32 * num_pixels);
+      LLVMTypeRef vec4_type = lp_build_vec_type(gallivm, lp_float32_vec4_type());
+      LLVMValueRef rgba[4];
+      LLVMValueRef tmps[LP_MAX_VECTOR_LENGTH / 4];
+      unsigned k, chan;
+
+      lp_build_fetch_compressed_rgba_soa(gallivm, format_desc, float_type,
+                                         base_ptr, offset, i, j, rgba);
+
+      for (k = 0; k < num_pixels; ++k) {
+         LLVMValueRef index = lp_build_const_int32(gallivm, k);
+
+         tmps[k] = LLVMGetUndef(vec4_type);
+         for (chan = 0; chan < 4; ++chan) {
+            LLVMValueRef x = rgba[chan];
+            if (num_pixels > 1) {
+               x = LLVMBuildExtractElement(builder, x, index, "");
+            }
+            tmps[k] = LLVMBuildInsertElement(builder, tmps[k], x,
+                                             lp_build_const_int32(gallivm, chan), "");
+         }
+      }
+
+      lp_build_conv(gallivm, lp_float32_vec4_type(), type,
+                    tmps, num_pixels, &res, 1);
+   }
+
+   return res;
+}
@@ -459,6 +459,17 @@ lp_build_fetch_rgba_soa(struct gallivm_state *gallivm,
       return;
    }
 
+   if (lp_build_format_compressed_supported(format_desc) &&
+       (format_desc->layout != UTIL_FORMAT_LAYOUT_S3TC || !cache) &&
+       type.floating && type.width == 32) {
+      /*
+       * Decode the blocks of all pixels in parallel.
+       */
+      lp_build_fetch_compressed_rgba_soa(gallivm, format_desc, type,
+                                         base_ptr, offset, i, j, rgba_out);
+      return;
+   }
+
    /*
     * Try calling lp_build_fetch_rgba_aos for all pixels.
     */
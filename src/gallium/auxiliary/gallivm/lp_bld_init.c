@@ -30,13 +30,16 @@
 #include "pipe/p_compiler.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_debug.h"
+#include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "os/os_time.h"
 #include "lp_bld.h"
 #include "lp_bld_debug.h"
+#include "lp_bld_type.h"
 #include "lp_bld_misc.h"
 #include "lp_bld_init.h"
+#include "lp_bld_cache.h"
 
 #include <llvm-c/Analysis.h>
 #include <llvm-c/Transforms/Scalar.h>
@@ -145,7 +148,7 @@ create_pass_manager(struct gallivm_state *gallivm)
    LLVMSetDataLayout(gallivm->module, "");
 #endif
 
-   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0) {
+   if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) == 0 && !gallivm->no_opt) {
       /* These are the passes currently listed in llvm-c/Transforms/Scalar.h,
        * but there are more on SVN.
        * TODO: Add more passes.
@@ -177,6 +180,12 @@ create_pass_manager(struct gallivm_state *gallivm)
 void
 gallivm_free_ir(struct gallivm_state *gallivm)
 {
+   /* Now that all functions have been looked up, the object code is
+    * complete and can be written to the persistent cache.
+    */
+   if (gallivm->cache)
+      gallivm_cache_store(gallivm);
+
    if (gallivm->passmgr) {
       LLVMDisposePassManager(gallivm->passmgr);
    }
@@ -230,22 +239,29 @@ init_gallivm_engine(struct gallivm_state *gallivm)
 {
    if (1) {
       enum LLVM_CodeGenOpt_Level optlevel;
+      struct lp_cached_code *cache_out = NULL;
       char *error = NULL;
       int ret;
 
-      if (gallivm_debug & GALLIVM_DEBUG_NO_OPT) {
+      if ((gallivm_debug & GALLIVM_DEBUG_NO_OPT) || gallivm->no_opt) {
          optlevel = None;
       }
       else {
          optlevel = Default;
       }
 
+      /* Capture the object code for the persistent cache */
+      if (gallivm->cache && !gallivm->cache->hit) {
+         cache_out = &gallivm->cache->code;
+      }
+
       ret = lp_build_create_jit_compiler_for_module(&gallivm->engine,
                                                     &gallivm->code,
                                                     gallivm->module,
                                                     gallivm->memorymgr,
                                                     (unsigned) optlevel,
                                                     USE_MCJIT,
+                                                    cache_out,
                                                     &error);
       if (ret) {
          _debug_printf("%s\n", error);
@@ -413,10 +429,32 @@ lp_build_init(void)
        */
       lp_native_vector_width = 128;
    }
+
+#if HAVE_LLVM >= 0x0309
+   /* With AVX-512 a single 16-wide vector covers a whole 4x4 fragment
+    * stamp.  Older LLVM versions don't generate usable AVX-512 code.
+    */
+   if (util_cpu_caps.has_avx512f &&
+       util_cpu_caps.has_intel) {
+      lp_native_vector_width = 512;
+   }
+#endif
  
    lp_native_vector_width = debug_get_num_option("LP_NATIVE_VECTOR_WIDTH",
                                                  lp_native_vector_width);
 
+   lp_native_vector_width = MIN2(lp_native_vector_width, LP_MAX_VECTOR_WIDTH);
+
+   if (lp_native_vector_width <= 256) {
+      /* Likewise hide AVX-512 when not using 512-bit vectors, as LLVM would
+       * otherwise use the (possibly downclocking) 512-bit units on its own.
+       */
+      util_cpu_caps.has_avx512f = 0;
+      util_cpu_caps.has_avx512dq = 0;
+      util_cpu_caps.has_avx512bw = 0;
+      util_cpu_caps.has_avx512vl = 0;
+   }
+
    if (lp_native_vector_width <= 128) {
       /* Hide AVX support, as often LLVM AVX intrinsics are only guarded by
        * "util_cpu_caps.has_avx" predicate, and lack the
@@ -463,6 +501,7 @@ lp_build_init(void)
    util_cpu_caps.has_avx = 0;
    util_cpu_caps.has_avx2 = 0;
    util_cpu_caps.has_f16c = 0;
+   util_cpu_caps.has_avx512f = 0;
 #endif
 
    return TRUE;
@@ -490,6 +529,29 @@ gallivm_create(const char *name, LLVMContextRef context)
 }
 
 
+/**
+ * Create a new gallivm_state object whose code is generated with only the
+ * passes needed for correctness.  This is much quicker to compile and
+ * meant for code that is only used until an optimized version is ready.
+ */
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context)
+{
+   struct gallivm_state *gallivm;
+
+   gallivm = CALLOC_STRUCT(gallivm_state);
+   if (gallivm) {
+      gallivm->no_opt = TRUE;
+      if (!init_gallivm_state(gallivm, name, context)) {
+         FREE(gallivm);
+         gallivm = NULL;
+      }
+   }
+
+   return gallivm;
+}
+
+
 /**
  * Destroy a gallivm_state object.
  */
@@ -498,6 +560,7 @@ gallivm_destroy(struct gallivm_state *gallivm)
 {
    gallivm_free_ir(gallivm);
    gallivm_free_code(gallivm);
+   gallivm_cache_destroy(gallivm);
    FREE(gallivm);
 }
 
@@ -641,5 +704,8 @@ gallivm_jit_function(struct gallivm_state *gallivm,
    assert(code);
    jit_func = pointer_to_func(code);
 
+   if (gallivm->cache)
+      gallivm_cache_add_function(gallivm, func);
+
    return jit_func;
 }
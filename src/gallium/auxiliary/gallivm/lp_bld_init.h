@@ -36,6 +36,9 @@
 #include <llvm-c/ExecutionEngine.h>
 
 
+struct gallivm_cache_entry;
+
+
 struct gallivm_state
 {
    LLVMModuleRef module;
@@ -47,6 +50,13 @@ struct gallivm_state
    LLVMMCJITMemoryManagerRef memorymgr;
    struct lp_generated_code *code;
    unsigned compiled;
+   /** Skip optimization passes, see gallivm_create_unoptimized() */
+   boolean no_opt;
+
+   /** Persistent cache state, NULL when not cached, see lp_bld_cache.h */
+   struct gallivm_cache_entry *cache;
+   /** The IR embeds process-specific addresses, so must not be cached */
+   boolean cache_unsafe;
 };
 
 
@@ -57,6 +67,9 @@ lp_build_init(void);
 struct gallivm_state *
 gallivm_create(const char *name, LLVMContextRef context);
 
+struct gallivm_state *
+gallivm_create_unoptimized(const char *name, LLVMContextRef context);
+
 void
 gallivm_destroy(struct gallivm_state *gallivm);
 
@@ -65,6 +65,9 @@
 #include <llvm/ExecutionEngine/JITMemoryManager.h>
 #else
 #include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/MemoryBuffer.h>
 #endif
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/Host.h>
@@ -85,6 +88,8 @@
 #include "os/os_thread.h"
 #include "pipe/p_config.h"
 #include "util/u_debug.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
 #include "util/u_cpu_detect.h"
 
 #include "lp_bld_misc.h"
@@ -422,6 +427,39 @@ class ShaderMemoryManager : public DelegatingJITMemoryManager {
 };
 
 
+#if HAVE_LLVM >= 0x0306
+/**
+ * Captures the object code MCJIT generates for a module, so that it can
+ * be written to the persistent cache (see lp_bld_cache.c).  Cached
+ * objects are loaded directly with lp_build_add_cached_object() instead
+ * of through getObject(), as that would still require the IR.
+ */
+class LPObjectCache : public llvm::ObjectCache {
+   struct lp_cached_code *cache_out;
+
+public:
+   LPObjectCache(struct lp_cached_code *cache) : cache_out(cache) {}
+
+   void notifyObjectCompiled(const llvm::Module *M,
+                             llvm::MemoryBufferRef Obj) override
+   {
+      FREE(cache_out->data);
+      cache_out->data_size = Obj.getBufferSize();
+      cache_out->data = MALLOC(cache_out->data_size);
+      if (cache_out->data)
+         memcpy(cache_out->data, Obj.getBufferStart(), cache_out->data_size);
+      else
+         cache_out->data_size = 0;
+   }
+
+   std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *M) override
+   {
+      return NULL;
+   }
+};
+#endif
+
+
 /**
  * Same as LLVMCreateJITCompilerForModule, but:
  * - allows using MCJIT and enabling AVX feature where available.
@@ -440,6 +478,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef CMM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_cached_code *CacheOut,
                                         char **OutError)
 {
    using namespace llvm;
@@ -532,6 +571,12 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
    MAttrs.push_back(util_cpu_caps.has_avx  ? "+avx"  : "-avx");
    MAttrs.push_back(util_cpu_caps.has_f16c ? "+f16c" : "-f16c");
    MAttrs.push_back(util_cpu_caps.has_avx2 ? "+avx2" : "-avx2");
+#if HAVE_LLVM >= 0x0306
+   MAttrs.push_back(util_cpu_caps.has_avx512f  ? "+avx512f"  : "-avx512f");
+   MAttrs.push_back(util_cpu_caps.has_avx512dq ? "+avx512dq" : "-avx512dq");
+   MAttrs.push_back(util_cpu_caps.has_avx512bw ? "+avx512bw" : "-avx512bw");
+   MAttrs.push_back(util_cpu_caps.has_avx512vl ? "+avx512vl" : "-avx512vl");
+#endif
 #endif
 
 #if defined(PIPE_ARCH_PPC)
@@ -596,6 +641,13 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
 
    JIT = builder.create();
    if (JIT) {
+#if HAVE_LLVM >= 0x0306
+      if (useMCJIT && CacheOut) {
+         LPObjectCache *objcache = new LPObjectCache(CacheOut);
+         CacheOut->jit_obj_cache = objcache;
+         JIT->setObjectCache(objcache);
+      }
+#endif
       *OutJIT = wrap(JIT);
       return 0;
    }
@@ -633,3 +685,87 @@ lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr)
 {
    delete reinterpret_cast<BaseMemoryManager*>(memorymgr);
 }
+
+extern "C"
+void
+lp_free_objcache(void *objcache)
+{
+#if HAVE_LLVM >= 0x0306
+   delete reinterpret_cast<LPObjectCache *>(objcache);
+#else
+   assert(!objcache);
+#endif
+}
+
+
+/**
+ * Parse object code previously captured into a lp_cached_code.
+ * Returns NULL if the object can't be used.
+ */
+extern "C"
+void *
+lp_build_parse_cached_object(const void *data, size_t size)
+{
+#if HAVE_LLVM >= 0x0306
+   using namespace llvm;
+
+   std::unique_ptr<MemoryBuffer> buf =
+      MemoryBuffer::getMemBufferCopy(StringRef((const char *)data, size));
+
+#if HAVE_LLVM >= 0x0400
+   Expected<std::unique_ptr<object::ObjectFile> > obj =
+      object::ObjectFile::createObjectFile(buf->getMemBufferRef());
+   if (!obj) {
+      consumeError(obj.takeError());
+      return NULL;
+   }
+#else
+   ErrorOr<std::unique_ptr<object::ObjectFile> > obj =
+      object::ObjectFile::createObjectFile(buf->getMemBufferRef());
+   if (!obj)
+      return NULL;
+#endif
+
+   return new object::OwningBinary<object::ObjectFile>(std::move(*obj),
+                                                        std::move(buf));
+#else
+   return NULL;
+#endif
+}
+
+
+/**
+ * Hand an object returned by lp_build_parse_cached_object() over to the
+ * execution engine.  Its functions can then be looked up by name.
+ */
+extern "C"
+void
+lp_build_add_cached_object(LLVMExecutionEngineRef JIT, void *object)
+{
+#if HAVE_LLVM >= 0x0306
+   using namespace llvm;
+   object::OwningBinary<object::ObjectFile> *binary =
+      reinterpret_cast<object::OwningBinary<object::ObjectFile> *>(object);
+
+   unwrap(JIT)->addObjectFile(std::move(*binary));
+   delete binary;
+#else
+   assert(0);
+#endif
+}
+
+
+/**
+ * Name of the host CPU, as used for code generation.
+ */
+extern "C"
+void
+lp_build_host_cpu_name(char *buf, unsigned size)
+{
+#if HAVE_LLVM >= 0x0305
+   llvm::StringRef name = llvm::sys::getHostCPUName();
+   util_snprintf(buf, size, "%.*s", (int) name.size(), name.data());
+#else
+   util_snprintf(buf, size, "generic");
+#endif
+}
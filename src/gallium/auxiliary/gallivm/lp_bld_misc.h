@@ -41,6 +41,15 @@ extern "C" {
 
 struct lp_generated_code;
 
+/**
+ * Object code captured from MCJIT for the persistent cache.
+ */
+struct lp_cached_code {
+   void *data;
+   size_t data_size;
+   void *jit_obj_cache;
+};
+
 extern void
 gallivm_init_llvm_targets(void);
 
@@ -59,6 +68,7 @@ lp_build_create_jit_compiler_for_module(LLVMExecutionEngineRef *OutJIT,
                                         LLVMMCJITMemoryManagerRef MM,
                                         unsigned OptLevel,
                                         int useMCJIT,
+                                        struct lp_cached_code *CacheOut,
                                         char **OutError);
 
 extern void
@@ -70,6 +80,18 @@ lp_get_default_memory_manager();
 extern void
 lp_free_memory_manager(LLVMMCJITMemoryManagerRef memorymgr);
 
+extern void
+lp_free_objcache(void *objcache);
+
+extern void *
+lp_build_parse_cached_object(const void *data, size_t size);
+
+extern void
+lp_build_add_cached_object(LLVMExecutionEngineRef JIT, void *object);
+
+extern void
+lp_build_host_cpu_name(char *buf, unsigned size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -104,22 +104,29 @@ lp_build_const_unpack_shuffle(struct gallivm_state *gallivm,
 }
 
 /**
- * Similar to lp_build_const_unpack_shuffle but for special AVX 256bit unpack.
+ * Similar to lp_build_const_unpack_shuffle but for special AVX 256bit and
+ * AVX-512 512bit unpacks, which interleave each 128bit lane separately.
  * See comment above lp_build_interleave2_half for more details.
+ *
+ * \param lane_length  number of elements per 128bit lane
  */
 static LLVMValueRef
 lp_build_const_unpack_shuffle_half(struct gallivm_state *gallivm,
-                                   unsigned n, unsigned lo_hi)
+                                   unsigned n, unsigned lane_length,
+                                   unsigned lo_hi)
 {
    LLVMValueRef elems[LP_MAX_VECTOR_LENGTH];
    unsigned i, j;
 
    assert(n <= LP_MAX_VECTOR_LENGTH);
+   assert(n % lane_length == 0);
    assert(lo_hi < 2);
 
-   for (i = 0, j = lo_hi*(n/4); i < n; i += 2, ++j) {
-      if (i == (n / 2))
-         j += n / 4;
+   for (i = 0; i < n; i += 2) {
+      unsigned lane = i / lane_length;
+
+      j = lane * lane_length + lo_hi * (lane_length / 2) +
+          (i % lane_length) / 2;
 
       elems[i + 0] = lp_build_const_int32(gallivm, 0 + j);
       elems[i + 1] = lp_build_const_int32(gallivm, n + j);
@@ -343,6 +350,9 @@ lp_build_interleave2(struct gallivm_state *gallivm,
  *
  * And interleave-hi would result in:
  *   a2 b2 a3 b3 a6 b6 a7 b7
+ *
+ * 512 bit vectors are treated the same way, as 4 concatenated 128 bit
+ * vectors, matching the AVX-512 unpack instructions.
  */
 LLVMValueRef
 lp_build_interleave2_half(struct gallivm_state *gallivm,
@@ -351,8 +361,11 @@ lp_build_interleave2_half(struct gallivm_state *gallivm,
                      LLVMValueRef b,
                      unsigned lo_hi)
 {
-   if (type.length * type.width == 256) {
-      LLVMValueRef shuffle = lp_build_const_unpack_shuffle_half(gallivm, type.length, lo_hi);
+   if (type.length * type.width == 256 ||
+       type.length * type.width == 512) {
+      LLVMValueRef shuffle =
+         lp_build_const_unpack_shuffle_half(gallivm, type.length,
+                                            128 / type.width, lo_hi);
       return LLVMBuildShuffleVector(gallivm->builder, a, b, shuffle, "");
    } else {
       return lp_build_interleave2(gallivm, type, a, b, lo_hi);
@@ -118,6 +118,7 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
    state->pot_height        = util_is_power_of_two(texture->height0);
    state->pot_depth         = util_is_power_of_two(texture->depth0);
    state->level_zero_only   = !view->u.tex.last_level;
+   state->num_samples       = texture->nr_samples;
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -2019,6 +2020,76 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 }
 
 
+/**
+ * Compute the partial offset of a pixel block along the x, y or z axis of
+ * an image, in either the linear or the tiled layout (see
+ * LP_BLD_TEX_TILE_ORDER).
+ *
+ * @param tiled   whether the image is tiled
+ * @param axis    0, 1 or 2 for x, y or z
+ * @param coord   coordinate in pixels
+ * @param stride  number of bytes between successive pixel blocks along the
+ *                axis, i.e. the pixel block size, row stride or image stride
+ *                (for tiled images, the row stride is the one of tile rows)
+ * @param out_offset    resulting relative offset of the pixel block in bytes
+ * @param out_subcoord  resulting sub-block pixel coordinate
+ */
+void
+lp_build_sample_axis_offset(struct lp_build_context *bld,
+                            const struct util_format_description *format_desc,
+                            boolean tiled,
+                            unsigned axis,
+                            LLVMValueRef coord,
+                            LLVMValueRef stride,
+                            LLVMValueRef *out_offset,
+                            LLVMValueRef *out_subcoord)
+{
+   LLVMBuilderRef builder = bld->gallivm->builder;
+   LLVMValueRef tile_stride, texel_stride;
+   LLVMValueRef tile, texel;
+   unsigned block_size;
+
+   if (!tiled || axis > 1) {
+      unsigned block_length = axis == 0 ? format_desc->block.width :
+                              axis == 1 ? format_desc->block.height : 1;
+      lp_build_sample_partial_offset(bld, block_length, coord, stride,
+                                     out_offset, out_subcoord);
+      return;
+   }
+
+   assert(format_desc->block.width == 1 && format_desc->block.height == 1);
+
+   /*
+    * offset = (coord / TILE_SIZE) * tile_stride +
+    *          (coord % TILE_SIZE) * texel_stride
+    */
+   block_size = format_desc->block.bits / 8;
+   if (axis == 0) {
+      tile_stride = lp_build_const_int_vec(bld->gallivm, bld->type,
+                                           block_size * LP_BLD_TEX_TILE_SIZE *
+                                           LP_BLD_TEX_TILE_SIZE);
+      texel_stride = stride;
+   }
+   else {
+      tile_stride = stride;
+      texel_stride = lp_build_const_int_vec(bld->gallivm, bld->type,
+                                            block_size * LP_BLD_TEX_TILE_SIZE);
+   }
+
+   tile = LLVMBuildLShr(builder, coord,
+                        lp_build_const_int_vec(bld->gallivm, bld->type,
+                                               LP_BLD_TEX_TILE_ORDER), "");
+   texel = LLVMBuildAnd(builder, coord,
+                        lp_build_const_int_vec(bld->gallivm, bld->type,
+                                               LP_BLD_TEX_TILE_SIZE - 1), "");
+
+   *out_offset = lp_build_add(bld,
+                              lp_build_mul(bld, tile, tile_stride),
+                              lp_build_mul(bld, texel, texel_stride));
+   *out_subcoord = bld->zero;
+}
+
+
 /**
  * Compute the offset of a pixel block.
  *
@@ -2029,6 +2100,7 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -2044,17 +2116,15 @@ lp_build_sample_offset(struct lp_build_context *bld,
    x_stride = lp_build_const_vec(bld->gallivm, bld->type,
                                  format_desc->block.bits/8);
 
-   lp_build_sample_partial_offset(bld,
-                                  format_desc->block.width,
-                                  x, x_stride,
-                                  &offset, out_i);
+   lp_build_sample_axis_offset(bld, format_desc, tiled, 0,
+                               x, x_stride,
+                               &offset, out_i);
 
    if (y && y_stride) {
       LLVMValueRef y_offset;
-      lp_build_sample_partial_offset(bld,
-                                     format_desc->block.height,
-                                     y, y_stride,
-                                     &y_offset, out_j);
+      lp_build_sample_axis_offset(bld, format_desc, tiled, 1,
+                                  y, y_stride,
+                                  &y_offset, out_j);
       offset = lp_build_add(bld, offset, y_offset);
    }
    else {
@@ -104,6 +104,7 @@ struct lp_sampler_params
    const LLVMValueRef *offsets;
    LLVMValueRef lod;
    const struct lp_derivatives *derivs;
+   LLVMValueRef ms_index;   /**< sample index for fetches from msaa textures */
    LLVMValueRef *texel;
 };
 
@@ -129,9 +130,25 @@ struct lp_static_texture_state
    unsigned pot_height:1;
    unsigned pot_depth:1;
    unsigned level_zero_only:1;
+   unsigned num_samples:5;   /**< 0 or 1 unless multisampled */
+   unsigned tiled:1;         /**< images stored as tiles, see below */
 };
 
 
+/**
+ * Tiled texture layout.
+ *
+ * Each 2D image (mip level, layer, face or 3D slice) is stored as rows of
+ * square tiles of LP_BLD_TEX_TILE_SIZE x LP_BLD_TEX_TILE_SIZE texels, each
+ * tile being contiguous in memory with its texels in row-major order.  The
+ * row stride is the distance between successive rows of tiles.  This keeps
+ * the texels of a filter footprint close together whichever direction the
+ * texture is walked in.  Only formats with 1x1 pixel blocks can be tiled.
+ */
+#define LP_BLD_TEX_TILE_ORDER 2
+#define LP_BLD_TEX_TILE_SIZE (1 << LP_BLD_TEX_TILE_ORDER)
+
+
 /**
  * Sampler static state.
  *
@@ -239,6 +256,18 @@ struct lp_sampler_dynamic_state
                   LLVMValueRef context_ptr,
                   unsigned texture_unit);
 
+   /**
+    * Obtain offset between the samples of a multisample texture.
+    *
+    * It's optional: fetches from multisample textures always return
+    * sample 0 if it's NULL.
+    */
+   LLVMValueRef
+   (*sample_stride)(const struct lp_sampler_dynamic_state *state,
+                    struct gallivm_state *gallivm,
+                    LLVMValueRef context_ptr,
+                    unsigned texture_unit);
+
    /* These are callbacks for sampler state */
 
    /** Obtain texture min lod (returns float) */
@@ -569,9 +598,21 @@ lp_build_sample_partial_offset(struct lp_build_context *bld,
                                LLVMValueRef *out_i);
 
 
+void
+lp_build_sample_axis_offset(struct lp_build_context *bld,
+                            const struct util_format_description *format_desc,
+                            boolean tiled,
+                            unsigned axis,
+                            LLVMValueRef coord,
+                            LLVMValueRef stride,
+                            LLVMValueRef *out_offset,
+                            LLVMValueRef *out_subcoord);
+
+
 void
 lp_build_sample_offset(struct lp_build_context *bld,
                        const struct util_format_description *format_desc,
+                       boolean tiled,
                        LLVMValueRef x,
                        LLVMValueRef y,
                        LLVMValueRef z,
@@ -138,6 +138,7 @@ lp_build_sample_texel_soa(struct lp_build_sample_context *bld,
    /* convert x,y,z coords to linear offset from start of texture, in bytes */
    lp_build_sample_offset(&bld->int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x, y, z, y_stride, z_stride,
                           &offset, &i, &j);
    if (mipoffsets) {
@@ -2287,6 +2288,7 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
                      const LLVMValueRef *coords,
                      LLVMValueRef explicit_lod,
                      const LLVMValueRef *offsets,
+                     LLVMValueRef ms_index,
                      LLVMValueRef *colors_out)
 {
    struct lp_build_context *perquadi_bld = &bld->lodi_bld;
@@ -2375,6 +2377,7 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
 
    lp_build_sample_offset(int_coord_bld,
                           bld->format_desc,
+                          bld->static_texture_state->tiled,
                           x, y, z, row_stride_vec, img_stride_vec,
                           &offset, &i, &j);
 
@@ -2383,6 +2386,31 @@ lp_build_fetch_texel(struct lp_build_sample_context *bld,
                             lp_build_get_mip_offsets(bld, ilevel));
    }
 
+   /*
+    * The samples of a multisample texture are stored as consecutive
+    * images, sample_stride bytes apart.
+    */
+   if (ms_index && bld->static_texture_state->num_samples > 1 &&
+       bld->dynamic_state->sample_stride) {
+      LLVMValueRef sample_stride, num_samples;
+
+      sample_stride = bld->dynamic_state->sample_stride(bld->dynamic_state,
+                                                        bld->gallivm,
+                                                        bld->context_ptr,
+                                                        texture_unit);
+      sample_stride = lp_build_broadcast_scalar(int_coord_bld, sample_stride);
+      num_samples = lp_build_const_int_vec(bld->gallivm, int_coord_bld->type,
+                                           bld->static_texture_state->num_samples);
+
+      out1 = lp_build_cmp(int_coord_bld, PIPE_FUNC_LESS, ms_index, int_coord_bld->zero);
+      out_of_bounds = lp_build_or(int_coord_bld, out_of_bounds, out1);
+      out1 = lp_build_cmp(int_coord_bld, PIPE_FUNC_GEQUAL, ms_index, num_samples);
+      out_of_bounds = lp_build_or(int_coord_bld, out_of_bounds, out1);
+
+      offset = lp_build_add(int_coord_bld, offset,
+                            lp_build_mul(int_coord_bld, ms_index, sample_stride));
+   }
+
    offset = lp_build_andnot(int_coord_bld, offset, out_of_bounds);
 
    lp_build_fetch_rgba_soa(bld->gallivm,
@@ -2449,6 +2477,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
                          const LLVMValueRef *offsets,
                          const struct lp_derivatives *derivs, /* optional */
                          LLVMValueRef lod, /* optional */
+                         LLVMValueRef ms_index, /* optional */
                          LLVMValueRef texel_out[4])
 {
    unsigned target = static_texture_state->target;
@@ -2755,7 +2784,7 @@ lp_build_sample_soa_code(struct gallivm_state *gallivm,
 
    else if (op_type == LP_SAMPLER_OP_FETCH) {
       lp_build_fetch_texel(&bld, texture_index, newcoords,
-                           lod, offsets,
+                           lod, offsets, ms_index,
                            texel_out);
    }
 
@@ -3173,6 +3202,7 @@ lp_build_sample_gen_func(struct gallivm_state *gallivm,
                             offsets,
                             deriv_ptr,
                             lod,
+                            NULL,
                             texel_out);
 
    LLVMBuildAggregateRet(gallivm->builder, texel_out, 4);
@@ -3405,7 +3435,9 @@ lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
              static_texture_state->level_zero_only == TRUE) &&
             static_sampler_state->min_img_filter == static_sampler_state->mag_img_filter);
 
-      use_tex_func = format_desc && !(simple_format && simple_tex);
+      /* the sample index isn't passed to texture functions */
+      use_tex_func = format_desc && !(simple_format && simple_tex) &&
+                     !params->ms_index;
    }
 
    if (use_tex_func) {
@@ -3430,6 +3462,7 @@ lp_build_sample_soa(const struct lp_static_texture_state *static_texture_state,
                                params->offsets,
                                params->derivs,
                                params->lod,
+                               params->ms_index,
                                params->texel);
    }
 }
@@ -63,6 +63,7 @@ struct lp_build_mask_context;
 struct gallivm_state;
 struct lp_derivatives;
 struct lp_build_tgsi_gs_iface;
+struct lp_build_tgsi_cs_iface;
 
 
 enum lp_build_tex_modifier {
@@ -166,6 +167,12 @@ struct lp_bld_tgsi_system_values {
    LLVMValueRef prim_id;
    LLVMValueRef basevertex;
    LLVMValueRef invocation_id;
+
+   /* Compute shaders: thread_id are vectors, the others scalars */
+   LLVMValueRef thread_id[3];
+   LLVMValueRef block_id[3];
+   LLVMValueRef grid_size[3];
+   LLVMValueRef block_size[3];
 };
 
 
@@ -233,7 +240,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface);
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface);
 
 
 void
@@ -428,6 +436,54 @@ struct lp_build_tgsi_gs_iface
                        LLVMValueRef emitted_prims_vec);
 };
 
+/**
+ * Compute shader interface.
+ *
+ * The invocations of a work group are run one SIMD vector (chunk) at a
+ * time, in a loop.  A BARRIER ends that loop and starts a new one over
+ * all chunks, so temporaries live across barriers are kept per chunk.
+ * Barriers are only supported in uniform control flow.
+ */
+struct lp_build_tgsi_cs_iface
+{
+   /**
+    * Return the base pointer of a TGSI_FILE_BUFFER resource (including
+    * the TGSI_RESOURCE_LOCAL/INPUT ones) and its size in bytes.  The
+    * pointer must be valid for at least 16 bytes even if the size is
+    * zero, as out of bounds loads are redirected to offset zero.
+    */
+   LLVMValueRef (*get_buffer)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                              struct lp_build_tgsi_context * bld_base,
+                              unsigned index,
+                              LLVMValueRef *size);
+   /**
+    * Decode a scalar TGSI_RESOURCE_GLOBAL address: return the base
+    * pointer and the size in bytes of the buffer it falls in, as for
+    * get_buffer(), and the byte offset of the address in that buffer.
+    */
+   LLVMValueRef (*get_global)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                              struct lp_build_tgsi_context * bld_base,
+                              LLVMValueRef address,
+                              LLVMValueRef *offset,
+                              LLVMValueRef *size);
+   /**
+    * Return the temporary register array of the current chunk, for
+    * shaders with barriers.  It holds (file_max + 1) * 4 vectors.
+    */
+   LLVMValueRef (*get_temps)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                             struct lp_build_tgsi_context * bld_base);
+   /**
+    * End the loop over the chunks and start a new one, updating the
+    * thread ids and the execution mask for the new chunk.
+    */
+   void (*barrier)(const struct lp_build_tgsi_cs_iface *cs_iface,
+                   struct lp_build_tgsi_context * bld_base,
+                   struct lp_bld_tgsi_system_values *system_values);
+
+   /** Index of the first instruction of the kernel */
+   unsigned pc;
+};
+
 struct lp_build_tgsi_soa_context
 {
    struct lp_build_tgsi_context bld_base;
@@ -441,6 +497,8 @@ struct lp_build_tgsi_soa_context
    LLVMValueRef emitted_vertices_vec_ptr;
    LLVMValueRef max_output_vertices_vec;
 
+   const struct lp_build_tgsi_cs_iface *cs_iface;
+
    LLVMValueRef consts_ptr;
    LLVMValueRef const_sizes_ptr;
    LLVMValueRef consts[LP_MAX_TGSI_CONST_BUFFERS];
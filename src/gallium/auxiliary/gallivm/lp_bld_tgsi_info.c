@@ -306,7 +306,8 @@ analyse_instruction(struct analysis_context *ctx,
          regs = info->output;
          max_regs = Elements(info->output);
       } else if (dst->File == TGSI_FILE_ADDRESS ||
-                 dst->File == TGSI_FILE_PREDICATE) {
+                 dst->File == TGSI_FILE_PREDICATE ||
+                 dst->File == TGSI_FILE_BUFFER) {
          continue;
       } else {
          assert(0);
@@ -1678,6 +1678,36 @@ emit_fetch_system_value(
       atype = TGSI_TYPE_UNSIGNED;
       break;
 
+   case TGSI_SEMANTIC_THREAD_ID:
+      res = swizzle < 3 ? bld->system_values.thread_id[swizzle] :
+                          bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_ID:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_id[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_GRID_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.grid_size[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
+   case TGSI_SEMANTIC_BLOCK_SIZE:
+      res = swizzle < 3 ?
+         lp_build_broadcast_scalar(&bld_base->uint_bld,
+                                   bld->system_values.block_size[swizzle]) :
+         bld_base->uint_bld.zero;
+      atype = TGSI_TYPE_UNSIGNED;
+      break;
+
    default:
       assert(!"unexpected semantic in emit_fetch_system_value");
       res = bld_base->base.zero;
@@ -2028,7 +2058,8 @@ emit_store(
    unsigned chan_index;
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    enum tgsi_opcode_type dtype = tgsi_opcode_infer_dst_type(inst->Instruction.Opcode);
-   if(info->num_dst) {
+   /* STORE writes its buffer itself */
+   if(info->num_dst && inst->Dst[0].Register.File != TGSI_FILE_BUFFER) {
       LLVMValueRef pred[TGSI_NUM_CHANNELS];
 
       emit_fetch_predicate( bld, inst, pred );
@@ -2592,7 +2623,10 @@ emit_fetch_texels( struct lp_build_tgsi_soa_context *bld,
       explicit_lod = lp_build_emit_fetch(&bld->bld_base, inst, 0, 3);
       lod_property = lp_build_lod_property(&bld->bld_base, inst, 0);
    }
-   /* XXX: for real msaa support, the w component would be the sample index. */
+   else if (target != TGSI_TEXTURE_BUFFER) {
+      /* the w component is the sample index */
+      params.ms_index = lp_build_emit_fetch(&bld->bld_base, inst, 0, 3);
+   }
 
    for (i = 0; i < dims; i++) {
       coords[i] = lp_build_emit_fetch(&bld->bld_base, inst, 0, i);
@@ -3734,18 +3768,427 @@ cont_emit(
    lp_exec_continue(&bld->exec_mask);
 }
 
+/**
+ * Return the base pointer, as a pointer to 32 bit elements of the given
+ * type, and the size in dwords of the buffer used by a memory
+ * instruction.
+ */
+static LLVMValueRef
+get_buffer_ptr(struct lp_build_tgsi_soa_context *bld,
+               unsigned index,
+               LLVMTypeRef elem_type,
+               LLVMValueRef *num_dwords)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef base_ptr, size;
+
+   base_ptr = bld->cs_iface->get_buffer(bld->cs_iface, &bld->bld_base,
+                                        index, &size);
+   base_ptr = LLVMBuildBitCast(builder, base_ptr,
+                               LLVMPointerType(elem_type, 0), "");
+
+   size = LLVMBuildLShr(builder, size, lp_build_const_int32(gallivm, 2), "");
+   *num_dwords = lp_build_broadcast_scalar(&bld->bld_base.uint_bld, size);
+
+   return base_ptr;
+}
+
+/**
+ * Fetch the byte address operand of a memory instruction and convert it
+ * to a dword index, offset by the given channel.
+ */
+static LLVMValueRef
+get_buffer_index(struct lp_build_tgsi_context *bld_base,
+                 const struct tgsi_full_instruction *inst,
+                 unsigned src_op,
+                 unsigned chan)
+{
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   LLVMValueRef offset;
+
+   offset = lp_build_emit_fetch(bld_base, inst, src_op, TGSI_CHAN_X);
+   offset = LLVMBuildBitCast(builder, offset, uint_bld->vec_type, "");
+   offset = lp_build_shr_imm(uint_bld, offset, 2);
+   if (chan) {
+      offset = lp_build_add(uint_bld, offset,
+                            lp_build_const_int_vec(bld_base->base.gallivm,
+                                                   uint_bld->type, chan));
+   }
+   return offset;
+}
+
+/**
+ * Return the pointer to the 32 bit element of the given type accessed by
+ * one element of a TGSI_RESOURCE_GLOBAL memory instruction, offset by the
+ * given channel, and whether that element lies within its buffer.
+ *
+ * Unlike other buffers, each element of a global address may refer to a
+ * different buffer, so these are always accessed one element at a time.
+ */
+static LLVMValueRef
+get_global_ptr(struct lp_build_tgsi_soa_context *bld,
+               LLVMValueRef address,
+               LLVMValueRef ii,
+               unsigned chan,
+               LLVMTypeRef elem_type,
+               LLVMValueRef *in_bounds)
+{
+   struct gallivm_state *gallivm = bld->bld_base.base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef base_ptr, offset, size;
+
+   address = LLVMBuildExtractElement(builder, address, ii, "");
+   base_ptr = bld->cs_iface->get_global(bld->cs_iface, &bld->bld_base,
+                                        address, &offset, &size);
+
+   /* Same dword granularity as get_buffer_ptr() / get_buffer_index() */
+   offset = LLVMBuildLShr(builder, offset, lp_build_const_int32(gallivm, 2), "");
+   offset = LLVMBuildAdd(builder, offset, lp_build_const_int32(gallivm, chan), "");
+   size = LLVMBuildLShr(builder, size, lp_build_const_int32(gallivm, 2), "");
+   *in_bounds = LLVMBuildICmp(builder, LLVMIntULT, offset, size, "");
+
+   base_ptr = LLVMBuildBitCast(builder, base_ptr,
+                               LLVMPointerType(elem_type, 0), "");
+   return LLVMBuildGEP(builder, base_ptr, &offset, 1, "");
+}
+
+/**
+ * Fetch the byte address operand of a TGSI_RESOURCE_GLOBAL memory
+ * instruction.
+ */
+static LLVMValueRef
+get_global_address(struct lp_build_tgsi_context *bld_base,
+                   const struct tgsi_full_instruction *inst,
+                   unsigned src_op)
+{
+   LLVMBuilderRef builder = bld_base->base.gallivm->builder;
+   LLVMValueRef address;
+
+   address = lp_build_emit_fetch(bld_base, inst, src_op, TGSI_CHAN_X);
+   return LLVMBuildBitCast(builder, address, bld_base->uint_bld.vec_type, "");
+}
+
+static void
+load_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef base_ptr, num_dwords;
+   unsigned chan_index;
+
+   if (inst->Src[0].Register.Index == TGSI_RESOURCE_GLOBAL) {
+      struct lp_build_context *float_bld = &bld_base->base;
+      LLVMValueRef address = get_global_address(bld_base, inst, 1);
+      LLVMValueRef exec_mask = mask_vec(bld_base);
+
+      TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan_index) {
+         LLVMValueRef res_var, res;
+         unsigned i;
+
+         /* Disabled and out of bounds elements return zero */
+         res_var = lp_build_alloca(gallivm, float_bld->vec_type, "load_res");
+
+         for (i = 0; i < float_bld->type.length; i++) {
+            LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+            LLVMValueRef scalar_cond, scalar_ptr;
+            struct lp_build_if_state ifthen;
+
+            scalar_ptr = get_global_ptr(bld, address, ii, chan_index,
+                                        LLVMFloatTypeInContext(gallivm->context),
+                                        &scalar_cond);
+            scalar_cond = LLVMBuildAnd(builder, scalar_cond,
+                             LLVMBuildICmp(builder, LLVMIntNE,
+                                LLVMBuildExtractElement(builder, exec_mask, ii, ""),
+                                lp_build_const_int32(gallivm, 0), ""), "");
+            lp_build_if(&ifthen, gallivm, scalar_cond);
+            res = LLVMBuildLoad(builder, res_var, "");
+            res = LLVMBuildInsertElement(builder, res,
+                                         LLVMBuildLoad(builder, scalar_ptr, ""),
+                                         ii, "");
+            LLVMBuildStore(builder, res, res_var);
+            lp_build_endif(&ifthen);
+         }
+
+         emit_data->output[chan_index] = LLVMBuildLoad(builder, res_var, "");
+      }
+      return;
+   }
+
+   base_ptr = get_buffer_ptr(bld, inst->Src[0].Register.Index,
+                             LLVMFloatTypeInContext(gallivm->context),
+                             &num_dwords);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan_index) {
+      LLVMValueRef index, overflow_mask;
+
+      index = get_buffer_index(bld_base, inst, 1, chan_index);
+      overflow_mask = lp_build_compare(gallivm, bld_base->uint_bld.type,
+                                       PIPE_FUNC_GEQUAL, index, num_dwords);
+
+      /* Out of bounds loads return zero, like constant buffers */
+      emit_data->output[chan_index] =
+         build_gather(bld_base, base_ptr, index, overflow_mask, NULL);
+   }
+}
+
+static void
+store_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMValueRef base_ptr = NULL, num_dwords = NULL, address = NULL;
+   LLVMValueRef exec_mask;
+   boolean global = inst->Dst[0].Register.Index == TGSI_RESOURCE_GLOBAL;
+   unsigned chan_index;
+
+   if (global) {
+      address = get_global_address(bld_base, inst, 0);
+   }
+   else {
+      base_ptr = get_buffer_ptr(bld, inst->Dst[0].Register.Index,
+                                LLVMInt32TypeInContext(gallivm->context),
+                                &num_dwords);
+   }
+   exec_mask = mask_vec(bld_base);
+
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan_index) {
+      LLVMValueRef index = NULL, value, cond = exec_mask;
+      unsigned i;
+
+      value = lp_build_emit_fetch(bld_base, inst, 1, chan_index);
+      value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+
+      if (!global) {
+         index = get_buffer_index(bld_base, inst, 0, chan_index);
+         cond = lp_build_compare(gallivm, uint_bld->type, PIPE_FUNC_LESS,
+                                 index, num_dwords);
+         cond = LLVMBuildAnd(builder, cond, exec_mask, "");
+      }
+
+      /*
+       * Unlike emit_mask_scatter() we can't read-modify-write disabled
+       * elements, other threads may be writing to the same buffer.
+       */
+      for (i = 0; i < uint_bld->type.length; i++) {
+         LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+         LLVMValueRef scalar_cond, scalar_ptr, scalar_index, in_bounds;
+         struct lp_build_if_state ifthen;
+
+         scalar_cond = LLVMBuildExtractElement(builder, cond, ii, "");
+         scalar_cond = LLVMBuildICmp(builder, LLVMIntNE, scalar_cond,
+                                     lp_build_const_int32(gallivm, 0), "");
+         if (global) {
+            scalar_ptr = get_global_ptr(bld, address, ii, chan_index,
+                                        LLVMInt32TypeInContext(gallivm->context),
+                                        &in_bounds);
+            scalar_cond = LLVMBuildAnd(builder, scalar_cond, in_bounds, "");
+         }
+         lp_build_if(&ifthen, gallivm, scalar_cond);
+         if (!global) {
+            scalar_index = LLVMBuildExtractElement(builder, index, ii, "");
+            scalar_ptr = LLVMBuildGEP(builder, base_ptr, &scalar_index, 1, "");
+         }
+         LLVMBuildStore(builder,
+                        LLVMBuildExtractElement(builder, value, ii, ""),
+                        scalar_ptr);
+         lp_build_endif(&ifthen);
+      }
+   }
+}
+
+static void
+atomic_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+   struct gallivm_state *gallivm = bld_base->base.gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context *uint_bld = &bld_base->uint_bld;
+   const struct tgsi_full_instruction *inst = emit_data->inst;
+   LLVMAtomicRMWBinOp op = LLVMAtomicRMWBinOpXchg;
+   LLVMValueRef base_ptr = NULL, num_dwords, index = NULL, value, cmp = NULL;
+   LLVMValueRef address = NULL, cond, res_var, res;
+   boolean global = inst->Src[0].Register.Index == TGSI_RESOURCE_GLOBAL;
+   unsigned chan_index, i;
+
+   switch (inst->Instruction.Opcode) {
+   case TGSI_OPCODE_ATOMUADD:
+      op = LLVMAtomicRMWBinOpAdd;
+      break;
+   case TGSI_OPCODE_ATOMXCHG:
+   case TGSI_OPCODE_ATOMCAS:
+      op = LLVMAtomicRMWBinOpXchg;
+      break;
+   case TGSI_OPCODE_ATOMAND:
+      op = LLVMAtomicRMWBinOpAnd;
+      break;
+   case TGSI_OPCODE_ATOMOR:
+      op = LLVMAtomicRMWBinOpOr;
+      break;
+   case TGSI_OPCODE_ATOMXOR:
+      op = LLVMAtomicRMWBinOpXor;
+      break;
+   case TGSI_OPCODE_ATOMUMIN:
+      op = LLVMAtomicRMWBinOpUMin;
+      break;
+   case TGSI_OPCODE_ATOMUMAX:
+      op = LLVMAtomicRMWBinOpUMax;
+      break;
+   case TGSI_OPCODE_ATOMIMIN:
+      op = LLVMAtomicRMWBinOpMin;
+      break;
+   case TGSI_OPCODE_ATOMIMAX:
+      op = LLVMAtomicRMWBinOpMax;
+      break;
+   default:
+      assert(0);
+      break;
+   }
+
+   if (global) {
+      address = get_global_address(bld_base, inst, 1);
+   }
+   else {
+      base_ptr = get_buffer_ptr(bld, inst->Src[0].Register.Index,
+                                LLVMInt32TypeInContext(gallivm->context),
+                                &num_dwords);
+      index = get_buffer_index(bld_base, inst, 1, 0);
+   }
+   value = lp_build_emit_fetch(bld_base, inst, 2, TGSI_CHAN_X);
+   value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+   if (inst->Instruction.Opcode == TGSI_OPCODE_ATOMCAS) {
+      cmp = value;
+      value = lp_build_emit_fetch(bld_base, inst, 3, TGSI_CHAN_X);
+      value = LLVMBuildBitCast(builder, value, uint_bld->vec_type, "");
+   }
+
+   cond = mask_vec(bld_base);
+   if (!global) {
+      cond = LLVMBuildAnd(builder, cond,
+                          lp_build_compare(gallivm, uint_bld->type,
+                                           PIPE_FUNC_LESS, index, num_dwords),
+                          "");
+   }
+
+   /* Disabled and out of bounds elements return zero */
+   res_var = lp_build_alloca(gallivm, uint_bld->vec_type, "atomic_res");
+
+   for (i = 0; i < uint_bld->type.length; i++) {
+      LLVMValueRef ii = lp_build_const_int32(gallivm, i);
+      LLVMValueRef scalar_cond, scalar_ptr, scalar_index, scalar_value;
+      LLVMValueRef scalar_res, in_bounds;
+      struct lp_build_if_state ifthen;
+
+      scalar_cond = LLVMBuildExtractElement(builder, cond, ii, "");
+      scalar_cond = LLVMBuildICmp(builder, LLVMIntNE, scalar_cond,
+                                  lp_build_const_int32(gallivm, 0), "");
+      if (global) {
+         scalar_ptr = get_global_ptr(bld, address, ii, 0,
+                                     LLVMInt32TypeInContext(gallivm->context),
+                                     &in_bounds);
+         scalar_cond = LLVMBuildAnd(builder, scalar_cond, in_bounds, "");
+      }
+      lp_build_if(&ifthen, gallivm, scalar_cond);
+
+      if (!global) {
+         scalar_index = LLVMBuildExtractElement(builder, index, ii, "");
+         scalar_ptr = LLVMBuildGEP(builder, base_ptr, &scalar_index, 1, "");
+      }
+      scalar_value = LLVMBuildExtractElement(builder, value, ii, "");
+
+#if HAVE_LLVM >= 0x0306
+      if (cmp) {
+         scalar_res = LLVMBuildAtomicCmpXchg(builder, scalar_ptr,
+                         LLVMBuildExtractElement(builder, cmp, ii, ""),
+                         scalar_value,
+                         LLVMAtomicOrderingSequentiallyConsistent,
+                         LLVMAtomicOrderingSequentiallyConsistent,
+                         FALSE);
+         scalar_res = LLVMBuildExtractValue(builder, scalar_res, 0, "");
+      }
+      else
+#endif
+      {
+         scalar_res = LLVMBuildAtomicRMW(builder, op, scalar_ptr, scalar_value,
+                                         LLVMAtomicOrderingSequentiallyConsistent,
+                                         FALSE);
+      }
+
+      res = LLVMBuildLoad(builder, res_var, "");
+      res = LLVMBuildInsertElement(builder, res, scalar_res, ii, "");
+      LLVMBuildStore(builder, res, res_var);
+
+      lp_build_endif(&ifthen);
+   }
+
+   res = LLVMBuildLoad(builder, res_var, "");
+   res = LLVMBuildBitCast(builder, res, bld_base->base.vec_type, "");
+   TGSI_FOR_EACH_DST0_ENABLED_CHANNEL(inst, chan_index) {
+      emit_data->output[chan_index] = res;
+   }
+}
+
+static void
+barrier_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+   struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
+
+   /* Barriers are only supported in uniform control flow */
+   assert(!bld->exec_mask.has_mask);
+
+   bld->cs_iface->barrier(bld->cs_iface, bld_base, &bld->system_values);
+
+   /* Switch to the temporaries of the new chunk */
+   bld->temps_array = bld->cs_iface->get_temps(bld->cs_iface, bld_base);
+}
+
+static void
+membar_emit(
+   const struct lp_build_tgsi_action * action,
+   struct lp_build_tgsi_context * bld_base,
+   struct lp_build_emit_data * emit_data)
+{
+#if HAVE_LLVM >= 0x0305
+   LLVMBuildFence(bld_base->base.gallivm->builder,
+                  LLVMAtomicOrderingSequentiallyConsistent, FALSE, "");
+#endif
+}
+
 static void emit_prologue(struct lp_build_tgsi_context * bld_base)
 {
    struct lp_build_tgsi_soa_context * bld = lp_soa_context(bld_base);
    struct gallivm_state * gallivm = bld_base->base.gallivm;
 
    if (bld->indirect_files & (1 << TGSI_FILE_TEMPORARY)) {
-      LLVMValueRef array_size =
-         lp_build_const_int32(gallivm,
-                         bld_base->info->file_max[TGSI_FILE_TEMPORARY] * 4 + 4);
-      bld->temps_array = lp_build_array_alloca(gallivm,
-                                              bld_base->base.vec_type, array_size,
-                                              "temp_array");
+      if (bld->cs_iface && bld_base->info->opcode_count[TGSI_OPCODE_BARRIER]) {
+         bld->temps_array = bld->cs_iface->get_temps(bld->cs_iface, bld_base);
+      }
+      else {
+         LLVMValueRef array_size =
+            lp_build_const_int32(gallivm,
+                            bld_base->info->file_max[TGSI_FILE_TEMPORARY] * 4 + 4);
+         bld->temps_array = lp_build_array_alloca(gallivm,
+                                                 bld_base->base.vec_type, array_size,
+                                                 "temp_array");
+      }
    }
 
    if (bld->indirect_files & (1 << TGSI_FILE_OUTPUT)) {
@@ -3877,7 +4320,8 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                   LLVMValueRef thread_data_ptr,
                   struct lp_build_sampler_soa *sampler,
                   const struct tgsi_shader_info *info,
-                  const struct lp_build_tgsi_gs_iface *gs_iface)
+                  const struct lp_build_tgsi_gs_iface *gs_iface,
+                  const struct lp_build_tgsi_cs_iface *cs_iface)
 {
    struct lp_build_tgsi_soa_context bld;
 
@@ -4017,6 +4461,37 @@ lp_build_tgsi_soa(struct gallivm_state *gallivm,
                                 max_output_vertices);
    }
 
+   if (cs_iface) {
+      bld.cs_iface = cs_iface;
+      bld.bld_base.op_actions[TGSI_OPCODE_LOAD].emit = load_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_STORE].emit = store_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_BARRIER].emit = barrier_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_MEMBAR].emit = membar_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUADD].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXCHG].emit = atomic_emit;
+#if HAVE_LLVM >= 0x0306
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMCAS].emit = atomic_emit;
+#endif
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMAND].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMXOR].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMUMAX].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMIN].emit = atomic_emit;
+      bld.bld_base.op_actions[TGSI_OPCODE_ATOMIMAX].emit = atomic_emit;
+
+      /*
+       * The per-chunk temporaries (see lp_build_tgsi_cs_iface) are
+       * accessed like indirect ones.
+       */
+      if (info->opcode_count[TGSI_OPCODE_BARRIER]) {
+         bld.indirect_files |= (1 << TGSI_FILE_TEMPORARY);
+      }
+
+      /* Kernels may start anywhere in the program, and end at its RET */
+      bld.bld_base.pc = cs_iface->pc;
+   }
+
    lp_exec_mask_init(&bld.exec_mask, &bld.bld_base.int_bld);
 
    bld.system_values = *system_values;
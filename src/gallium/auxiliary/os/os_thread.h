@@ -96,6 +96,27 @@ static inline void pipe_thread_setname( const char *name )
    (void)name;
 }
 
+/**
+ * Pin the calling thread to the given CPU.
+ * Returns FALSE if that's not possible or not supported on this platform.
+ */
+static inline boolean pipe_thread_pin_to_cpu( unsigned cpu )
+{
+#if defined(HAVE_PTHREAD) && defined(PIPE_OS_LINUX) && defined(CPU_SETSIZE)
+   cpu_set_t set;
+
+   if (cpu >= CPU_SETSIZE)
+      return FALSE;
+
+   CPU_ZERO(&set);
+   CPU_SET(cpu, &set);
+   return pthread_setaffinity_np(pthread_self(), sizeof set, &set) == 0;
+#else
+   (void)cpu;
+   return FALSE;
+#endif
+}
+
 
 /* pipe_mutex
  */
@@ -95,7 +95,6 @@
 #include "translate/translate.h"
 #include "translate/translate_cache.h"
 #include "cso_cache/cso_cache.h"
-#include "cso_cache/cso_hash.h"
 
 struct u_vbuf_elements {
    unsigned count;
@@ -329,7 +328,7 @@ u_vbuf_set_vertex_elements_internal(struct u_vbuf *mgr, unsigned count,
 {
    struct pipe_context *pipe = mgr->pipe;
    unsigned key_size, hash_key;
-   struct cso_hash_iter iter;
+   struct cso_velements *found;
    struct u_vbuf_elements *ve;
    struct cso_velems_state velems_state;
 
@@ -339,20 +338,27 @@ u_vbuf_set_vertex_elements_internal(struct u_vbuf *mgr, unsigned count,
    memcpy(velems_state.velems, states,
           sizeof(struct pipe_vertex_element) * count);
    hash_key = cso_construct_key((void*)&velems_state, key_size);
-   iter = cso_find_state_template(mgr->cso_cache, hash_key, CSO_VELEMENTS,
-                                  (void*)&velems_state, key_size);
+   found = cso_find_state_template(mgr->cso_cache, hash_key, CSO_VELEMENTS,
+                                   (void*)&velems_state, key_size);
 
-   if (cso_hash_iter_is_null(iter)) {
+   if (!found) {
       struct cso_velements *cso = MALLOC_STRUCT(cso_velements);
+      if (!cso)
+         return NULL;
+
       memcpy(&cso->state, &velems_state, key_size);
       cso->data = u_vbuf_create_vertex_elements(mgr, count, states);
       cso->delete_state = (cso_state_callback)u_vbuf_delete_vertex_elements;
       cso->context = (void*)mgr;
 
-      iter = cso_insert_state(mgr->cso_cache, hash_key, CSO_VELEMENTS, cso);
+      if (!cso_insert_state(mgr->cso_cache, hash_key, CSO_VELEMENTS, cso)) {
+         u_vbuf_delete_vertex_elements(mgr, cso->data);
+         FREE(cso);
+         return NULL;
+      }
       ve = cso->data;
    } else {
-      ve = ((struct cso_velements *)cso_hash_iter_data(iter))->data;
+      ve = found->data;
    }
 
    assert(ve);
@@ -366,7 +372,13 @@ u_vbuf_set_vertex_elements_internal(struct u_vbuf *mgr, unsigned count,
 void u_vbuf_set_vertex_elements(struct u_vbuf *mgr, unsigned count,
                                const struct pipe_vertex_element *states)
 {
-   mgr->ve = u_vbuf_set_vertex_elements_internal(mgr, count, states);
+   struct u_vbuf_elements *ve;
+
+   ve = u_vbuf_set_vertex_elements_internal(mgr, count, states);
+
+   /* Out of memory, keep the previous elements bound. */
+   if (ve)
+      mgr->ve = ve;
 }
 
 void u_vbuf_destroy(struct u_vbuf *mgr)
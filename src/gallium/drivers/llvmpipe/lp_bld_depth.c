@@ -511,6 +511,127 @@ lp_build_occlusion_count(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Index in a 16-wide swizzled (2x2 quads of 2x2 pixels) vector of the
+ * pixel at column x, row y of the 4x4 block.
+ */
+static inline unsigned
+swizzled_index_4x4(unsigned x, unsigned y)
+{
+   return ((y / 2) * 2 + x / 2) * 4 + (y % 2) * 2 + x % 2;
+}
+
+
+/**
+ * Load the four rows of a 4x4 depth/stencil block, which is processed as
+ * a single 16-wide vector, and swizzle them.  Only the first row exists
+ * for 1d resources.
+ */
+static LLVMValueRef
+lp_build_depth_stencil_load_4x4(struct gallivm_state *gallivm,
+                                struct lp_type zs_type,
+                                boolean is_1d,
+                                LLVMValueRef depth_ptr,
+                                LLVMValueRef depth_stride)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef shuffles[16];
+   LLVMValueRef rows[4];
+   LLVMValueRef lo, hi;
+   struct lp_type row_type = zs_type;
+   LLVMTypeRef row_ptr_type;
+   unsigned x, y;
+
+   assert(zs_type.length == 16);
+
+   row_type.length = 4;
+   row_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, row_type), 0);
+
+   for (y = 0; y < 4; y++) {
+      if (is_1d && y > 0) {
+         rows[y] = lp_build_undef(gallivm, row_type);
+      }
+      else {
+         LLVMValueRef offset = LLVMBuildMul(builder, depth_stride,
+                                            lp_build_const_int32(gallivm, y), "");
+         LLVMValueRef ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+         ptr = LLVMBuildBitCast(builder, ptr, row_ptr_type, "");
+         rows[y] = LLVMBuildLoad(builder, ptr, "");
+      }
+   }
+
+   lo = lp_build_concat(gallivm, &rows[0], row_type, 2);
+   hi = lp_build_concat(gallivm, &rows[2], row_type, 2);
+
+   for (y = 0; y < 4; y++) {
+      for (x = 0; x < 4; x++) {
+         shuffles[swizzled_index_4x4(x, y)] =
+            lp_build_const_int32(gallivm, y * 4 + x);
+      }
+   }
+
+   return LLVMBuildShuffleVector(builder, lo, hi,
+                                 LLVMConstVector(shuffles, 16), "");
+}
+
+
+/**
+ * Counterpart of lp_build_depth_stencil_load_4x4.  For formats wider than
+ * 32 bits the z and s values are interleaved here.
+ */
+static void
+lp_build_depth_stencil_store_4x4(struct gallivm_state *gallivm,
+                                 struct lp_type zs_type,
+                                 boolean is_1d,
+                                 LLVMValueRef depth_ptr,
+                                 LLVMValueRef depth_stride,
+                                 LLVMValueRef z_value,
+                                 LLVMValueRef s_value)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef shuffles[8];
+   struct lp_type row_type = zs_type;
+   LLVMTypeRef row_vec_type;
+   unsigned num_rows = is_1d ? 1 : 4;
+   unsigned x, y;
+
+   assert(zs_type.length == 16);
+
+   row_type.length = 4;
+   row_vec_type = lp_build_vec_type(gallivm, row_type);
+
+   for (y = 0; y < num_rows; y++) {
+      LLVMValueRef offset, ptr, row;
+
+      if (s_value) {
+         for (x = 0; x < 4; x++) {
+            shuffles[x*2 + 0] = lp_build_const_int32(gallivm,
+                                                     swizzled_index_4x4(x, y));
+            shuffles[x*2 + 1] = lp_build_const_int32(gallivm,
+                                                     swizzled_index_4x4(x, y) + 16);
+         }
+         row = LLVMBuildShuffleVector(builder, z_value, s_value,
+                                      LLVMConstVector(shuffles, 8), "");
+         row = LLVMBuildBitCast(builder, row, row_vec_type, "");
+      }
+      else {
+         for (x = 0; x < 4; x++) {
+            shuffles[x] = lp_build_const_int32(gallivm,
+                                               swizzled_index_4x4(x, y));
+         }
+         row = LLVMBuildShuffleVector(builder, z_value, z_value,
+                                      LLVMConstVector(shuffles, 4), "");
+      }
+
+      offset = LLVMBuildMul(builder, depth_stride,
+                            lp_build_const_int32(gallivm, y), "");
+      ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+      ptr = LLVMBuildBitCast(builder, ptr, LLVMPointerType(row_vec_type, 0), "");
+      LLVMBuildStore(builder, row, ptr);
+   }
+}
+
+
 /**
  * Load depth/stencil values.
  * The stored values are linear, swizzle them.
@@ -548,7 +669,12 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
    zs_load_type.length = zs_load_type.length / 2;
    load_ptr_type = LLVMPointerType(lp_build_vec_type(gallivm, zs_load_type), 0);
 
-   if (z_src_type.length == 4) {
+   if (z_src_type.length == 16) {
+      /* The whole 4x4 block at once, there's only one loop iteration */
+      *z_fb = lp_build_depth_stencil_load_4x4(gallivm, zs_type, is_1d,
+                                              depth_ptr, depth_stride);
+   }
+   else if (z_src_type.length == 4) {
       unsigned i;
       LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
                                           lp_build_const_int32(gallivm, 1), "");
@@ -580,23 +706,25 @@ lp_build_depth_stencil_load_swizzled(struct gallivm_state *gallivm,
       }
    }
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+   if (z_src_type.length != 16) {
+      depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
 
-   /* Load current z/stencil values from z/stencil buffer */
-   zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-   zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   if (is_1d) {
-      zs_dst2 = lp_build_undef(gallivm, zs_load_type);
-   }
-   else {
-      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+      /* Load current z/stencil values from z/stencil buffer */
+      zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
       zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
-      zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
-   }
+      zs_dst1 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      if (is_1d) {
+         zs_dst2 = lp_build_undef(gallivm, zs_load_type);
+      }
+      else {
+         zs_dst_ptr = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+         zs_dst_ptr = LLVMBuildBitCast(builder, zs_dst_ptr, load_ptr_type, "");
+         zs_dst2 = LLVMBuildLoad(builder, zs_dst_ptr, "");
+      }
 
-   *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
-                                  LLVMConstVector(shuffles, zs_type.length), "");
+      *z_fb = LLVMBuildShuffleVector(builder, zs_dst1, zs_dst2,
+                                     LLVMConstVector(shuffles, zs_type.length), "");
+   }
    *s_fb = *z_fb;
 
    if (format_desc->block.bits < z_src_type.width) {
@@ -695,7 +823,11 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
     * This is far from ideal, at least for late depth write we should do this
     * outside the fs loop to avoid all the swizzle stuff.
     */
-   if (z_src_type.length == 4) {
+   if (z_src_type.length == 16) {
+      /* handled below, once the values are final */
+      depth_offset1 = NULL;
+   }
+   else if (z_src_type.length == 4) {
       LLVMValueRef looplsb = LLVMBuildAnd(builder, loop_counter,
                                           lp_build_const_int32(gallivm, 1), "");
       LLVMValueRef loopmsb = LLVMBuildAnd(builder, loop_counter,
@@ -721,13 +853,6 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
       }
    }
 
-   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
-
-   zs_dst_ptr1 = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
-   zs_dst_ptr1 = LLVMBuildBitCast(builder, zs_dst_ptr1, load_ptr_type, "");
-   zs_dst_ptr2 = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
-   zs_dst_ptr2 = LLVMBuildBitCast(builder, zs_dst_ptr2, load_ptr_type, "");
-
    if (format_desc->block.bits > 32) {
       s_value = LLVMBuildBitCast(builder, s_value, z_bld.vec_type, "");
    }
@@ -747,6 +872,22 @@ lp_build_depth_stencil_write_swizzled(struct gallivm_state *gallivm,
                                lp_build_int_vec_type(gallivm, zs_type), "");
    }
 
+   if (z_src_type.length == 16) {
+      lp_build_depth_stencil_store_4x4(gallivm, zs_type, is_1d,
+                                       depth_ptr, depth_stride,
+                                       z_value,
+                                       format_desc->block.bits > 32 ?
+                                          s_value : NULL);
+      return;
+   }
+
+   depth_offset2 = LLVMBuildAdd(builder, depth_offset1, depth_stride, "");
+
+   zs_dst_ptr1 = LLVMBuildGEP(builder, depth_ptr, &depth_offset1, 1, "");
+   zs_dst_ptr1 = LLVMBuildBitCast(builder, zs_dst_ptr1, load_ptr_type, "");
+   zs_dst_ptr2 = LLVMBuildGEP(builder, depth_ptr, &depth_offset2, 1, "");
+   zs_dst_ptr2 = LLVMBuildBitCast(builder, zs_dst_ptr2, load_ptr_type, "");
+
    if (format_desc->block.bits <= 32) {
       if (z_src_type.length == 4) {
          zs_dst1 = lp_build_extract_range(gallivm, z_value, 0, 2);
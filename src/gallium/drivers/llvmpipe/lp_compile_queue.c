@@ -0,0 +1,233 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Compile queue: a small pool of threads running LLVM compilations in the
+ * background, so that expensive shader variants don't have to be
+ * compiled on the draw path.
+ */
+
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "os/os_thread.h"
+#include "gallivm/lp_bld_init.h"
+#include "lp_limits.h"
+#include "lp_compile_queue.h"
+
+
+struct lp_compile_queue
+{
+   /** FIFO of queued jobs */
+   struct lp_compile_job *head, *tail;
+
+   pipe_mutex mutex;
+   pipe_condvar work_cond;   /**< signalled when a job is queued */
+   pipe_condvar done_cond;   /**< signalled when a job completes */
+   boolean exit;
+
+   unsigned num_threads;
+   pipe_thread threads[LP_MAX_THREADS];
+};
+
+
+static PIPE_THREAD_ROUTINE( compile_thread_function, init_data )
+{
+   struct lp_compile_queue *queue = (struct lp_compile_queue *) init_data;
+   LLVMContextRef context;
+
+   pipe_thread_setname("llvmpipe-cc");
+
+   context = LLVMContextCreate();
+
+   pipe_mutex_lock(queue->mutex);
+
+   while (1) {
+      struct lp_compile_job *job;
+
+      while (!queue->head && !queue->exit)
+         pipe_condvar_wait(queue->work_cond, queue->mutex);
+
+      if (queue->exit)
+         break;
+
+      job = queue->head;
+      queue->head = job->next;
+      if (!queue->head)
+         queue->tail = NULL;
+      job->next = NULL;
+      job->state = LP_COMPILE_JOB_RUNNING;
+
+      pipe_mutex_unlock(queue->mutex);
+
+      job->func(job, context);
+
+      pipe_mutex_lock(queue->mutex);
+      job->state = LP_COMPILE_JOB_DONE;
+      pipe_condvar_broadcast(queue->done_cond);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+
+   LLVMContextDispose(context);
+
+   return 0;
+}
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads)
+{
+   struct lp_compile_queue *queue;
+   unsigned i;
+
+   assert(num_threads > 0);
+
+   queue = CALLOC_STRUCT(lp_compile_queue);
+   if (!queue)
+      return NULL;
+
+   pipe_mutex_init(queue->mutex);
+   pipe_condvar_init(queue->work_cond);
+   pipe_condvar_init(queue->done_cond);
+
+   /* Make sure LLVM is initialized before any thread uses it */
+   lp_build_init();
+
+   num_threads = MIN2(num_threads, LP_MAX_THREADS);
+   for (i = 0; i < num_threads; i++) {
+      queue->threads[i] = pipe_thread_create(compile_thread_function, queue);
+      if (!queue->threads[i])
+         break;
+   }
+   queue->num_threads = i;
+
+   if (!queue->num_threads) {
+      lp_compile_queue_destroy(queue);
+      return NULL;
+   }
+
+   return queue;
+}
+
+
+/**
+ * Wait for the running jobs to finish and destroy the queue.  Jobs still
+ * queued are left untouched: their owners must have cancelled them.
+ */
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue)
+{
+   unsigned i;
+
+   assert(!queue->head);
+
+   pipe_mutex_lock(queue->mutex);
+   queue->exit = TRUE;
+   pipe_condvar_broadcast(queue->work_cond);
+   pipe_mutex_unlock(queue->mutex);
+
+   for (i = 0; i < queue->num_threads; i++) {
+      pipe_thread_wait(queue->threads[i]);
+   }
+
+   pipe_condvar_destroy(queue->done_cond);
+   pipe_condvar_destroy(queue->work_cond);
+   pipe_mutex_destroy(queue->mutex);
+   FREE(queue);
+}
+
+
+void
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_compile_job *job)
+{
+   job->state = LP_COMPILE_JOB_QUEUED;
+   job->next = NULL;
+
+   pipe_mutex_lock(queue->mutex);
+   if (queue->tail)
+      queue->tail->next = job;
+   else
+      queue->head = job;
+   queue->tail = job;
+   pipe_condvar_signal(queue->work_cond);
+   pipe_mutex_unlock(queue->mutex);
+}
+
+
+/**
+ * Has the job finished running?  Never blocks.
+ */
+boolean
+lp_compile_job_is_done(struct lp_compile_queue *queue,
+                       struct lp_compile_job *job)
+{
+   boolean done;
+
+   pipe_mutex_lock(queue->mutex);
+   done = job->state == LP_COMPILE_JOB_DONE;
+   pipe_mutex_unlock(queue->mutex);
+
+   return done;
+}
+
+
+/**
+ * Remove the job from the queue if it hasn't started yet, otherwise wait
+ * for it to finish.  Either way the queue no longer references the job
+ * afterwards, and its state tells whether it ran.
+ */
+void
+lp_compile_job_cancel(struct lp_compile_queue *queue,
+                      struct lp_compile_job *job)
+{
+   pipe_mutex_lock(queue->mutex);
+
+   if (job->state == LP_COMPILE_JOB_QUEUED) {
+      struct lp_compile_job **prev = &queue->head;
+
+      queue->tail = NULL;
+      while (*prev) {
+         if (*prev == job) {
+            *prev = job->next;
+         }
+         else {
+            queue->tail = *prev;
+            prev = &(*prev)->next;
+         }
+      }
+      job->next = NULL;
+      job->state = LP_COMPILE_JOB_CANCELLED;
+   }
+   else {
+      while (job->state == LP_COMPILE_JOB_RUNNING)
+         pipe_condvar_wait(queue->done_cond, queue->mutex);
+   }
+
+   pipe_mutex_unlock(queue->mutex);
+}
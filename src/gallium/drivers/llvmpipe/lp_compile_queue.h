@@ -0,0 +1,87 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+
+#ifndef LP_COMPILE_QUEUE_H
+#define LP_COMPILE_QUEUE_H
+
+#include "pipe/p_compiler.h"
+#include "gallivm/lp_bld.h"
+
+
+struct lp_compile_queue;
+struct lp_compile_job;
+
+
+/**
+ * Run on a compile thread.  Each thread has its own LLVM context, as
+ * LLVM contexts can't be shared between threads.
+ */
+typedef void (*lp_compile_func)(struct lp_compile_job *job,
+                                LLVMContextRef context);
+
+
+enum lp_compile_job_state {
+   LP_COMPILE_JOB_QUEUED,
+   LP_COMPILE_JOB_RUNNING,
+   LP_COMPILE_JOB_DONE,
+   LP_COMPILE_JOB_CANCELLED
+};
+
+
+/**
+ * A unit of work for the compile threads.  Usually embedded in a larger
+ * structure holding the job's inputs and results.
+ */
+struct lp_compile_job {
+   lp_compile_func func;
+   enum lp_compile_job_state state;
+   struct lp_compile_job *next;
+};
+
+
+struct lp_compile_queue *
+lp_compile_queue_create(unsigned num_threads);
+
+void
+lp_compile_queue_destroy(struct lp_compile_queue *queue);
+
+void
+lp_compile_queue_add(struct lp_compile_queue *queue,
+                     struct lp_compile_job *job);
+
+boolean
+lp_compile_job_is_done(struct lp_compile_queue *queue,
+                       struct lp_compile_job *job);
+
+void
+lp_compile_job_cancel(struct lp_compile_queue *queue,
+                      struct lp_compile_job *job);
+
+
+#endif /* LP_COMPILE_QUEUE_H */
@@ -30,6 +30,7 @@
  *    Keith Whitwell <keithw@vmware.com>
  */
 
+#include "cso_cache/cso_hash.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
 #include "pipe/p_defines.h"
@@ -44,6 +45,7 @@
 #include "lp_state.h"
 #include "lp_surface.h"
 #include "lp_query.h"
+#include "lp_screen.h"
 #include "lp_setup.h"
 
 /* This is only safe if there's just one concurrent context */
@@ -95,7 +97,26 @@ static void llvmpipe_destroy( struct pipe_context *pipe )
       pipe_resource_reference(&llvmpipe->vertex_buffer[i].buffer, NULL);
    }
 
+   for (i = 0; i < Elements(llvmpipe->shader_buffers); i++) {
+      pipe_resource_reference(&llvmpipe->shader_buffers[i].buffer, NULL);
+   }
+
+   for (i = 0; i < Elements(llvmpipe->global_buffers); i++) {
+      pipe_resource_reference(&llvmpipe->global_buffers[i], NULL);
+   }
+
+   /* Don't leave compile threads working on our variants */
+   llvmpipe_poll_fs_compiles(llvmpipe, TRUE);
+
+   /* lp_setup_destroy() flushed the last scene and waited for every scene
+    * to be rasterized, so no scene holds a variant reference any more.
+    */
+   llvmpipe_sweep_shader_variants(llvmpipe);
+   assert(is_empty_list(&llvmpipe->fs_variants_retired));
+
    lp_delete_setup_variants(llvmpipe);
+   if (llvmpipe->setup_variants_hash)
+      cso_hash_delete(llvmpipe->setup_variants_hash);
 
 #ifndef USE_GLOBAL_LLVM_CONTEXT
    LLVMContextDispose(llvmpipe->context);
@@ -142,6 +163,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    memset(llvmpipe, 0, sizeof *llvmpipe);
 
    make_empty_list(&llvmpipe->fs_variants_list);
+   make_empty_list(&llvmpipe->fs_variants_retired);
+   make_empty_list(&llvmpipe->fs_variants_pending);
 
    make_empty_list(&llvmpipe->setup_variants_list);
 
@@ -167,6 +190,7 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    llvmpipe_init_fs_funcs(llvmpipe);
    llvmpipe_init_vs_funcs(llvmpipe);
    llvmpipe_init_gs_funcs(llvmpipe);
+   llvmpipe_init_cs_funcs(llvmpipe);
    llvmpipe_init_rasterizer_funcs(llvmpipe);
    llvmpipe_init_context_resource_funcs( &llvmpipe->pipe );
    llvmpipe_init_surface_functions(llvmpipe);
@@ -180,6 +204,10 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context)
       goto fail;
 
+   llvmpipe->setup_variants_hash = cso_hash_create();
+   if (!llvmpipe->setup_variants_hash)
+      goto fail;
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -188,6 +216,10 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->draw)
       goto fail;
 
+   /* Vertex shading of big draws can use as many threads as rasterization */
+   draw_set_num_threads(llvmpipe->draw,
+                        llvmpipe_screen(screen)->num_threads);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create( &llvmpipe->pipe,
@@ -43,11 +43,13 @@
 #include "lp_state_setup.h"
 
 
+struct cso_hash;
 struct llvmpipe_vbuf_render;
 struct draw_context;
 struct draw_stage;
 struct draw_vertex_shader;
 struct lp_fragment_shader;
+struct lp_compute_shader;
 struct lp_blend_state;
 struct lp_setup_context;
 struct lp_setup_variant;
@@ -65,6 +67,7 @@ struct llvmpipe_context {
    struct lp_fragment_shader *fs;
    struct draw_vertex_shader *vs;
    const struct lp_geometry_shader *gs;
+   struct lp_compute_shader *cs;
    const struct lp_velems_state *velems;
    const struct lp_so_state *so;
 
@@ -78,6 +81,10 @@ struct llvmpipe_context {
    struct pipe_poly_stipple poly_stipple;
    struct pipe_scissor_state scissors[PIPE_MAX_VIEWPORTS];
    struct pipe_sampler_view *sampler_views[PIPE_SHADER_TYPES][PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   /** Shader buffers, only supported for compute shaders */
+   struct pipe_shader_buffer shader_buffers[PIPE_MAX_SHADER_BUFFERS];
+   /** Buffers bound with set_global_binding, slot i + 1 of the addresses */
+   struct pipe_resource *global_buffers[LP_MAX_CS_GLOBAL_BUFFERS];
 
    struct pipe_viewport_state viewports[PIPE_MAX_VIEWPORTS];
    struct pipe_vertex_buffer vertex_buffer[PIPE_MAX_ATTRIBS];
@@ -142,11 +149,18 @@ struct llvmpipe_context {
    /** List of all fragment shader variants */
    struct lp_fs_variant_list_item fs_variants_list;
    unsigned nr_fs_variants;
+   /** Evicted variants waiting for the scenes using them to retire */
+   struct lp_fs_variant_list_item fs_variants_retired;
+   /** Variants whose optimized code is being compiled in the background */
+   struct lp_fs_variant_list_item fs_variants_pending;
    unsigned nr_fs_instrs;
 
    struct lp_setup_variant_list_item setup_variants_list;
    unsigned nr_setup_variants;
 
+   /** The setup variants above, indexed by the hash of their key */
+   struct cso_hash *setup_variants_hash;
+
    /** Conditional query object and mode */
    struct pipe_query *render_cond_query;
    uint render_cond_mode;
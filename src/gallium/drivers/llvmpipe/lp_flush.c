@@ -38,6 +38,7 @@
 #include "lp_flush.h"
 #include "lp_context.h"
 #include "lp_setup.h"
+#include "lp_state_fs.h"
 
 
 /**
@@ -55,6 +56,9 @@ llvmpipe_flush( struct pipe_context *pipe,
    /* ask the setup module to flush */
    lp_setup_flush(llvmpipe->setup, fence, reason);
 
+   /* Reclaim the retired shader variants of the scenes rasterized by now */
+   llvmpipe_sweep_shader_variants(llvmpipe);
+
    /* Enable to dump BMPs of the color/depth buffers each frame */
    if (0) {
       static unsigned frame_no = 1;
@@ -39,6 +39,7 @@
 #include "gallivm/lp_bld_format.h"
 #include "lp_context.h"
 #include "lp_jit.h"
+#include "lp_state_cs.h"
 
 
 static void
@@ -82,6 +83,7 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       elem_types[LP_JIT_TEXTURE_IMG_STRIDE] =
       elem_types[LP_JIT_TEXTURE_MIP_OFFSETS] =
          LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TEXTURE_LEVELS);
+      elem_types[LP_JIT_TEXTURE_SAMPLE_STRIDE] = LLVMInt32TypeInContext(lc);
 
       texture_type = LLVMStructTypeInContext(lc, elem_types,
                                              Elements(elem_types), 0);
@@ -113,6 +115,9 @@ lp_jit_create_types(struct lp_fragment_shader_variant *lp)
       LP_CHECK_MEMBER_OFFSET(struct lp_jit_texture, mip_offsets,
                              gallivm->target, texture_type,
                              LP_JIT_TEXTURE_MIP_OFFSETS);
+      LP_CHECK_MEMBER_OFFSET(struct lp_jit_texture, sample_stride,
+                             gallivm->target, texture_type,
+                             LP_JIT_TEXTURE_SAMPLE_STRIDE);
       LP_CHECK_STRUCT_SIZE(struct lp_jit_texture,
                            gallivm->target, texture_type);
    }
@@ -247,3 +252,73 @@ lp_jit_init_types(struct lp_fragment_shader_variant *lp)
    if (!lp->jit_context_ptr_type)
       lp_jit_create_types(lp);
 }
+
+
+static void
+lp_jit_create_cs_types(struct lp_compute_shader_variant *lp)
+{
+   struct gallivm_state *gallivm = lp->gallivm;
+   LLVMContextRef lc = gallivm->context;
+   LLVMTypeRef elem_types[LP_JIT_CS_CTX_COUNT];
+   LLVMTypeRef context_type;
+
+   elem_types[LP_JIT_CS_CTX_CONSTANTS] =
+      LLVMArrayType(LLVMPointerType(LLVMFloatTypeInContext(lc), 0), LP_MAX_TGSI_CONST_BUFFERS);
+   elem_types[LP_JIT_CS_CTX_NUM_CONSTANTS] =
+         LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_TGSI_CONST_BUFFERS);
+   elem_types[LP_JIT_CS_CTX_BUFFERS] =
+      LLVMArrayType(LLVMPointerType(LLVMInt8TypeInContext(lc), 0), PIPE_MAX_SHADER_BUFFERS);
+   elem_types[LP_JIT_CS_CTX_BUFFER_SIZES] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), PIPE_MAX_SHADER_BUFFERS);
+   elem_types[LP_JIT_CS_CTX_INPUT] = LLVMPointerType(LLVMInt8TypeInContext(lc), 0);
+   elem_types[LP_JIT_CS_CTX_INPUT_SIZE] = LLVMInt32TypeInContext(lc);
+   elem_types[LP_JIT_CS_CTX_GLOBAL_BUFFERS] =
+      LLVMArrayType(LLVMPointerType(LLVMInt8TypeInContext(lc), 0),
+                    LP_MAX_CS_GLOBAL_BUFFERS + 1);
+   elem_types[LP_JIT_CS_CTX_GLOBAL_BUFFER_SIZES] =
+      LLVMArrayType(LLVMInt32TypeInContext(lc), LP_MAX_CS_GLOBAL_BUFFERS + 1);
+
+   context_type = LLVMStructTypeInContext(lc, elem_types,
+                                          Elements(elem_types), 0);
+
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, constants,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_CONSTANTS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, num_constants,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_NUM_CONSTANTS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, buffers,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_BUFFERS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, buffer_sizes,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_BUFFER_SIZES);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, input,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_INPUT);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, input_size,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_INPUT_SIZE);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, global_buffers,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_GLOBAL_BUFFERS);
+   LP_CHECK_MEMBER_OFFSET(struct lp_jit_cs_context, global_buffer_sizes,
+                          gallivm->target, context_type,
+                          LP_JIT_CS_CTX_GLOBAL_BUFFER_SIZES);
+   LP_CHECK_STRUCT_SIZE(struct lp_jit_cs_context,
+                        gallivm->target, context_type);
+
+   lp->jit_context_ptr_type = LLVMPointerType(context_type, 0);
+
+   if (gallivm_debug & GALLIVM_DEBUG_IR) {
+      LLVMDumpModule(gallivm->module);
+   }
+}
+
+
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp)
+{
+   if (!lp->jit_context_ptr_type)
+      lp_jit_create_cs_types(lp);
+}
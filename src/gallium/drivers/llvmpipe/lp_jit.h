@@ -45,6 +45,7 @@
 
 struct lp_build_format_cache;
 struct lp_fragment_shader_variant;
+struct lp_compute_shader_variant;
 struct llvmpipe_screen;
 
 
@@ -59,6 +60,7 @@ struct lp_jit_texture
    uint32_t row_stride[LP_MAX_TEXTURE_LEVELS];
    uint32_t img_stride[LP_MAX_TEXTURE_LEVELS];
    uint32_t mip_offsets[LP_MAX_TEXTURE_LEVELS];
+   uint32_t sample_stride;  /* for multisample textures */
 };
 
 
@@ -88,6 +90,7 @@ enum {
    LP_JIT_TEXTURE_ROW_STRIDE,
    LP_JIT_TEXTURE_IMG_STRIDE,
    LP_JIT_TEXTURE_MIP_OFFSETS,
+   LP_JIT_TEXTURE_SAMPLE_STRIDE,
    LP_JIT_TEXTURE_NUM_FIELDS  /* number of fields above */
 };
 
@@ -233,10 +236,12 @@ enum {
  * @param dady          shader input dady
  * @param color         color buffer
  * @param depth         depth buffer
- * @param mask          mask of visible pixels in block
+ * @param mask          mask of visible pixels in block, 16 bits per sample
  * @param thread_data   task thread data
  * @param stride        color buffer row stride in bytes
  * @param depth_stride  depth buffer row stride in bytes
+ * @param sample_stride color buffer sample stride in bytes
+ * @param depth_sample_stride  depth buffer sample stride in bytes
  */
 typedef void
 (*lp_jit_frag_func)(const struct lp_jit_context *context,
@@ -248,10 +253,107 @@ typedef void
                     const void *dady,
                     uint8_t **color,
                     uint8_t *depth,
-                    uint32_t mask,
+                    uint64_t mask,
                     struct lp_jit_thread_data *thread_data,
                     unsigned *stride,
-                    unsigned depth_stride);
+                    unsigned depth_stride,
+                    unsigned *sample_stride,
+                    unsigned depth_sample_stride);
+
+
+/**
+ * This structure is passed directly to the generated compute shader.
+ *
+ * Changes here must be reflected in the lp_jit_cs_context_* macros and
+ * lp_jit_init_cs_types function.
+ */
+struct lp_jit_cs_context
+{
+   const float *constants[LP_MAX_TGSI_CONST_BUFFERS];
+   int num_constants[LP_MAX_TGSI_CONST_BUFFERS];
+
+   /** Shader buffers, a dummy buffer of zero size when unbound */
+   const void *buffers[PIPE_MAX_SHADER_BUFFERS];
+   uint32_t buffer_sizes[PIPE_MAX_SHADER_BUFFERS];
+
+   /** The INPUT resource passed to launch_grid */
+   const void *input;
+   uint32_t input_size;
+
+   /**
+    * Global buffers, indexed by the top bits of a TGSI_RESOURCE_GLOBAL
+    * address.  Unused slots are a dummy buffer of zero size.
+    */
+   const void *global_buffers[LP_MAX_CS_GLOBAL_BUFFERS + 1];
+   uint32_t global_buffer_sizes[LP_MAX_CS_GLOBAL_BUFFERS + 1];
+};
+
+
+/**
+ * These enum values must match the position of the fields in the
+ * lp_jit_cs_context struct above.
+ */
+enum {
+   LP_JIT_CS_CTX_CONSTANTS = 0,
+   LP_JIT_CS_CTX_NUM_CONSTANTS,
+   LP_JIT_CS_CTX_BUFFERS,
+   LP_JIT_CS_CTX_BUFFER_SIZES,
+   LP_JIT_CS_CTX_INPUT,
+   LP_JIT_CS_CTX_INPUT_SIZE,
+   LP_JIT_CS_CTX_GLOBAL_BUFFERS,
+   LP_JIT_CS_CTX_GLOBAL_BUFFER_SIZES,
+   LP_JIT_CS_CTX_COUNT
+};
+
+
+#define lp_jit_cs_context_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_CONSTANTS, "constants")
+
+#define lp_jit_cs_context_num_constants(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_NUM_CONSTANTS, "num_constants")
+
+#define lp_jit_cs_context_buffers(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_BUFFERS, "buffers")
+
+#define lp_jit_cs_context_buffer_sizes(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_BUFFER_SIZES, "buffer_sizes")
+
+#define lp_jit_cs_context_input(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_INPUT, "input")
+
+#define lp_jit_cs_context_input_size(_gallivm, _ptr) \
+   lp_build_struct_get(_gallivm, _ptr, LP_JIT_CS_CTX_INPUT_SIZE, "input_size")
+
+#define lp_jit_cs_context_global_buffers(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GLOBAL_BUFFERS, "global_buffers")
+
+#define lp_jit_cs_context_global_buffer_sizes(_gallivm, _ptr) \
+   lp_build_struct_get_ptr(_gallivm, _ptr, LP_JIT_CS_CTX_GLOBAL_BUFFER_SIZES, "global_buffer_sizes")
+
+
+/**
+ * typedef for compute shader function, running one work group
+ *
+ * @param context       jit context
+ * @param block_id_x    work group x
+ * @param block_id_y    work group y
+ * @param block_id_z    work group z
+ * @param grid_size_x   number of work groups in x
+ * @param grid_size_y   number of work groups in y
+ * @param grid_size_z   number of work groups in z
+ * @param shared_mem    the LOCAL resource of the work group
+ * @param temps         per chunk temporaries, for shaders with barriers
+ */
+typedef void
+(*lp_jit_cs_func)(const struct lp_jit_cs_context *context,
+                  uint32_t block_id_x,
+                  uint32_t block_id_y,
+                  uint32_t block_id_z,
+                  uint32_t grid_size_x,
+                  uint32_t grid_size_y,
+                  uint32_t grid_size_z,
+                  uint8_t *shared_mem,
+                  void *temps);
 
 
 void
@@ -266,4 +368,8 @@ void
 lp_jit_init_types(struct lp_fragment_shader_variant *lp);
 
 
+void
+lp_jit_init_cs_types(struct lp_compute_shader_variant *lp);
+
+
 #endif /* LP_JIT_H */
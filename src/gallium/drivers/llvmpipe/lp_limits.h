@@ -40,6 +40,29 @@
 #define TILE_SIZE (1 << TILE_ORDER)
 
 
+/**
+ * Scene bins are square, between TILE_SIZE and 1 << LP_MAX_BIN_ORDER
+ * pixels wide.  A bin larger than a tile is rasterized one tile at a time.
+ * The bin size is picked per scene, see lp_scene_begin_binning() and
+ * LP_BIN_SIZE.
+ */
+#define LP_MAX_BIN_ORDER 8
+
+
+/**
+ * Bins are only made larger while there are at least this many of them
+ * per rasterizer thread, so that the threads stay load balanced.
+ */
+#define LP_MIN_BINS_PER_THREAD 64
+
+
+/**
+ * Number of samples of multisample surfaces.  Only this one sample
+ * count is supported, at the standard 4x sample positions.
+ */
+#define LP_MAX_SAMPLES 4
+
+
 /**
  * Max texture sizes
  */
@@ -61,7 +84,48 @@
 #define LP_MAX_WIDTH  (1 << (LP_MAX_TEXTURE_LEVELS - 1))
 
 
-#define LP_MAX_THREADS 16
+/**
+ * Max number of rasterizer threads.  The default is the number of CPUs
+ * we're allowed to run on, see LP_NUM_THREADS and LP_CPUS.
+ */
+#define LP_MAX_THREADS 128
+
+
+/**
+ * Compute shader limits.  The threads of a work group are run on one
+ * rasterizer thread, one SIMD vector at a time.
+ */
+#define LP_MAX_CS_THREADS_PER_BLOCK 1024
+#define LP_MAX_CS_LOCAL_SIZE (32 * 1024)
+#define LP_MAX_CS_INPUT_SIZE 4096
+
+/** Work groups are handed out with a 32-bit atomic counter */
+#define LP_MAX_CS_BLOCKS_PER_GRID 0x7fffffff
+
+/**
+ * Advertised grid size per dimension.  The product must not exceed
+ * LP_MAX_CS_BLOCKS_PER_GRID, so that every grid within these limits
+ * can be launched.
+ */
+#define LP_MAX_CS_GRID_SIZE_X 65535
+#define LP_MAX_CS_GRID_SIZE_Y 1023
+#define LP_MAX_CS_GRID_SIZE_Z 32
+
+/**
+ * TGSI_RESOURCE_GLOBAL addresses are 32 bits: the top bits select one of
+ * the buffers bound with set_global_binding (slot 0 is the null pointer),
+ * the low LP_CS_GLOBAL_OFFSET_BITS are the byte offset in that buffer.
+ */
+#define LP_CS_GLOBAL_OFFSET_BITS 28
+#define LP_MAX_CS_GLOBAL_BUFFERS ((1 << (32 - LP_CS_GLOBAL_OFFSET_BITS)) - 1)
+
+
+/**
+ * Max number of scenes per context.  The number actually in use is
+ * set with LP_NUM_SCENES; with more than one, binning of a scene can
+ * overlap with rasterization of the previous ones.
+ */
+#define LP_MAX_SCENES 4
 
 
 /**
@@ -26,6 +26,7 @@
  **************************************************************************/
 
 #include "util/u_debug.h"
+#include "gallivm/lp_bld_cache.h"
 #include "lp_debug.h"
 #include "lp_perf.h"
 
@@ -106,5 +107,15 @@ lp_print_counters(void)
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      {
+         struct gallivm_cache_stats stats;
+         gallivm_cache_get_stats(&stats);
+         debug_printf("llvmpipe: gallivm cache hits:           %9u\n", stats.hits);
+         debug_printf("llvmpipe: gallivm cache misses:         %9u\n", stats.misses);
+         debug_printf("llvmpipe: gallivm cache stores:         %9u\n", stats.stores);
+         debug_printf("llvmpipe: gallivm cache evictions:      %9u\n", stats.evictions);
+         debug_printf("llvmpipe: gallivm cache uncacheable:    %9u\n", stats.uncacheable);
+      }
+
    }
 }
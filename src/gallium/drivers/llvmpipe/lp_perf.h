@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "pipe/p_compiler.h"
+#include "pipe/p_defines.h"
 
 /**
  * Various counters
@@ -68,6 +69,64 @@ struct lp_counters
 extern struct lp_counters lp_count;
 
 
+/**
+ * Counters which are collected in release builds too, and are exposed
+ * as driver queries for the HUD and GL_AMD_performance_monitor, see
+ * llvmpipe_get_driver_query_info().
+ *
+ * The setup counters live in the setup context and are only touched by
+ * the binning thread.  The rasterizer counters are kept per thread in
+ * the rasterizer task; they're cleared at the start of each tile and
+ * summed into the active queries at its end, like the occlusion counters.
+ */
+enum lp_perf_counter
+{
+   LP_PERF_TRIS,                  /**< binned triangles, lines and points */
+   LP_PERF_CULLED_TRIS,
+   LP_PERF_EMPTY_64,
+   LP_PERF_PARTIALLY_COVERED_64,
+   LP_PERF_FULLY_COVERED_64,
+   LP_PERF_SHADE_OPAQUE_64,       /**< opaque whole tile fast path */
+   LP_PERF_SCENE_BYTES,
+   LP_PERF_SCENE_PEAK_BYTES,      /**< largest scene so far, not a sum */
+   LP_PERF_SCENE_BLOCK_ALLOCS,    /**< scene data blocks not recycled */
+   LP_PERF_SCENE_WAITS,           /**< setup waited for a free scene */
+
+   LP_PERF_FIRST_RAST,
+   LP_PERF_EMPTY_16 = LP_PERF_FIRST_RAST,
+   LP_PERF_PARTIALLY_COVERED_16,
+   LP_PERF_FULLY_COVERED_16,
+   LP_PERF_EMPTY_4,
+   LP_PERF_PARTIALLY_COVERED_4,
+   LP_PERF_FULLY_COVERED_4,
+   LP_PERF_HIZ_TESTED_16,         /**< 16x16 blocks checked against hiz */
+   LP_PERF_HIZ_REJECTED_16,       /**< 16x16 blocks rejected by hiz */
+   LP_PERF_RAST_TIME,             /**< rasterizer busy time, nanoseconds */
+
+   LP_PERF_COUNTERS
+};
+
+
+/** Driver specific query type of a perf counter, and vice versa */
+#define LP_QUERY_PERF(counter) (PIPE_QUERY_DRIVER_SPECIFIC + (counter))
+#define LP_QUERY_PERF_COUNTER(query_type) \
+   ((enum lp_perf_counter)((query_type) - PIPE_QUERY_DRIVER_SPECIFIC))
+
+static inline boolean
+lp_query_is_perf(unsigned query_type)
+{
+   return query_type >= LP_QUERY_PERF(0) &&
+          query_type < LP_QUERY_PERF(LP_PERF_COUNTERS);
+}
+
+static inline boolean
+lp_query_is_rast_perf(unsigned query_type)
+{
+   return query_type >= LP_QUERY_PERF(LP_PERF_FIRST_RAST) &&
+          query_type < LP_QUERY_PERF(LP_PERF_COUNTERS);
+}
+
+
 /** Increment the named counter (only for debug builds) */
 #ifdef DEBUG
 #define LP_COUNT(counter) lp_count.counter++
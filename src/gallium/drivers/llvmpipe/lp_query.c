@@ -37,6 +37,7 @@
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_fence.h"
+#include "lp_perf.h"
 #include "lp_query.h"
 #include "lp_screen.h"
 #include "lp_state.h"
@@ -55,7 +56,7 @@ llvmpipe_create_query(struct pipe_context *pipe,
 {
    struct llvmpipe_query *pq;
 
-   assert(type < PIPE_QUERY_TYPES);
+   assert(type < PIPE_QUERY_TYPES || lp_query_is_perf(type));
 
    pq = CALLOC_STRUCT( llvmpipe_query );
 
@@ -176,7 +177,14 @@ llvmpipe_get_query_result(struct pipe_context *pipe,
    }
       break;
    default:
-      assert(0);
+      assert(lp_query_is_perf(pq->type));
+      /* setup counters only use the first slot */
+      for (i = 0; i < num_threads; i++) {
+         *result += pq->end[i];
+      }
+      if (pq->type == LP_QUERY_PERF(LP_PERF_RAST_TIME)) {
+         *result /= 1000; /* microseconds */
+      }
       break;
    }
 
@@ -198,6 +206,13 @@ llvmpipe_begin_query(struct pipe_context *pipe, struct pipe_query *q)
       llvmpipe_finish(pipe, __FUNCTION__);
    }
 
+   /* A previously issued scene may still be rasterizing and writing
+    * the per-thread results we're about to reset.
+    */
+   if (pq->fence && !lp_fence_signalled(pq->fence)) {
+      lp_fence_wait(pq->fence);
+   }
+
 
    memset(pq->start, 0, sizeof(pq->start));
    memset(pq->end, 0, sizeof(pq->end));
@@ -49,6 +49,14 @@
 #include "lp_tex_sample.h"
 
 
+const int lp_sample_pos_4x[LP_MAX_SAMPLES][2] = {
+   { FIXED_ONE * 3 / 8, FIXED_ONE * 1 / 8 },
+   { FIXED_ONE * 7 / 8, FIXED_ONE * 3 / 8 },
+   { FIXED_ONE * 1 / 8, FIXED_ONE * 5 / 8 },
+   { FIXED_ONE * 5 / 8, FIXED_ONE * 7 / 8 }
+};
+
+
 #ifdef DEBUG
 int jit_line = 0;
 const struct lp_rast_state *jit_state = NULL;
@@ -73,12 +81,36 @@ lp_rast_begin( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * End rasterizing a scene.
+ * Called once per scene by one thread, after all threads are done with it.
+ * The scene's fence is only signalled once the scene has been released,
+ * as the setup code may start binning into it again right away.
+ */
 static void
 lp_rast_end( struct lp_rasterizer *rast )
 {
+   struct lp_fence *fence = NULL;
+
+   if (LP_DEBUG & DEBUG_SCENE) {
+      unsigned i;
+      debug_printf("bins rasterized per thread:");
+      for (i = 0; i < MAX2(1, rast->num_threads); i++) {
+         debug_printf(" %u", rast->tasks[i].num_bins);
+      }
+      debug_printf("\n");
+   }
+
+   lp_fence_reference(&fence, rast->curr_scene->fence);
+
    lp_scene_end_rasterization( rast->curr_scene );
 
    rast->curr_scene = NULL;
+
+   if (fence) {
+      lp_fence_signal(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 }
 
 
@@ -90,23 +122,29 @@ lp_rast_end( struct lp_rasterizer *rast )
 static void
 lp_rast_tile_begin(struct lp_rasterizer_task *task,
                    const struct cmd_bin *bin,
-                   int x, int y)
+                   unsigned x, unsigned y)
 {
    unsigned i;
    struct lp_scene *scene = task->scene;
 
-   LP_DBG(DEBUG_RAST, "%s %d,%d\n", __FUNCTION__, x, y);
+   LP_DBG(DEBUG_RAST, "%s %u,%u\n", __FUNCTION__, x, y);
 
    task->bin = bin;
-   task->x = x * TILE_SIZE;
-   task->y = y * TILE_SIZE;
-   task->width = TILE_SIZE + x * TILE_SIZE > task->scene->fb.width ?
-                    task->scene->fb.width - x * TILE_SIZE : TILE_SIZE;
-   task->height = TILE_SIZE + y * TILE_SIZE > task->scene->fb.height ?
-                    task->scene->fb.height - y * TILE_SIZE : TILE_SIZE;
+   task->x = x;
+   task->y = y;
+   task->width = MIN2(task->scene->fb.width - x, TILE_SIZE);
+   task->height = MIN2(task->scene->fb.height - y, TILE_SIZE);
 
    task->thread_data.vis_counter = 0;
    task->ps_invocations = 0;
+   memset(&task->counters[LP_PERF_FIRST_RAST], 0,
+          (LP_PERF_COUNTERS - LP_PERF_FIRST_RAST) * sizeof task->counters[0]);
+   task->tile_start_time = os_time_get_nano();
+
+   if (scene->hiz) {
+      for (i = 0; i < Elements(task->hiz_zmax); i++)
+         task->hiz_zmax[i] = FLT_MAX;
+   }
 
    for (i = 0; i < task->scene->fb.nr_cbufs; i++) {
       if (task->scene->fb.cbufs[i]) {
@@ -134,6 +172,8 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 {
    const struct lp_scene *scene = task->scene;
    unsigned cbuf = arg.clear_rb->cbuf;
+   unsigned layer_stride = scene->cbufs[cbuf].layer_stride;
+   unsigned num_layers = scene->fb_max_layer + 1;
    union util_color uc;
    enum pipe_format format;
 
@@ -152,16 +192,22 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
           __FUNCTION__, format, uc.ui[0], uc.ui[1], uc.ui[2], uc.ui[3]);
 
 
+   /* The samples of all layers are evenly spaced images */
+   if (scene->cbufs[cbuf].sample_stride) {
+      layer_stride = scene->cbufs[cbuf].sample_stride;
+      num_layers *= scene->nr_samples;
+   }
+
    util_fill_box(scene->cbufs[cbuf].map,
                  format,
                  scene->cbufs[cbuf].stride,
-                 scene->cbufs[cbuf].layer_stride,
+                 layer_stride,
                  task->x,
                  task->y,
                  0,
                  task->width,
                  task->height,
-                 scene->fb_max_layer + 1,
+                 num_layers,
                  &uc);
 
    /* this will increase for each rb which probably doesn't mean much */
@@ -169,6 +215,169 @@ lp_rast_clear_color(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Conservative range of the depth plane of a triangle over the pixels
+ * [x0, x1) x [y0, y1).  One pixel of margin covers the pixel center and
+ * sample offsets, and the slack the rounding of the shader's own
+ * interpolation of the plane.
+ */
+static inline void
+hiz_tri_zrange(const struct lp_rast_shader_inputs *inputs,
+               int x0, int y0, int x1, int y1,
+               float *zmin, float *zmax)
+{
+   const float a0 = GET_A0(inputs)[0][2];
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+   const float zx0 = dzdx * (float)(x0 - 1);
+   const float zx1 = dzdx * (float)(x1 + 1);
+   const float zy0 = dzdy * (float)(y0 - 1);
+   const float zy1 = dzdy * (float)(y1 + 1);
+   const float slack = (fabsf(a0) +
+                        MAX2(fabsf(zx0), fabsf(zx1)) +
+                        MAX2(fabsf(zy0), fabsf(zy1))) * (1.0f / (1 << 20));
+
+   *zmin = a0 + MIN2(zx0, zx1) + MIN2(zy0, zy1) - slack;
+   *zmax = a0 + MAX2(zx0, zx1) + MAX2(zy0, zy1) + slack;
+}
+
+
+/**
+ * Hierarchical depth rejection.  For each 16x16 block of the current tile
+ * the task keeps an upper bound of the stored depth values.  With a LESS
+ * or LEQUAL depth test, fragments whose depth is above that bound fail,
+ * so blocks where the whole triangle is behind don't need to be shaded.
+ *
+ * \param mask  16x16 blocks of the tile touched by the triangle
+ * \return the subset of mask which may pass the depth test
+ */
+unsigned
+lp_rast_hiz_test(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 unsigned mask)
+{
+   const struct lp_scene *scene = task->scene;
+   const unsigned tested = mask;
+   unsigned visible = mask;
+
+   if (!scene->hiz || !task->state->variant->hiz_reject)
+      return mask;
+
+   while (mask) {
+      int i = ffs(mask) - 1;
+      int x = task->x + (i & 3) * 16;
+      int y = task->y + (i >> 2) * 16;
+      float bound = task->hiz_zmax[i] + scene->hiz_quantum;
+      float zmin, zmax;
+
+      mask &= ~(1 << i);
+
+      /*
+       * The fragment depth gets clamped to 1.0, which passes a LEQUAL
+       * test against a stored 1.0.
+       */
+      if (bound >= 1.0f)
+         continue;
+
+      hiz_tri_zrange(inputs, x, y, x + 16, y + 16, &zmin, &zmax);
+      if (zmin > bound)
+         visible &= ~(1 << i);
+   }
+
+   task->counters[LP_PERF_HIZ_TESTED_16] += util_bitcount(tested);
+   task->counters[LP_PERF_HIZ_REJECTED_16] += util_bitcount(tested & ~visible);
+
+   return visible;
+}
+
+
+/**
+ * Lower the depth bounds of the 16x16 blocks in mask, which are about
+ * to be completely shaded with the current triangle.  With a LESS or
+ * LEQUAL test and depth writes, every pixel then holds a depth no greater
+ * than the triangle's.
+ */
+void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned mask)
+{
+   const struct lp_scene *scene = task->scene;
+
+   /*
+    * With multisampling the fully covered blocks are only known to cover
+    * the pixel centers.
+    */
+   if (!scene->hiz || !task->state->variant->hiz_update ||
+       scene->nr_samples > 1)
+      return;
+
+   while (mask) {
+      int i = ffs(mask) - 1;
+      int x = task->x + (i & 3) * 16;
+      int y = task->y + (i >> 2) * 16;
+      float zmin, zmax;
+
+      mask &= ~(1 << i);
+
+      hiz_tri_zrange(inputs, x, y, x + 16, y + 16, &zmin, &zmax);
+      if (util_is_inf_or_nan(zmax))
+         continue;
+
+      /* unorm conversion clamps negative depths to zero, and rounds */
+      zmax = MAX2(zmax, 0.0f) + scene->hiz_quantum;
+      if (zmax < task->hiz_zmax[i])
+         task->hiz_zmax[i] = zmax;
+   }
+}
+
+
+/**
+ * Update the depth bounds of the tile after a depth/stencil clear.
+ */
+static void
+lp_rast_hiz_clear(struct lp_rasterizer_task *task,
+                  uint64_t clear_value64, uint64_t clear_mask64)
+{
+   enum pipe_format format = task->scene->fb.zsbuf->format;
+   uint64_t depth_mask64 = util_pack64_mask_z(format, ~0);
+   float depth = FLT_MAX;
+   unsigned i;
+
+   if (!(clear_mask64 & depth_mask64)) {
+      /* stencil only clear */
+      return;
+   }
+
+   if ((clear_mask64 & depth_mask64) == depth_mask64) {
+      const struct util_format_description *desc =
+         util_format_description(format);
+      union {
+         uint16_t ui16;
+         uint32_t ui32;
+         uint64_t ui64;
+      } native;
+
+      switch (desc->block.bits) {
+      case 16:
+         native.ui16 = (uint16_t) clear_value64;
+         break;
+      case 32:
+         native.ui32 = (uint32_t) clear_value64;
+         break;
+      default:
+         native.ui64 = clear_value64;
+         break;
+      }
+
+      desc->unpack_z_float(&depth, 0, (const uint8_t *)&native, 0, 1, 1);
+   }
+
+   for (i = 0; i < Elements(task->hiz_zmax); i++)
+      task->hiz_zmax[i] = depth;
+}
+
+
 /**
  * Clear the rasterizer's current z/stencil tile.
  * This is a bin command called during bin processing.
@@ -199,12 +408,20 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
 
    if (scene->fb.zsbuf) {
       unsigned layer;
+      unsigned layer_stride = scene->zsbuf.layer_stride;
+      unsigned num_layers = scene->fb_max_layer + 1;
       uint8_t *dst_layer = task->depth_tile;
       block_size = util_format_get_blocksize(scene->fb.zsbuf->format);
 
       clear_value &= clear_mask;
 
-      for (layer = 0; layer <= scene->fb_max_layer; layer++) {
+      /* The samples of all layers are evenly spaced images */
+      if (scene->zsbuf.sample_stride) {
+         layer_stride = scene->zsbuf.sample_stride;
+         num_layers *= scene->nr_samples;
+      }
+
+      for (layer = 0; layer < num_layers; layer++) {
          dst = dst_layer;
 
          switch (block_size) {
@@ -278,8 +495,11 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
             assert(0);
             break;
          }
-         dst_layer += scene->zsbuf.layer_stride;
+         dst_layer += layer_stride;
       }
+
+      if (scene->hiz)
+         lp_rast_hiz_clear(task, arg.clear_zstencil.value, clear_mask64);
    }
 }
 
@@ -299,6 +519,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_rast_state *state;
    struct lp_fragment_shader_variant *variant;
    const unsigned tile_x = task->x, tile_y = task->y;
+   unsigned visible = 0xffff;
    unsigned x, y;
 
    if (inputs->disable) {
@@ -315,24 +536,37 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    }
    variant = state->variant;
 
+   if (scene->hiz) {
+      visible = lp_rast_hiz_test(task, inputs, visible);
+      lp_rast_hiz_update(task, inputs, visible);
+   }
+
    /* render the whole 64x64 tile in 4x4 chunks */
    for (y = 0; y < task->height; y += 4){
       for (x = 0; x < task->width; x += 4) {
          uint8_t *color[PIPE_MAX_COLOR_BUFS];
          unsigned stride[PIPE_MAX_COLOR_BUFS];
+         unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
          uint8_t *depth = NULL;
          unsigned depth_stride = 0;
+         unsigned depth_sample_stride = 0;
          unsigned i;
 
+         /* skip 16x16 blocks rejected by hierarchical depth */
+         if (!(visible & (1 << ((y / 16) * 4 + x / 16))))
+            continue;
+
          /* color buffer */
          for (i = 0; i < scene->fb.nr_cbufs; i++){
             if (scene->fb.cbufs[i]) {
                stride[i] = scene->cbufs[i].stride;
+               sample_stride[i] = scene->cbufs[i].sample_stride;
                color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
                                                           tile_y + y, inputs->layer);
             }
             else {
                stride[i] = 0;
+               sample_stride[i] = 0;
                color[i] = NULL;
             }
          }
@@ -342,6 +576,7 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
             depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
                                                     tile_y + y, inputs->layer);
             depth_stride = scene->zsbuf.stride;
+            depth_sample_stride = scene->zsbuf.sample_stride;
          }
 
          /* Propagate non-interpolated raster state. */
@@ -357,10 +592,12 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
                                             GET_DADY(inputs),
                                             color,
                                             depth,
-                                            0xffff,
+                                            lp_rast_full_mask(task),
                                             &task->thread_data,
                                             stride,
-                                            depth_stride);
+                                            depth_stride,
+                                            sample_stride,
+                                            depth_sample_stride);
          END_JIT_CALL();
       }
    }
@@ -392,27 +629,30 @@ lp_rast_shade_tile_opaque(struct lp_rasterizer_task *task,
  * This is a bin command called during bin processing.
  * \param x  X position of quad in window coords
  * \param y  Y position of quad in window coords
+ * \param mask  coverage mask, 16 bits per sample
  */
 void
-lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
-                         const struct lp_rast_shader_inputs *inputs,
-                         unsigned x, unsigned y,
-                         unsigned mask)
+lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
+                                const struct lp_rast_shader_inputs *inputs,
+                                unsigned x, unsigned y,
+                                uint64_t mask)
 {
    const struct lp_rast_state *state = task->state;
    struct lp_fragment_shader_variant *variant = state->variant;
    const struct lp_scene *scene = task->scene;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    assert(state);
 
    /* Sanity checks */
-   assert(x < scene->tiles_x * TILE_SIZE);
-   assert(y < scene->tiles_y * TILE_SIZE);
+   assert(x < scene->tiles_x * scene->tile_size);
+   assert(y < scene->tiles_y * scene->tile_size);
    assert(x % TILE_VECTOR_WIDTH == 0);
    assert(y % TILE_VECTOR_HEIGHT == 0);
 
@@ -423,11 +663,13 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -435,6 +677,7 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
    /* depth buffer */
    if (scene->zsbuf.map) {
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.sample_stride;
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
    }
 
@@ -465,7 +708,9 @@ lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                                             mask,
                                             &task->thread_data,
                                             stride,
-                                            depth_stride);
+                                            depth_stride,
+                                            sample_stride,
+                                            depth_sample_stride);
       END_JIT_CALL();
    }
 }
@@ -492,7 +737,9 @@ lp_rast_begin_query(struct lp_rasterizer_task *task,
       pq->start[task->thread_index] = task->ps_invocations;
       break;
    default:
-      assert(0);
+      assert(lp_query_is_rast_perf(pq->type));
+      pq->start[task->thread_index] =
+         task->counters[LP_QUERY_PERF_COUNTER(pq->type)];
       break;
    }
 }
@@ -525,7 +772,11 @@ lp_rast_end_query(struct lp_rasterizer_task *task,
       pq->start[task->thread_index] = 0;
       break;
    default:
-      assert(0);
+      assert(lp_query_is_rast_perf(pq->type));
+      pq->end[task->thread_index] +=
+         task->counters[LP_QUERY_PERF_COUNTER(pq->type)] -
+         pq->start[task->thread_index];
+      pq->start[task->thread_index] = 0;
       break;
    }
 }
@@ -536,6 +787,13 @@ lp_rast_set_state(struct lp_rasterizer_task *task,
                   const union lp_rast_cmd_arg arg)
 {
    task->state = arg.state;
+
+   /* Depth writes with other tests may increase the depth values */
+   if (task->scene->hiz && arg.state->variant->hiz_invalidate) {
+      unsigned i;
+      for (i = 0; i < Elements(task->hiz_zmax); i++)
+         task->hiz_zmax[i] = FLT_MAX;
+   }
 }
 
 
@@ -548,6 +806,9 @@ lp_rast_tile_end(struct lp_rasterizer_task *task)
 {
    unsigned i;
 
+   task->counters[LP_PERF_RAST_TIME] +=
+      os_time_get_nano() - task->tile_start_time;
+
    for (i = 0; i < task->scene->num_active_queries; ++i) {
       lp_rast_end_query(task, lp_rast_arg_query(task->scene->active_queries[i]));
    }
@@ -615,19 +876,36 @@ do_rasterize_bin(struct lp_rasterizer_task *task,
 
 /**
  * Rasterize commands for a single bin.
- * \param x, y  position of the bin's tile in the framebuffer
+ * \param x, y  position of the bin in the framebuffer, in bins
  * Must be called between lp_rast_begin() and lp_rast_end().
  * Called per thread.
+ *
+ * Bins may be larger than a tile, in which case the bin's commands are
+ * replayed for each of the tiles it covers.
  */
 static void
 rasterize_bin(struct lp_rasterizer_task *task,
               const struct cmd_bin *bin, int x, int y )
 {
-   lp_rast_tile_begin( task, bin, x, y );
+   const struct lp_scene *scene = task->scene;
+   unsigned x0 = x << scene->tile_order;
+   unsigned y0 = y << scene->tile_order;
+   unsigned x1 = MIN2(x0 + scene->tile_size, scene->fb.width);
+   unsigned y1 = MIN2(y0 + scene->tile_size, scene->fb.height);
+   unsigned tx, ty;
+
+   task->bin_x = x0;
+   task->bin_y = y0;
+
+   for (ty = y0; ty < y1; ty += TILE_SIZE) {
+      for (tx = x0; tx < x1; tx += TILE_SIZE) {
+         lp_rast_tile_begin( task, bin, tx, ty );
 
-   do_rasterize_bin(task, bin, x, y);
+         do_rasterize_bin(task, bin, x, y);
 
-   lp_rast_tile_end(task);
+         lp_rast_tile_end(task);
+      }
+   }
 
 
    /* Debug/Perf flags:
@@ -664,6 +942,7 @@ rasterize_scene(struct lp_rasterizer_task *task,
                 struct lp_scene *scene)
 {
    task->scene = scene;
+   task->num_bins = 0;
 
    /* Clear the cache tags. This should not always be necessary but
       simpler for now. */
@@ -684,8 +963,10 @@ rasterize_scene(struct lp_rasterizer_task *task,
 
          assert(scene);
          while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
-            if (!is_empty_bin( bin ))
+            if (!is_empty_bin( bin )) {
                rasterize_bin(task, bin, i, j);
+               task->num_bins++;
+            }
          }
       }
    }
@@ -705,10 +986,6 @@ rasterize_scene(struct lp_rasterizer_task *task,
    }
 #endif
 
-   if (scene->fence) {
-      lp_fence_signal(scene->fence);
-   }
-
    task->scene = NULL;
 }
 
@@ -757,19 +1034,42 @@ lp_rast_queue_scene( struct lp_rasterizer *rast,
 }
 
 
+/**
+ * Run func(data, thread_index) once on each rasterizer thread, or once
+ * on the calling thread without threads, and wait for completion.  Used
+ * for compute work, which is not binned.
+ *
+ * The caller must hold the screen's rast_mutex and have waited for the
+ * last queued scene, so that no scene is being rasterized meanwhile.
+ */
 void
-lp_rast_finish( struct lp_rasterizer *rast )
+lp_rast_run_job( struct lp_rasterizer *rast,
+                 lp_rast_job_func func,
+                 void *data )
 {
    if (rast->num_threads == 0) {
-      /* nothing to do */
+      unsigned fpstate = util_fpstate_get();
+
+      util_fpstate_set_denorms_to_zero(fpstate);
+
+      func(data, 0);
+
+      util_fpstate_set(fpstate);
    }
    else {
-      int i;
+      unsigned i;
+
+      rast->job_func = func;
+      rast->job_data = data;
 
-      /* wait for work to complete */
       for (i = 0; i < rast->num_threads; i++) {
-         pipe_semaphore_wait(&rast->tasks[i].work_done);
+         pipe_semaphore_signal(&rast->tasks[i].work_ready);
       }
+
+      pipe_semaphore_wait(&rast->job_done);
+
+      rast->job_func = NULL;
+      rast->job_data = NULL;
    }
 }
 
@@ -779,7 +1079,11 @@ lp_rast_finish( struct lp_rasterizer *rast )
  * It's a simple loop:
  *   1. wait for work
  *   2. do work
- *   3. signal that we're done
+ *   3. thread 0 releases the scene and signals its fence
+ *
+ * Each lp_rast_queue_scene() call posts one work item per thread, and
+ * thread 0 dequeues scenes in order, so several scenes may be queued.
+ * lp_rast_run_job() posts a job instead, which is never queued.
  */
 static PIPE_THREAD_ROUTINE( thread_function, init_data )
 {
@@ -792,6 +1096,25 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
    util_snprintf(thread_name, sizeof thread_name, "llvmpipe-%u", task->thread_index);
    pipe_thread_setname(thread_name);
 
+   if (task->cpu >= 0) {
+      if (pipe_thread_pin_to_cpu(task->cpu)) {
+         /* Reallocate the per-thread data from the pinned thread, so that
+          * with first-touch NUMA policies it lands on the local node.
+          */
+         struct lp_build_format_cache *cache =
+            align_malloc(sizeof(struct lp_build_format_cache), 16);
+         if (cache) {
+            memset(cache, 0, sizeof *cache);
+            align_free(task->thread_data.cache);
+            task->thread_data.cache = cache;
+         }
+      }
+      else if (debug) {
+         debug_printf("thread %d couldn't be pinned to cpu %d\n",
+                      task->thread_index, task->cpu);
+      }
+   }
+
    /* Make sure that denorms are treated like zeros. This is 
     * the behavior required by D3D10. OpenGL doesn't care.
     */
@@ -807,6 +1130,18 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       if (rast->exit_flag)
          break;
 
+      if (rast->job_func) {
+         rast->job_func(rast->job_data, task->thread_index);
+
+         /* wait for all threads to finish with this job */
+         pipe_barrier_wait( &rast->barrier );
+
+         if (task->thread_index == 0) {
+            pipe_semaphore_signal(&rast->job_done);
+         }
+         continue;
+      }
+
       if (task->thread_index == 0) {
          /* thread[0]:
           *  - get next scene to rasterize
@@ -831,17 +1166,12 @@ static PIPE_THREAD_ROUTINE( thread_function, init_data )
       /* wait for all threads to finish with this scene */
       pipe_barrier_wait( &rast->barrier );
 
-      /* XXX: shouldn't be necessary:
-       */
       if (task->thread_index == 0) {
          lp_rast_end( rast );
       }
 
-      /* signal done with work */
       if (debug)
          debug_printf("thread %d done working\n", task->thread_index);
-
-      pipe_semaphore_signal(&task->work_done);
    }
 
 #ifdef _WIN32
@@ -875,9 +1205,14 @@ create_rast_threads(struct lp_rasterizer *rast)
  * Create new lp_rasterizer.  If num_threads is zero, don't create any
  * new threads, do rendering synchronously.
  * \param num_threads  number of rasterizer threads to create
+ * \param thread_cpus  CPUs to pin the threads to, round-robin
+ * \param num_thread_cpus  number of entries in thread_cpus, zero for
+ *                         no pinning
  */
 struct lp_rasterizer *
-lp_rast_create( unsigned num_threads )
+lp_rast_create( unsigned num_threads,
+                const unsigned *thread_cpus,
+                unsigned num_thread_cpus )
 {
    struct lp_rasterizer *rast;
    unsigned i;
@@ -896,6 +1231,7 @@ lp_rast_create( unsigned num_threads )
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->cpu = num_thread_cpus ? (int) thread_cpus[i % num_thread_cpus] : -1;
       task->thread_data.cache = align_malloc(sizeof(struct lp_build_format_cache),
                                              16);
       if (!task->thread_data.cache) {
@@ -909,8 +1245,11 @@ lp_rast_create( unsigned num_threads )
 
    create_rast_threads(rast);
 
-   /* for synchronizing rasterization threads */
-   pipe_barrier_init( &rast->barrier, rast->num_threads );
+   /* for synchronizing rasterization threads, if there are any */
+   if (rast->num_threads > 0) {
+      pipe_barrier_init( &rast->barrier, rast->num_threads );
+   }
+   pipe_semaphore_init( &rast->job_done, 0 );
 
    memset(lp_dummy_tile, 0, sizeof lp_dummy_tile);
 
@@ -967,7 +1306,10 @@ void lp_rast_destroy( struct lp_rasterizer *rast )
    }
 
    /* for synchronizing rasterization threads */
-   pipe_barrier_destroy( &rast->barrier );
+   if (rast->num_threads > 0) {
+      pipe_barrier_destroy( &rast->barrier );
+   }
+   pipe_semaphore_destroy( &rast->job_done );
 
    lp_scene_queue_destroy(rast->full_scenes);
 
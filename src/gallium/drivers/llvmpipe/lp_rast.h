@@ -66,6 +66,12 @@ struct cmd_bin;
 /* Rasterizer output size going to jit fs, width/height */
 #define LP_RASTER_BLOCK_SIZE 4
 
+/**
+ * Standard 4x sample positions, relative to the upper left pixel corner,
+ * in FIXED_ONE units.
+ */
+extern const int lp_sample_pos_4x[LP_MAX_SAMPLES][2];
+
 #define LP_MAX_ACTIVE_BINNED_QUERIES 64
 
 #define IMUL64(a, b) (((int64_t)(a)) * ((int64_t)(b)))
@@ -88,6 +94,12 @@ struct lp_rast_state {
     * the tile color/z/stencil data somehow
      */
    struct lp_fragment_shader_variant *variant;
+
+   /* Coverage mask of the samples enabled by the sample mask, with
+    * 16 bits (one 4x4 block) per sample.  Only used in multisample
+    * scenes.
+    */
+   uint64_t sample_coverage;
 };
 
 
@@ -100,7 +112,8 @@ struct lp_rast_shader_inputs {
    unsigned frontfacing:1;      /** True for front-facing */
    unsigned disable:1;          /** Partially binned, disable this command */
    unsigned opaque:1;           /** Is opaque */
-   unsigned pad0:29;            /* wasted space */
+   unsigned multisample:1;      /** Coverage is computed per sample */
+   unsigned pad0:28;            /* wasted space */
    unsigned stride;             /* how much to advance data between a0, dadx, dady */
    unsigned layer;              /* the layer to render to (from gs, already clamped) */
    unsigned viewport_index;     /* the active viewport index (from gs, already clamped) */
@@ -151,7 +164,9 @@ struct lp_rast_clear_rb {
 
 
 struct lp_rasterizer *
-lp_rast_create( unsigned num_threads );
+lp_rast_create( unsigned num_threads,
+                const unsigned *thread_cpus,
+                unsigned num_thread_cpus );
 
 void
 lp_rast_destroy( struct lp_rasterizer * );
@@ -160,8 +175,13 @@ void
 lp_rast_queue_scene( struct lp_rasterizer *rast,
                      struct lp_scene *scene );
 
+
+typedef void (*lp_rast_job_func)(void *data, unsigned thread_index);
+
 void
-lp_rast_finish( struct lp_rasterizer *rast );
+lp_rast_run_job( struct lp_rasterizer *rast,
+                 lp_rast_job_func func,
+                 void *data );
 
 
 union lp_rast_cmd_arg {
@@ -37,6 +37,7 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
@@ -87,6 +88,7 @@ struct lp_rasterizer_task
    struct lp_scene *scene;
    unsigned x, y;          /**< Pos of this tile in framebuffer, in pixels */
    unsigned width, height; /**< width, height of current tile, in pixels */
+   unsigned bin_x, bin_y;  /**< Pos of the bin containing the tile, in pixels */
 
    uint8_t *color_tiles[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth_tile;
@@ -97,11 +99,32 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** CPU to pin this thread to, or -1 */
+   int cpu;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
    uint64_t ps_invocations;
    uint8_t ps_inv_multiplier;
 
+   /**
+    * Rasterizer perf counters of the current tile, indexed by
+    * enum lp_perf_counter (the setup ones are unused).
+    */
+   uint64_t counters[LP_PERF_COUNTERS];
+   int64_t tile_start_time;
+
+   /**
+    * Upper bound of the depth values in each 16x16 block of the current
+    * tile, or FLT_MAX if unknown.  Only maintained if scene->hiz is set.
+    */
+   float hiz_zmax[16];
+
+   /** Number of (non-empty) bins this thread rasterized in the current
+    * scene.  Reported with LP_DEBUG=scene, useful for load balancing.
+    */
+   unsigned num_bins;
+
    pipe_semaphore work_ready;
    pipe_semaphore work_done;
 };
@@ -131,14 +154,56 @@ struct lp_rasterizer
 
    /** For synchronizing the rasterization threads */
    pipe_barrier barrier;
+
+   /** Job run by all threads instead of a scene, see lp_rast_run_job() */
+   lp_rast_job_func job_func;
+   void *job_data;
+   pipe_semaphore job_done;
 };
 
 
 void
+lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
+                                const struct lp_rast_shader_inputs *inputs,
+                                unsigned x, unsigned y,
+                                uint64_t mask);
+
+
+/**
+ * Coverage mask of a fully covered 4x4 block.  In multisample scenes
+ * that's all samples enabled by the sample mask.
+ */
+static inline uint64_t
+lp_rast_full_mask(const struct lp_rasterizer_task *task)
+{
+   if (task->scene->nr_samples > 1)
+      return task->state->sample_coverage;
+   return 0xffff;
+}
+
+
+/**
+ * Shade a 4x4 block with the same pixel coverage for all samples.
+ * \param mask  16 bit pixel mask
+ */
+static inline void
 lp_rast_shade_quads_mask(struct lp_rasterizer_task *task,
                          const struct lp_rast_shader_inputs *inputs,
                          unsigned x, unsigned y,
-                         unsigned mask);
+                         unsigned mask)
+{
+   uint64_t mask64 = mask;
+
+   if (task->scene->nr_samples > 1) {
+      STATIC_ASSERT(LP_MAX_SAMPLES == 4);
+      mask64 = (mask64 * 0x0001000100010001ULL) &
+               task->state->sample_coverage;
+      if (!mask64)
+         return;
+   }
+
+   lp_rast_shade_quads_mask_sample(task, inputs, x, y, mask64);
+}
 
 
 /**
@@ -153,8 +218,8 @@ lp_rast_get_color_block_pointer(struct lp_rasterizer_task *task,
    unsigned px, py, pixel_offset;
    uint8_t *color;
 
-   assert(x < task->scene->tiles_x * TILE_SIZE);
-   assert(y < task->scene->tiles_y * TILE_SIZE);
+   assert(x < task->scene->tiles_x * task->scene->tile_size);
+   assert(y < task->scene->tiles_y * task->scene->tile_size);
    assert((x % TILE_VECTOR_WIDTH) == 0);
    assert((y % TILE_VECTOR_HEIGHT) == 0);
    assert(buf < task->scene->fb.nr_cbufs);
@@ -193,8 +258,8 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
    unsigned px, py, pixel_offset;
    uint8_t *depth;
 
-   assert(x < task->scene->tiles_x * TILE_SIZE);
-   assert(y < task->scene->tiles_y * TILE_SIZE);
+   assert(x < task->scene->tiles_x * task->scene->tile_size);
+   assert(y < task->scene->tiles_y * task->scene->tile_size);
    assert((x % TILE_VECTOR_WIDTH) == 0);
    assert((y % TILE_VECTOR_HEIGHT) == 0);
 
@@ -232,19 +297,23 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    struct lp_fragment_shader_variant *variant = state->variant;
    uint8_t *color[PIPE_MAX_COLOR_BUFS];
    unsigned stride[PIPE_MAX_COLOR_BUFS];
+   unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
    uint8_t *depth = NULL;
    unsigned depth_stride = 0;
+   unsigned depth_sample_stride = 0;
    unsigned i;
 
    /* color buffer */
    for (i = 0; i < scene->fb.nr_cbufs; i++) {
       if (scene->fb.cbufs[i]) {
          stride[i] = scene->cbufs[i].stride;
+         sample_stride[i] = scene->cbufs[i].sample_stride;
          color[i] = lp_rast_get_color_block_pointer(task, i, x, y,
                                                     inputs->layer);
       }
       else {
          stride[i] = 0;
+         sample_stride[i] = 0;
          color[i] = NULL;
       }
    }
@@ -252,6 +321,7 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
    if (scene->zsbuf.map) {
       depth = lp_rast_get_depth_block_pointer(task, x, y, inputs->layer);
       depth_stride = scene->zsbuf.stride;
+      depth_sample_stride = scene->zsbuf.sample_stride;
    }
 
    /*
@@ -276,14 +346,76 @@ lp_rast_shade_quads_all( struct lp_rasterizer_task *task,
                                          GET_DADY(inputs),
                                          color,
                                          depth,
-                                         0xffff,
+                                         lp_rast_full_mask(task),
                                          &task->thread_data,
                                          stride,
-                                         depth_stride);
+                                         depth_stride,
+                                         sample_stride,
+                                         depth_sample_stride);
       END_JIT_CALL();
    }
 }
 
+
+/**
+ * Find the block a contained triangle (see lp_rast_arg_triangle_contained())
+ * was binned at.  Its position is relative to the bin, which may span
+ * several tiles.
+ * \param x, y  returns location of the block in window coords
+ * \return FALSE if the block is not within the current tile
+ */
+static inline boolean
+lp_rast_contained_block(const struct lp_rasterizer_task *task,
+                        unsigned plane_mask,
+                        int *x, int *y)
+{
+   *x = task->bin_x + (plane_mask & 0xff);
+   *y = task->bin_y + (plane_mask >> 8);
+
+   return (unsigned)(*x - task->x) < TILE_SIZE &&
+          (unsigned)(*y - task->y) < TILE_SIZE;
+}
+
+
+unsigned
+lp_rast_hiz_test(struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 unsigned mask);
+
+void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned mask);
+
+
+/**
+ * Whether hierarchical depth rejects a whole size x size block (at most
+ * 16x16, 4 pixel aligned) of the current tile.
+ * \param x, y location of the block in window coords
+ */
+static inline boolean
+lp_rast_hiz_reject_block(struct lp_rasterizer_task *task,
+                         const struct lp_rast_shader_inputs *inputs,
+                         int x, int y, unsigned size)
+{
+   unsigned x0, y0, x1, y1, mask;
+
+   if (!task->scene->hiz || !task->state->variant->hiz_reject)
+      return FALSE;
+
+   x0 = (x - task->x) / 16;
+   y0 = (y - task->y) / 16;
+   x1 = MIN2((x - task->x + size - 1) / 16, 3);
+   y1 = MIN2((y - task->y + size - 1) / 16, 3);
+
+   /* mask of the 16x16 blocks touched, 4 bits per row */
+   mask = ((2 << x1) - (1 << x0)) * 0x1111;
+   mask &= ((16 << (4 * y1)) - (1 << (4 * y0)));
+
+   return lp_rast_hiz_test(task, inputs, mask) == 0;
+}
+
+
 void lp_rast_triangle_1( struct lp_rasterizer_task *, 
                          const union lp_rast_cmd_arg );
 void lp_rast_triangle_2( struct lp_rasterizer_task *, 
@@ -63,6 +63,45 @@ block_full_16(struct lp_rasterizer_task *task,
 	 block_full_4(task, tri, x + ix, y + iy);
 }
 
+/**
+ * Update the coverage counters for a 4x4 block of the SSE paths for
+ * triangles contained in a 16x16 or 4x4 block.  These compute the covered
+ * pixels directly rather than classifying the block against the trivial
+ * accept and reject planes, so classify it by its pixel mask.
+ */
+static inline void
+count_block_4(struct lp_rasterizer_task *task, unsigned mask)
+{
+   if (mask == 0) {
+      LP_COUNT(nr_empty_4);
+      task->counters[LP_PERF_EMPTY_4]++;
+   }
+   else if (mask == 0xffff) {
+      LP_COUNT(nr_fully_covered_4);
+      task->counters[LP_PERF_FULLY_COVERED_4]++;
+   }
+   else {
+      LP_COUNT(nr_partially_covered_4);
+      task->counters[LP_PERF_PARTIALLY_COVERED_4]++;
+   }
+}
+
+
+/**
+ * Update the counters for a 16x16 block of those paths, and for the 4x4
+ * blocks in it which aren't covered at all.
+ */
+static inline void
+count_block_16(struct lp_rasterizer_task *task, unsigned nr_empty_4)
+{
+   LP_COUNT(nr_partially_covered_16);
+   task->counters[LP_PERF_PARTIALLY_COVERED_16]++;
+
+   LP_COUNT_ADD(nr_empty_4, nr_empty_4);
+   task->counters[LP_PERF_EMPTY_4] += nr_empty_4;
+}
+
+
 static inline unsigned
 build_mask_linear(int32_t c, int32_t dcdx, int32_t dcdy)
 {
@@ -111,6 +150,12 @@ lp_rast_triangle_3_16(struct lp_rasterizer_task *task,
                       const union lp_rast_cmd_arg arg)
 {
    union lp_rast_cmd_arg arg2;
+   int x, y;
+
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
    arg2.triangle.tri = arg.triangle.tri;
    arg2.triangle.plane_mask = (1<<3)-1;
    lp_rast_triangle_3(task, arg2);
@@ -128,6 +173,12 @@ lp_rast_triangle_4_16(struct lp_rasterizer_task *task,
                       const union lp_rast_cmd_arg arg)
 {
    union lp_rast_cmd_arg arg2;
+   int x, y;
+
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
    arg2.triangle.tri = arg.triangle.tri;
    arg2.triangle.plane_mask = (1<<4)-1;
    lp_rast_triangle_4(task, arg2);
@@ -243,8 +294,7 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
 {
    const struct lp_rast_triangle *tri = arg.triangle.tri;
    const struct lp_rast_plane *plane = GET_PLANES(tri);
-   int x = (arg.triangle.plane_mask & 0xff) + task->x;
-   int y = (arg.triangle.plane_mask >> 8) + task->y;
+   int x, y;
    unsigned i, j;
 
    struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
@@ -265,6 +315,13 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
+   if (lp_rast_hiz_reject_block(task, &tri->inputs, x, y, 16))
+      return;
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &unused, &dcdx, &dcdy);
 
@@ -342,12 +399,16 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
       c = _mm_add_epi32(c, _mm_slli_epi32(dcdy, 2));
    }
 
-   for (i = 0; i < nr; i++)
+   count_block_16(task, 16 - nr);
+
+   for (i = 0; i < nr; i++) {
+      count_block_4(task, 0xffff & ~out[i].mask);
       lp_rast_shade_quads_mask(task,
                                &tri->inputs,
                                x + 4 * out[i].j,
                                y + 4 * out[i].i,
                                0xffff & ~out[i].mask);
+   }
 }
 
 void
@@ -356,8 +417,7 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 {
    const struct lp_rast_triangle *tri = arg.triangle.tri;
    const struct lp_rast_plane *plane = GET_PLANES(tri);
-   unsigned x = (arg.triangle.plane_mask & 0xff) + task->x;
-   unsigned y = (arg.triangle.plane_mask >> 8) + task->y;
+   int x, y;
 
    /* p0 and p2 are aligned, p1 is not (plane size 24 bytes). */
    __m128i p0 = _mm_load_si128((__m128i *)&plane[0]); /* clo, chi, dcdx, dcdy */
@@ -373,6 +433,13 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
    __m128i span_2;                /* 0,dcdx,2dcdx,3dcdx for plane 2 */
    __m128i unused;
 
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
+   if (lp_rast_hiz_reject_block(task, &tri->inputs, x, y, 4))
+      return;
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &unused, &dcdx, &dcdy);
 
@@ -423,6 +490,8 @@ lp_rast_triangle_32_3_4(struct lp_rasterizer_task *task,
 
       unsigned mask = _mm_movemask_epi8(c_0123);
 
+      count_block_4(task, 0xffff & ~mask);
+
       if (mask != 0xffff)
          lp_rast_shade_quads_mask(task,
                                   &tri->inputs,
@@ -527,8 +596,7 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
 {
    const struct lp_rast_triangle *tri = arg.triangle.tri;
    const struct lp_rast_plane *plane = GET_PLANES(tri);
-   int x = (arg.triangle.plane_mask & 0xff) + task->x;
-   int y = (arg.triangle.plane_mask >> 8) + task->y;
+   int x, y;
    unsigned i, j;
 
    struct { unsigned mask:16; unsigned i:8; unsigned j:8; } out[16];
@@ -566,6 +634,13 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
    vshuf_mask2 = (__m128i) vec_splats((unsigned int) 0x04050607);
 #endif
 
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
+   if (lp_rast_hiz_reject_block(task, &tri->inputs, x, y, 16))
+      return;
+
    transpose4_epi32(&p0, &p1, &p2, &zero,
                     &c, &dcdx, &dcdy, &rej4);
 
@@ -640,12 +715,16 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
       c = vec_add_epi32(c, vec_slli_epi32(dcdy, 2));
    }
 
-   for (i = 0; i < nr; i++)
+   count_block_16(task, 16 - nr);
+
+   for (i = 0; i < nr; i++) {
+      count_block_4(task, 0xffff & ~out[i].mask);
       lp_rast_shade_quads_mask(task,
                                &tri->inputs,
                                x + 4 * out[i].j,
                                y + 4 * out[i].i,
                                0xffff & ~out[i].mask);
+   }
 }
 
 #undef NR_PLANES
@@ -657,6 +736,12 @@ lp_rast_triangle_32_3_16(struct lp_rasterizer_task *task,
                          const union lp_rast_cmd_arg arg)
 {
    union lp_rast_cmd_arg arg2;
+   int x, y;
+
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
    arg2.triangle.tri = arg.triangle.tri;
    arg2.triangle.plane_mask = (1<<3)-1;
    lp_rast_triangle_32_3(task, arg2);
@@ -669,6 +754,12 @@ lp_rast_triangle_32_4_16(struct lp_rasterizer_task *task,
                          const union lp_rast_cmd_arg arg)
 {
    union lp_rast_cmd_arg arg2;
+   int x, y;
+
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, arg.triangle.plane_mask, &x, &y))
+      return;
+
    arg2.triangle.tri = arg.triangle.tri;
    arg2.triangle.plane_mask = (1<<4)-1;
    lp_rast_triangle_32_4(task, arg2);
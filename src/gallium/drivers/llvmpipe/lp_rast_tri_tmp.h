@@ -32,19 +32,12 @@
 
 
 /**
- * Prototype for a 8 plane rasterizer function.  Will codegenerate
- * several of these.
- *
- * XXX: Varients for more/fewer planes.
- * XXX: Need ways of dropping planes as we descend.
- * XXX: SIMD
+ * Compute the coverage mask of a 4x4 block, given the plane values at
+ * the block origin.
  */
-static void
-TAG(do_block_4)(struct lp_rasterizer_task *task,
-                const struct lp_rast_triangle *tri,
-                const struct lp_rast_plane *plane,
-                int x, int y,
-                const int64_t *c)
+static inline unsigned
+TAG(build_mask_4)(const struct lp_rast_plane *plane,
+                  const int64_t *c)
 {
    unsigned mask = 0xffff;
    int j;
@@ -61,10 +54,57 @@ TAG(do_block_4)(struct lp_rasterizer_task *task,
 #endif
    }
 
-   /* Now pass to the shader:
-    */
-   if (mask)
-      lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+   return mask;
+}
+
+
+/**
+ * Prototype for a 8 plane rasterizer function.  Will codegenerate
+ * several of these.
+ *
+ * XXX: Varients for more/fewer planes.
+ * XXX: Need ways of dropping planes as we descend.
+ * XXX: SIMD
+ */
+static void
+TAG(do_block_4)(struct lp_rasterizer_task *task,
+                const struct lp_rast_triangle *tri,
+                const struct lp_rast_plane *plane,
+                int x, int y,
+                const int64_t *c)
+{
+   if (tri->inputs.multisample) {
+      uint64_t mask = 0;
+      unsigned s;
+      int j;
+
+      /* Evaluate the planes at each sample position, the plane values
+       * at integer positions being those of the pixel corners.
+       */
+      for (s = 0; s < LP_MAX_SAMPLES; s++) {
+         int64_t cs[NR_PLANES];
+
+         for (j = 0; j < NR_PLANES; j++)
+            cs[j] = (c[j]
+                     + IMUL64(plane[j].dcdy >> FIXED_ORDER, lp_sample_pos_4x[s][1])
+                     - IMUL64(plane[j].dcdx >> FIXED_ORDER, lp_sample_pos_4x[s][0]));
+
+         mask |= (uint64_t)TAG(build_mask_4)(plane, cs) << (16 * s);
+      }
+
+      mask &= task->state->sample_coverage;
+
+      if (mask)
+         lp_rast_shade_quads_mask_sample(task, &tri->inputs, x, y, mask);
+   }
+   else {
+      unsigned mask = TAG(build_mask_4)(plane, c);
+
+      /* Now pass to the shader:
+       */
+      if (mask)
+         lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
+   }
 }
 
 /**
@@ -128,7 +168,11 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
 
    assert((partial_mask & inmask) == 0);
 
-   LP_COUNT_ADD(nr_empty_4, util_bitcount(0xffff & ~(partial_mask | inmask)));
+   {
+      unsigned nr_empty = util_bitcount(0xffff & ~(partial_mask | inmask));
+      LP_COUNT_ADD(nr_empty_4, nr_empty);
+      task->counters[LP_PERF_EMPTY_4] += nr_empty;
+   }
 
    /* Iterate over partials:
     */
@@ -143,6 +187,7 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
       partial_mask &= ~(1 << i);
 
       LP_COUNT(nr_partially_covered_4);
+      task->counters[LP_PERF_PARTIALLY_COVERED_4]++;
 
       for (j = 0; j < NR_PLANES; j++)
          cx[j] = (c[j] 
@@ -164,6 +209,7 @@ TAG(do_block_16)(struct lp_rasterizer_task *task,
       inmask &= ~(1 << i);
 
       LP_COUNT(nr_fully_covered_4);
+      task->counters[LP_PERF_FULLY_COVERED_4]++;
       block_full_4(task, tri, px, py);
    }
 }
@@ -200,6 +246,33 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       plane_mask &= ~(1 << i);
       c[j] = plane[j].c + IMUL64(plane[j].dcdy, y) - IMUL64(plane[j].dcdx, x);
 
+      if (task->scene->tile_order > TILE_ORDER) {
+         /*
+          * The plane mask was computed for the whole bin, but this is only
+          * one tile of it.  Redo the binner's tests for this tile, so that
+          * we skip tiles the triangle doesn't touch, and so that planes far
+          * away from the tile don't break the 32bit math below.
+          */
+         int64_t eo = (int64_t)plane[j].eo << TILE_ORDER;
+         int64_t ei = (plane[j].dcdy - plane[j].dcdx -
+                       (int64_t)plane[j].eo) << TILE_ORDER;
+
+         if (c[j] + eo < 0) {
+            /* Trivially rejected by this plane */
+            return;
+         }
+
+         if (c[j] + ei - 1 >= 0) {
+            /* Trivially accepted by this plane, so replace it with one
+             * that is inside everywhere.
+             */
+            plane[j].dcdx = 0;
+            plane[j].dcdy = 0;
+            plane[j].eo = 0;
+            c[j] = (int64_t)1 << FIXED_ORDER;
+         }
+      }
+
       {
 #ifdef RASTER_64
          /*
@@ -282,7 +355,19 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
 
    assert((partial_mask & inmask) == 0);
 
-   LP_COUNT_ADD(nr_empty_16, util_bitcount(0xffff & ~(partial_mask | inmask)));
+   {
+      unsigned nr_empty = util_bitcount(0xffff & ~(partial_mask | inmask));
+      LP_COUNT_ADD(nr_empty_16, nr_empty);
+      task->counters[LP_PERF_EMPTY_16] += nr_empty;
+   }
+
+   if (task->scene->hiz) {
+      unsigned visible = lp_rast_hiz_test(task, &tri->inputs,
+                                          inmask | partial_mask);
+      inmask &= visible;
+      partial_mask &= visible;
+      lp_rast_hiz_update(task, &tri->inputs, inmask);
+   }
 
    /* Iterate over partials:
     */
@@ -302,6 +387,7 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       partial_mask &= ~(1 << i);
 
       LP_COUNT(nr_partially_covered_16);
+      task->counters[LP_PERF_PARTIALLY_COVERED_16]++;
       TAG(do_block_16)(task, tri, plane, px, py, cx);
    }
 
@@ -317,6 +403,7 @@ TAG(lp_rast_triangle)(struct lp_rasterizer_task *task,
       inmask &= ~(1 << i);
 
       LP_COUNT(nr_fully_covered_16);
+      task->counters[LP_PERF_FULLY_COVERED_16]++;
       block_full_16(task, tri, px, py);
    }
 }
@@ -337,13 +424,13 @@ TRI_16(struct lp_rasterizer_task *task,
    unsigned j;
    __m128i cstep4[NR_PLANES][4];
 
-   int x = (mask & 0xff);
-   int y = (mask >> 8);
+   int x, y;
+
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, mask, &x, &y))
+      return;
 
    outmask = 0;                 /* outside one or more trivial reject planes */
-   
-   x += task->x;
-   y += task->y;
 
    for (j = 0; j < NR_PLANES; j++) {
       const int dcdx = -plane[j].dcdx * 4;
@@ -372,6 +459,8 @@ TRI_16(struct lp_rasterizer_task *task,
     */
    partial_mask = 0xffff & ~outmask;
 
+   count_block_16(task, util_bitcount(outmask));
+
    /* Iterate over partials:
     */
    while (partial_mask) {
@@ -392,6 +481,8 @@ TRI_16(struct lp_rasterizer_task *task,
 	 mask &= ~sign_bits4(cstep4[j], cx);
       }
 
+      count_block_4(task, mask);
+
       if (mask)
 	 lp_rast_shade_quads_mask(task, &tri->inputs, px, py, mask);
    }
@@ -406,10 +497,13 @@ TRI_4(struct lp_rasterizer_task *task,
    const struct lp_rast_triangle *tri = arg.triangle.tri;
    const struct lp_rast_plane *plane = GET_PLANES(tri);
    unsigned mask = arg.triangle.plane_mask;
-   const int x = task->x + (mask & 0xff);
-   const int y = task->y + (mask >> 8);
+   int x, y;
    unsigned j;
 
+   /* Not in the current tile */
+   if (!lp_rast_contained_block(task, mask, &x, &y))
+      return;
+
    /* Iterate over partials:
     */
    {
@@ -438,6 +532,8 @@ TRI_4(struct lp_rasterizer_task *task,
 	 mask &= ~_mm_movemask_epi8(result);
       }
 
+      count_block_4(task, mask);
+
       if (mask)
 	 lp_rast_shade_quads_mask(task, &tri->inputs, x, y, mask);
    }
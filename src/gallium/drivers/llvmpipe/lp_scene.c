@@ -31,8 +31,11 @@
 #include "util/u_inlines.h"
 #include "util/simple_list.h"
 #include "util/u_format.h"
+#include "util/u_atomic.h"
 #include "lp_scene.h"
 #include "lp_fence.h"
+#include "lp_state_fs.h"
+#include "lp_screen.h"
 #include "lp_debug.h"
 
 
@@ -45,6 +48,15 @@ struct resource_ref {
    struct resource_ref *next;
 };
 
+#define SHADER_REF_SZ 32
+
+/** List of fragment shader variant references */
+struct shader_ref {
+   struct lp_fragment_shader_variant *variant[SHADER_REF_SZ];
+   int count;
+   struct shader_ref *next;
+};
+
 
 /**
  * Create a new scene object.
@@ -62,6 +74,21 @@ lp_scene_create( struct pipe_context *pipe )
    scene->data.head =
       CALLOC_STRUCT(data_block);
 
+   /* Start with enough bins for any framebuffer at the largest bin size,
+    * so binning can always fall back to that if growing the bins fails.
+    */
+   scene->max_bins = LP_SCENE_MIN_BINS;
+   scene->tile = CALLOC(scene->max_bins, sizeof *scene->tile);
+   scene->bin_order = MALLOC(scene->max_bins * sizeof *scene->bin_order);
+
+   if (!scene->data.head || !scene->tile || !scene->bin_order) {
+      FREE(scene->data.head);
+      FREE(scene->tile);
+      FREE(scene->bin_order);
+      FREE(scene);
+      return NULL;
+   }
+
    pipe_mutex_init(scene->mutex);
 
 #ifdef DEBUG
@@ -93,6 +120,13 @@ lp_scene_destroy(struct lp_scene *scene)
    pipe_mutex_destroy(scene->mutex);
    assert(scene->data.head->next == NULL);
    FREE(scene->data.head);
+   while (scene->data.free) {
+      struct data_block *block = scene->data.free;
+      scene->data.free = block->next;
+      FREE(block);
+   }
+   FREE(scene->tile);
+   FREE(scene->bin_order);
    FREE(scene);
 }
 
@@ -104,14 +138,11 @@ lp_scene_destroy(struct lp_scene *scene)
 boolean
 lp_scene_is_empty(struct lp_scene *scene )
 {
-   unsigned x, y;
+   unsigned i;
 
-   for (y = 0; y < TILES_Y; y++) {
-      for (x = 0; x < TILES_X; x++) {
-         const struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
-         if (bin->head) {
-            return FALSE;
-         }
+   for (i = 0; i < scene->max_bins; i++) {
+      if (scene->tile[i].head) {
+         return FALSE;
       }
    }
    return TRUE;
@@ -160,6 +191,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       if (!cbuf) {
          scene->cbufs[i].stride = 0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = NULL;
          continue;
       }
@@ -169,6 +201,8 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                            cbuf->u.tex.level);
          scene->cbufs[i].layer_stride = llvmpipe_layer_stride(cbuf->texture,
                                                               cbuf->u.tex.level);
+         scene->cbufs[i].sample_stride =
+            llvmpipe_resource(cbuf->texture)->sample_stride;
 
          scene->cbufs[i].map = llvmpipe_resource_map(cbuf->texture,
                                                      cbuf->u.tex.level,
@@ -181,6 +215,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
          unsigned pixstride = util_format_get_blocksize(cbuf->format);
          scene->cbufs[i].stride = cbuf->texture->width0;
          scene->cbufs[i].layer_stride = 0;
+         scene->cbufs[i].sample_stride = 0;
          scene->cbufs[i].map = lpr->data;
          scene->cbufs[i].map += cbuf->u.buf.first_element * pixstride;
          scene->cbufs[i].format_bytes = util_format_get_blocksize(cbuf->format);
@@ -191,6 +226,7 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
       struct pipe_surface *zsbuf = scene->fb.zsbuf;
       scene->zsbuf.stride = llvmpipe_resource_stride(zsbuf->texture, zsbuf->u.tex.level);
       scene->zsbuf.layer_stride = llvmpipe_layer_stride(zsbuf->texture, zsbuf->u.tex.level);
+      scene->zsbuf.sample_stride = llvmpipe_resource(zsbuf->texture)->sample_stride;
 
       scene->zsbuf.map = llvmpipe_resource_map(zsbuf->texture,
                                                zsbuf->u.tex.level,
@@ -198,6 +234,26 @@ lp_scene_begin_rasterization(struct lp_scene *scene)
                                                LP_TEX_USAGE_READ_WRITE);
       scene->zsbuf.format_bytes = util_format_get_blocksize(zsbuf->format);
    }
+
+   /*
+    * Hierarchical depth rejection only tracks one image per tile, so
+    * layered rendering doesn't get it.
+    */
+   scene->hiz = FALSE;
+   scene->hiz_quantum = 0.0f;
+   if (fb->zsbuf && scene->fb_max_layer == 0 && !(LP_PERF & PERF_NO_HIZ)) {
+      const struct util_format_description *desc =
+         util_format_description(fb->zsbuf->format);
+
+      if (util_format_has_depth(desc)) {
+         const struct util_format_channel_description *chan =
+            &desc->channel[desc->swizzle[0]];
+
+         scene->hiz = TRUE;
+         if (chan->type != UTIL_FORMAT_TYPE_FLOAT)
+            scene->hiz_quantum = 1.0f / (float)((1ULL << chan->size) - 1);
+      }
+   }
 }
 
 
@@ -249,6 +305,11 @@ lp_scene_end_rasterization(struct lp_scene *scene )
     */
    assert(lp_scene_is_empty(scene));
 
+   /* This may run on a rasterizer thread while the setup thread is
+    * checking resource references (lp_scene_is_resource_referenced()).
+    */
+   pipe_mutex_lock(scene->mutex);
+
    /* Decrement texture ref counts
     */
    {
@@ -274,30 +335,66 @@ lp_scene_end_rasterization(struct lp_scene *scene )
                       j, scene->resource_reference_size);
    }
 
-   /* Free all scene data blocks:
+   /* Decrement shader variant ref counts.  Evicted variants whose count
+    * drops to zero here are destroyed later by the context
+    * (llvmpipe_sweep_shader_variants()), not on this thread.
+    */
+   {
+      struct shader_ref *ref;
+      int i;
+
+      for (ref = scene->frag_shaders; ref; ref = ref->next) {
+         for (i = 0; i < ref->count; i++) {
+            p_atomic_dec(&ref->variant[i]->reference.count);
+            ref->variant[i] = NULL;
+         }
+      }
+   }
+
+   /* Put all scene data blocks but the head on the free list, and only
+    * release the ones recent scenes didn't need:
     */
    {
       struct data_block_list *list = &scene->data;
       struct data_block *block, *tmp;
+      unsigned nr_used = 0;
 
       for (block = list->head->next; block; block = tmp) {
          tmp = block->next;
-	 FREE(block);
+         block->next = list->free;
+         list->free = block;
+         list->nr_free++;
+         nr_used++;
+      }
+
+      list->nr_retain = MAX2(nr_used, list->nr_retain - list->nr_retain / 8);
+
+      while (list->nr_free > list->nr_retain) {
+         block = list->free;
+         list->free = block->next;
+         list->nr_free--;
+         FREE(block);
       }
 
       list->head->next = NULL;
       list->head->used = 0;
+      list->nr_allocs = 0;
    }
 
-   lp_fence_reference(&scene->fence, NULL);
-
    scene->resources = NULL;
+   scene->frag_shaders = NULL;
    scene->scene_size = 0;
    scene->resource_reference_size = 0;
 
    scene->alloc_failed = FALSE;
 
    util_unreference_framebuffer_state( &scene->fb );
+
+   pipe_mutex_unlock(scene->mutex);
+
+   /* Note the fence is left alone, it is owned by the setup code which
+    * releases it once it has waited for it.
+    */
 }
 
 
@@ -336,10 +433,19 @@ lp_scene_new_data_block( struct lp_scene *scene )
       return NULL;
    }
    else {
-      struct data_block *block = MALLOC_STRUCT(data_block);
-      if (!block)
-         return NULL;
-      
+      struct data_block *block = scene->data.free;
+
+      if (block) {
+         scene->data.free = block->next;
+         scene->data.nr_free--;
+      }
+      else {
+         block = MALLOC_STRUCT(data_block);
+         if (!block)
+            return NULL;
+         scene->data.nr_allocs++;
+      }
+
       scene->scene_size += sizeof *block;
 
       block->used = 0;
@@ -428,82 +534,252 @@ lp_scene_add_resource_reference(struct lp_scene *scene,
 
 
 /**
- * Does this scene have a reference to the given resource?
+ * Add a reference to a fragment shader variant by the scene, keeping
+ * the variant alive until the scene has been rasterized.
  */
 boolean
-lp_scene_is_resource_referenced(const struct lp_scene *scene,
+lp_scene_add_frag_shader_reference(struct lp_scene *scene,
+                                   struct lp_fragment_shader_variant *variant)
+{
+   struct shader_ref *ref, **last = &scene->frag_shaders;
+   int i;
+
+   /* Look at existing shader blocks:
+    */
+   for (ref = scene->frag_shaders; ref; ref = ref->next) {
+      last = &ref->next;
+
+      /* Search for this variant:
+       */
+      for (i = 0; i < ref->count; i++)
+         if (ref->variant[i] == variant)
+            return TRUE;
+
+      if (ref->count < SHADER_REF_SZ) {
+         /* If the block is half-empty, then append the reference here.
+          */
+         break;
+      }
+   }
+
+   /* Create a new block if no half-empty block was found.
+    */
+   if (!ref) {
+      assert(*last == NULL);
+      *last = lp_scene_alloc(scene, sizeof *ref);
+      if (*last == NULL)
+          return FALSE;
+
+      ref = *last;
+      memset(ref, 0, sizeof *ref);
+   }
+
+   /* Append the reference to the reference block.
+    */
+   pipe_reference(NULL, &variant->reference);
+   ref->variant[ref->count++] = variant;
+
+   return TRUE;
+}
+
+
+/**
+ * Does this scene have a reference to the given resource?
+ * Returns a mask of LP_REFERENCED_FOR_READ/WRITE bits.
+ * Safe to call while the scene is being rasterized.
+ */
+unsigned
+lp_scene_is_resource_referenced(struct lp_scene *scene,
                                 const struct pipe_resource *resource)
 {
    const struct resource_ref *ref;
+   unsigned referenced = LP_UNREFERENCED;
    int i;
 
+   pipe_mutex_lock(scene->mutex);
+
+   /* render targets */
+   for (i = 0; i < scene->fb.nr_cbufs; i++) {
+      if (scene->fb.cbufs[i] && scene->fb.cbufs[i]->texture == resource) {
+         referenced = LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+         goto end;
+      }
+   }
+   if (scene->fb.zsbuf && scene->fb.zsbuf->texture == resource) {
+      referenced = LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
+      goto end;
+   }
+
+   /* textures */
    for (ref = scene->resources; ref; ref = ref->next) {
-      for (i = 0; i < ref->count; i++)
-         if (ref->resource[i] == resource)
-            return TRUE;
+      for (i = 0; i < ref->count; i++) {
+         if (ref->resource[i] == resource) {
+            referenced = LP_REFERENCED_FOR_READ;
+            goto end;
+         }
+      }
    }
 
-   return FALSE;
+end:
+   pipe_mutex_unlock(scene->mutex);
+   return referenced;
 }
 
 
 
 
-/** advance curr_x,y to the next bin */
-static boolean
-next_bin(struct lp_scene *scene)
+/**
+ * Extract the even bits of a Morton code.
+ */
+static inline unsigned
+morton_compact(unsigned v)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return FALSE;
+   v &= 0x55555555;
+   v = (v | (v >> 1)) & 0x33333333;
+   v = (v | (v >> 2)) & 0x0f0f0f0f;
+   v = (v | (v >> 4)) & 0x00ff00ff;
+   v = (v | (v >> 8)) & 0x0000ffff;
+   return v;
+}
+
+
+/**
+ * Lay out the scene's bins in Morton (Z) order, so that bins handed out
+ * consecutively are close to each other on screen.
+ */
+static void
+compute_bin_order(struct lp_scene *scene)
+{
+   unsigned size = util_next_power_of_two(MAX2(scene->tiles_x,
+                                               scene->tiles_y));
+   unsigned n = 0;
+   unsigned i;
+
+   STATIC_ASSERT(TILES_X <= 256 && TILES_Y <= 256);
+   assert(lp_scene_get_num_bins(scene) <= scene->max_bins);
+
+   for (i = 0; i < size * size; i++) {
+      unsigned x = morton_compact(i);
+      unsigned y = morton_compact(i >> 1);
+      if (x < scene->tiles_x && y < scene->tiles_y) {
+         scene->bin_order[n].x = x;
+         scene->bin_order[n].y = y;
+         n++;
+      }
    }
-   return TRUE;
+   assert(n == lp_scene_get_num_bins(scene));
+
+   scene->order_tiles_x = scene->tiles_x;
+   scene->order_tiles_y = scene->tiles_y;
 }
 
 
 void
 lp_scene_bin_iter_begin( struct lp_scene *scene )
 {
-   scene->curr_x = scene->curr_y = -1;
+   scene->curr_bin = -1;
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
+ * The lp_scene::curr_bin field will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  This is lock-free: each call atomically
+ * claims the next bin in lp_scene::bin_order.
  */
 struct cmd_bin *
 lp_scene_bin_iter_next( struct lp_scene *scene , int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
-
-   pipe_mutex_lock(scene->mutex);
+   int i = p_atomic_inc_return(&scene->curr_bin);
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   }
-   else if (!next_bin(scene)) {
+   if (i >= (int) lp_scene_get_num_bins(scene)) {
       /* no more bins left */
-      goto end;
+      return NULL;
    }
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+   *x = scene->bin_order[i].x;
+   *y = scene->bin_order[i].y;
 
-end:
    /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   pipe_mutex_unlock(scene->mutex);
-   return bin;
+   return lp_scene_get_bin(scene, *x, *y);
+}
+
+
+/**
+ * Pick the bin size for a framebuffer.
+ *
+ * Every bin costs a command list walk and a tile load/store per thread,
+ * and large triangles get binned once per bin they touch, so fewer, larger
+ * bins are cheaper.  But bins are also the unit of work handed out to the
+ * rasterizer threads, so keep enough of them around for load balancing.
+ */
+static unsigned
+choose_bin_order(const struct lp_scene *scene,
+                 const struct pipe_framebuffer_state *fb)
+{
+   const struct llvmpipe_screen *screen = llvmpipe_screen(scene->pipe->screen);
+   unsigned min_bins = MAX2(screen->num_threads, 1) * LP_MIN_BINS_PER_THREAD;
+   unsigned order = TILE_ORDER;
+
+   if (screen->bin_order)
+      return screen->bin_order;
+
+   while (order < LP_MAX_BIN_ORDER) {
+      unsigned size = 1 << (order + 1);
+      unsigned num_bins = (align(fb->width, size) >> (order + 1)) *
+                          (align(fb->height, size) >> (order + 1));
+      if (num_bins < min_bins)
+         break;
+      order++;
+   }
+
+   return order;
+}
+
+
+static void
+set_bin_order(struct lp_scene *scene,
+              const struct pipe_framebuffer_state *fb,
+              unsigned order)
+{
+   scene->tile_order = order;
+   scene->tile_size = 1 << order;
+   scene->tiles_x = align(fb->width, scene->tile_size) >> order;
+   scene->tiles_y = align(fb->height, scene->tile_size) >> order;
+   assert(scene->tiles_x <= TILES_X);
+   assert(scene->tiles_y <= TILES_Y);
+}
+
+
+/**
+ * Make room for num_bins bins.  The bins are all empty at this point.
+ */
+static boolean
+grow_bins(struct lp_scene *scene, unsigned num_bins)
+{
+   struct cmd_bin *tile;
+   void *bin_order;
+
+   tile = CALLOC(num_bins, sizeof *scene->tile);
+   bin_order = MALLOC(num_bins * sizeof *scene->bin_order);
+   if (!tile || !bin_order) {
+      FREE(tile);
+      FREE(bin_order);
+      return FALSE;
+   }
+
+   FREE(scene->tile);
+   FREE(scene->bin_order);
+   scene->tile = tile;
+   scene->bin_order = bin_order;
+   scene->max_bins = num_bins;
+
+   /* Force recomputation of the bin order */
+   scene->order_tiles_x = 0;
+   scene->order_tiles_y = 0;
+
+   return TRUE;
 }
 
 
@@ -518,10 +794,21 @@ void lp_scene_begin_binning( struct lp_scene *scene,
    scene->discard = discard;
    util_copy_framebuffer_state(&scene->fb, fb);
 
-   scene->tiles_x = align(fb->width, TILE_SIZE) / TILE_SIZE;
-   scene->tiles_y = align(fb->height, TILE_SIZE) / TILE_SIZE;
-   assert(scene->tiles_x <= TILES_X);
-   assert(scene->tiles_y <= TILES_Y);
+   set_bin_order(scene, fb, choose_bin_order(scene, fb));
+
+   if (lp_scene_get_num_bins(scene) > scene->max_bins &&
+       !grow_bins(scene, lp_scene_get_num_bins(scene))) {
+      /* Out of memory: the largest bins always fit. */
+      set_bin_order(scene, fb, LP_MAX_BIN_ORDER);
+   }
+
+   if (LP_DEBUG & DEBUG_SCENE)
+      debug_printf("%s: %ux%u bins of %u pixels\n", __FUNCTION__,
+                   scene->tiles_x, scene->tiles_y, scene->tile_size);
+
+   if (scene->tiles_x != scene->order_tiles_x ||
+       scene->tiles_y != scene->order_tiles_y)
+      compute_bin_order(scene);
 
    /*
     * Determine how many layers the fb has (used for clamping layer value).
@@ -546,6 +833,8 @@ void lp_scene_begin_binning( struct lp_scene *scene,
       max_layer = MIN2(max_layer, zsbuf->u.tex.last_layer - zsbuf->u.tex.first_layer);
    }
    scene->fb_max_layer = max_layer;
+
+   scene->nr_samples = util_framebuffer_get_num_samples(fb);
 }
 
 
@@ -557,6 +846,8 @@ void lp_scene_end_binning( struct lp_scene *scene )
                    scene->scene_size);
       debug_printf("  data size: %u\n",
                    lp_scene_data_size(scene));
+      debug_printf("  blocks malloced: %u, spare: %u\n",
+                   scene->data.nr_allocs, scene->data.nr_free);
 
       if (0)
          lp_debug_bins( scene );
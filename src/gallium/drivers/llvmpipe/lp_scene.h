@@ -42,12 +42,19 @@
 struct lp_scene_queue;
 struct lp_rast_state;
 
-/* We're limited to 2K by 2K for 32bit fixed point rasterization.
- * Will need a 64-bit version for larger framebuffers.
+/* Upper bound on the number of bins in each dimension, for the largest
+ * framebuffer and the smallest bin size.  The bin arrays themselves are
+ * sized to the framebuffer, see lp_scene_begin_binning().
  */
 #define TILES_X (LP_MAX_WIDTH / TILE_SIZE)
 #define TILES_Y (LP_MAX_HEIGHT / TILE_SIZE)
 
+/* Number of bins the scene can always hold, whatever the framebuffer size:
+ * enough for the largest framebuffer binned with the largest bins.
+ */
+#define LP_SCENE_MIN_BINS ((LP_MAX_WIDTH >> LP_MAX_BIN_ORDER) * \
+                           (LP_MAX_HEIGHT >> LP_MAX_BIN_ORDER))
+
 
 /* Commands per command block (ideally so sizeof(cmd_block) is a power of
  * two in size.)
@@ -113,9 +120,23 @@ struct cmd_bin {
 struct data_block_list {
    struct data_block first;
    struct data_block *head;
+
+   /** Blocks of previous scenes kept for reuse, so that binning doesn't
+    * need to malloc in steady state.
+    */
+   struct data_block *free;
+   unsigned nr_free;
+   /** Number of free blocks to keep, decays slowly towards the number of
+    * blocks recent scenes needed.
+    */
+   unsigned nr_retain;
+   /** Blocks which had to be malloc'ed while binning the scene */
+   unsigned nr_allocs;
 };
 
 struct resource_ref;
+struct shader_ref;
+struct lp_fragment_shader_variant;
 
 /**
  * All bins and bin data are contained here.
@@ -142,18 +163,31 @@ struct lp_scene {
       uint8_t *map;
       unsigned stride;
       unsigned layer_stride;
+      unsigned sample_stride;
       unsigned format_bytes;
    } zsbuf, cbufs[PIPE_MAX_COLOR_BUFS];
 
    /* The amount of layers in the fb (minimum of all attachments) */
    unsigned fb_max_layer;
 
+   /* Number of samples of the fb attachments, 1 if not multisampled */
+   unsigned nr_samples;
+
+   /* Whether the rasterizer keeps per tile depth bounds for hierarchical
+    * depth rejection, and the precision of the depth buffer values.
+    */
+   boolean hiz;
+   float hiz_quantum;
+
    /** the framebuffer to render the scene into */
    struct pipe_framebuffer_state fb;
 
    /** list of resources referenced by the scene commands */
    struct resource_ref *resources;
 
+   /** list of frag shader variants referenced by the scene commands */
+   struct shader_ref *frag_shaders;
+
    /** Total memory used by the scene (in bytes).  This sums all the
     * data blocks and counts all bins, state, resource references and
     * other random allocations within the scene.
@@ -168,15 +202,36 @@ struct lp_scene {
    boolean alloc_failed;
    boolean discard;
    /**
-    * Number of active tiles in each dimension.
-    * This basically the framebuffer size divided by tile size
+    * Size of the bins, in pixels (1 << tile_order).  This is a multiple
+    * of TILE_SIZE, chosen per scene in lp_scene_begin_binning().
+    */
+   unsigned tile_order, tile_size;
+
+   /**
+    * Number of active bins in each dimension.
+    * This basically the framebuffer size divided by bin size
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
+   /**
+    * Order in which the rasterizer threads pick up bins (Morton order,
+    * for texture/framebuffer locality).  Only recomputed when the
+    * number of bins changes, see lp_scene_begin_binning().
+    */
+   struct {
+      uint8_t x, y;
+   } *bin_order;
+   unsigned order_tiles_x, order_tiles_y;
+
+   int curr_bin;  /**< for iterating over bins, index into bin_order */
    pipe_mutex mutex;
 
-   struct cmd_bin tile[TILES_X][TILES_Y];
+   /** The bins, tiles_x * tiles_y of them in row-major order.  Room for
+    * max_bins is allocated; this only grows with the framebuffer size.
+    */
+   struct cmd_bin *tile;
+   unsigned max_bins;
+
    struct data_block_list data;
 };
 
@@ -199,8 +254,11 @@ boolean lp_scene_add_resource_reference(struct lp_scene *scene,
                                         struct pipe_resource *resource,
                                         boolean initializing_scene);
 
-boolean lp_scene_is_resource_referenced(const struct lp_scene *scene,
-                                        const struct pipe_resource *resource );
+boolean lp_scene_add_frag_shader_reference(struct lp_scene *scene,
+                                           struct lp_fragment_shader_variant *variant);
+
+unsigned lp_scene_is_resource_referenced(struct lp_scene *scene,
+                                         const struct pipe_resource *resource );
 
 
 /**
@@ -285,7 +343,7 @@ lp_scene_putback_data( struct lp_scene *scene, unsigned size)
 static inline struct cmd_bin *
 lp_scene_get_bin(struct lp_scene *scene, unsigned x, unsigned y)
 {
-   return &scene->tile[x][y];
+   return &scene->tile[y * scene->tiles_x + x];
 }
 
 
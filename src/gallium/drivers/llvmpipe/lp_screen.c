@@ -35,6 +35,7 @@
 #include "pipe/p_defines.h"
 #include "pipe/p_screen.h"
 #include "draw/draw_context.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_type.h"
 
 #include "os/os_misc.h"
@@ -45,12 +46,18 @@
 #include "lp_screen.h"
 #include "lp_context.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
+#include "lp_compile_queue.h"
 
 #include "state_tracker/sw_winsys.h"
 
+#ifdef PIPE_OS_LINUX
+#include <sched.h>
+#endif
+
 #ifdef DEBUG
 int LP_DEBUG = 0;
 
@@ -81,6 +88,7 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_blend",       PERF_NO_BLEND, NULL },
    { "no_depth",       PERF_NO_DEPTH, NULL },
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -210,7 +218,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_QUADS_FOLLOW_PROVOKING_VERTEX_CONVENTION:
       return 0;
    case PIPE_CAP_COMPUTE:
-      return 0;
+      return 1;
    case PIPE_CAP_USER_VERTEX_BUFFERS:
    case PIPE_CAP_USER_INDEX_BUFFERS:
       return 1;
@@ -229,7 +237,7 @@ llvmpipe_get_param(struct pipe_screen *screen, enum pipe_cap param)
    case PIPE_CAP_CONSTANT_BUFFER_OFFSET_ALIGNMENT:
       return 16;
    case PIPE_CAP_TEXTURE_MULTISAMPLE:
-      return 0;
+      return 1;
    case PIPE_CAP_MIN_MAP_BUFFER_ALIGNMENT:
       return 64;
    case PIPE_CAP_TEXTURE_BUFFER_OBJECTS:
@@ -352,11 +360,84 @@ llvmpipe_get_shader_param(struct pipe_screen *screen, unsigned shader, enum pipe
       default:
          return draw_get_shader_param(shader, param);
       }
+   case PIPE_SHADER_COMPUTE:
+      switch (param) {
+      case PIPE_SHADER_CAP_MAX_TEXTURE_SAMPLERS:
+      case PIPE_SHADER_CAP_MAX_SAMPLER_VIEWS:
+         /* The compute shader path has no texture sampling */
+         return 0;
+      case PIPE_SHADER_CAP_MAX_INPUTS:
+      case PIPE_SHADER_CAP_MAX_OUTPUTS:
+         return 0;
+      case PIPE_SHADER_CAP_MAX_SHADER_BUFFERS:
+         return PIPE_MAX_SHADER_BUFFERS;
+      default:
+         return gallivm_get_shader_param(param);
+      }
    default:
       return 0;
    }
 }
 
+static int
+llvmpipe_get_compute_param(struct pipe_screen *_screen,
+                           enum pipe_compute_cap param,
+                           void *ret)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
+
+#define RET(x) do {                  \
+   if (ret)                          \
+      memcpy(ret, x, sizeof(x));     \
+   return sizeof(x);                 \
+} while (0)
+
+   switch (param) {
+   case PIPE_COMPUTE_CAP_GRID_DIMENSION:
+      RET((uint64_t []) { 3 });
+   case PIPE_COMPUTE_CAP_MAX_GRID_SIZE:
+      STATIC_ASSERT((uint64_t) LP_MAX_CS_GRID_SIZE_X * LP_MAX_CS_GRID_SIZE_Y *
+                    LP_MAX_CS_GRID_SIZE_Z <= LP_MAX_CS_BLOCKS_PER_GRID);
+      RET(((uint64_t []) { LP_MAX_CS_GRID_SIZE_X, LP_MAX_CS_GRID_SIZE_Y,
+                           LP_MAX_CS_GRID_SIZE_Z }));
+   case PIPE_COMPUTE_CAP_MAX_BLOCK_SIZE:
+      RET(((uint64_t []) { LP_MAX_CS_THREADS_PER_BLOCK,
+                           LP_MAX_CS_THREADS_PER_BLOCK, 64 }));
+   case PIPE_COMPUTE_CAP_MAX_THREADS_PER_BLOCK:
+      RET((uint64_t []) { LP_MAX_CS_THREADS_PER_BLOCK });
+   case PIPE_COMPUTE_CAP_MAX_LOCAL_SIZE:
+      RET((uint64_t []) { LP_MAX_CS_LOCAL_SIZE });
+   case PIPE_COMPUTE_CAP_MAX_INPUT_SIZE:
+      RET((uint64_t []) { LP_MAX_CS_INPUT_SIZE });
+   case PIPE_COMPUTE_CAP_MAX_MEM_ALLOC_SIZE:
+      /* Global buffers must be addressable, see LP_CS_GLOBAL_OFFSET_BITS */
+      RET((uint64_t []) { MIN2(LP_MAX_TEXTURE_SIZE,
+                               1ULL << LP_CS_GLOBAL_OFFSET_BITS) });
+   case PIPE_COMPUTE_CAP_MAX_COMPUTE_UNITS:
+      RET((uint32_t []) { MAX2(1, screen->num_threads) });
+   case PIPE_COMPUTE_CAP_SUBGROUP_SIZE:
+      RET((uint32_t []) { MIN2(lp_native_vector_width / 32, 16) });
+   case PIPE_COMPUTE_CAP_IMAGES_SUPPORTED:
+      RET((uint32_t []) { 0 });
+   case PIPE_COMPUTE_CAP_MAX_GLOBAL_SIZE:
+      RET((uint64_t []) { (uint64_t) LP_MAX_CS_GLOBAL_BUFFERS <<
+                          LP_CS_GLOBAL_OFFSET_BITS });
+   case PIPE_COMPUTE_CAP_MAX_PRIVATE_SIZE:
+      /* PRIVATE resources aren't supported */
+      RET((uint64_t []) { 0 });
+   case PIPE_COMPUTE_CAP_IR_TARGET:
+      /* Kernels are run from TGSI, there is no target to compile for */
+      RET("llvmpipe");
+   case PIPE_COMPUTE_CAP_MAX_CLOCK_FREQUENCY:
+      /* MHz, arbitrary */
+      RET((uint32_t []) { 1000 });
+   default:
+      return 0;
+   }
+
+#undef RET
+}
+
 static float
 llvmpipe_get_paramf(struct pipe_screen *screen, enum pipe_capf param)
 {
@@ -415,8 +496,15 @@ llvmpipe_is_format_supported( struct pipe_screen *_screen,
           target == PIPE_TEXTURE_CUBE ||
           target == PIPE_TEXTURE_CUBE_ARRAY);
 
-   if (sample_count > 1)
-      return FALSE;
+   if (sample_count > 1) {
+      if (sample_count != LP_MAX_SAMPLES)
+         return FALSE;
+      if ((target != PIPE_TEXTURE_2D &&
+           target != PIPE_TEXTURE_2D_ARRAY) ||
+          (bind & PIPE_BIND_DISPLAY_TARGET) ||
+          util_format_is_compressed(format))
+         return FALSE;
+   }
 
    if (bind & PIPE_BIND_RENDER_TARGET) {
       if (format_desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB) {
@@ -509,6 +597,19 @@ llvmpipe_flush_frontbuffer(struct pipe_screen *_screen,
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
    struct llvmpipe_resource *texture = llvmpipe_resource(resource);
+   struct lp_fence *fence = NULL;
+
+   /* Scenes are rasterized asynchronously, make sure everything queued
+    * so far (which includes the rendering to this display target) has
+    * landed before presenting it.
+    */
+   pipe_mutex_lock(screen->rast_mutex);
+   lp_fence_reference(&fence, screen->last_fence);
+   pipe_mutex_unlock(screen->rast_mutex);
+   if (fence) {
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
 
    assert(texture->dt);
    if (texture->dt)
@@ -521,15 +622,23 @@ llvmpipe_destroy_screen( struct pipe_screen *_screen )
    struct llvmpipe_screen *screen = llvmpipe_screen(_screen);
    struct sw_winsys *winsys = screen->winsys;
 
+   if (screen->compile_queue)
+      lp_compile_queue_destroy(screen->compile_queue);
+
    if (screen->rast)
       lp_rast_destroy(screen->rast);
 
+   lp_fence_reference(&screen->last_fence, NULL);
+
+   gallivm_cache_print_stats();
+
    lp_jit_screen_cleanup(screen);
 
    if(winsys->destroy)
       winsys->destroy(winsys);
 
    pipe_mutex_destroy(screen->rast_mutex);
+   pipe_mutex_destroy(screen->tex_mutex);
 
    FREE(screen);
 }
@@ -575,6 +684,148 @@ llvmpipe_get_timestamp(struct pipe_screen *_screen)
    return os_time_get_nano();
 }
 
+
+static int
+llvmpipe_get_driver_query_info(struct pipe_screen *screen,
+                               unsigned index,
+                               struct pipe_driver_query_info *info)
+{
+#define QUERY(NAME, COUNTER, UNITS) \
+   {NAME, LP_QUERY_PERF(COUNTER), {0}, UNITS, \
+    PIPE_DRIVER_QUERY_RESULT_TYPE_AVERAGE, 0, 0x0}
+
+   static const struct pipe_driver_query_info queries[] = {
+      /* setup */
+      QUERY("lp-tris-binned", LP_PERF_TRIS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-tris-culled", LP_PERF_CULLED_TRIS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-tiles-empty-64", LP_PERF_EMPTY_64,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-tiles-partial-64", LP_PERF_PARTIALLY_COVERED_64,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-tiles-full-64", LP_PERF_FULLY_COVERED_64,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-tiles-opaque-64", LP_PERF_SHADE_OPAQUE_64,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-scene-size", LP_PERF_SCENE_BYTES,
+            PIPE_DRIVER_QUERY_TYPE_BYTES),
+      QUERY("lp-scene-peak-size", LP_PERF_SCENE_PEAK_BYTES,
+            PIPE_DRIVER_QUERY_TYPE_BYTES),
+      QUERY("lp-scene-block-allocs", LP_PERF_SCENE_BLOCK_ALLOCS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-scene-waits", LP_PERF_SCENE_WAITS,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+
+      /* rasterizer, summed over the threads */
+      QUERY("lp-blocks-empty-16", LP_PERF_EMPTY_16,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-blocks-partial-16", LP_PERF_PARTIALLY_COVERED_16,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-blocks-full-16", LP_PERF_FULLY_COVERED_16,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-blocks-empty-4", LP_PERF_EMPTY_4,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-blocks-partial-4", LP_PERF_PARTIALLY_COVERED_4,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-blocks-full-4", LP_PERF_FULLY_COVERED_4,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-hiz-tested-16", LP_PERF_HIZ_TESTED_16,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-hiz-rejected-16", LP_PERF_HIZ_REJECTED_16,
+            PIPE_DRIVER_QUERY_TYPE_UINT64),
+      QUERY("lp-rast-busy-time", LP_PERF_RAST_TIME,
+            PIPE_DRIVER_QUERY_TYPE_MICROSECONDS),
+   };
+#undef QUERY
+
+   STATIC_ASSERT(Elements(queries) == LP_PERF_COUNTERS);
+
+   if (!info)
+      return Elements(queries);
+
+   if (index >= Elements(queries))
+      return 0;
+
+   *info = queries[index];
+   return 1;
+}
+
+
+static int
+llvmpipe_get_driver_query_group_info(struct pipe_screen *screen,
+                                     unsigned index,
+                                     struct pipe_driver_query_group_info *info)
+{
+   if (!info)
+      return 1;
+
+   if (index != 0)
+      return 0;
+
+   info->name = "llvmpipe";
+   info->max_active_queries = LP_MAX_ACTIVE_BINNED_QUERIES;
+   info->num_queries = LP_PERF_COUNTERS;
+   return 1;
+}
+
+/**
+ * Parse a CPU list such as "0-7,16,18-19" (the taskset/cpuset syntax)
+ * into an array of CPU numbers.
+ * \return the number of CPUs stored in \p cpus
+ */
+static unsigned
+lp_parse_cpu_list(const char *str, unsigned *cpus, unsigned max_cpus)
+{
+   unsigned n = 0;
+
+   while (*str && n < max_cpus) {
+      unsigned first, last, cpu;
+      char *end;
+
+      first = last = strtoul(str, &end, 10);
+      if (end == str)
+         break;
+      str = end;
+
+      if (*str == '-') {
+         str++;
+         last = strtoul(str, &end, 10);
+         if (end == str)
+            break;
+         str = end;
+      }
+
+      for (cpu = first; cpu <= last && n < max_cpus; cpu++)
+         cpus[n++] = cpu;
+
+      if (*str != ',')
+         break;
+      str++;
+   }
+
+   return n;
+}
+
+
+/**
+ * Number of CPUs we're allowed to run on.  This can be much less than
+ * the number of CPUs in the machine, e.g. inside a container or when
+ * started with taskset.
+ */
+static unsigned
+lp_get_num_allowed_cpus(void)
+{
+#if defined(PIPE_OS_LINUX) && defined(CPU_COUNT)
+   cpu_set_t set;
+
+   if (sched_getaffinity(0, sizeof set, &set) == 0 && CPU_COUNT(&set) > 0)
+      return MIN2(CPU_COUNT(&set), util_cpu_caps.nr_cpus);
+#endif
+   return util_cpu_caps.nr_cpus;
+}
+
+
 /**
  * Create a new pipe_screen object
  * Note: we're not presently subclassing pipe_screen (no llvmpipe_screen).
@@ -610,6 +861,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.get_device_vendor = llvmpipe_get_vendor; // TODO should be the CPU vendor
    screen->base.get_param = llvmpipe_get_param;
    screen->base.get_shader_param = llvmpipe_get_shader_param;
+   screen->base.get_compute_param = llvmpipe_get_compute_param;
    screen->base.get_paramf = llvmpipe_get_paramf;
    screen->base.is_format_supported = llvmpipe_is_format_supported;
 
@@ -619,23 +871,68 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->base.fence_finish = llvmpipe_fence_finish;
 
    screen->base.get_timestamp = llvmpipe_get_timestamp;
+   screen->base.get_driver_query_info = llvmpipe_get_driver_query_info;
+   screen->base.get_driver_query_group_info = llvmpipe_get_driver_query_group_info;
 
    llvmpipe_init_screen_resource_funcs(&screen->base);
 
-   screen->num_threads = util_cpu_caps.nr_cpus > 1 ? util_cpu_caps.nr_cpus : 0;
+   {
+      /* LP_CPUS pins the rasterizer threads to the given CPUs */
+      const char *cpu_list = debug_get_option("LP_CPUS", NULL);
+      unsigned nr_cpus = lp_get_num_allowed_cpus();
+
+      if (cpu_list) {
+         screen->num_thread_cpus = lp_parse_cpu_list(cpu_list,
+                                                     screen->thread_cpus,
+                                                     LP_MAX_THREADS);
+         if (screen->num_thread_cpus)
+            nr_cpus = screen->num_thread_cpus;
+      }
+
+      screen->num_threads = nr_cpus > 1 ? nr_cpus : 0;
+   }
 #ifdef PIPE_SUBSYSTEM_EMBEDDED
    screen->num_threads = 0;
 #endif
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS", screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
 
-   screen->rast = lp_rast_create(screen->num_threads);
+   /* Without rasterizer threads scenes are rendered synchronously, so
+    * there's nothing to gain from more than one scene per context.
+    */
+   screen->num_scenes = screen->num_threads ? 2 : 1;
+   screen->num_scenes = debug_get_num_option("LP_NUM_SCENES", screen->num_scenes);
+   screen->num_scenes = CLAMP(screen->num_scenes, 1, LP_MAX_SCENES);
+
+   {
+      unsigned bin_size = debug_get_num_option("LP_BIN_SIZE", 0);
+      if (bin_size)
+         screen->bin_order = CLAMP(util_logbase2(bin_size),
+                                   TILE_ORDER, LP_MAX_BIN_ORDER);
+   }
+
+   screen->tiled_textures = debug_get_bool_option("LP_TILED_TEXTURES", FALSE);
+
+   screen->rast = lp_rast_create(screen->num_threads,
+                                 screen->thread_cpus,
+                                 screen->num_thread_cpus);
    if (!screen->rast) {
       lp_jit_screen_cleanup(screen);
       FREE(screen);
       return NULL;
    }
    pipe_mutex_init(screen->rast_mutex);
+   pipe_mutex_init(screen->tex_mutex);
+
+   /* Optimized fragment shader variants are compiled in the background
+    * while a quickly compiled unoptimized one is used, when requested.
+    */
+   {
+      unsigned num_compile_threads =
+         debug_get_num_option("LP_NUM_COMPILE_THREADS", 0);
+      if (num_compile_threads)
+         screen->compile_queue = lp_compile_queue_create(num_compile_threads);
+   }
 
    util_format_s3tc_init();
 
@@ -38,9 +38,12 @@
 #include "pipe/p_defines.h"
 #include "os/os_thread.h"
 #include "gallivm/lp_bld.h"
+#include "lp_limits.h"
 
 
 struct sw_winsys;
+struct lp_fence;
+struct lp_compile_queue;
 
 
 struct llvmpipe_screen
@@ -51,12 +54,42 @@ struct llvmpipe_screen
 
    unsigned num_threads;
 
+   /** CPUs to pin the rasterizer threads to (LP_CPUS), if any */
+   unsigned thread_cpus[LP_MAX_THREADS];
+   unsigned num_thread_cpus;
+
+   /** Number of scenes per context, see lp_setup_context::scenes */
+   unsigned num_scenes;
+
+   /** Fixed log2 of the scene bin size (LP_BIN_SIZE), or 0 to choose the
+    * bin size per scene, see lp_scene_begin_binning()
+    */
+   unsigned bin_order;
+
+   /** Store sampled textures tiled (LP_TILED_TEXTURES), see lp_texture.c */
+   boolean tiled_textures;
+
    /* Increments whenever textures are modified.  Contexts can track this.
     */
    unsigned timestamp;
 
+   /** Serializes llvmpipe_resource_make_linear() against the contexts
+    * taking a snapshot of texture layouts for sampling.
+    */
+   pipe_mutex tex_mutex;
+
    struct lp_rasterizer *rast;
    pipe_mutex rast_mutex;
+
+   /** Background shader compilation threads (LP_NUM_COMPILE_THREADS),
+    * NULL when shaders are compiled synchronously.
+    */
+   struct lp_compile_queue *compile_queue;
+
+   /** Fence of the last scene queued to the rasterizer (by any context),
+    * protected by rast_mutex.
+    */
+   struct lp_fence *last_fence;
 };
 
 
@@ -69,16 +69,23 @@ lp_setup_get_empty_scene(struct lp_setup_context *setup)
    assert(setup->scene == NULL);
 
    setup->scene_idx++;
-   setup->scene_idx %= Elements(setup->scenes);
+   setup->scene_idx %= setup->num_scenes;
 
    setup->scene = setup->scenes[setup->scene_idx];
 
+   /* The rasterizer signals the fence only once it has finished with the
+    * scene (lp_rast_end), so after this the scene is free for reuse.
+    */
    if (setup->scene->fence) {
+      if (!lp_fence_signalled(setup->scene->fence))
+         setup->counters[LP_PERF_SCENE_WAITS]++;
+
       if (LP_DEBUG & DEBUG_SETUP)
          debug_printf("%s: wait for scene %d\n",
                       __FUNCTION__, setup->scene->fence->id);
 
       lp_fence_wait(setup->scene->fence);
+      lp_fence_reference(&setup->scene->fence, NULL);
    }
 
    lp_scene_begin_binning(setup->scene, &setup->fb, setup->rasterizer_discard);
@@ -157,6 +164,11 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
    memcpy(scene->active_queries, setup->active_queries,
           scene->num_active_queries * sizeof(scene->active_queries[0]));
 
+   setup->counters[LP_PERF_SCENE_BYTES] += scene->scene_size;
+   setup->counters[LP_PERF_SCENE_PEAK_BYTES] =
+      MAX2(setup->counters[LP_PERF_SCENE_PEAK_BYTES], scene->scene_size);
+   setup->counters[LP_PERF_SCENE_BLOCK_ALLOCS] += scene->data.nr_allocs;
+
    lp_scene_end_binning(scene);
 
    lp_fence_reference(&setup->last_fence, scene->fence);
@@ -166,21 +178,17 @@ lp_setup_rasterize_scene( struct lp_setup_context *setup )
 
    pipe_mutex_lock(screen->rast_mutex);
 
-   /* FIXME: We enqueue the scene then wait on the rasterizer to finish.
-    * This means we never actually run any vertex stuff in parallel to
-    * rasterization (not in the same context at least) which is what the
-    * multiple scenes per setup is about - when we get a new empty scene
-    * any old one is already empty again because we waited here for
-    * raster tasks to be finished. Ideally, we shouldn't need to wait here
-    * and rely on fences elsewhere when waiting is necessary.
-    * Certainly, lp_scene_end_rasterization() would need to be deferred too
-    * and there's probably other bits why this doesn't actually work.
+   /* We don't wait for the rasterizer here.  The scene is released by
+    * the rasterizer (lp_rast_end) which then signals the scene's fence;
+    * anybody needing the results (lp_setup_get_empty_scene(), queries,
+    * resource mapping, flush_frontbuffer) waits on the fences instead.
+    * Scenes are rasterized in submission order, so waiting for the last
+    * fence implies all earlier scenes have completed too.
     */
+   lp_fence_reference(&screen->last_fence, scene->fence);
    lp_rast_queue_scene(screen->rast, scene);
-   lp_rast_finish(screen->rast);
    pipe_mutex_unlock(screen->rast_mutex);
 
-   lp_scene_end_rasterization(setup->scene);
    lp_setup_reset( setup );
 
    LP_DBG(DEBUG_SETUP, "%s done \n", __FUNCTION__);
@@ -198,9 +206,10 @@ begin_binning( struct lp_setup_context *setup )
    assert(scene);
    assert(scene->fence == NULL);
 
-   /* Always create a fence:
+   /* Always create a fence.  It is signalled once, by the rasterizer,
+    * after all threads are done with the scene:
     */
-   scene->fence = lp_fence_create(MAX2(1, setup->num_threads));
+   scene->fence = lp_fence_create(1);
    if (!scene->fence)
       return FALSE;
 
@@ -342,6 +351,7 @@ set_scene_state( struct lp_setup_context *setup,
 fail:
    if (setup->scene) {
       lp_scene_end_rasterization(setup->scene);
+      lp_fence_reference(&setup->scene->fence, NULL);
       setup->scene = NULL;
    }
 
@@ -635,7 +645,20 @@ lp_setup_set_fs_variant( struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %p\n", __FUNCTION__,
           variant);
-   /* FIXME: reference count */
+
+   /* Hold a reference for as long as setup points at the variant, so that
+    * removing it from the variant cache can't free it under us.  If this
+    * drops the last reference the variant is already retired, and
+    * llvmpipe_sweep_shader_variants() destroys it.
+    */
+   if (setup->fs.current.variant != variant) {
+      struct lp_fragment_shader_variant *old = setup->fs.current.variant;
+
+      if (variant)
+         pipe_reference(NULL, &variant->reference);
+      if (old)
+         pipe_reference(&old->reference, NULL);
+   }
 
    setup->fs.current.variant = variant;
    setup->dirty |= LP_SETUP_NEW_FS;
@@ -739,6 +762,35 @@ lp_setup_set_rasterizer_discard( struct lp_setup_context *setup,
    }
 }
 
+void
+lp_setup_set_multisample( struct lp_setup_context *setup,
+                          boolean multisample )
+{
+   LP_DBG(DEBUG_SETUP, "%s %d\n", __FUNCTION__, multisample);
+
+   setup->multisample = multisample;
+}
+
+void
+lp_setup_set_sample_mask( struct lp_setup_context *setup,
+                          unsigned sample_mask )
+{
+   uint64_t sample_coverage = 0;
+   unsigned s;
+
+   LP_DBG(DEBUG_SETUP, "%s 0x%x\n", __FUNCTION__, sample_mask);
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      if (sample_mask & (1 << s))
+         sample_coverage |= (uint64_t)0xffff << (16 * s);
+   }
+
+   if (setup->fs.current.sample_coverage != sample_coverage) {
+      setup->fs.current.sample_coverage = sample_coverage;
+      setup->dirty |= LP_SETUP_NEW_FS;
+   }
+}
+
 void 
 lp_setup_set_vertex_info( struct lp_setup_context *setup,
                           struct vertex_info *vertex_info )
@@ -799,6 +851,7 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                                     unsigned num,
                                     struct pipe_sampler_view **views)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
    unsigned i, max_tex_num;
 
    LP_DBG(DEBUG_SETUP, "%s\n", __FUNCTION__);
@@ -807,6 +860,9 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
 
    max_tex_num = MAX2(num, setup->fs.current_tex_num);
 
+   /* Another context may be making one of the textures linear */
+   pipe_mutex_lock(screen->tex_mutex);
+
    for (i = 0; i < max_tex_num; i++) {
       struct pipe_sampler_view *view = i < num ? views[i] : NULL;
 
@@ -849,6 +905,7 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                jit_tex->mip_offsets[0] = 0;
                jit_tex->row_stride[0] = 0;
                jit_tex->img_stride[0] = 0;
+               jit_tex->sample_stride = 0;
             }
             else {
                jit_tex->width = res->width0;
@@ -863,6 +920,7 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                      jit_tex->row_stride[j] = lp_tex->row_stride[j];
                      jit_tex->img_stride[j] = lp_tex->img_stride[j];
                   }
+                  jit_tex->sample_stride = lp_tex->sample_stride;
 
                   if (res->target == PIPE_TEXTURE_1D_ARRAY ||
                       res->target == PIPE_TEXTURE_2D_ARRAY ||
@@ -897,6 +955,7 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
                   jit_tex->mip_offsets[0] = 0;
                   jit_tex->row_stride[0] = 0;
                   jit_tex->img_stride[0] = 0;
+                  jit_tex->sample_stride = 0;
 
                   /* everything specified in number of elements here. */
                   jit_tex->width = view->u.buf.last_element - view->u.buf.first_element + 1;
@@ -920,6 +979,7 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
             jit_tex->row_stride[0] = lp_tex->row_stride[0];
             jit_tex->img_stride[0] = lp_tex->img_stride[0];
             jit_tex->mip_offsets[0] = 0;
+            jit_tex->sample_stride = 0;
             jit_tex->width = res->width0;
             jit_tex->height = res->height0;
             jit_tex->depth = res->depth0;
@@ -931,6 +991,9 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
          pipe_resource_reference(&setup->fs.current_tex[i], NULL);
       }
    }
+
+   pipe_mutex_unlock(screen->tex_mutex);
+
    setup->fs.current_tex_num = num;
 
    setup->dirty |= LP_SETUP_NEW_FS;
@@ -978,6 +1041,7 @@ unsigned
 lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture )
 {
+   unsigned referenced = LP_UNREFERENCED;
    unsigned i;
 
    /* check the render targets */
@@ -989,14 +1053,14 @@ lp_setup_is_resource_referenced( const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
-   /* check textures referenced by the scene */
-   for (i = 0; i < Elements(setup->scenes); i++) {
-      if (lp_scene_is_resource_referenced(setup->scenes[i], texture)) {
-         return LP_REFERENCED_FOR_READ;
-      }
+   /* check textures and render targets referenced by the scenes, some of
+    * which may still be queued or being rasterized
+    */
+   for (i = 0; i < setup->num_scenes; i++) {
+      referenced |= lp_scene_is_resource_referenced(setup->scenes[i], texture);
    }
 
-   return LP_UNREFERENCED;
+   return referenced;
 }
 
 
@@ -1162,7 +1226,17 @@ try_update_scene_state( struct lp_setup_context *setup )
                 &setup->fs.current,
                 sizeof setup->fs.current);
          setup->fs.stored = stored;
-         
+
+         /* The scene must keep the shader variant alive until it has
+          * been rasterized, even if the variant gets evicted meanwhile.
+          */
+         if (setup->fs.current.variant &&
+             !lp_scene_add_frag_shader_reference(scene,
+                                                 setup->fs.current.variant)) {
+            assert(!new_scene);
+            return FALSE;
+         }
+
          /* The scene now references the textures in the rasterization
           * state record.  Note that now.
           */
@@ -1279,8 +1353,16 @@ lp_setup_destroy( struct lp_setup_context *setup )
 {
    uint i;
 
+   /* Rasterize the scene that is still being binned, if any.  Dropping it
+    * in lp_setup_reset() would leak the scene's resource and shader variant
+    * references.
+    */
+   set_scene_state( setup, SETUP_FLUSHED, __FUNCTION__ );
+
    lp_setup_reset( setup );
 
+   lp_setup_set_fs_variant( setup, NULL );
+
    util_unreference_framebuffer_state(&setup->fb);
 
    for (i = 0; i < Elements(setup->fs.current_tex); i++) {
@@ -1292,7 +1374,7 @@ lp_setup_destroy( struct lp_setup_context *setup )
    }
 
    /* free the scenes in the 'empty' queue */
-   for (i = 0; i < Elements(setup->scenes); i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
       if (scene->fence)
@@ -1333,6 +1415,7 @@ lp_setup_create( struct pipe_context *pipe,
 
 
    setup->num_threads = screen->num_threads;
+   setup->num_scenes = screen->num_scenes;
    setup->vbuf = draw_vbuf_stage(draw, &setup->base);
    if (!setup->vbuf) {
       goto no_vbuf;
@@ -1342,7 +1425,7 @@ lp_setup_create( struct pipe_context *pipe,
    draw_set_render(draw, &setup->base);
 
    /* create some empty scenes */
-   for (i = 0; i < MAX_SCENES; i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       setup->scenes[i] = lp_scene_create( pipe );
       if (!setup->scenes[i]) {
          goto no_scenes;
@@ -1352,13 +1435,16 @@ lp_setup_create( struct pipe_context *pipe,
    setup->triangle = first_triangle;
    setup->line     = first_line;
    setup->point    = first_point;
+
+   /* The sample mask is state, and must survive lp_setup_reset() */
+   setup->fs.current.sample_coverage = ~(uint64_t)0;
    
    setup->dirty = ~0;
 
    return setup;
 
 no_scenes:
-   for (i = 0; i < MAX_SCENES; i++) {
+   for (i = 0; i < setup->num_scenes; i++) {
       if (setup->scenes[i]) {
          lp_scene_destroy(setup->scenes[i]);
       }
@@ -1382,9 +1468,15 @@ lp_setup_begin_query(struct lp_setup_context *setup,
 
    set_scene_state(setup, SETUP_ACTIVE, "begin_query");
 
+   if (lp_query_is_perf(pq->type) && !lp_query_is_rast_perf(pq->type)) {
+      pq->start[0] = setup->counters[LP_QUERY_PERF_COUNTER(pq->type)];
+      return;
+   }
+
    if (!(pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
          pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
-         pq->type == PIPE_QUERY_PIPELINE_STATISTICS))
+         pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
+         lp_query_is_rast_perf(pq->type)))
       return;
 
    /* init the query to its beginning state */
@@ -1435,7 +1527,8 @@ lp_setup_end_query(struct lp_setup_context *setup, struct llvmpipe_query *pq)
       if (pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
           pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
           pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
-          pq->type == PIPE_QUERY_TIMESTAMP) {
+          pq->type == PIPE_QUERY_TIMESTAMP ||
+          lp_query_is_rast_perf(pq->type)) {
          if (pq->type == PIPE_QUERY_TIMESTAMP &&
                !(setup->scene->tiles_x | setup->scene->tiles_y)) {
             /*
@@ -1465,12 +1558,21 @@ lp_setup_end_query(struct lp_setup_context *setup, struct llvmpipe_query *pq)
    }
 
 fail:
+   if (lp_query_is_perf(pq->type) && !lp_query_is_rast_perf(pq->type)) {
+      pq->end[0] = setup->counters[LP_QUERY_PERF_COUNTER(pq->type)];
+      /* high-water marks are reported as they are */
+      if (pq->type != LP_QUERY_PERF(LP_PERF_SCENE_PEAK_BYTES))
+         pq->end[0] -= pq->start[0];
+      return;
+   }
+
    /* Need to do this now not earlier since it still needs to be marked as
     * active when binning it would cause a flush.
     */
    if (pq->type == PIPE_QUERY_OCCLUSION_COUNTER ||
       pq->type == PIPE_QUERY_OCCLUSION_PREDICATE ||
-      pq->type == PIPE_QUERY_PIPELINE_STATISTICS) {
+      pq->type == PIPE_QUERY_PIPELINE_STATISTICS ||
+      lp_query_is_rast_perf(pq->type)) {
       unsigned i;
 
       /* remove from active binned query list */
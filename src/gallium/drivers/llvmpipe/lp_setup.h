@@ -147,6 +147,14 @@ void
 lp_setup_set_rasterizer_discard( struct lp_setup_context *setup, 
                                  boolean rasterizer_discard );
 
+void
+lp_setup_set_multisample( struct lp_setup_context *setup,
+                          boolean multisample );
+
+void
+lp_setup_set_sample_mask( struct lp_setup_context *setup,
+                          unsigned sample_mask );
+
 void
 lp_setup_set_vertex_info( struct lp_setup_context *setup, 
                           struct vertex_info *info );
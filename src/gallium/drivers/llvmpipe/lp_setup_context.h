@@ -39,6 +39,7 @@
 #include "lp_rast.h"
 #include "lp_scene.h"
 #include "lp_bld_interp.h"	/* for struct lp_shader_input */
+#include "lp_perf.h"
 
 #include "draw/draw_vbuf.h"
 #include "util/u_rect.h"
@@ -54,12 +55,6 @@
 struct lp_setup_variant;
 
 
-/** Max number of scenes */
-/* XXX: make multiple scenes per context work, see lp_setup_rasterize_scene */
-#define MAX_SCENES 1
-
-
-
 /**
  * Point/line/triangle setup context.
  * Note: "stored" below indicates data which is stored in the bins,
@@ -87,19 +82,24 @@ struct lp_setup_context
     */
    struct draw_stage *vbuf;
    unsigned num_threads;
+   unsigned num_scenes;
    unsigned scene_idx;
-   struct lp_scene *scenes[MAX_SCENES];  /**< all the scenes */
+   struct lp_scene *scenes[LP_MAX_SCENES];  /**< all the scenes */
    struct lp_scene *scene;               /**< current scene being built */
 
    struct lp_fence *last_fence;
    struct llvmpipe_query *active_queries[LP_MAX_ACTIVE_BINNED_QUERIES];
    unsigned active_binned_queries;
 
+   /** Setup part of the perf counters, indexed by enum lp_perf_counter */
+   uint64_t counters[LP_PERF_FIRST_RAST];
+
    boolean flatshade_first;
    boolean ccw_is_frontface;
    boolean scissor_test;
    boolean point_size_per_vertex;
    boolean rasterizer_discard;
+   boolean multisample;         /**< per sample coverage for triangles */
    unsigned cullmode;
    unsigned bottom_edge_rule;
    float pixel_offset;
@@ -439,6 +439,7 @@ try_setup_point( struct lp_setup_context *setup,
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("offscreen\n");
       LP_COUNT(nr_culled_tris);
+      setup->counters[LP_PERF_CULLED_TRIS]++;
       return TRUE;
    }
 
@@ -457,6 +458,7 @@ try_setup_point( struct lp_setup_context *setup,
 #endif
 
    LP_COUNT(nr_tris);
+   setup->counters[LP_PERF_TRIS]++;
 
    if (lp_context->active_statistics_queries &&
        !llvmpipe_rasterization_disabled(lp_context)) {
@@ -486,6 +488,7 @@ try_setup_point( struct lp_setup_context *setup,
 
    point->inputs.disable = FALSE;
    point->inputs.opaque = FALSE;
+   point->inputs.multisample = FALSE;
    point->inputs.layer = layer;
    point->inputs.viewport_index = viewport_index;
 
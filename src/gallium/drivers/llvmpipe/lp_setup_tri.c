@@ -220,6 +220,7 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
    struct lp_scene *scene = setup->scene;
 
    LP_COUNT(nr_fully_covered_64);
+   setup->counters[LP_PERF_FULLY_COVERED_64]++;
 
    /* if variant is opaque and scissor doesn't effect the tile */
    if (inputs->opaque) {
@@ -243,6 +244,7 @@ lp_setup_whole_tile(struct lp_setup_context *setup,
       }
 
       LP_COUNT(nr_shade_opaque_64);
+      setup->counters[LP_PERF_SHADE_OPAQUE_64]++;
       return lp_scene_bin_cmd_with_state( scene, tx, ty,
                                           setup->fs.stored,
                                           LP_RAST_OP_SHADE_TILE_OPAQUE,
@@ -324,12 +326,14 @@ do_triangle_ccw(struct lp_setup_context *setup,
        bbox.y1 < bbox.y0) {
       if (0) debug_printf("empty bounding box\n");
       LP_COUNT(nr_culled_tris);
+      setup->counters[LP_PERF_CULLED_TRIS]++;
       return TRUE;
    }
 
    if (!u_rect_test_intersection(&setup->draw_regions[viewport_index], &bbox)) {
       if (0) debug_printf("offscreen\n");
       LP_COUNT(nr_culled_tris);
+      setup->counters[LP_PERF_CULLED_TRIS]++;
       return TRUE;
    }
 
@@ -369,6 +373,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
 #endif
 
    LP_COUNT(nr_tris);
+   setup->counters[LP_PERF_TRIS]++;
 
    /* Setup parameter interpolants:
     */
@@ -381,6 +386,7 @@ do_triangle_ccw(struct lp_setup_context *setup,
    tri->inputs.frontfacing = frontfacing;
    tri->inputs.disable = FALSE;
    tri->inputs.opaque = setup->fs.current.variant->opaque;
+   tri->inputs.multisample = setup->multisample;
    tri->inputs.layer = layer;
    tri->inputs.viewport_index = viewport_index;
 
@@ -782,15 +788,23 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
     */
    if (dx < TILE_SIZE)
    {
-      int ix0 = bbox->x0 / TILE_SIZE;
-      int iy0 = bbox->y0 / TILE_SIZE;
-      unsigned px = bbox->x0 & 63 & ~3;
-      unsigned py = bbox->y0 & 63 & ~3;
+      int ix0 = bbox->x0 >> scene->tile_order;
+      int iy0 = bbox->y0 >> scene->tile_order;
+      unsigned px = bbox->x0 & (TILE_SIZE - 1) & ~3;
+      unsigned py = bbox->y0 & (TILE_SIZE - 1) & ~3;
+      /* Position of the tile within the bin, contained triangles are
+       * positioned relative to the bin.
+       */
+      unsigned tx = bbox->x0 & (scene->tile_size - 1) & ~(TILE_SIZE - 1);
+      unsigned ty = bbox->y0 & (scene->tile_size - 1) & ~(TILE_SIZE - 1);
 
-      assert(iy0 == bbox->y1 / TILE_SIZE &&
-	     ix0 == bbox->x1 / TILE_SIZE);
+      assert(iy0 == bbox->y1 >> scene->tile_order &&
+	     ix0 == bbox->x1 >> scene->tile_order);
+      /* 8 bits per coordinate in lp_rast_arg_triangle_contained() */
+      STATIC_ASSERT(LP_MAX_BIN_ORDER <= 8);
 
-      if (nr_planes == 3) {
+      /* The contained rasterizer functions only compute pixel coverage */
+      if (nr_planes == 3 && !tri->inputs.multisample) {
          if (sz < 4)
          {
             /* Triangle is contained in a single 4x4 stamp:
@@ -802,7 +816,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                                                 use_32bits ?
                                                 LP_RAST_OP_TRIANGLE_32_3_4 :
                                                 LP_RAST_OP_TRIANGLE_3_4,
-                                                lp_rast_arg_triangle_contained(tri, px, py) );
+                                                lp_rast_arg_triangle_contained(tri, tx + px, ty + py) );
          }
 
          if (sz < 16)
@@ -826,10 +840,10 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                                                 use_32bits ?
                                                 LP_RAST_OP_TRIANGLE_32_3_16 :
                                                 LP_RAST_OP_TRIANGLE_3_16,
-                                                lp_rast_arg_triangle_contained(tri, px, py) );
+                                                lp_rast_arg_triangle_contained(tri, tx + px, ty + py) );
          }
       }
-      else if (nr_planes == 4 && sz < 16) 
+      else if (nr_planes == 4 && sz < 16 && !tri->inputs.multisample)
       {
          px = MIN2(px, TILE_SIZE - 16);
          py = MIN2(py, TILE_SIZE - 16);
@@ -842,7 +856,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                                             use_32bits ?
                                             LP_RAST_OP_TRIANGLE_32_4_16 :
                                             LP_RAST_OP_TRIANGLE_4_16,
-                                            lp_rast_arg_triangle_contained(tri, px, py));
+                                            lp_rast_arg_triangle_contained(tri, tx + px, ty + py));
       }
 
 
@@ -864,23 +878,24 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
       int64_t ystep[MAX_PLANES];
       int x, y;
 
-      int ix0 = trimmed_box.x0 / TILE_SIZE;
-      int iy0 = trimmed_box.y0 / TILE_SIZE;
-      int ix1 = trimmed_box.x1 / TILE_SIZE;
-      int iy1 = trimmed_box.y1 / TILE_SIZE;
+      const unsigned order = scene->tile_order;
+      int ix0 = trimmed_box.x0 >> order;
+      int iy0 = trimmed_box.y0 >> order;
+      int ix1 = trimmed_box.x1 >> order;
+      int iy1 = trimmed_box.y1 >> order;
       
       for (i = 0; i < nr_planes; i++) {
          c[i] = (plane[i].c + 
-                 IMUL64(plane[i].dcdy, iy0) * TILE_SIZE -
-                 IMUL64(plane[i].dcdx, ix0) * TILE_SIZE);
+                 IMUL64(plane[i].dcdy, iy0) * scene->tile_size -
+                 IMUL64(plane[i].dcdx, ix0) * scene->tile_size);
 
          ei[i] = (plane[i].dcdy - 
                   plane[i].dcdx - 
-                  (int64_t)plane[i].eo) << TILE_ORDER;
+                  (int64_t)plane[i].eo) << order;
 
-         eo[i] = (int64_t)plane[i].eo << TILE_ORDER;
-         xstep[i] = -(((int64_t)plane[i].dcdx) << TILE_ORDER);
-         ystep[i] = ((int64_t)plane[i].dcdy) << TILE_ORDER;
+         eo[i] = (int64_t)plane[i].eo << order;
+         xstep[i] = -(((int64_t)plane[i].dcdx) << order);
+         ystep[i] = ((int64_t)plane[i].dcdy) << order;
       }
 
 
@@ -915,6 +930,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                if (in)
                   break;  /* exiting triangle, all done with this row */
                LP_COUNT(nr_empty_64);
+               setup->counters[LP_PERF_EMPTY_64]++;
             }
             else if (partial) {
                /* Not trivially accepted by at least one plane -
@@ -932,6 +948,7 @@ lp_setup_bin_triangle( struct lp_setup_context *setup,
                   goto fail;
 
                LP_COUNT(nr_partially_covered_64);
+               setup->counters[LP_PERF_PARTIALLY_COVERED_64]++;
             }
             else {
                /* triangle covers the whole tile- shade whole tile */
@@ -997,6 +1014,12 @@ calc_fixed_position(struct lp_setup_context *setup,
                     const float (*v1)[4],
                     const float (*v2)[4])
 {
+   /*
+    * For multisampling the coverage is evaluated at sample positions
+    * relative to the pixel corner, so move that to the integer positions.
+    */
+   const float pixel_offset = setup->multisample ?
+                              setup->pixel_offset - 0.5f : setup->pixel_offset;
    /*
     * The rounding may not be quite the same with PIPE_ARCH_SSE
     * (util_iround right now only does nearest/even on x87,
@@ -1008,7 +1031,7 @@ calc_fixed_position(struct lp_setup_context *setup,
    __m128 vxy0xy2, vxy1xy0;
    __m128i vxy0xy2i, vxy1xy0i;
    __m128i dxdy0120, x0x2y0y2, x1x0y1y0, x0120, y0120;
-   __m128 pix_offset = _mm_set1_ps(setup->pixel_offset);
+   __m128 pix_offset = _mm_set1_ps(pixel_offset);
    __m128 fixed_one = _mm_set1_ps((float)FIXED_ONE);
    v0r = _mm_castpd_ps(_mm_load_sd((double *)v0[0]));
    vxy0xy2 = _mm_loadh_pi(v0r, (__m64 *)v2[0]);
@@ -1034,14 +1057,14 @@ calc_fixed_position(struct lp_setup_context *setup,
    _mm_store_si128((__m128i *)&position->y[0], y0120);
 
 #else
-   position->x[0] = subpixel_snap(v0[0][0] - setup->pixel_offset);
-   position->x[1] = subpixel_snap(v1[0][0] - setup->pixel_offset);
-   position->x[2] = subpixel_snap(v2[0][0] - setup->pixel_offset);
+   position->x[0] = subpixel_snap(v0[0][0] - pixel_offset);
+   position->x[1] = subpixel_snap(v1[0][0] - pixel_offset);
+   position->x[2] = subpixel_snap(v2[0][0] - pixel_offset);
    position->x[3] = 0; // should be unused
 
-   position->y[0] = subpixel_snap(v0[0][1] - setup->pixel_offset);
-   position->y[1] = subpixel_snap(v1[0][1] - setup->pixel_offset);
-   position->y[2] = subpixel_snap(v2[0][1] - setup->pixel_offset);
+   position->y[0] = subpixel_snap(v0[0][1] - pixel_offset);
+   position->y[1] = subpixel_snap(v1[0][1] - pixel_offset);
+   position->y[2] = subpixel_snap(v2[0][1] - pixel_offset);
    position->y[3] = 0; // should be unused
 
    position->dx01 = position->x[0] - position->x[1];
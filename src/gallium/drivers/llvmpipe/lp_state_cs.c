@@ -0,0 +1,846 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+/**
+ * @file
+ * Compute shaders.
+ *
+ * A variant is generated per kernel (the pc passed to launch_grid) and
+ * work group size.  Its function runs a whole
+ * work group, one SIMD vector of invocations (a chunk) at a time, see
+ * lp_build_tgsi_cs_iface.  launch_grid() hands the work groups out to
+ * the rasterizer threads, which run them to completion; compute work is
+ * not binned, so it is synchronous with respect to rendering.
+ */
+
+#include <inttypes.h>
+
+#include "pipe/p_defines.h"
+#include "util/u_atomic.h"
+#include "util/u_inlines.h"
+#include "util/u_math.h"
+#include "util/u_memory.h"
+#include "util/u_string.h"
+#include "tgsi/tgsi_dump.h"
+#include "tgsi/tgsi_parse.h"
+#include "gallivm/lp_bld_const.h"
+#include "gallivm/lp_bld_debug.h"
+#include "gallivm/lp_bld_flow.h"
+#include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_intr.h"
+#include "gallivm/lp_bld_logic.h"
+#include "gallivm/lp_bld_struct.h"
+#include "gallivm/lp_bld_tgsi.h"
+#include "gallivm/lp_bld_type.h"
+
+#include "lp_context.h"
+#include "lp_debug.h"
+#include "lp_fence.h"
+#include "lp_flush.h"
+#include "lp_jit.h"
+#include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_state.h"
+#include "lp_state_cs.h"
+#include "lp_texture.h"
+
+
+/** Compute shader number (for debugging) */
+static unsigned cs_no = 0;
+
+
+/**
+ * Backing store of unbound shader buffers and of empty INPUT and LOCAL
+ * resources.  Loads from it are always out of bounds, so they are
+ * redirected to its first element and it's never written.
+ */
+static const uint32_t dummy_buffer[4];
+
+
+struct lp_cs_iface
+{
+   struct lp_build_tgsi_cs_iface base;
+
+   struct gallivm_state *gallivm;
+   struct lp_type type;
+   const struct lp_compute_shader_variant_key *key;
+
+   LLVMValueRef context_ptr;
+   LLVMValueRef shared_ptr;
+   LLVMValueRef shared_size;
+   LLVMValueRef temps_ptr;
+   unsigned temps_per_chunk;  /**< in vectors */
+
+   unsigned num_chunks;
+   struct lp_build_loop_state loop;
+   struct lp_build_mask_context *mask;
+};
+
+
+/**
+ * Start running a chunk: compute the thread ids of its invocations and
+ * return the mask of the ones within the work group.
+ */
+static LLVMValueRef
+cs_begin_chunk(struct lp_cs_iface *cs,
+               struct lp_bld_tgsi_system_values *system_values)
+{
+   struct gallivm_state *gallivm = cs->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_type uint_type = lp_uint_type(cs->type);
+   struct lp_build_context bld;
+   const unsigned *block_size = cs->key->block_size;
+   LLVMValueRef index, vec;
+   unsigned i;
+
+   lp_build_context_init(&bld, gallivm, uint_type);
+
+   /* linear index of the invocations in the work group */
+   index = LLVMBuildMul(builder, cs->loop.counter,
+                        lp_build_const_int32(gallivm, cs->type.length), "");
+   index = lp_build_broadcast_scalar(&bld, index);
+   {
+      LLVMValueRef elems[LP_MAX_VECTOR_LENGTH];
+      for (i = 0; i < cs->type.length; i++) {
+         elems[i] = lp_build_const_int32(gallivm, i);
+      }
+      index = LLVMBuildAdd(builder, index,
+                           LLVMConstVector(elems, cs->type.length), "");
+   }
+
+   vec = lp_build_const_int_vec(gallivm, uint_type, block_size[0]);
+   system_values->thread_id[0] = LLVMBuildURem(builder, index, vec, "");
+   vec = lp_build_const_int_vec(gallivm, uint_type, block_size[1]);
+   system_values->thread_id[1] =
+      LLVMBuildURem(builder,
+                    LLVMBuildUDiv(builder, index,
+                                  lp_build_const_int_vec(gallivm, uint_type,
+                                                         block_size[0]), ""),
+                    vec, "");
+   vec = lp_build_const_int_vec(gallivm, uint_type,
+                                block_size[0] * block_size[1]);
+   system_values->thread_id[2] = LLVMBuildUDiv(builder, index, vec, "");
+
+   vec = lp_build_const_int_vec(gallivm, uint_type,
+                                block_size[0] * block_size[1] * block_size[2]);
+   return lp_build_compare(gallivm, uint_type, PIPE_FUNC_LESS, index, vec);
+}
+
+
+static LLVMValueRef
+cs_get_buffer(const struct lp_build_tgsi_cs_iface *iface,
+              struct lp_build_tgsi_context *bld_base,
+              unsigned index,
+              LLVMValueRef *size)
+{
+   const struct lp_cs_iface *cs = (const struct lp_cs_iface *) iface;
+   struct gallivm_state *gallivm = cs->gallivm;
+   LLVMValueRef ptr;
+
+   switch (index) {
+   case TGSI_RESOURCE_LOCAL:
+      *size = cs->shared_size;
+      return cs->shared_ptr;
+   case TGSI_RESOURCE_INPUT:
+      *size = lp_jit_cs_context_input_size(gallivm, cs->context_ptr);
+      return lp_jit_cs_context_input(gallivm, cs->context_ptr);
+   default:
+      if (index < PIPE_MAX_SHADER_BUFFERS) {
+         LLVMValueRef idx = lp_build_const_int32(gallivm, index);
+         ptr = lp_jit_cs_context_buffer_sizes(gallivm, cs->context_ptr);
+         *size = lp_build_array_get(gallivm, ptr, idx);
+         ptr = lp_jit_cs_context_buffers(gallivm, cs->context_ptr);
+         return lp_build_array_get(gallivm, ptr, idx);
+      }
+      /* PRIVATE resources aren't supported, make them empty */
+      debug_printf("llvmpipe: unsupported compute resource %x\n", index);
+      *size = lp_build_const_int32(gallivm, 0);
+      return lp_jit_cs_context_input(gallivm, cs->context_ptr);
+   }
+}
+
+
+static LLVMValueRef
+cs_get_global(const struct lp_build_tgsi_cs_iface *iface,
+              struct lp_build_tgsi_context *bld_base,
+              LLVMValueRef address,
+              LLVMValueRef *offset,
+              LLVMValueRef *size)
+{
+   const struct lp_cs_iface *cs = (const struct lp_cs_iface *) iface;
+   struct gallivm_state *gallivm = cs->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef slot, ptr;
+
+   slot = LLVMBuildLShr(builder, address,
+                        lp_build_const_int32(gallivm,
+                                             LP_CS_GLOBAL_OFFSET_BITS), "");
+   *offset = LLVMBuildAnd(builder, address,
+                          lp_build_const_int32(gallivm,
+                                  (1 << LP_CS_GLOBAL_OFFSET_BITS) - 1), "");
+
+   ptr = lp_jit_cs_context_global_buffer_sizes(gallivm, cs->context_ptr);
+   *size = lp_build_array_get(gallivm, ptr, slot);
+   ptr = lp_jit_cs_context_global_buffers(gallivm, cs->context_ptr);
+   return lp_build_array_get(gallivm, ptr, slot);
+}
+
+
+static LLVMValueRef
+cs_get_temps(const struct lp_build_tgsi_cs_iface *iface,
+             struct lp_build_tgsi_context *bld_base)
+{
+   const struct lp_cs_iface *cs = (const struct lp_cs_iface *) iface;
+   struct gallivm_state *gallivm = cs->gallivm;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMValueRef offset;
+
+   offset = LLVMBuildMul(builder, cs->loop.counter,
+                         lp_build_const_int32(gallivm, cs->temps_per_chunk),
+                         "");
+   return LLVMBuildGEP(builder, cs->temps_ptr, &offset, 1, "chunk_temps");
+}
+
+
+static void
+cs_barrier(const struct lp_build_tgsi_cs_iface *iface,
+           struct lp_build_tgsi_context *bld_base,
+           struct lp_bld_tgsi_system_values *system_values)
+{
+   struct lp_cs_iface *cs = (struct lp_cs_iface *) iface;
+   struct gallivm_state *gallivm = cs->gallivm;
+   LLVMValueRef mask;
+
+   /* All chunks have reached the barrier, run them again from there */
+   lp_build_loop_end_cond(&cs->loop,
+                          lp_build_const_int32(gallivm, cs->num_chunks),
+                          NULL, LLVMIntUGE);
+   lp_build_loop_begin(&cs->loop, gallivm, lp_build_const_int32(gallivm, 0));
+
+   mask = cs_begin_chunk(cs, system_values);
+   LLVMBuildStore(gallivm->builder, mask, cs->mask->var);
+}
+
+
+static void
+generate_compute(struct lp_compute_shader *shader,
+                 struct lp_compute_shader_variant *variant)
+{
+   struct gallivm_state *gallivm = variant->gallivm;
+   const struct lp_compute_shader_variant_key *key = &variant->key;
+   const struct tgsi_shader_info *info = &shader->info.base;
+   LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
+   LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
+   LLVMTypeRef arg_types[9];
+   LLVMTypeRef func_type;
+   LLVMValueRef function;
+   LLVMValueRef context_ptr;
+   LLVMValueRef consts_ptr, num_consts_ptr;
+   LLVMBasicBlockRef block;
+   LLVMBuilderRef builder;
+   struct lp_type type;
+   struct lp_bld_tgsi_system_values system_values;
+   struct lp_build_mask_context mask;
+   struct lp_cs_iface cs;
+   char func_name[64];
+   unsigned num_threads, i;
+
+   util_snprintf(func_name, sizeof(func_name), "cs%u_variant%u",
+                 shader->no, variant->no);
+
+   memset(&type, 0, sizeof type);
+   type.floating = TRUE;
+   type.sign = TRUE;
+   type.width = 32;
+   type.length = MIN2(lp_native_vector_width / 32, 16);
+
+   arg_types[0] = variant->jit_context_ptr_type;      /* context */
+   arg_types[1] = int32_type;                         /* block_id_x */
+   arg_types[2] = int32_type;                         /* block_id_y */
+   arg_types[3] = int32_type;                         /* block_id_z */
+   arg_types[4] = int32_type;                         /* grid_size_x */
+   arg_types[5] = int32_type;                         /* grid_size_y */
+   arg_types[6] = int32_type;                         /* grid_size_z */
+   arg_types[7] = LLVMPointerType(int8_type, 0);      /* shared_mem */
+   arg_types[8] = LLVMPointerType(lp_build_vec_type(gallivm, type), 0); /* temps */
+
+   func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
+                                arg_types, Elements(arg_types), 0);
+
+   function = LLVMAddFunction(gallivm->module, func_name, func_type);
+   LLVMSetFunctionCallConv(function, LLVMCCallConv);
+
+   variant->function = function;
+
+   for (i = 0; i < Elements(arg_types); ++i)
+      if (LLVMGetTypeKind(arg_types[i]) == LLVMPointerTypeKind)
+         LLVMAddAttribute(LLVMGetParam(function, i), LLVMNoAliasAttribute);
+
+   context_ptr = LLVMGetParam(function, 0);
+   lp_build_name(context_ptr, "context");
+
+   memset(&system_values, 0, sizeof system_values);
+   for (i = 0; i < 3; i++) {
+      system_values.block_id[i] = LLVMGetParam(function, 1 + i);
+      system_values.grid_size[i] = LLVMGetParam(function, 4 + i);
+      system_values.block_size[i] =
+         lp_build_const_int32(gallivm, key->block_size[i]);
+      lp_build_name(system_values.block_id[i], "block_id_%c", "xyz"[i]);
+      lp_build_name(system_values.grid_size[i], "grid_size_%c", "xyz"[i]);
+   }
+
+   num_threads = key->block_size[0] * key->block_size[1] * key->block_size[2];
+
+   memset(&cs, 0, sizeof cs);
+   cs.base.get_buffer = cs_get_buffer;
+   cs.base.get_global = cs_get_global;
+   cs.base.get_temps = cs_get_temps;
+   cs.base.barrier = cs_barrier;
+   cs.base.pc = key->pc;
+   cs.gallivm = gallivm;
+   cs.type = type;
+   cs.key = key;
+   cs.context_ptr = context_ptr;
+   cs.shared_ptr = LLVMGetParam(function, 7);
+   cs.shared_size = lp_build_const_int32(gallivm, shader->base.req_local_mem);
+   cs.temps_ptr = LLVMGetParam(function, 8);
+   cs.temps_per_chunk = (info->file_max[TGSI_FILE_TEMPORARY] + 1) * 4;
+   cs.num_chunks = (num_threads + type.length - 1) / type.length;
+   cs.mask = &mask;
+   lp_build_name(cs.shared_ptr, "shared_mem");
+   lp_build_name(cs.temps_ptr, "temps");
+
+   block = LLVMAppendBasicBlockInContext(gallivm->context, function, "entry");
+   builder = gallivm->builder;
+   assert(builder);
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   consts_ptr = lp_jit_cs_context_constants(gallivm, context_ptr);
+   num_consts_ptr = lp_jit_cs_context_num_constants(gallivm, context_ptr);
+
+   lp_build_loop_begin(&cs.loop, gallivm, lp_build_const_int32(gallivm, 0));
+
+   lp_build_mask_begin(&mask, gallivm, type,
+                       cs_begin_chunk(&cs, &system_values));
+
+   lp_build_tgsi_soa(gallivm, shader->base.prog, type, &mask,
+                     consts_ptr, num_consts_ptr, &system_values,
+                     NULL, NULL, context_ptr, NULL,
+                     NULL, info, NULL, &cs.base);
+
+   lp_build_mask_end(&mask);
+
+   lp_build_loop_end_cond(&cs.loop,
+                          lp_build_const_int32(gallivm, cs.num_chunks),
+                          NULL, LLVMIntUGE);
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, function);
+
+   variant->temps_size = info->opcode_count[TGSI_OPCODE_BARRIER] ?
+      cs.num_chunks * cs.temps_per_chunk * type.length * 4 : 0;
+}
+
+
+static struct lp_compute_shader_variant *
+generate_variant(struct llvmpipe_context *lp,
+                 struct lp_compute_shader *shader,
+                 const struct lp_compute_shader_variant_key *key)
+{
+   struct lp_compute_shader_variant *variant;
+   char module_name[64];
+
+   variant = CALLOC_STRUCT(lp_compute_shader_variant);
+   if (!variant)
+      return NULL;
+
+   variant->no = shader->variants_created++;
+   variant->key = *key;
+
+   util_snprintf(module_name, sizeof(module_name), "cs%u_variant%u",
+                 shader->no, variant->no);
+
+   variant->gallivm = gallivm_create(module_name, lp->context);
+   if (!variant->gallivm) {
+      FREE(variant);
+      return NULL;
+   }
+
+   lp_jit_init_cs_types(variant);
+
+   generate_compute(shader, variant);
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs = lp_build_count_ir_module(variant->gallivm->module);
+
+   variant->jit_function = (lp_jit_cs_func)
+      gallivm_jit_function(variant->gallivm, variant->function);
+
+   gallivm_free_ir(variant->gallivm);
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: compute shader #%u variant #%u, "
+                   "pc %u, block %ux%ux%u, %u instrs\n",
+                   shader->no, variant->no, key->pc, key->block_size[0],
+                   key->block_size[1], key->block_size[2], variant->nr_instrs);
+   }
+
+   return variant;
+}
+
+
+static struct lp_compute_shader_variant *
+get_variant(struct llvmpipe_context *lp,
+            struct lp_compute_shader *shader,
+            const uint *block_layout,
+            uint32_t pc)
+{
+   struct lp_compute_shader_variant_key key;
+   struct lp_compute_shader_variant *variant;
+
+   memset(&key, 0, sizeof key);
+   key.block_size[0] = block_layout[0];
+   key.block_size[1] = block_layout[1];
+   key.block_size[2] = block_layout[2];
+   key.pc = pc;
+
+   for (variant = shader->variants; variant; variant = variant->next) {
+      if (memcmp(&variant->key, &key, sizeof key) == 0)
+         return variant;
+   }
+
+   variant = generate_variant(lp, shader, &key);
+   if (variant) {
+      variant->next = shader->variants;
+      shader->variants = variant;
+   }
+   return variant;
+}
+
+
+/**
+ * Check that every BARRIER is in uniform control flow, which is all
+ * barrier_emit() can handle: outside of any IF, loop, switch or
+ * subroutine, and not after a return that may only be taken by some
+ * invocations.
+ */
+static boolean
+barriers_in_uniform_control_flow(const struct tgsi_token *tokens)
+{
+   struct tgsi_parse_context parse;
+   unsigned depth = 0;
+   boolean diverged = FALSE;
+   boolean uniform = TRUE;
+
+   tgsi_parse_init(&parse, tokens);
+
+   while (uniform && !tgsi_parse_end_of_tokens(&parse)) {
+      tgsi_parse_token(&parse);
+
+      if (parse.FullToken.Token.Type != TGSI_TOKEN_TYPE_INSTRUCTION)
+         continue;
+
+      switch (parse.FullToken.FullInstruction.Instruction.Opcode) {
+      case TGSI_OPCODE_IF:
+      case TGSI_OPCODE_UIF:
+      case TGSI_OPCODE_BGNLOOP:
+      case TGSI_OPCODE_SWITCH:
+      case TGSI_OPCODE_BGNSUB:
+         depth++;
+         break;
+      case TGSI_OPCODE_ENDIF:
+      case TGSI_OPCODE_ENDLOOP:
+      case TGSI_OPCODE_ENDSWITCH:
+      case TGSI_OPCODE_ENDSUB:
+         if (depth)
+            depth--;
+         break;
+      case TGSI_OPCODE_RET:
+         if (depth)
+            diverged = TRUE;
+         break;
+      case TGSI_OPCODE_BARRIER:
+         if (depth || diverged)
+            uniform = FALSE;
+         break;
+      default:
+         break;
+      }
+   }
+
+   tgsi_parse_free(&parse);
+
+   return uniform;
+}
+
+
+static void *
+llvmpipe_create_compute_state(struct pipe_context *pipe,
+                              const struct pipe_compute_state *templ)
+{
+   struct lp_compute_shader *shader;
+
+   shader = CALLOC_STRUCT(lp_compute_shader);
+   if (!shader)
+      return NULL;
+
+   shader->no = cs_no++;
+
+   /* we need to keep a local copy of the tokens */
+   shader->base = *templ;
+   shader->base.prog = tgsi_dup_tokens(templ->prog);
+   if (!shader->base.prog) {
+      FREE(shader);
+      return NULL;
+   }
+
+   /* get/save the summary info for this shader */
+   lp_build_tgsi_info(shader->base.prog, &shader->info);
+
+   /* No samplers are exposed for compute shaders */
+   if (shader->info.base.file_max[TGSI_FILE_SAMPLER] >= 0 ||
+       shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] >= 0) {
+      debug_printf("llvmpipe: texture sampling in compute shaders "
+                   "is not supported\n");
+      FREE((void *) shader->base.prog);
+      FREE(shader);
+      return NULL;
+   }
+
+   if (shader->info.base.opcode_count[TGSI_OPCODE_BARRIER] &&
+       !barriers_in_uniform_control_flow(shader->base.prog)) {
+      debug_printf("llvmpipe: barriers in non-uniform control flow "
+                   "are not supported\n");
+      FREE((void *) shader->base.prog);
+      FREE(shader);
+      return NULL;
+   }
+
+   if (LP_DEBUG & DEBUG_TGSI) {
+      debug_printf("llvmpipe: Create compute shader #%u %p:\n",
+                   shader->no, (void *) shader);
+      tgsi_dump(shader->base.prog, 0);
+   }
+
+   return shader;
+}
+
+
+static void
+llvmpipe_bind_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+
+   llvmpipe->cs = (struct lp_compute_shader *) cs;
+}
+
+
+static void
+llvmpipe_delete_compute_state(struct pipe_context *pipe, void *cs)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct lp_compute_shader *shader = (struct lp_compute_shader *) cs;
+   struct lp_compute_shader_variant *variant, *next;
+
+   if (llvmpipe->cs == shader)
+      llvmpipe->cs = NULL;
+
+   /* launch_grid() is synchronous, nothing can be using the variants */
+   for (variant = shader->variants; variant; variant = next) {
+      next = variant->next;
+      gallivm_destroy(variant->gallivm);
+      FREE(variant);
+   }
+
+   FREE((void *) shader->base.prog);
+   FREE(shader);
+}
+
+
+static void
+llvmpipe_set_shader_buffers(struct pipe_context *pipe,
+                            unsigned shader, unsigned start_slot,
+                            unsigned count,
+                            struct pipe_shader_buffer *buffers)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   /* Only compute shaders report shader buffer support */
+   if (shader != PIPE_SHADER_COMPUTE)
+      return;
+
+   assert(start_slot + count <= PIPE_MAX_SHADER_BUFFERS);
+
+   for (i = 0; i < count; i++) {
+      struct pipe_shader_buffer *dst = &llvmpipe->shader_buffers[start_slot + i];
+
+      if (buffers && buffers[i].buffer) {
+         pipe_resource_reference(&dst->buffer, buffers[i].buffer);
+         dst->buffer_offset = buffers[i].buffer_offset;
+         dst->buffer_size = buffers[i].buffer_size;
+      }
+      else {
+         pipe_resource_reference(&dst->buffer, NULL);
+         dst->buffer_offset = 0;
+         dst->buffer_size = 0;
+      }
+   }
+}
+
+
+static void
+llvmpipe_set_compute_resources(struct pipe_context *pipe,
+                               unsigned start, unsigned count,
+                               struct pipe_surface **resources)
+{
+   /* No RESOURCE (image) file in compute shaders, nothing to bind */
+}
+
+
+/**
+ * Bind buffers for TGSI_RESOURCE_GLOBAL accesses.  The 32-bit handles
+ * hold an offset into each buffer, the address of buffer i is added to
+ * it, see LP_CS_GLOBAL_OFFSET_BITS.
+ */
+static void
+llvmpipe_set_global_binding(struct pipe_context *pipe,
+                            unsigned first, unsigned count,
+                            struct pipe_resource **resources,
+                            uint32_t **handles)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   unsigned i;
+
+   assert(first + count <= LP_MAX_CS_GLOBAL_BUFFERS);
+
+   for (i = 0; i < count; i++) {
+      unsigned slot = first + i;
+
+      if (resources && resources[i]) {
+         pipe_resource_reference(&llvmpipe->global_buffers[slot],
+                                 resources[i]);
+         assert(*handles[i] < (1u << LP_CS_GLOBAL_OFFSET_BITS));
+         *handles[i] += (slot + 1) << LP_CS_GLOBAL_OFFSET_BITS;
+      }
+      else {
+         pipe_resource_reference(&llvmpipe->global_buffers[slot], NULL);
+      }
+   }
+}
+
+
+/**
+ * State of a launch_grid() call shared by the rasterizer threads.
+ */
+struct lp_cs_job
+{
+   const struct lp_compute_shader_variant *variant;
+   struct lp_jit_cs_context jit_context;
+
+   unsigned grid_size[3];
+   unsigned num_blocks;
+   int32_t next_block;
+
+   /** Per thread LOCAL resource and temporaries */
+   uint8_t *thread_mem;
+   unsigned shared_size;
+   unsigned thread_mem_stride;
+};
+
+
+static void
+run_cs_job(void *data, unsigned thread_index)
+{
+   struct lp_cs_job *job = (struct lp_cs_job *) data;
+   uint8_t *shared_mem = job->thread_mem + thread_index * job->thread_mem_stride;
+   void *temps = shared_mem + job->shared_size;
+   unsigned block;
+
+   /* Work groups are handed out one at a time, they may vary in cost */
+   while ((block = p_atomic_inc_return(&job->next_block) - 1) <
+          job->num_blocks) {
+      unsigned x = block % job->grid_size[0];
+      unsigned y = (block / job->grid_size[0]) % job->grid_size[1];
+      unsigned z = block / (job->grid_size[0] * job->grid_size[1]);
+
+      job->variant->jit_function(&job->jit_context, x, y, z,
+                                 job->grid_size[0], job->grid_size[1],
+                                 job->grid_size[2],
+                                 shared_mem, temps);
+   }
+}
+
+
+static void
+llvmpipe_launch_grid(struct pipe_context *pipe,
+                     const uint *block_layout, const uint *grid_layout,
+                     uint32_t pc, const void *input)
+{
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_compute_shader *shader = llvmpipe->cs;
+   const unsigned num_threads = MAX2(1, screen->num_threads);
+   struct lp_fence *fence = NULL;
+   struct lp_cs_job job;
+   uint64_t num_blocks;
+   unsigned i;
+
+   if (!shader)
+      return;
+
+   if (!block_layout[0] || !block_layout[1] || !block_layout[2] ||
+       !grid_layout[0] || !grid_layout[1] || !grid_layout[2])
+      return;
+
+   num_blocks = (uint64_t) grid_layout[0] * grid_layout[1] * grid_layout[2];
+   if (num_blocks > LP_MAX_CS_BLOCKS_PER_GRID) {
+      debug_printf("llvmpipe: grid of %" PRIu64 " work groups is too large\n",
+                   num_blocks);
+      return;
+   }
+
+   assert(block_layout[0] * block_layout[1] * block_layout[2] <=
+          LP_MAX_CS_THREADS_PER_BLOCK);
+
+   if (pc >= shader->info.base.num_instructions) {
+      debug_printf("llvmpipe: kernel pc %u is out of range\n", pc);
+      return;
+   }
+
+   memset(&job, 0, sizeof job);
+
+   job.variant = get_variant(llvmpipe, shader, block_layout, pc);
+   if (!job.variant)
+      return;
+
+   /* Rendering may be reading or writing the same buffers */
+   llvmpipe_finish(pipe, __FUNCTION__);
+
+   for (i = 0; i < LP_MAX_TGSI_CONST_BUFFERS; i++) {
+      const struct pipe_constant_buffer *cb =
+         &llvmpipe->constants[PIPE_SHADER_COMPUTE][i];
+      const ubyte *data = NULL;
+
+      if (cb->buffer)
+         data = (const ubyte *) llvmpipe_resource_data(cb->buffer);
+      else if (cb->user_buffer)
+         data = (const ubyte *) cb->user_buffer;
+
+      if (data) {
+         unsigned size = MIN2(cb->buffer_size, LP_MAX_TGSI_CONST_BUFFER_SIZE);
+         job.jit_context.constants[i] = (const float *) (data + cb->buffer_offset);
+         job.jit_context.num_constants[i] = size / (sizeof(float) * 4);
+      }
+      else {
+         job.jit_context.constants[i] = (const float *) dummy_buffer;
+         job.jit_context.num_constants[i] = 0;
+      }
+   }
+
+   for (i = 0; i < PIPE_MAX_SHADER_BUFFERS; i++) {
+      const struct pipe_shader_buffer *sb = &llvmpipe->shader_buffers[i];
+
+      if (sb->buffer) {
+         job.jit_context.buffers[i] =
+            (const ubyte *) llvmpipe_resource_data(sb->buffer) + sb->buffer_offset;
+         job.jit_context.buffer_sizes[i] = sb->buffer_size;
+      }
+      else {
+         job.jit_context.buffers[i] = dummy_buffer;
+         job.jit_context.buffer_sizes[i] = 0;
+      }
+   }
+
+   /* Slot 0 is the null pointer */
+   job.jit_context.global_buffers[0] = dummy_buffer;
+   job.jit_context.global_buffer_sizes[0] = 0;
+   for (i = 0; i < LP_MAX_CS_GLOBAL_BUFFERS; i++) {
+      struct pipe_resource *res = llvmpipe->global_buffers[i];
+
+      if (res) {
+         job.jit_context.global_buffers[i + 1] = llvmpipe_resource_data(res);
+         job.jit_context.global_buffer_sizes[i + 1] = res->width0;
+      }
+      else {
+         job.jit_context.global_buffers[i + 1] = dummy_buffer;
+         job.jit_context.global_buffer_sizes[i + 1] = 0;
+      }
+   }
+
+   if (input && shader->base.req_input_mem) {
+      job.jit_context.input = input;
+      job.jit_context.input_size = shader->base.req_input_mem;
+   }
+   else {
+      job.jit_context.input = dummy_buffer;
+      job.jit_context.input_size = 0;
+   }
+
+   job.grid_size[0] = grid_layout[0];
+   job.grid_size[1] = grid_layout[1];
+   job.grid_size[2] = grid_layout[2];
+   job.num_blocks = (unsigned) num_blocks;
+
+   job.shared_size = align(MAX2(shader->base.req_local_mem,
+                                sizeof dummy_buffer), 64);
+   job.thread_mem_stride = job.shared_size +
+                           align(job.variant->temps_size, 64);
+   job.thread_mem = align_malloc(num_threads * job.thread_mem_stride, 64);
+   if (!job.thread_mem)
+      return;
+
+   pipe_mutex_lock(screen->rast_mutex);
+
+   /* Other contexts may still have scenes in flight */
+   lp_fence_reference(&fence, screen->last_fence);
+   if (fence) {
+      lp_fence_wait(fence);
+      lp_fence_reference(&fence, NULL);
+   }
+
+   lp_rast_run_job(screen->rast, run_cs_job, &job);
+
+   pipe_mutex_unlock(screen->rast_mutex);
+
+   align_free(job.thread_mem);
+}
+
+
+void
+llvmpipe_init_cs_funcs(struct llvmpipe_context *llvmpipe)
+{
+   llvmpipe->pipe.create_compute_state = llvmpipe_create_compute_state;
+   llvmpipe->pipe.bind_compute_state = llvmpipe_bind_compute_state;
+   llvmpipe->pipe.delete_compute_state = llvmpipe_delete_compute_state;
+   llvmpipe->pipe.set_shader_buffers = llvmpipe_set_shader_buffers;
+   llvmpipe->pipe.set_compute_resources = llvmpipe_set_compute_resources;
+   llvmpipe->pipe.set_global_binding = llvmpipe_set_global_binding;
+   llvmpipe->pipe.launch_grid = llvmpipe_launch_grid;
+}
@@ -25,8 +25,10 @@
  * 
  **************************************************************************/
 
+#include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
+#include "util/simple_list.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vertex.h"
@@ -186,11 +188,15 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
 
    /* Check for updated textures.
     */
-   if (llvmpipe->tex_timestamp != lp_screen->timestamp) {
-      llvmpipe->tex_timestamp = lp_screen->timestamp;
+   if (llvmpipe->tex_timestamp != p_atomic_read(&lp_screen->timestamp)) {
+      llvmpipe->tex_timestamp = p_atomic_read(&lp_screen->timestamp);
       llvmpipe->dirty |= LP_NEW_SAMPLER_VIEW;
    }
 
+   /* Pick up fragment shaders optimized in the background */
+   if (!is_empty_list(&llvmpipe->fs_variants_pending))
+      llvmpipe_poll_fs_compiles(llvmpipe, FALSE);
+
    /* This needs LP_NEW_RASTERIZER because of draw_prepare_shader_outputs(). */
    if (llvmpipe->dirty & (LP_NEW_RASTERIZER |
                           LP_NEW_FS |
@@ -208,12 +214,20 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
                           LP_NEW_OCCLUSION_QUERY))
       llvmpipe_update_fs( llvmpipe );
 
-   if (llvmpipe->dirty & (LP_NEW_RASTERIZER)) {
+   if (llvmpipe->dirty & (LP_NEW_RASTERIZER |
+                          LP_NEW_FRAMEBUFFER)) {
+      unsigned nr_samples =
+         util_framebuffer_get_num_samples(&llvmpipe->framebuffer);
       boolean discard =
-         (llvmpipe->sample_mask & 1) == 0 ||
+         (llvmpipe->sample_mask & ((1 << nr_samples) - 1)) == 0 ||
          (llvmpipe->rasterizer ? llvmpipe->rasterizer->rasterizer_discard : FALSE);
 
       lp_setup_set_rasterizer_discard(llvmpipe->setup, discard);
+      lp_setup_set_sample_mask(llvmpipe->setup, llvmpipe->sample_mask);
+      lp_setup_set_multisample(llvmpipe->setup,
+                               nr_samples > 1 &&
+                               llvmpipe->rasterizer &&
+                               llvmpipe->rasterizer->multisample);
    }
 
    if (llvmpipe->dirty & (LP_NEW_FS |
@@ -263,5 +277,12 @@ void llvmpipe_update_derived( struct llvmpipe_context *llvmpipe )
    }
 
    llvmpipe->dirty = 0;
+
+   /* If another context made a texture linear after the fragment shader
+    * variant was chosen, the variant may expect the tiled layout while the
+    * sampler views have the linear one.  Pick both up again.
+    */
+   if (llvmpipe->tex_timestamp != p_atomic_read(&lp_screen->timestamp))
+      llvmpipe_update_derived(llvmpipe);
 }
 
@@ -60,6 +60,7 @@
 #include <limits.h>
 #include "pipe/p_defines.h"
 #include "util/u_inlines.h"
+#include "util/u_atomic.h"
 #include "util/u_memory.h"
 #include "util/u_pointer.h"
 #include "util/u_format.h"
@@ -67,8 +68,11 @@
 #include "util/u_string.h"
 #include "util/simple_list.h"
 #include "util/u_dual_blend.h"
+#include "util/u_framebuffer.h"
+#include "util/u_hash.h"
 #include "os/os_time.h"
 #include "pipe/p_shader_tokens.h"
+#include "cso_cache/cso_hash.h"
 #include "draw/draw_context.h"
 #include "tgsi/tgsi_dump.h"
 #include "tgsi/tgsi_scan.h"
@@ -77,6 +81,7 @@
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_conv.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_logic.h"
 #include "gallivm/lp_bld_tgsi.h"
@@ -98,9 +103,11 @@
 #include "lp_setup.h"
 #include "lp_state.h"
 #include "lp_tex_sample.h"
-#include "lp_flush.h"
 #include "lp_state_fs.h"
 #include "lp_rast.h"
+#include "lp_screen.h"
+#include "lp_texture.h"
+#include "lp_compile_queue.h"
 
 
 /** Fragment shader number (for debugging) */
@@ -238,6 +245,114 @@ lp_llvm_viewport(LLVMValueRef context_ptr,
 }
 
 
+/**
+ * Per sample depth/stencil test and occlusion count for multisampling.
+ * The shader runs once per pixel; each sample's coverage mask is combined
+ * with the shader's pixel mask, tested against that sample's depth/stencil
+ * values and written back to sample_mask_store for the blend stage.
+ *
+ * \param dzdx, dzdy  z gradients to evaluate z at the sample positions,
+ *                    or NULL when the shader writes z
+ */
+static void
+generate_fs_sample_tests(struct gallivm_state *gallivm,
+                         const struct lp_fragment_shader_variant_key *key,
+                         struct lp_type type,
+                         const struct util_format_description *zs_format_desc,
+                         unsigned depth_mode,
+                         LLVMValueRef pixel_mask,
+                         LLVMValueRef *sample_mask_store,
+                         LLVMValueRef loop_counter,
+                         LLVMValueRef stencil_refs[2],
+                         LLVMValueRef z,
+                         LLVMValueRef dzdx,
+                         LLVMValueRef dzdy,
+                         LLVMValueRef facing,
+                         LLVMValueRef depth_ptr,
+                         LLVMValueRef depth_stride,
+                         LLVMValueRef depth_sample_stride,
+                         LLVMValueRef thread_data_ptr)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   struct lp_build_context f32_bld;
+   unsigned s;
+
+   lp_build_context_init(&f32_bld, gallivm, type);
+
+   for (s = 0; s < LP_MAX_SAMPLES; s++) {
+      struct lp_build_mask_context mask;
+      LLVMValueRef mask_ptr, mask_val;
+
+      mask_ptr = LLVMBuildGEP(builder, sample_mask_store[s],
+                              &loop_counter, 1, "sample_mask_ptr");
+      mask_val = LLVMBuildLoad(builder, mask_ptr, "");
+      mask_val = LLVMBuildAnd(builder, mask_val, pixel_mask, "");
+
+      lp_build_mask_begin(&mask, gallivm, type, mask_val);
+
+      if (depth_mode & LATE_DEPTH_TEST) {
+         LLVMValueRef sample_z = z;
+         LLVMValueRef sample_depth_ptr;
+         LLVMValueRef offset;
+         LLVMValueRef z_fb, s_fb;
+         LLVMValueRef z_value, s_value;
+
+         if (dzdx) {
+            /* z is interpolated at the pixel center */
+            float ox = (float)lp_sample_pos_4x[s][0] / FIXED_ONE - 0.5f;
+            float oy = (float)lp_sample_pos_4x[s][1] / FIXED_ONE - 0.5f;
+
+            sample_z = lp_build_add(&f32_bld, sample_z,
+                          lp_build_mul(&f32_bld, dzdx,
+                                       lp_build_const_vec(gallivm, type, ox)));
+            sample_z = lp_build_add(&f32_bld, sample_z,
+                          lp_build_mul(&f32_bld, dzdy,
+                                       lp_build_const_vec(gallivm, type, oy)));
+         }
+
+         offset = LLVMBuildMul(builder, depth_sample_stride,
+                               lp_build_const_int32(gallivm, s), "");
+         sample_depth_ptr = LLVMBuildGEP(builder, depth_ptr, &offset, 1, "");
+
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              sample_depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     sample_z, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     FALSE);
+
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_counter,
+                                                  sample_depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
+      }
+
+      if (key->occlusion_count) {
+         LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
+         lp_build_name(counter, "counter");
+         lp_build_occlusion_count(gallivm, type,
+                                  lp_build_mask_value(&mask), counter);
+      }
+
+      mask_val = lp_build_mask_end(&mask);
+      LLVMBuildStore(builder, mask_val, mask_ptr);
+   }
+}
+
+
 /**
  * Generate the fragment shader, depth/stencil test, and alpha tests.
  */
@@ -252,9 +367,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
                  struct lp_build_interp_soa_context *interp,
                  struct lp_build_sampler_soa *sampler,
                  LLVMValueRef mask_store,
+                 LLVMValueRef *sample_mask_store,
                  LLVMValueRef (*out_color)[4],
                  LLVMValueRef depth_ptr,
                  LLVMValueRef depth_stride,
+                 LLVMValueRef depth_sample_stride,
+                 LLVMValueRef dzdx,
+                 LLVMValueRef dzdy,
                  LLVMValueRef facing,
                  LLVMValueRef thread_data_ptr)
 {
@@ -320,6 +439,10 @@ generate_fs_loop(struct gallivm_state *gallivm,
          depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
       }
 
+      /* Samples are only tested once the final pixel mask is known */
+      if (key->multisample)
+         depth_mode = LATE_DEPTH_TEST | LATE_DEPTH_WRITE;
+
       if (!(key->depth.enabled && key->depth.writemask) &&
           !(key->stencil[0].enabled && (key->stencil[0].writemask ||
                                         (key->stencil[1].enabled &&
@@ -422,7 +545,7 @@ generate_fs_loop(struct gallivm_state *gallivm,
                      consts_ptr, num_consts_ptr, &system_values,
                      interp->inputs,
                      outputs, context_ptr, thread_data_ptr,
-                     sampler, &shader->info.base, NULL);
+                     sampler, &shader->info.base, NULL, NULL);
 
    /* Alpha test */
    if (key->alpha.enabled) {
@@ -527,29 +650,43 @@ generate_fs_loop(struct gallivm_state *gallivm,
          stencil_refs[1] = stencil_refs[0];
       }
 
-      lp_build_depth_stencil_load_swizzled(gallivm, type,
-                                           zs_format_desc, key->resource_1d,
-                                           depth_ptr, depth_stride,
-                                           &z_fb, &s_fb, loop_state.counter);
+      if (key->multisample) {
+         boolean writes_z = pos0 != -1 && outputs[pos0][2];
 
-      lp_build_depth_stencil_test(gallivm,
-                                  &key->depth,
-                                  key->stencil,
-                                  type,
-                                  zs_format_desc,
-                                  &mask,
-                                  stencil_refs,
-                                  z, z_fb, s_fb,
-                                  facing,
-                                  &z_value, &s_value,
-                                  !simple_shader);
-      /* Late Z write */
-      if (depth_mode & LATE_DEPTH_WRITE) {
-         lp_build_depth_stencil_write_swizzled(gallivm, type,
-                                               zs_format_desc, key->resource_1d,
-                                               NULL, NULL, NULL, loop_state.counter,
-                                               depth_ptr, depth_stride,
-                                               z_value, s_value);
+         generate_fs_sample_tests(gallivm, key, type, zs_format_desc,
+                                  depth_mode, lp_build_mask_value(&mask),
+                                  sample_mask_store, loop_state.counter,
+                                  stencil_refs, z,
+                                  writes_z ? NULL : dzdx,
+                                  writes_z ? NULL : dzdy,
+                                  facing, depth_ptr, depth_stride,
+                                  depth_sample_stride, thread_data_ptr);
+      }
+      else {
+         lp_build_depth_stencil_load_swizzled(gallivm, type,
+                                              zs_format_desc, key->resource_1d,
+                                              depth_ptr, depth_stride,
+                                              &z_fb, &s_fb, loop_state.counter);
+
+         lp_build_depth_stencil_test(gallivm,
+                                     &key->depth,
+                                     key->stencil,
+                                     type,
+                                     zs_format_desc,
+                                     &mask,
+                                     stencil_refs,
+                                     z, z_fb, s_fb,
+                                     facing,
+                                     &z_value, &s_value,
+                                     !simple_shader);
+         /* Late Z write */
+         if (depth_mode & LATE_DEPTH_WRITE) {
+            lp_build_depth_stencil_write_swizzled(gallivm, type,
+                                                  zs_format_desc, key->resource_1d,
+                                                  NULL, NULL, NULL, loop_state.counter,
+                                                  depth_ptr, depth_stride,
+                                                  z_value, s_value);
+         }
       }
    }
    else if ((depth_mode & EARLY_DEPTH_TEST) &&
@@ -565,6 +702,14 @@ generate_fs_loop(struct gallivm_state *gallivm,
                                             depth_ptr, depth_stride,
                                             z_value, s_value);
    }
+   else if (key->multisample) {
+      generate_fs_sample_tests(gallivm, key, type, NULL,
+                               depth_mode, lp_build_mask_value(&mask),
+                               sample_mask_store, loop_state.counter,
+                               stencil_refs, z, NULL, NULL,
+                               facing, depth_ptr, depth_stride,
+                               depth_sample_stride, thread_data_ptr);
+   }
 
 
    /* Color write  */
@@ -590,7 +735,8 @@ generate_fs_loop(struct gallivm_state *gallivm,
       }
    }
 
-   if (key->occlusion_count) {
+   /* with multisampling samples are counted in generate_fs_sample_tests */
+   if (key->occlusion_count && !key->multisample) {
       LLVMValueRef counter = lp_jit_thread_data_counter(gallivm, thread_data_ptr);
       lp_build_name(counter, "counter");
       lp_build_occlusion_count(gallivm, type,
@@ -1685,7 +1831,8 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
    undef_src_val = lp_build_undef(gallivm, fs_type);
 
    row_type.length = fs_type.length;
-   vector_width    = dst_type.floating ? lp_native_vector_width : lp_integer_vector_width;
+   /* the blend code is written for at most 256 bit (8 x float) vectors */
+   vector_width    = dst_type.floating ? MIN2(lp_native_vector_width, 256) : lp_integer_vector_width;
 
    /* Compute correct swizzle and count channels */
    memset(swizzle, LP_BLD_SWIZZLE_DONTCARE, TGSI_NUM_CHANNELS);
@@ -2153,6 +2300,31 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
 }
 
 
+/**
+ * Split the 16-wide shader output pointed to by ptrs[0] into 8-wide
+ * halves, returning pointers to them in ptrs[0..num_halves-1].
+ */
+static void
+split_fs_output(struct gallivm_state *gallivm,
+                struct lp_type half_type,
+                unsigned num_halves,
+                LLVMValueRef *ptrs)
+{
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef half_vec_type = lp_build_vec_type(gallivm, half_type);
+   LLVMValueRef value = LLVMBuildLoad(builder, ptrs[0], "");
+   unsigned i;
+
+   for (i = 0; i < num_halves; i++) {
+      LLVMValueRef half = lp_build_extract_range(gallivm, value,
+                                                 i * half_type.length,
+                                                 half_type.length);
+      ptrs[i] = lp_build_alloca(gallivm, half_vec_type, "");
+      LLVMBuildStore(builder, half, ptrs[i]);
+   }
+}
+
+
 /**
  * Generate the runtime callable function for the whole fragment pipeline.
  * Note that the function which we generate operates on a block of 16
@@ -2160,8 +2332,7 @@ generate_unswizzled_blend(struct gallivm_state *gallivm,
  * 2x2 pixels.
  */
 static void
-generate_fragment(struct llvmpipe_context *lp,
-                  struct lp_fragment_shader *shader,
+generate_fragment(struct lp_fragment_shader *shader,
                   struct lp_fragment_shader_variant *variant,
                   unsigned partial_mask)
 {
@@ -2173,7 +2344,7 @@ generate_fragment(struct llvmpipe_context *lp,
    struct lp_type blend_type;
    LLVMTypeRef fs_elem_type;
    LLVMTypeRef blend_vec_type;
-   LLVMTypeRef arg_types[13];
+   LLVMTypeRef arg_types[15];
    LLVMTypeRef func_type;
    LLVMTypeRef int32_type = LLVMInt32TypeInContext(gallivm->context);
    LLVMTypeRef int8_type = LLVMInt8TypeInContext(gallivm->context);
@@ -2187,18 +2358,22 @@ generate_fragment(struct llvmpipe_context *lp,
    LLVMValueRef stride_ptr;
    LLVMValueRef depth_ptr;
    LLVMValueRef depth_stride;
+   LLVMValueRef sample_stride_ptr;
+   LLVMValueRef depth_sample_stride;
    LLVMValueRef mask_input;
+   LLVMValueRef pixel_mask_input;
    LLVMValueRef thread_data_ptr;
    LLVMBasicBlockRef block;
    LLVMBuilderRef builder;
    struct lp_build_sampler_soa *sampler;
    struct lp_build_interp_soa_context interp;
    LLVMValueRef fs_mask[16 / 4];
+   LLVMValueRef fs_sample_mask[LP_MAX_SAMPLES][16 / 4];
    LLVMValueRef fs_out_color[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS][16 / 4];
    LLVMValueRef function;
    LLVMValueRef facing;
    unsigned num_fs;
-   unsigned i;
+   unsigned i, s;
    unsigned chan;
    unsigned cbuf;
    boolean cbuf0_write_all;
@@ -2261,10 +2436,12 @@ generate_fragment(struct llvmpipe_context *lp,
    arg_types[6] = LLVMPointerType(fs_elem_type, 0);    /* dady */
    arg_types[7] = LLVMPointerType(LLVMPointerType(blend_vec_type, 0), 0);  /* color */
    arg_types[8] = LLVMPointerType(int8_type, 0);       /* depth */
-   arg_types[9] = int32_type;                          /* mask_input */
+   arg_types[9] = LLVMInt64TypeInContext(gallivm->context); /* mask_input */
    arg_types[10] = variant->jit_thread_data_ptr_type;  /* per thread data */
    arg_types[11] = LLVMPointerType(int32_type, 0);     /* stride */
    arg_types[12] = int32_type;                         /* depth_stride */
+   arg_types[13] = LLVMPointerType(int32_type, 0);     /* sample_stride */
+   arg_types[14] = int32_type;                         /* depth_sample_stride */
 
    func_type = LLVMFunctionType(LLVMVoidTypeInContext(gallivm->context),
                                 arg_types, Elements(arg_types), 0);
@@ -2294,6 +2471,8 @@ generate_fragment(struct llvmpipe_context *lp,
    thread_data_ptr  = LLVMGetParam(function, 10);
    stride_ptr   = LLVMGetParam(function, 11);
    depth_stride = LLVMGetParam(function, 12);
+   sample_stride_ptr = LLVMGetParam(function, 13);
+   depth_sample_stride = LLVMGetParam(function, 14);
 
    lp_build_name(context_ptr, "context");
    lp_build_name(x, "x");
@@ -2307,6 +2486,8 @@ generate_fragment(struct llvmpipe_context *lp,
    lp_build_name(thread_data_ptr, "thread_data");
    lp_build_name(stride_ptr, "stride_ptr");
    lp_build_name(depth_stride, "depth_stride");
+   lp_build_name(sample_stride_ptr, "sample_stride_ptr");
+   lp_build_name(depth_sample_stride, "depth_sample_stride");
 
    /*
     * Function body
@@ -2322,7 +2503,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
    num_fs = 16 / fs_type.length; /* number of loops per 4x4 stamp */
    /* for 1d resources only run "upper half" of stamp */
-   if (key->resource_1d)
+   if (key->resource_1d && num_fs > 1)
       num_fs /= 2;
 
    {
@@ -2330,6 +2511,8 @@ generate_fragment(struct llvmpipe_context *lp,
       LLVMTypeRef mask_type = lp_build_int_vec_type(gallivm, fs_type);
       LLVMValueRef mask_store = lp_build_array_alloca(gallivm, mask_type,
                                                       num_loop, "mask_store");
+      LLVMValueRef sample_mask_store[LP_MAX_SAMPLES];
+      LLVMValueRef dzdx = NULL, dzdy = NULL;
       LLVMValueRef color_store[PIPE_MAX_COLOR_BUFS][TGSI_NUM_CHANNELS];
       boolean pixel_center_integer =
          shader->info.base.properties[TGSI_PROPERTY_FS_COORD_PIXEL_CENTER];
@@ -2348,6 +2531,57 @@ generate_fragment(struct llvmpipe_context *lp,
                                a0_ptr, dadx_ptr, dady_ptr,
                                x, y);
 
+      /*
+       * mask_input holds 16 bits per sample.  The shader is run for the
+       * pixels with any sample covered.
+       */
+      pixel_mask_input = LLVMBuildTrunc(builder, mask_input, int32_type, "");
+      if (key->multisample) {
+         LLVMTypeRef int64_type = LLVMInt64TypeInContext(gallivm->context);
+         LLVMValueRef index = lp_build_const_int32(gallivm, 2);
+
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            LLVMValueRef sample_mask_input;
+
+            sample_mask_input = LLVMBuildLShr(builder, mask_input,
+                                              LLVMConstInt(int64_type, 16 * s, 0), "");
+            sample_mask_input = LLVMBuildTrunc(builder, sample_mask_input,
+                                               int32_type, "");
+            if (s > 0)
+               pixel_mask_input = LLVMBuildOr(builder, pixel_mask_input,
+                                              sample_mask_input, "");
+
+            sample_mask_store[s] = lp_build_array_alloca(gallivm, mask_type,
+                                                         num_loop,
+                                                         "sample_mask_store");
+            for (i = 0; i < num_fs; i++) {
+               LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
+               LLVMValueRef mask_ptr = LLVMBuildGEP(builder, sample_mask_store[s],
+                                                    &indexi, 1, "");
+               LLVMBuildStore(builder,
+                              generate_quad_mask(gallivm, fs_type,
+                                                 i*fs_type.length/4,
+                                                 sample_mask_input),
+                              mask_ptr);
+            }
+         }
+
+         /* z gradients for evaluating depth at the sample positions */
+         dzdx = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, dadx_ptr, &index, 1, ""),
+                              "dzdx");
+         dzdx = lp_build_broadcast(gallivm, lp_build_vec_type(gallivm, fs_type),
+                                   dzdx);
+         dzdy = LLVMBuildLoad(builder,
+                              LLVMBuildGEP(builder, dady_ptr, &index, 1, ""),
+                              "dzdy");
+         dzdy = lp_build_broadcast(gallivm, lp_build_vec_type(gallivm, fs_type),
+                                   dzdy);
+      }
+      else {
+         memset(sample_mask_store, 0, sizeof sample_mask_store);
+      }
+
       for (i = 0; i < num_fs; i++) {
          LLVMValueRef mask;
          LLVMValueRef indexi = lp_build_const_int32(gallivm, i);
@@ -2356,7 +2590,7 @@ generate_fragment(struct llvmpipe_context *lp,
 
          if (partial_mask) {
             mask = generate_quad_mask(gallivm, fs_type,
-                                      i*fs_type.length/4, mask_input);
+                                      i*fs_type.length/4, pixel_mask_input);
          }
          else {
             mask = lp_build_const_int_vec(gallivm, fs_type, ~0);
@@ -2373,9 +2607,12 @@ generate_fragment(struct llvmpipe_context *lp,
                        &interp,
                        sampler,
                        mask_store, /* output */
+                       sample_mask_store, /* output */
                        color_store,
                        depth_ptr,
                        depth_stride,
+                       depth_sample_stride,
+                       dzdx, dzdy,
                        facing,
                        thread_data_ptr);
 
@@ -2384,6 +2621,13 @@ generate_fragment(struct llvmpipe_context *lp,
          LLVMValueRef ptr = LLVMBuildGEP(builder, mask_store,
                                          &indexi, 1, "");
          fs_mask[i] = LLVMBuildLoad(builder, ptr, "mask");
+         if (key->multisample) {
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               ptr = LLVMBuildGEP(builder, sample_mask_store[s],
+                                  &indexi, 1, "");
+               fs_sample_mask[s][i] = LLVMBuildLoad(builder, ptr, "sample_mask");
+            }
+         }
          /* This is fucked up need to reorganize things */
          for (cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
             for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
@@ -2407,6 +2651,47 @@ generate_fragment(struct llvmpipe_context *lp,
 
    sampler->destroy(sampler);
 
+   /*
+    * The blending code is built around 128 bit interleaves and copes with
+    * at most 8-wide vectors, so hand a 16-wide stamp to it as two halves,
+    * i.e. quads 0-1 and 2-3.  That's also what 8-wide shading produces.
+    */
+   if (fs_type.length == 16) {
+      unsigned num_outputs = key->nr_cbufs;
+      unsigned num_halves = key->resource_1d ? 1 : 2;
+
+      if (dual_source_blend)
+         num_outputs = MAX2(num_outputs, 2);
+
+      fs_type.length = 8;
+
+      for (cbuf = 0; cbuf < num_outputs; cbuf++) {
+         for (chan = 0; chan < TGSI_NUM_CHANNELS; ++chan) {
+            split_fs_output(gallivm, fs_type, num_halves,
+                            fs_out_color[cbuf][chan]);
+         }
+      }
+
+      for (i = num_halves; i-- > 0; ) {
+         fs_mask[i] = lp_build_extract_range(gallivm, fs_mask[0],
+                                             i * fs_type.length,
+                                             fs_type.length);
+      }
+
+      if (key->multisample) {
+         for (s = 0; s < LP_MAX_SAMPLES; s++) {
+            for (i = num_halves; i-- > 0; ) {
+               fs_sample_mask[s][i] =
+                  lp_build_extract_range(gallivm, fs_sample_mask[s][0],
+                                         i * fs_type.length,
+                                         fs_type.length);
+            }
+         }
+      }
+
+      num_fs = num_halves;
+   }
+
    /* Loop over color outputs / color buffers to do blending.
     */
    for(cbuf = 0; cbuf < key->nr_cbufs; cbuf++) {
@@ -2431,11 +2716,42 @@ generate_fragment(struct llvmpipe_context *lp,
                                 LLVMBuildGEP(builder, stride_ptr, &index, 1, ""),
                                 "");
 
-         generate_unswizzled_blend(gallivm, cbuf, variant,
-                                   key->cbuf_format[cbuf],
-                                   num_fs, fs_type, fs_mask, fs_out_color,
-                                   context_ptr, color_ptr, stride,
-                                   partial_mask, do_branch);
+         if (key->multisample) {
+            LLVMValueRef sample_stride;
+
+            sample_stride = LLVMBuildLoad(builder,
+                                          LLVMBuildGEP(builder, sample_stride_ptr,
+                                                       &index, 1, ""),
+                                          "");
+
+            /* Blend each sample with the pixel's color, under its own mask */
+            for (s = 0; s < LP_MAX_SAMPLES; s++) {
+               LLVMValueRef offset, sample_color_ptr;
+
+               offset = LLVMBuildMul(builder, sample_stride,
+                                     lp_build_const_int32(gallivm, s), "");
+               sample_color_ptr = LLVMBuildBitCast(builder, color_ptr,
+                                     LLVMPointerType(int8_type, 0), "");
+               sample_color_ptr = LLVMBuildGEP(builder, sample_color_ptr,
+                                               &offset, 1, "");
+               sample_color_ptr = LLVMBuildBitCast(builder, sample_color_ptr,
+                                                   LLVMTypeOf(color_ptr), "");
+
+               generate_unswizzled_blend(gallivm, cbuf, variant,
+                                         key->cbuf_format[cbuf],
+                                         num_fs, fs_type, fs_sample_mask[s],
+                                         fs_out_color, context_ptr,
+                                         sample_color_ptr, stride,
+                                         TRUE, do_branch);
+            }
+         }
+         else {
+            generate_unswizzled_blend(gallivm, cbuf, variant,
+                                      key->cbuf_format[cbuf],
+                                      num_fs, fs_type, fs_mask, fs_out_color,
+                                      context_ptr, color_ptr, stride,
+                                      partial_mask, do_branch);
+         }
       }
    }
 
@@ -2483,6 +2799,10 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
       debug_printf("occlusion_count = 1\n");
    }
 
+   if (key->multisample) {
+      debug_printf("multisample = 1\n");
+   }
+
    if (key->blend.logicop_enable) {
       debug_printf("blend.logicop_func = %s\n", util_dump_logicop(key->blend.logicop_func, TRUE));
    }
@@ -2532,6 +2852,7 @@ dump_fs_variant_key(const struct lp_fragment_shader_variant_key *key)
                    texture->pot_width,
                    texture->pot_height,
                    texture->pot_depth);
+      debug_printf("  .tiled = %u\n", texture->tiled);
    }
 }
 
@@ -2544,40 +2865,278 @@ lp_debug_fs_variant(const struct lp_fragment_shader_variant *variant)
    tgsi_dump(variant->shader->base.tokens, 0);
    dump_fs_variant_key(&variant->key);
    debug_printf("variant->opaque = %u\n", variant->opaque);
+   debug_printf("variant->hiz_reject = %u\n", variant->hiz_reject);
+   debug_printf("variant->hiz_update = %u\n", variant->hiz_update);
+   debug_printf("variant->hiz_invalidate = %u\n", variant->hiz_invalidate);
    debug_printf("\n");
 }
 
 
+/**
+ * Background compilation of an optimized variant, see
+ * llvmpipe_poll_fs_compiles().
+ */
+struct lp_fs_compile_job
+{
+   struct lp_compile_job base;
+
+   /** Scratch variant the worker compiles into */
+   struct lp_fragment_shader_variant *result;
+   boolean ok;
+};
+
+
+/**
+ * Generate and JIT the code of a variant whose key, shader and opaque
+ * flag are set.  May run on a compile thread, in which case only the
+ * variant and the (immutable) shader tokens and info may be touched.
+ *
+ * \param optimize  run the full optimization passes
+ * \param optimized  returns whether the code is fully optimized, which is
+ *                   also the case for unoptimized requests served from the
+ *                   persistent cache
+ */
+static boolean
+compile_variant(struct lp_fragment_shader_variant *variant,
+                LLVMContextRef context,
+                boolean optimize,
+                boolean *optimized)
+{
+   struct lp_fragment_shader *shader = variant->shader;
+   const struct lp_fragment_shader_variant_key *key = &variant->key;
+   char module_name[64];
+
+   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
+                 shader->no, variant->no);
+
+   if (optimize)
+      variant->gallivm = gallivm_create(module_name, context);
+   else
+      variant->gallivm = gallivm_create_unoptimized(module_name, context);
+   if (!variant->gallivm)
+      return FALSE;
+
+   *optimized = optimize;
+
+   /*
+    * Try the persistent cache first.  LP_PERF options change the generated
+    * code without being part of the key, so don't cache then.
+    */
+   if (!LP_PERF &&
+       gallivm_cache_lookup(variant->gallivm, shader->base.tokens,
+                            key, shader->variant_key_size)) {
+      /* Functions are cached in the order they are jitted below */
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_cached_function(variant->gallivm, 0);
+      if (variant->opaque) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_cached_function(variant->gallivm, 1);
+      } else {
+         variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+      }
+
+      if (variant->jit_function[RAST_EDGE_TEST] &&
+          variant->jit_function[RAST_WHOLE]) {
+         variant->nr_instrs += gallivm_cached_nr_instrs(variant->gallivm);
+
+         gallivm_free_ir(variant->gallivm);
+
+         *optimized = TRUE;
+         return TRUE;
+      }
+
+      /* Unusable cache entry, compile the variant in a fresh module */
+      variant->jit_function[RAST_EDGE_TEST] = NULL;
+      variant->jit_function[RAST_WHOLE] = NULL;
+      gallivm_destroy(variant->gallivm);
+
+      if (optimize)
+         variant->gallivm = gallivm_create(module_name, context);
+      else
+         variant->gallivm = gallivm_create_unoptimized(module_name, context);
+      if (!variant->gallivm)
+         return FALSE;
+   }
+
+   lp_jit_init_types(variant);
+   
+   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
+      generate_fragment(shader, variant, RAST_EDGE_TEST);
+
+   if (variant->jit_function[RAST_WHOLE] == NULL) {
+      if (variant->opaque) {
+         /* Specialized shader, which doesn't need to read the color buffer. */
+         generate_fragment(shader, variant, RAST_WHOLE);
+      }
+   }
+
+   /*
+    * Compile everything
+    */
+
+   gallivm_compile_module(variant->gallivm);
+
+   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
+
+   if (variant->function[RAST_EDGE_TEST]) {
+      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
+            gallivm_jit_function(variant->gallivm,
+                                 variant->function[RAST_EDGE_TEST]);
+   }
+
+   if (variant->function[RAST_WHOLE]) {
+         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
+               gallivm_jit_function(variant->gallivm,
+                                    variant->function[RAST_WHOLE]);
+   } else if (!variant->jit_function[RAST_WHOLE]) {
+      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   }
+
+   gallivm_free_ir(variant->gallivm);
+
+   return TRUE;
+}
+
+
+static void
+compile_fs_job(struct lp_compile_job *job, LLVMContextRef context)
+{
+   struct lp_fs_compile_job *fs_job = (struct lp_fs_compile_job *) job;
+   boolean optimized;
+
+   fs_job->ok = compile_variant(fs_job->result, context, TRUE, &optimized);
+}
+
+
+/**
+ * Queue the compilation of an optimized version of the variant.  The
+ * variant keeps running its unoptimized code until then.
+ */
+static void
+queue_variant_compile(struct llvmpipe_context *lp,
+                      struct lp_fragment_shader_variant *variant)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fs_compile_job *job;
+   struct lp_fragment_shader_variant *result;
+
+   job = CALLOC_STRUCT(lp_fs_compile_job);
+   result = CALLOC_STRUCT(lp_fragment_shader_variant);
+   if (!job || !result) {
+      FREE(job);
+      FREE(result);
+      return;
+   }
+
+   memcpy(&result->key, &variant->key, variant->shader->variant_key_size);
+   result->opaque = variant->opaque;
+   result->shader = variant->shader;
+   result->no = variant->no;
+
+   job->base.func = compile_fs_job;
+   job->result = result;
+
+   variant->compile_job = job;
+   insert_at_tail(&lp->fs_variants_pending, &variant->list_item_pending);
+
+   lp_compile_queue_add(screen->compile_queue, &job->base);
+}
+
+
+/**
+ * Retire the variant's compile job, which must not be queued or running
+ * anymore, installing the optimized code if it completed.
+ */
+static void
+finish_variant_compile(struct llvmpipe_context *lp,
+                       struct lp_fragment_shader_variant *variant)
+{
+   struct lp_fs_compile_job *job = variant->compile_job;
+   struct lp_fragment_shader_variant *result = job->result;
+
+   if (job->base.state == LP_COMPILE_JOB_DONE && job->ok) {
+      /*
+       * Scenes already binned may still be running the unoptimized code,
+       * so it is kept around for as long as the variant lives.
+       */
+      variant->gallivm_unoptimized = variant->gallivm;
+      variant->gallivm = result->gallivm;
+      variant->jit_function[RAST_WHOLE] = result->jit_function[RAST_WHOLE];
+      variant->jit_function[RAST_EDGE_TEST] = result->jit_function[RAST_EDGE_TEST];
+
+      lp->nr_fs_instrs -= variant->nr_instrs;
+      variant->nr_instrs = result->nr_instrs;
+      lp->nr_fs_instrs += variant->nr_instrs;
+   }
+   else if (result->gallivm) {
+      gallivm_destroy(result->gallivm);
+   }
+
+   remove_from_list(&variant->list_item_pending);
+   variant->compile_job = NULL;
+   FREE(result);
+   FREE(job);
+}
+
+
+/**
+ * Install the optimized code of the variants whose background compilation
+ * has completed.  With wait set, block for the running compiles and drop
+ * those not started yet.
+ */
+void
+llvmpipe_poll_fs_compiles(struct llvmpipe_context *lp, boolean wait)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_fs_variant_list_item *li;
+
+   li = first_elem(&lp->fs_variants_pending);
+   while (!at_end(&lp->fs_variants_pending, li)) {
+      struct lp_fs_variant_list_item *next = next_elem(li);
+      struct lp_fragment_shader_variant *variant = li->base;
+      struct lp_compile_job *job = &variant->compile_job->base;
+
+      if (wait) {
+         lp_compile_job_cancel(screen->compile_queue, job);
+         finish_variant_compile(lp, variant);
+      }
+      else if (lp_compile_job_is_done(screen->compile_queue, job)) {
+         finish_variant_compile(lp, variant);
+      }
+      li = next;
+   }
+}
+
+
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ *
+ * When background compilation is enabled the variant is first compiled
+ * without optimizations, which is several times quicker, and the optimized
+ * code replaces it once a compile thread has produced it.  Both are built
+ * from the same key so render identically.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
                  const struct lp_fragment_shader_variant_key *key)
 {
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
    struct lp_fragment_shader_variant *variant;
    const struct util_format_description *cbuf0_format_desc;
    boolean fullcolormask;
-   char module_name[64];
+   boolean optimized;
 
    variant = CALLOC_STRUCT(lp_fragment_shader_variant);
    if (!variant)
       return NULL;
 
-   util_snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-                 shader->no, shader->variants_created);
-
-   variant->gallivm = gallivm_create(module_name, lp->context);
-   if (!variant->gallivm) {
-      FREE(variant);
-      return NULL;
-   }
-
+   pipe_reference_init(&variant->reference, 1);
    variant->shader = shader;
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
+   variant->list_item_pending.base = variant;
    variant->no = shader->variants_created++;
 
    memcpy(&variant->key, key, shader->variant_key_size);
@@ -2599,9 +3158,37 @@ generate_variant(struct llvmpipe_context *lp,
          !key->alpha.enabled &&
          !key->blend.alpha_to_coverage &&
          !key->depth.enabled &&
+         !key->multisample &&
          !shader->info.base.uses_kill
       ? TRUE : FALSE;
 
+   variant->hiz_reject =
+         key->depth.enabled &&
+         (key->depth.func == PIPE_FUNC_LESS ||
+          key->depth.func == PIPE_FUNC_LEQUAL) &&
+         !key->stencil[0].enabled &&
+         !key->depth_clamp &&
+         !shader->info.base.writes_z &&
+         !(LP_PERF & PERF_NO_HIZ)
+      ? TRUE : FALSE;
+
+   variant->hiz_update =
+         variant->hiz_reject &&
+         key->depth.writemask &&
+         !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage &&
+         !shader->info.base.uses_kill
+      ? TRUE : FALSE;
+
+   variant->hiz_invalidate =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         key->depth.func != PIPE_FUNC_NEVER &&
+         key->depth.func != PIPE_FUNC_LESS &&
+         key->depth.func != PIPE_FUNC_LEQUAL &&
+         key->depth.func != PIPE_FUNC_EQUAL
+      ? TRUE : FALSE;
+
    if ((shader->info.base.num_tokens <= 1) &&
        !key->depth.enabled && !key->stencil[0].enabled) {
       variant->ps_inv_multiplier = 0;
@@ -2613,42 +3200,16 @@ generate_variant(struct llvmpipe_context *lp,
       lp_debug_fs_variant(variant);
    }
 
-   lp_jit_init_types(variant);
-   
-   if (variant->jit_function[RAST_EDGE_TEST] == NULL)
-      generate_fragment(lp, shader, variant, RAST_EDGE_TEST);
-
-   if (variant->jit_function[RAST_WHOLE] == NULL) {
-      if (variant->opaque) {
-         /* Specialized shader, which doesn't need to read the color buffer. */
-         generate_fragment(lp, shader, variant, RAST_WHOLE);
-      }
-   }
-
-   /*
-    * Compile everything
-    */
-
-   gallivm_compile_module(variant->gallivm);
-
-   variant->nr_instrs += lp_build_count_ir_module(variant->gallivm->module);
-
-   if (variant->function[RAST_EDGE_TEST]) {
-      variant->jit_function[RAST_EDGE_TEST] = (lp_jit_frag_func)
-            gallivm_jit_function(variant->gallivm,
-                                 variant->function[RAST_EDGE_TEST]);
+   if (!compile_variant(variant, lp->context,
+                        screen->compile_queue == NULL, &optimized)) {
+      FREE(variant);
+      return NULL;
    }
 
-   if (variant->function[RAST_WHOLE]) {
-         variant->jit_function[RAST_WHOLE] = (lp_jit_frag_func)
-               gallivm_jit_function(variant->gallivm,
-                                    variant->function[RAST_WHOLE]);
-   } else if (!variant->jit_function[RAST_WHOLE]) {
-      variant->jit_function[RAST_WHOLE] = variant->jit_function[RAST_EDGE_TEST];
+   if (!optimized) {
+      queue_variant_compile(lp, variant);
    }
 
-   gallivm_free_ir(variant->gallivm);
-
    return variant;
 }
 
@@ -2670,6 +3231,12 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
    shader->no = fs_no++;
    make_empty_list(&shader->variants);
 
+   shader->variants_hash = cso_hash_create();
+   if (!shader->variants_hash) {
+      FREE(shader);
+      return NULL;
+   }
+
    /* get/save the summary info for this shader */
    lp_build_tgsi_info(templ->tokens, &shader->info);
 
@@ -2678,6 +3245,7 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
 
    shader->draw_data = draw_create_fragment_shader(llvmpipe->draw, templ);
    if (shader->draw_data == NULL) {
+      cso_hash_delete(shader->variants_hash);
       FREE((void *) shader->base.tokens);
       FREE(shader);
       return NULL;
@@ -2770,10 +3338,27 @@ llvmpipe_bind_fs_state(struct pipe_context *pipe, void *fs)
  * Remove shader variant from two lists: the shader's variant list
  * and the context's variant list.
  */
+static void
+destroy_shader_variant(struct lp_fragment_shader_variant *variant)
+{
+   gallivm_destroy(variant->gallivm);
+   if (variant->gallivm_unoptimized)
+      gallivm_destroy(variant->gallivm_unoptimized);
+   FREE(variant);
+}
+
+
 void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant)
 {
+   /* The compile thread must be done with the variant's shader */
+   if (variant->compile_job) {
+      struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+      lp_compile_job_cancel(screen->compile_queue, &variant->compile_job->base);
+      finish_variant_compile(lp, variant);
+   }
+
    if (gallivm_debug & GALLIVM_DEBUG_IR) {
       debug_printf("llvmpipe: del fs #%u var #%u v created #%u v cached"
                    " #%u v total cached #%u\n",
@@ -2784,18 +3369,55 @@ llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                    lp->nr_fs_variants);
    }
 
-   gallivm_destroy(variant->gallivm);
-
-   /* remove from shader's list */
+   /* remove from shader's list and hash */
    remove_from_list(&variant->list_item_local);
    variant->shader->variants_cached--;
+   cso_hash_erase_data(variant->shader->variants_hash, variant->hash_key,
+                       variant);
+   variant->shader = NULL;
 
    /* remove from context's list */
    remove_from_list(&variant->list_item_global);
    lp->nr_fs_variants--;
    lp->nr_fs_instrs -= variant->nr_instrs;
 
-   FREE(variant);
+   /* Drop the cache's reference.  If scenes still have the variant binned
+    * it can't be destroyed yet, so park it on the retired list until
+    * llvmpipe_sweep_shader_variants() finds it unreferenced.
+    */
+   if (pipe_reference(&variant->reference, NULL)) {
+      destroy_shader_variant(variant);
+   }
+   else {
+      insert_at_head(&lp->fs_variants_retired, &variant->list_item_global);
+   }
+}
+
+
+/**
+ * Destroy the retired shader variants which are no longer referenced by
+ * any scene.
+ *
+ * Scenes drop their references from the rasterizer threads, but the
+ * variants share the context's LLVM context, so the actual destruction
+ * must happen here on the context's thread.
+ */
+void
+llvmpipe_sweep_shader_variants(struct llvmpipe_context *lp)
+{
+   struct lp_fs_variant_list_item *li;
+
+   li = first_elem(&lp->fs_variants_retired);
+   while (!at_end(&lp->fs_variants_retired, li)) {
+      struct lp_fs_variant_list_item *next = next_elem(li);
+      struct lp_fragment_shader_variant *variant = li->base;
+
+      if (p_atomic_read(&variant->reference.count) == 0) {
+         remove_from_list(&variant->list_item_global);
+         destroy_shader_variant(variant);
+      }
+      li = next;
+   }
 }
 
 
@@ -2808,14 +3430,11 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
 
    assert(fs != llvmpipe->fs);
 
-   /*
-    * XXX: we need to flush the context until we have some sort of reference
-    * counting in fragment shaders as they may still be binned
-    * Flushing alone might not sufficient we need to wait on it too.
-    */
-   llvmpipe_finish(pipe, __FUNCTION__);
+   llvmpipe_sweep_shader_variants(llvmpipe);
 
-   /* Delete all the variants */
+   /* Delete all the variants.  Those still binned in a scene are only
+    * retired, and get destroyed once the scenes have been rasterized.
+    */
    li = first_elem(&shader->variants);
    while(!at_end(&shader->variants, li)) {
       struct lp_fs_variant_list_item *next = next_elem(li);
@@ -2827,6 +3446,8 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
    draw_delete_fragment_shader(llvmpipe->draw, shader->draw_data);
 
    assert(shader->variants_cached == 0);
+   assert(cso_hash_size(shader->variants_hash) == 0);
+   cso_hash_delete(shader->variants_hash);
    FREE((void *) shader->base.tokens);
    FREE(shader);
 }
@@ -2900,6 +3521,23 @@ force_dst_alpha_one(unsigned factor, boolean clamped_zero)
 }
 
 
+/**
+ * Fill in the static texture state of a sampler view, including the
+ * llvmpipe texture layout.
+ */
+static void
+make_texture_state_key(struct lp_static_texture_state *state,
+                       struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+
+   if (view && view->texture &&
+       llvmpipe_resource_is_texture(view->texture)) {
+      state->tiled = llvmpipe_resource(view->texture)->tiled;
+   }
+}
+
+
 /**
  * We need to generate several variants of the fragment pipeline to match
  * all the combinations of the contributing state atoms.
@@ -2963,6 +3601,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->occlusion_count = TRUE;
    }
 
+   key->multisample = util_framebuffer_get_num_samples(&lp->framebuffer) > 1;
+
    if (lp->framebuffer.nr_cbufs) {
       memcpy(&key->blend, lp->blend, sizeof key->blend);
    }
@@ -3069,8 +3709,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = shader->info.base.file_max[TGSI_FILE_SAMPLER_VIEW] + 1;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER_VIEW] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            make_texture_state_key(&key->state[i].texture_state,
+                                   lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3078,8 +3718,8 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for(i = 0; i < key->nr_sampler_views; ++i) {
          if(shader->info.base.file_mask[TGSI_FILE_SAMPLER] & (1 << i)) {
-            lp_sampler_static_texture_state(&key->state[i].texture_state,
-                                            lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
+            make_texture_state_key(&key->state[i].texture_state,
+                                   lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
    }
@@ -3097,18 +3737,22 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    struct lp_fragment_shader *shader = lp->fs;
    struct lp_fragment_shader_variant_key key;
    struct lp_fragment_shader_variant *variant = NULL;
-   struct lp_fs_variant_list_item *li;
+   struct cso_hash_iter iter;
+   unsigned hash_key;
 
    make_variant_key(lp, shader, &key);
 
    /* Search the variants for one which matches the key */
-   li = first_elem(&shader->variants);
-   while(!at_end(&shader->variants, li)) {
-      if(memcmp(&li->base->key, &key, shader->variant_key_size) == 0) {
-         variant = li->base;
+   hash_key = util_hash_crc32(&key, shader->variant_key_size);
+   iter = cso_hash_find(shader->variants_hash, hash_key);
+   while (!cso_hash_iter_is_null(iter) &&
+          cso_hash_iter_key(iter) == hash_key) {
+      struct lp_fragment_shader_variant *v = cso_hash_iter_data(iter);
+      if (memcmp(&v->key, &key, shader->variant_key_size) == 0) {
+         variant = v;
          break;
       }
-      li = next_elem(li);
+      iter = cso_hash_iter_next(iter);
    }
 
    if (variant) {
@@ -3123,6 +3767,9 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       unsigned i;
       unsigned variants_to_cull;
 
+      /* Reclaim retired variants whose scenes have been rasterized */
+      llvmpipe_sweep_shader_variants(lp);
+
       if (0) {
          debug_printf("%u variants,\t%u instrs,\t%u instrs/variant\n",
                       lp->nr_fs_variants,
@@ -3137,21 +3784,11 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
 
       if (variants_to_cull ||
           lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         struct pipe_context *pipe = &lp->pipe;
-
          /*
-          * XXX: we need to flush the context until we have some sort of
-          * reference counting in fragment shaders as they may still be binned
-          * Flushing alone might not be sufficient we need to wait on it too.
+          * Variants still binned in a queued scene hold a reference, so
+          * they are merely retired here and destroyed later on.  No need
+          * to flush or wait for the rasterizer.
           */
-         llvmpipe_finish(pipe, __FUNCTION__);
-
-         /*
-          * We need to re-check lp->nr_fs_variants because an arbitrarliy large
-          * number of shader variants (potentially all of them) could be
-          * pending for destruction on flush.
-          */
-
          for (i = 0; i < variants_to_cull || lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS; i++) {
             struct lp_fs_variant_list_item *item;
             if (is_empty_list(&lp->fs_variants_list)) {
@@ -3174,8 +3811,10 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
       LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
-      /* Put the new variant into the list */
+      /* Put the new variant into the list and hash */
       if (variant) {
+         variant->hash_key = hash_key;
+         cso_hash_insert(shader->variants_hash, hash_key, variant);
          insert_at_head(&shader->variants, &variant->list_item_local);
          insert_at_head(&lp->fs_variants_list, &variant->list_item_global);
          lp->nr_fs_variants++;
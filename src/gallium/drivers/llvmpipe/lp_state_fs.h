@@ -39,7 +39,9 @@
 
 
 struct tgsi_token;
+struct cso_hash;
 struct lp_fragment_shader;
+struct lp_fs_compile_job;
 
 
 /** Indexes into jit_function[] array */
@@ -77,6 +79,7 @@ struct lp_fragment_shader_variant_key
    unsigned occlusion_count:1;
    unsigned resource_1d:1;
    unsigned depth_clamp:1;
+   unsigned multisample:1;
 
    enum pipe_format zsbuf_format;
    enum pipe_format cbuf_format[PIPE_MAX_COLOR_BUFS];
@@ -95,12 +98,33 @@ struct lp_fs_variant_list_item
 
 struct lp_fragment_shader_variant
 {
+   /*
+    * One reference is held by the variant cache while the variant is on
+    * the context's and shader's lists, plus one per scene that has the
+    * variant binned.
+    */
+   struct pipe_reference reference;
+
    struct lp_fragment_shader_variant_key key;
 
    boolean opaque;
    uint8_t ps_inv_multiplier;
 
+   /*
+    * Hierarchical depth properties, see lp_rast_hiz_test():
+    * hiz_reject - fragments fail where the stored depth is known to be
+    *              less than the interpolated one;
+    * hiz_update - all fragments of fully covered pixels write a depth
+    *              no greater than the interpolated one;
+    * hiz_invalidate - stored depth values may increase.
+    */
+   boolean hiz_reject;
+   boolean hiz_update;
+   boolean hiz_invalidate;
+
    struct gallivm_state *gallivm;
+   /** Code used until the optimized gallivm above was ready */
+   struct gallivm_state *gallivm_unoptimized;
 
    LLVMTypeRef jit_context_ptr_type;
    LLVMTypeRef jit_thread_data_ptr_type;
@@ -113,7 +137,14 @@ struct lp_fragment_shader_variant
    /* Total number of LLVM instructions generated */
    unsigned nr_instrs;
 
+   /* Hash of the key, see lp_fragment_shader::variants_hash */
+   unsigned hash_key;
+
    struct lp_fs_variant_list_item list_item_global, list_item_local;
+
+   /** Pending background compile, on lp->fs_variants_pending */
+   struct lp_fs_compile_job *compile_job;
+   struct lp_fs_variant_list_item list_item_pending;
    struct lp_fragment_shader *shader;
 
    /* For debugging/profiling purposes */
@@ -130,6 +161,9 @@ struct lp_fragment_shader
 
    struct lp_fs_variant_list_item variants;
 
+   /* The same variants as above, indexed by the hash of their key */
+   struct cso_hash *variants_hash;
+
    struct draw_fragment_shader *draw_data;
 
    /* For debugging/profiling purposes */
@@ -150,6 +184,12 @@ void
 llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
                                struct lp_fragment_shader_variant *variant);
 
+void
+llvmpipe_sweep_shader_variants(struct llvmpipe_context *lp);
+
+void
+llvmpipe_poll_fs_compiles(struct llvmpipe_context *lp, boolean wait);
+
 boolean
 llvmpipe_rasterization_disabled(struct llvmpipe_context *lp);
 
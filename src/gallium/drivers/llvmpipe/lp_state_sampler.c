@@ -29,6 +29,7 @@
  *  Brian Paul
  */
 
+#include "util/u_format.h"
 #include "util/u_inlines.h"
 #include "util/u_memory.h"
 
@@ -38,6 +39,7 @@
 #include "lp_screen.h"
 #include "lp_state.h"
 #include "lp_debug.h"
+#include "lp_texture.h"
 #include "state_tracker/sw_winsys.h"
 
 
@@ -104,6 +106,25 @@ llvmpipe_bind_sampler_states(struct pipe_context *pipe,
 }
 
 
+/**
+ * Only fragment shaders sample tiled textures, and only through views
+ * with the same texel size as the texture.
+ */
+static boolean
+can_sample_tiled(unsigned shader, const struct pipe_sampler_view *view)
+{
+   const struct util_format_description *view_desc =
+      util_format_description(view->format);
+   const struct util_format_description *tex_desc =
+      util_format_description(view->texture->format);
+
+   return shader == PIPE_SHADER_FRAGMENT &&
+          view_desc->block.width == 1 &&
+          view_desc->block.height == 1 &&
+          view_desc->block.bits == tex_desc->block.bits;
+}
+
+
 static void
 llvmpipe_set_sampler_views(struct pipe_context *pipe,
                            unsigned shader,
@@ -140,6 +161,13 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
       }
       pipe_sampler_view_reference(&llvmpipe->sampler_views[shader][start + i],
                                   views[i]);
+
+      if (views[i] && views[i]->texture &&
+          llvmpipe_resource_is_texture(views[i]->texture) &&
+          llvmpipe_resource(views[i]->texture)->tiled &&
+          !can_sample_tiled(shader, views[i])) {
+         llvmpipe_resource_make_linear(pipe, views[i]->texture);
+      }
    }
 
    /* find highest non-null sampler_views[] entry */
@@ -29,12 +29,15 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/simple_list.h"
+#include "util/u_hash.h"
+#include "cso_cache/cso_hash.h"
 #include "os/os_time.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_init.h"
+#include "gallivm/lp_bld_cache.h"
 #include "gallivm/lp_bld_logic.h"
 #include "gallivm/lp_bld_intr.h"
 #include "gallivm/lp_bld_flow.h"
@@ -42,7 +45,6 @@
 
 #include "lp_perf.h"
 #include "lp_debug.h"
-#include "lp_flush.h"
 #include "lp_screen.h"
 #include "lp_context.h"
 #include "lp_state.h"
@@ -745,6 +747,16 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    memcpy(&variant->key, key, key->size);
    variant->list_item_global.base = variant;
 
+   if (gallivm_cache_lookup(gallivm, NULL, key, key->size)) {
+      variant->jit_function = (lp_jit_setup_triangle)
+         gallivm_cached_function(gallivm, 0);
+      if (!variant->jit_function)
+         goto fail;
+
+      gallivm_free_ir(variant->gallivm);
+      return variant;
+   }
+
    /* Currently always deal with full 4-wide vertex attributes from
     * the vertices.
     */
@@ -898,6 +910,10 @@ remove_setup_variant(struct llvmpipe_context *lp,
 
    remove_from_list(&variant->list_item_global);
    lp->nr_setup_variants--;
+
+   cso_hash_erase_data(lp->setup_variants_hash, variant->hash_key,
+                       variant);
+
    FREE(variant);
 }
 
@@ -909,15 +925,11 @@ remove_setup_variant(struct llvmpipe_context *lp,
 static void
 cull_setup_variants(struct llvmpipe_context *lp)
 {
-   struct pipe_context *pipe = &lp->pipe;
    int i;
 
-   /*
-    * XXX: we need to flush the context until we have some sort of reference
-    * counting in fragment shaders as they may still be binned
-    * Flushing alone might not be sufficient we need to wait on it too.
+   /* Setup variants are only invoked while binning, on this thread, so
+    * unlike fragment shader variants no scene can still be using them.
     */
-   llvmpipe_finish(pipe, __FUNCTION__);
 
    for (i = 0; i < LP_MAX_SETUP_VARIANTS / 4; i++) {
       struct lp_setup_variant_list_item *item;
@@ -942,16 +954,22 @@ llvmpipe_update_setup(struct llvmpipe_context *lp)
 {
    struct lp_setup_variant_key *key = &lp->setup_variant.key;
    struct lp_setup_variant *variant = NULL;
-   struct lp_setup_variant_list_item *li;
+   struct cso_hash_iter iter;
+   unsigned hash_key;
 
    lp_make_setup_variant_key(lp, key);
 
-   foreach(li, &lp->setup_variants_list) {
-      if(li->base->key.size == key->size &&
-         memcmp(&li->base->key, key, key->size) == 0) {
-         variant = li->base;
+   hash_key = util_hash_crc32(key, key->size);
+   iter = cso_hash_find(lp->setup_variants_hash, hash_key);
+   while (!cso_hash_iter_is_null(iter) &&
+          cso_hash_iter_key(iter) == hash_key) {
+      struct lp_setup_variant *v = cso_hash_iter_data(iter);
+      if (v->key.size == key->size &&
+          memcmp(&v->key, key, key->size) == 0) {
+         variant = v;
          break;
       }
+      iter = cso_hash_iter_next(iter);
    }
 
    if (variant) {
@@ -964,6 +982,8 @@ llvmpipe_update_setup(struct llvmpipe_context *lp)
 
       variant = generate_setup_variant(key, lp);
       if (variant) {
+         variant->hash_key = hash_key;
+         cso_hash_insert(lp->setup_variants_hash, hash_key, variant);
          insert_at_head(&lp->setup_variants_list, &variant->list_item_global);
          lp->nr_setup_variants++;
       }
@@ -57,6 +57,9 @@ struct lp_setup_variant {
    
    struct lp_setup_variant_list_item list_item_global;
 
+   /* Hash of the key, see llvmpipe_context::setup_variants_hash */
+   unsigned hash_key;
+
    struct gallivm_state *gallivm;
 
    /* XXX: this is a pointer to the LLVM IR.  Once jit_function is
@@ -36,6 +36,7 @@
 #include "lp_scene.h"
 #include "lp_state.h"
 #include "lp_setup.h"
+#include "lp_texture.h"
 
 #include "draw/draw_context.h"
 
@@ -79,6 +80,12 @@ llvmpipe_set_framebuffer_state(struct pipe_context *pipe,
          }
       }
 
+      /* The rasterizer only writes linear images */
+      for (i = 0; i < fb->nr_cbufs; i++) {
+         if (fb->cbufs[i])
+            llvmpipe_resource_make_linear(pipe, fb->cbufs[i]->texture);
+      }
+
       util_copy_framebuffer_state(&lp->framebuffer, fb);
 
       if (LP_PERF & PERF_NO_DEPTH) {
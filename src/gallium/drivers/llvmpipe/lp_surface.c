@@ -25,11 +25,16 @@
  * 
  **************************************************************************/
 
+#include "util/u_box.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
 #include "util/u_rect.h"
 #include "util/u_surface.h"
 #include "lp_context.h"
 #include "lp_flush.h"
 #include "lp_limits.h"
+#include "lp_rast.h"
 #include "lp_surface.h"
 #include "lp_texture.h"
 #include "lp_query.h"
@@ -56,39 +61,212 @@ lp_resource_copy(struct pipe_context *pipe,
                            FALSE, /* do_not_block */
                            "blit src");
 
+   if (src->nr_samples > 1) {
+      /*
+       * Transfers only see sample 0, so copy the sample images directly.
+       */
+      struct llvmpipe_resource *dst_tex = llvmpipe_resource(dst);
+      struct llvmpipe_resource *src_tex = llvmpipe_resource(src);
+      unsigned layer, sample;
+
+      assert(dst->nr_samples == src->nr_samples);
+
+      for (layer = 0; layer < src_box->depth; layer++) {
+         const ubyte *src_map;
+         ubyte *dst_map;
+
+         src_map = llvmpipe_resource_map(src, src_level, src_box->z + layer,
+                                         LP_TEX_USAGE_READ);
+         dst_map = llvmpipe_resource_map(dst, dst_level, dstz + layer,
+                                         LP_TEX_USAGE_READ_WRITE);
+
+         for (sample = 0; sample < src->nr_samples; sample++) {
+            util_copy_rect(dst_map + sample * dst_tex->sample_stride,
+                           dst->format,
+                           llvmpipe_resource_stride(dst, dst_level),
+                           dstx, dsty,
+                           src_box->width, src_box->height,
+                           src_map + sample * src_tex->sample_stride,
+                           llvmpipe_resource_stride(src, src_level),
+                           src_box->x, src_box->y);
+         }
+
+         llvmpipe_resource_unmap(dst, dst_level, dstz + layer);
+         llvmpipe_resource_unmap(src, src_level, src_box->z + layer);
+      }
+      return;
+   }
+
    util_resource_copy_region(pipe, dst, dst_level, dstx, dsty, dstz,
                              src, src_level, src_box);
 }
 
 
-static void lp_blit(struct pipe_context *pipe,
-                    const struct pipe_blit_info *blit_info)
+/**
+ * Resolve a multisample color buffer by averaging the samples of each
+ * pixel.  Only unscaled blits of all channels are handled, others return
+ * FALSE and must go through the blitter.
+ */
+static boolean
+lp_resolve(struct pipe_context *pipe,
+           const struct pipe_blit_info *info)
 {
-   struct llvmpipe_context *lp = llvmpipe_context(pipe);
+   struct pipe_resource *src = info->src.resource;
+   struct pipe_resource *dst = info->dst.resource;
+   struct llvmpipe_resource *src_tex = llvmpipe_resource(src);
+   const unsigned width = info->src.box.width;
+   const unsigned height = info->src.box.height;
+   const float scale = 1.0f / src->nr_samples;
+   float *sum, *tmp;
+   unsigned layer, y, i, sample;
+
+   if (info->dst.box.width != info->src.box.width ||
+       info->dst.box.height != info->src.box.height ||
+       info->src.box.width <= 0 || info->src.box.height <= 0 ||
+       info->dst.box.depth != info->src.box.depth ||
+       info->mask != PIPE_MASK_RGBA ||
+       info->scissor_enable) {
+      return FALSE;
+   }
+
+   sum = MALLOC(width * 4 * sizeof(float));
+   tmp = MALLOC(width * 4 * sizeof(float));
+   if (!sum || !tmp) {
+      FREE(sum);
+      FREE(tmp);
+      return FALSE;
+   }
+
+   llvmpipe_flush_resource(pipe, dst, info->dst.level,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve dest");
+   llvmpipe_flush_resource(pipe, src, info->src.level,
+                           TRUE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           "resolve src");
+
+   for (layer = 0; layer < info->src.box.depth; layer++) {
+      unsigned src_layer = info->src.box.z + layer;
+      unsigned dst_layer = info->dst.box.z + layer;
+      unsigned src_stride = llvmpipe_resource_stride(src, info->src.level);
+      unsigned dst_stride = llvmpipe_resource_stride(dst, info->dst.level);
+      const ubyte *src_map;
+      ubyte *dst_map;
+
+      src_map = llvmpipe_resource_map(src, info->src.level, src_layer,
+                                      LP_TEX_USAGE_READ);
+      dst_map = llvmpipe_resource_map(dst, info->dst.level, dst_layer,
+                                      LP_TEX_USAGE_READ_WRITE);
+
+      for (y = 0; y < height; y++) {
+         memset(sum, 0, width * 4 * sizeof(float));
+
+         for (sample = 0; sample < src->nr_samples; sample++) {
+            util_format_read_4f(info->src.format, tmp, 0,
+                                src_map + sample * src_tex->sample_stride,
+                                src_stride,
+                                info->src.box.x, info->src.box.y + y,
+                                width, 1);
+            for (i = 0; i < width * 4; i++)
+               sum[i] += tmp[i];
+         }
+
+         for (i = 0; i < width * 4; i++)
+            sum[i] *= scale;
+
+         util_format_write_4f(info->dst.format, sum, 0,
+                              dst_map, dst_stride,
+                              info->dst.box.x, info->dst.box.y + y,
+                              width, 1);
+      }
+
+      llvmpipe_resource_unmap(dst, info->dst.level, dst_layer);
+      llvmpipe_resource_unmap(src, info->src.level, src_layer);
+   }
+
+   FREE(sum);
+   FREE(tmp);
+   return TRUE;
+}
+
+
+/**
+ * Blit to a tiled texture, which can't be rendered to, by blitting to a
+ * linear temporary and copying the result in.  This keeps things like
+ * mipmap generation from converting textures to the linear layout.
+ */
+static void
+lp_blit_to_tiled(struct pipe_context *pipe,
+                 const struct pipe_blit_info *blit_info)
+{
+   struct pipe_resource *dst = blit_info->dst.resource;
+   const struct pipe_box *dst_box = &blit_info->dst.box;
    struct pipe_blit_info info = *blit_info;
+   struct pipe_resource templ, *tmp = NULL;
+   struct pipe_box box;
 
-   if (blit_info->render_condition_enable && !llvmpipe_check_render_cond(lp))
-      return;
+   if (dst_box->width > 0 && dst_box->height > 0 && dst_box->depth > 0) {
+      memset(&templ, 0, sizeof templ);
+      templ.target = dst_box->depth > 1 ? PIPE_TEXTURE_2D_ARRAY :
+                                          PIPE_TEXTURE_2D;
+      templ.format = dst->format;
+      templ.width0 = dst_box->width;
+      templ.height0 = dst_box->height;
+      templ.depth0 = 1;
+      templ.array_size = dst_box->depth;
+      templ.bind = PIPE_BIND_RENDER_TARGET | PIPE_BIND_LINEAR;
 
-   if (info.src.resource->nr_samples > 1 &&
-       info.dst.resource->nr_samples <= 1 &&
-       !util_format_is_depth_or_stencil(info.src.resource->format) &&
-       !util_format_is_pure_integer(info.src.resource->format)) {
-      debug_printf("llvmpipe: color resolve unimplemented\n");
+      tmp = pipe->screen->resource_create(pipe->screen, &templ);
+   }
+
+   if (!tmp) {
+      llvmpipe_resource_make_linear(pipe, dst);
+      pipe->blit(pipe, blit_info);
       return;
    }
 
-   if (util_try_blit_via_copy_region(pipe, &info)) {
-      return; /* done */
+   /* Texels the blit doesn't overwrite must be preserved */
+   if (info.scissor_enable || info.alpha_blend ||
+       (info.mask & PIPE_MASK_RGBA) != PIPE_MASK_RGBA) {
+      pipe->resource_copy_region(pipe, tmp, 0, 0, 0, 0,
+                                 dst, blit_info->dst.level, dst_box);
    }
 
-   if (!util_blitter_is_blit_supported(lp->blitter, &info)) {
-      debug_printf("llvmpipe: blit unsupported %s -> %s\n",
-                   util_format_short_name(info.src.resource->format),
-                   util_format_short_name(info.dst.resource->format));
-      return;
+   info.dst.resource = tmp;
+   info.dst.level = 0;
+   info.dst.box.x = 0;
+   info.dst.box.y = 0;
+   info.dst.box.z = 0;
+   if (info.scissor_enable) {
+      info.scissor.minx = MAX2((int) info.scissor.minx - dst_box->x, 0);
+      info.scissor.miny = MAX2((int) info.scissor.miny - dst_box->y, 0);
+      info.scissor.maxx = MAX2((int) info.scissor.maxx - dst_box->x, 0);
+      info.scissor.maxy = MAX2((int) info.scissor.maxy - dst_box->y, 0);
    }
+   /* the render condition was already checked */
+   info.render_condition_enable = FALSE;
 
+   pipe->blit(pipe, &info);
+
+   u_box_3d(0, 0, 0, dst_box->width, dst_box->height, dst_box->depth, &box);
+   pipe->resource_copy_region(pipe, dst, blit_info->dst.level,
+                              dst_box->x, dst_box->y, dst_box->z,
+                              tmp, 0, &box);
+
+   pipe_resource_reference(&tmp, NULL);
+}
+
+
+/**
+ * Save the state util_blitter overrides, it's restored once the blitter
+ * is done.
+ */
+static void
+lp_blitter_save_state(struct llvmpipe_context *lp)
+{
    /* XXX turn off occlusion and streamout queries */
 
    util_blitter_save_vertex_buffer_slot(lp->blitter, lp->vertex_buffer);
@@ -104,7 +282,7 @@ static void lp_blit(struct pipe_context *pipe,
    util_blitter_save_blend(lp->blitter, (void*)lp->blend);
    util_blitter_save_depth_stencil_alpha(lp->blitter, (void*)lp->depth_stencil);
    util_blitter_save_stencil_ref(lp->blitter, &lp->stencil_ref);
-   /*util_blitter_save_sample_mask(sp->blitter, lp->sample_mask);*/
+   util_blitter_save_sample_mask(lp->blitter, lp->sample_mask);
    util_blitter_save_framebuffer(lp->blitter, &lp->framebuffer);
    util_blitter_save_fragment_sampler_states(lp->blitter,
                      lp->num_samplers[PIPE_SHADER_FRAGMENT],
@@ -114,6 +292,45 @@ static void lp_blit(struct pipe_context *pipe,
                      lp->sampler_views[PIPE_SHADER_FRAGMENT]);
    util_blitter_save_render_condition(lp->blitter, lp->render_cond_query,
                                       lp->render_cond_cond, lp->render_cond_mode);
+}
+
+
+static void lp_blit(struct pipe_context *pipe,
+                    const struct pipe_blit_info *blit_info)
+{
+   struct llvmpipe_context *lp = llvmpipe_context(pipe);
+   struct pipe_blit_info info = *blit_info;
+
+   if (blit_info->render_condition_enable && !llvmpipe_check_render_cond(lp))
+      return;
+
+   if (llvmpipe_resource(info.dst.resource)->tiled) {
+      if (!util_try_blit_via_copy_region(pipe, &info))
+         lp_blit_to_tiled(pipe, &info);
+      return;
+   }
+
+   if (info.src.resource->nr_samples > 1 &&
+       info.dst.resource->nr_samples <= 1 &&
+       !util_format_is_depth_or_stencil(info.src.resource->format) &&
+       !util_format_is_pure_integer(info.src.resource->format)) {
+      if (lp_resolve(pipe, &info))
+         return; /* done */
+      /* Scaled, masked and scissored resolves are left to the blitter */
+   }
+
+   if (util_try_blit_via_copy_region(pipe, &info)) {
+      return; /* done */
+   }
+
+   if (!util_blitter_is_blit_supported(lp->blitter, &info)) {
+      debug_printf("llvmpipe: blit unsupported %s -> %s\n",
+                   util_format_short_name(info.src.resource->format),
+                   util_format_short_name(info.dst.resource->format));
+      return;
+   }
+
+   lp_blitter_save_state(lp);
    util_blitter_blit(lp->blitter, &info);
 }
 
@@ -124,6 +341,23 @@ lp_flush_resource(struct pipe_context *ctx, struct pipe_resource *resource)
 }
 
 
+static void
+lp_get_sample_position(struct pipe_context *pipe,
+                       unsigned sample_count,
+                       unsigned sample_index,
+                       float *out_value)
+{
+   if (sample_count == LP_MAX_SAMPLES && sample_index < LP_MAX_SAMPLES) {
+      out_value[0] = (float)lp_sample_pos_4x[sample_index][0] / FIXED_ONE;
+      out_value[1] = (float)lp_sample_pos_4x[sample_index][1] / FIXED_ONE;
+   }
+   else {
+      out_value[0] = 0.5f;
+      out_value[1] = 0.5f;
+   }
+}
+
+
 static struct pipe_surface *
 llvmpipe_create_surface(struct pipe_context *pipe,
                         struct pipe_resource *pt,
@@ -190,6 +424,14 @@ llvmpipe_clear_render_target(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   /* Transfers only see sample 0, clear multisample surfaces by drawing */
+   if (dst->texture->nr_samples > 1) {
+      lp_blitter_save_state(llvmpipe);
+      util_blitter_clear_render_target(llvmpipe->blitter, dst, color,
+                                       dstx, dsty, width, height);
+      return;
+   }
+
    util_clear_render_target(pipe, dst, color,
                             dstx, dsty, width, height);
 }
@@ -209,6 +451,14 @@ llvmpipe_clear_depth_stencil(struct pipe_context *pipe,
    if (!llvmpipe_check_render_cond(llvmpipe))
       return;
 
+   if (dst->texture->nr_samples > 1) {
+      lp_blitter_save_state(llvmpipe);
+      util_blitter_clear_depth_stencil(llvmpipe->blitter, dst, clear_flags,
+                                       depth, stencil,
+                                       dstx, dsty, width, height);
+      return;
+   }
+
    util_clear_depth_stencil(pipe, dst, clear_flags,
                             depth, stencil,
                             dstx, dsty, width, height);
@@ -226,4 +476,5 @@ llvmpipe_init_surface_functions(struct llvmpipe_context *lp)
    lp->pipe.resource_copy_region = lp_resource_copy;
    lp->pipe.blit = lp_blit;
    lp->pipe.flush_resource = lp_flush_resource;
+   lp->pipe.get_sample_position = lp_get_sample_position;
 }
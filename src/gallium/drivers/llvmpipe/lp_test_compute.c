@@ -0,0 +1,332 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Compute shader tests.
+ *
+ * Kernels are dispatched with launch_grid() on a whole llvmpipe context,
+ * the way clover drives it, and their results read back and checked.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_state.h"
+#include "state_tracker/sw_winsys.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "test\n");
+
+   fflush(fp);
+}
+
+
+static boolean
+null_is_displaytarget_format_supported(struct sw_winsys *ws,
+                                       unsigned tex_usage,
+                                       enum pipe_format format)
+{
+   return FALSE;
+}
+
+
+/** Nothing here renders to a display target */
+static struct sw_winsys null_winsys = {
+   NULL,
+   null_is_displaytarget_format_supported
+};
+
+
+static void *
+create_kernel(struct pipe_context *pipe, const char *text,
+              unsigned local_mem, unsigned input_mem)
+{
+   struct tgsi_token tokens[1024];
+   struct pipe_compute_state state;
+
+   if (!tgsi_text_translate(text, tokens, Elements(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof state);
+   state.prog = tokens;
+   state.req_local_mem = local_mem;
+   state.req_input_mem = input_mem;
+
+   return pipe->create_compute_state(pipe, &state);
+}
+
+
+static boolean
+check_results(const char *name, unsigned verbose,
+              const uint32_t *results, const uint32_t *expected,
+              unsigned count)
+{
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      if (results[i] != expected[i]) {
+         fprintf(stderr, "%s: element %u is %u, expected %u\n",
+                 name, i, results[i], expected[i]);
+         return FALSE;
+      }
+   }
+
+   if (verbose)
+      fprintf(stderr, "%s: %u elements ok\n", name, count);
+
+   return TRUE;
+}
+
+
+/**
+ * Each invocation writes its global id to the LOCAL resource and, after
+ * a barrier, reads back the one of the invocation mirrored in the work
+ * group.  The work group spans several SIMD vectors, so this only works
+ * if all of them reach the barrier before any goes past it.
+ */
+static boolean
+test_shared_barrier(struct pipe_context *pipe, unsigned verbose, FILE *fp)
+{
+   static const char text[] =
+      "COMP\n"
+      "DCL SV[0], THREAD_ID[0]\n"
+      "DCL SV[1], BLOCK_ID[0]\n"
+      "DCL SV[2], BLOCK_SIZE[0]\n"
+      "DCL BUFFER[0]\n"
+      "DCL BUFFER[32766]\n"
+      "DCL TEMP[0..3]\n"
+      "IMM[0] UINT32 {4, 63, 0, 0}\n"
+      "  0: UMUL TEMP[0].x, SV[0].xxxx, IMM[0].xxxx\n"
+      "  1: UMAD TEMP[1].x, SV[1].xxxx, SV[2].xxxx, SV[0].xxxx\n"
+      "  2: STORE BUFFER[32766].x, TEMP[0].xxxx, TEMP[1].xxxx\n"
+      "  3: BARRIER\n"
+      "  4: XOR TEMP[2].x, SV[0].xxxx, IMM[0].yyyy\n"
+      "  5: UMUL TEMP[2].x, TEMP[2].xxxx, IMM[0].xxxx\n"
+      "  6: LOAD TEMP[3].x, BUFFER[32766], TEMP[2].xxxx\n"
+      "  7: UMUL TEMP[1].x, TEMP[1].xxxx, IMM[0].xxxx\n"
+      "  8: STORE BUFFER[0].x, TEMP[1].xxxx, TEMP[3].xxxx\n"
+      "  9: END\n";
+   const uint block[3] = { 64, 1, 1 };
+   const uint grid[3] = { 4, 1, 1 };
+   const unsigned count = 64 * 4;
+   struct pipe_resource *buf;
+   struct pipe_shader_buffer sb;
+   uint32_t results[64 * 4], expected[64 * 4];
+   boolean success = FALSE;
+   void *cs;
+   unsigned i;
+
+   cs = create_kernel(pipe, text, 64 * 4, 0);
+   if (!cs) {
+      fprintf(stderr, "shared_barrier: failed to create kernel\n");
+      goto out;
+   }
+
+   buf = pipe_buffer_create(pipe->screen, PIPE_BIND_SHADER_BUFFER,
+                            PIPE_USAGE_DEFAULT, sizeof results);
+
+   memset(&sb, 0, sizeof sb);
+   sb.buffer = buf;
+   sb.buffer_size = sizeof results;
+
+   pipe->bind_compute_state(pipe, cs);
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, &sb);
+   pipe->launch_grid(pipe, block, grid, 0, NULL);
+   pipe->set_shader_buffers(pipe, PIPE_SHADER_COMPUTE, 0, 1, NULL);
+   pipe->bind_compute_state(pipe, NULL);
+
+   pipe_buffer_read(pipe, buf, 0, sizeof results, results);
+
+   for (i = 0; i < count; i++)
+      expected[i] = (i & ~63) + (63 - (i & 63));
+
+   success = check_results("shared_barrier", verbose,
+                           results, expected, count);
+
+   pipe->delete_compute_state(pipe, cs);
+   pipe_resource_reference(&buf, NULL);
+
+out:
+   if (fp)
+      fprintf(fp, "%u\tshared_barrier\n", success ? 1 : 0);
+
+   return success;
+}
+
+
+/**
+ * Run the second of two kernels of a program, which reads the addresses
+ * of two global buffers from the INPUT resource, as clover sets them up.
+ * Loads past the end of the input buffer return zero, stores through the
+ * null pointer are dropped, and the first kernel, which would overwrite
+ * the output, must not run.
+ */
+static boolean
+test_global_input_pc(struct pipe_context *pipe, unsigned verbose, FILE *fp)
+{
+   static const char text[] =
+      "COMP\n"
+      "DCL SV[0], THREAD_ID[0]\n"
+      "DCL BUFFER[32767]\n"
+      "DCL BUFFER[32764]\n"
+      "DCL TEMP[0..2]\n"
+      "IMM[0] UINT32 {4, 1000, 0, 7}\n"
+      "  0: LOAD TEMP[0].x, BUFFER[32764], IMM[0].zzzz\n"
+      "  1: STORE BUFFER[32767].x, TEMP[0].xxxx, IMM[0].wwww\n"
+      "  2: RET\n"
+      "  3: LOAD TEMP[0].xy, BUFFER[32764], IMM[0].zzzz\n"
+      "  4: UMUL TEMP[1].x, SV[0].xxxx, IMM[0].xxxx\n"
+      "  5: UADD TEMP[2].x, TEMP[0].yyyy, TEMP[1].xxxx\n"
+      "  6: LOAD TEMP[2].x, BUFFER[32767], TEMP[2].xxxx\n"
+      "  7: UADD TEMP[2].x, TEMP[2].xxxx, IMM[0].yyyy\n"
+      "  8: UADD TEMP[1].x, TEMP[0].xxxx, TEMP[1].xxxx\n"
+      "  9: STORE BUFFER[32767].x, TEMP[1].xxxx, TEMP[2].xxxx\n"
+      " 10: STORE BUFFER[32767].x, IMM[0].zzzz, IMM[0].wwww\n"
+      " 11: RET\n"
+      " 12: END\n";
+   const uint block[3] = { 40, 1, 1 };
+   const uint grid[3] = { 1, 1, 1 };
+   const unsigned count = 40;
+   /* The input buffer is read from its second element on */
+   const unsigned num_inputs = 33;
+   struct pipe_resource *bufs[2];
+   uint32_t input[2], *handles[2];
+   uint32_t inputs[33], results[40], expected[40];
+   boolean success = FALSE;
+   void *cs;
+   unsigned i;
+
+   cs = create_kernel(pipe, text, 0, sizeof input);
+   if (!cs) {
+      fprintf(stderr, "global_input_pc: failed to create kernel\n");
+      goto out;
+   }
+
+   for (i = 0; i < num_inputs; i++)
+      inputs[i] = i * 3;
+
+   bufs[0] = pipe_buffer_create(pipe->screen, PIPE_BIND_GLOBAL,
+                                PIPE_USAGE_DEFAULT, sizeof results);
+   bufs[1] = pipe_buffer_create(pipe->screen, PIPE_BIND_GLOBAL,
+                                PIPE_USAGE_DEFAULT, sizeof inputs);
+   pipe_buffer_write(pipe, bufs[1], 0, sizeof inputs, inputs);
+
+   /* Offsets in the buffers, the driver turns them into addresses */
+   input[0] = 0;
+   input[1] = sizeof inputs[0];
+   handles[0] = &input[0];
+   handles[1] = &input[1];
+
+   pipe->bind_compute_state(pipe, cs);
+   pipe->set_global_binding(pipe, 0, 2, bufs, handles);
+   pipe->launch_grid(pipe, block, grid, 3, input);
+   pipe->set_global_binding(pipe, 0, 2, NULL, NULL);
+   pipe->bind_compute_state(pipe, NULL);
+
+   pipe_buffer_read(pipe, bufs[0], 0, sizeof results, results);
+
+   for (i = 0; i < count; i++)
+      expected[i] = (i + 1 < num_inputs ? inputs[i + 1] : 0) + 1000;
+
+   success = check_results("global_input_pc", verbose,
+                           results, expected, count);
+
+   pipe->delete_compute_state(pipe, cs);
+   pipe_resource_reference(&bufs[0], NULL);
+   pipe_resource_reference(&bufs[1], NULL);
+
+out:
+   if (fp)
+      fprintf(fp, "%u\tglobal_input_pc\n", success ? 1 : 0);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   boolean success = TRUE;
+
+   screen = llvmpipe_create_screen(&null_winsys);
+   if (!screen)
+      return FALSE;
+
+   if (!screen->get_param(screen, PIPE_CAP_COMPUTE)) {
+      fprintf(stderr, "compute not supported\n");
+      screen->destroy(screen);
+      return FALSE;
+   }
+
+   pipe = screen->context_create(screen, NULL, 0);
+
+   if (!test_shared_barrier(pipe, verbose, fp))
+      success = FALSE;
+
+   if (!test_global_input_pc(pipe, verbose, fp))
+      success = FALSE;
+
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
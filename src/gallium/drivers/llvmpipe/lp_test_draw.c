@@ -0,0 +1,510 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Threaded vertex processing tests.
+ *
+ * Large draws are rendered by contexts with and without draw threads
+ * (DRAW_NUM_THREADS), with blending which depends on the order of the
+ * primitives, and the results are compared byte for byte.  The draws span
+ * several segments, take the emit and the pipeline paths, and use strips
+ * and elements.  A benchmark reports the vertex processing time of both.
+ */
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "os/os_time.h"
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_shader_tokens.h"
+#include "pipe/p_state.h"
+#include "state_tracker/sw_winsys.h"
+#include "tgsi/tgsi_text.h"
+#include "util/u_draw.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "util/u_string.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define WIDTH  256
+#define HEIGHT 256
+
+/** Enough for a few segments even at DRAW_THREADED_SEGMENT_SIZE */
+#define NUM_VERTS (3 * 20000)
+
+/** Dependent instructions in the vertex shader, to give it some weight */
+#define VS_LENGTH 64
+
+/** Draw threads of the threaded contexts */
+#define NUM_DRAW_THREADS 3
+
+
+struct vertex
+{
+   float position[4];
+   float color[4];
+};
+
+
+struct draw_case
+{
+   const char *name;
+   unsigned mode;
+   boolean indexed;
+   boolean clipped;    /**< vertices outside the view volume */
+   boolean culled;     /**< all primitives culled, for timing */
+};
+
+
+static const struct draw_case cases[] = {
+   { "triangles", PIPE_PRIM_TRIANGLES, FALSE, FALSE, FALSE },
+   { "triangle_strip", PIPE_PRIM_TRIANGLE_STRIP, FALSE, FALSE, FALSE },
+   { "indexed", PIPE_PRIM_TRIANGLES, TRUE, FALSE, FALSE },
+   { "clipped", PIPE_PRIM_TRIANGLES, FALSE, TRUE, FALSE },
+   { "clipped_indexed", PIPE_PRIM_TRIANGLES, TRUE, TRUE, FALSE },
+};
+
+
+static struct vertex vertices[NUM_VERTS];
+static ushort indices[NUM_VERTS];
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "test\t"
+           "draw_threads\t"
+           "msecs\n");
+
+   fflush(fp);
+}
+
+
+static boolean
+null_is_displaytarget_format_supported(struct sw_winsys *ws,
+                                       unsigned tex_usage,
+                                       enum pipe_format format)
+{
+   return FALSE;
+}
+
+
+/** Nothing here renders to a display target */
+static struct sw_winsys null_winsys = {
+   NULL,
+   null_is_displaytarget_format_supported
+};
+
+
+static unsigned
+random_uint(unsigned *seed)
+{
+   *seed = *seed * 1103515245 + 12345;
+   return (*seed >> 16) & 0x7fff;
+}
+
+
+static float
+random_range(unsigned *seed, float min, float max)
+{
+   return min + (max - min) * (float)random_uint(seed) / 32767.0f;
+}
+
+
+/**
+ * Small translucent triangles all over the framebuffer, so that many of
+ * them overlap.  Elements pick vertices of a smaller window at random,
+ * so the vertex caches hit too.
+ */
+static void
+init_vertices(const struct draw_case *dc)
+{
+   const float zmax = dc->clipped ? 1.5f : 0.9f;
+   unsigned seed = 1;
+   unsigned i;
+
+   for (i = 0; i < NUM_VERTS; i++) {
+      struct vertex *v = &vertices[i];
+      float x, y;
+
+      if (i % 3 == 0 || dc->mode != PIPE_PRIM_TRIANGLES) {
+         x = random_range(&seed, -1.0f, 1.0f);
+         y = random_range(&seed, -1.0f, 1.0f);
+      }
+      else {
+         x = vertices[i - 1].position[0] + random_range(&seed, -0.2f, 0.2f);
+         y = vertices[i - 1].position[1] + random_range(&seed, -0.2f, 0.2f);
+      }
+
+      v->position[0] = x;
+      v->position[1] = y;
+      v->position[2] = random_range(&seed, -zmax, zmax);
+      v->position[3] = 1.0f;
+      v->color[0] = random_range(&seed, 0.0f, 1.0f);
+      v->color[1] = random_range(&seed, 0.0f, 1.0f);
+      v->color[2] = random_range(&seed, 0.0f, 1.0f);
+      v->color[3] = random_range(&seed, 0.25f, 0.75f);
+   }
+
+   for (i = 0; i < NUM_VERTS; i++) {
+      unsigned window = MIN2(i, 1000);
+      indices[i] = i - random_uint(&seed) % (window + 1);
+   }
+}
+
+
+static void *
+create_vs(struct pipe_context *pipe)
+{
+   struct tgsi_token tokens[4 * VS_LENGTH + 256];
+   struct pipe_shader_state state;
+   char text[64 * VS_LENGTH + 512];
+   unsigned len, i;
+
+   len = util_snprintf(text, sizeof text,
+                       "VERT\n"
+                       "DCL IN[0]\n"
+                       "DCL IN[1]\n"
+                       "DCL OUT[0], POSITION\n"
+                       "DCL OUT[1], COLOR\n"
+                       "DCL TEMP[0]\n"
+                       "IMM[0] FLT32 {0.999, 0.0005, 0.0, 0.0}\n"
+                       "  0: MOV OUT[0], IN[0]\n"
+                       "  1: MOV TEMP[0], IN[1]\n");
+   for (i = 0; i < VS_LENGTH; i++) {
+      len += util_snprintf(text + len, sizeof text - len,
+                           "%3u: MAD TEMP[0], TEMP[0], IMM[0].xxxx, "
+                           "IMM[0].yyyy\n", i + 2);
+   }
+   util_snprintf(text + len, sizeof text - len,
+                 "%3u: MOV OUT[1], TEMP[0]\n"
+                 "%3u: END\n", i + 2, i + 3);
+
+   if (!tgsi_text_translate(text, tokens, Elements(tokens)))
+      return NULL;
+
+   memset(&state, 0, sizeof state);
+   state.tokens = tokens;
+
+   return pipe->create_vs_state(pipe, &state);
+}
+
+
+/**
+ * Draw the case with a context with the given number of draw threads.
+ * The color buffer is read back into color unless it is NULL, and the
+ * time taken by the draw and the flush is returned in usecs.
+ */
+static boolean
+render(struct pipe_screen *screen, const struct draw_case *dc,
+       unsigned num_draw_threads, uint32_t *color, int64_t *usecs)
+{
+   static const union pipe_color_union clear_color =
+      { .f = { 0.0f, 0.0f, 0.0f, 1.0f } };
+   struct pipe_context *pipe;
+   struct pipe_resource templ, *cbuf;
+   struct pipe_surface surf_templ, *cbuf_surf;
+   struct pipe_framebuffer_state fb;
+   struct pipe_vertex_element velems[2];
+   struct pipe_vertex_buffer vbuf;
+   struct pipe_index_buffer ibuf;
+   struct pipe_rasterizer_state rast;
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_viewport_state viewport;
+   struct pipe_draw_info info;
+   struct pipe_transfer *transfer;
+   void *vs, *fs, *velems_cso, *rast_cso, *blend_cso, *dsa_cso;
+   const uint8_t *map;
+   char value[8];
+   int64_t start;
+   unsigned y;
+
+   util_snprintf(value, sizeof value, "%u", num_draw_threads);
+   setenv("DRAW_NUM_THREADS", value, 1);
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe)
+      return FALSE;
+
+   vs = create_vs(pipe);
+   if (!vs) {
+      fprintf(stderr, "failed to create vertex shader\n");
+      pipe->destroy(pipe);
+      return FALSE;
+   }
+   pipe->bind_vs_state(pipe, vs);
+   fs = util_make_fragment_passthrough_shader(pipe, TGSI_SEMANTIC_COLOR,
+                                              TGSI_INTERPOLATE_PERSPECTIVE,
+                                              FALSE);
+   pipe->bind_fs_state(pipe, fs);
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templ.width0 = WIDTH;
+   templ.height0 = HEIGHT;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.bind = PIPE_BIND_RENDER_TARGET;
+   cbuf = screen->resource_create(screen, &templ);
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = cbuf->format;
+   cbuf_surf = pipe->create_surface(pipe, cbuf, &surf_templ);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = cbuf_surf;
+   pipe->set_framebuffer_state(pipe, &fb);
+
+   viewport.scale[0] = WIDTH / 2.0f;
+   viewport.scale[1] = HEIGHT / 2.0f;
+   viewport.scale[2] = 0.5f;
+   viewport.translate[0] = WIDTH / 2.0f;
+   viewport.translate[1] = HEIGHT / 2.0f;
+   viewport.translate[2] = 0.5f;
+   pipe->set_viewport_states(pipe, 0, 1, &viewport);
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_offset = offsetof(struct vertex, position);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = offsetof(struct vertex, color);
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems_cso = pipe->create_vertex_elements_state(pipe, 2, velems);
+   pipe->bind_vertex_elements_state(pipe, velems_cso);
+
+   memset(&vbuf, 0, sizeof vbuf);
+   vbuf.stride = sizeof(struct vertex);
+   vbuf.user_buffer = vertices;
+   pipe->set_vertex_buffers(pipe, 0, 1, &vbuf);
+
+   memset(&rast, 0, sizeof rast);
+   rast.half_pixel_center = 1;
+   rast.bottom_edge_rule = 1;
+   rast.depth_clip = 1;
+   rast.cull_face = dc->culled ? PIPE_FACE_FRONT_AND_BACK : PIPE_FACE_NONE;
+   rast_cso = pipe->create_rasterizer_state(pipe, &rast);
+   pipe->bind_rasterizer_state(pipe, rast_cso);
+
+   /* the result of this blend depends on the order of the primitives */
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].blend_enable = 1;
+   blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_cso = pipe->create_blend_state(pipe, &blend);
+   pipe->bind_blend_state(pipe, blend_cso);
+
+   memset(&dsa, 0, sizeof dsa);
+   dsa_cso = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   pipe->bind_depth_stencil_alpha_state(pipe, dsa_cso);
+
+   pipe->clear(pipe, PIPE_CLEAR_COLOR, &clear_color, 0.0, 0);
+
+   util_draw_init_info(&info);
+   info.mode = dc->mode;
+   info.count = NUM_VERTS;
+   if (dc->indexed) {
+      memset(&ibuf, 0, sizeof ibuf);
+      ibuf.index_size = sizeof indices[0];
+      ibuf.user_buffer = indices;
+      pipe->set_index_buffer(pipe, &ibuf);
+
+      info.indexed = TRUE;
+      info.min_index = 0;
+      info.max_index = NUM_VERTS - 1;
+   }
+
+   /* make sure the shaders are compiled before timing */
+   pipe->flush(pipe, NULL, 0);
+
+   start = os_time_get();
+   pipe->draw_vbo(pipe, &info);
+   pipe->flush(pipe, NULL, 0);
+   if (usecs)
+      *usecs = os_time_get() - start;
+
+   if (color) {
+      map = pipe_transfer_map(pipe, cbuf, 0, 0, PIPE_TRANSFER_READ,
+                              0, 0, WIDTH, HEIGHT, &transfer);
+      for (y = 0; y < HEIGHT; y++)
+         memcpy(color + y * WIDTH, map + y * transfer->stride, WIDTH * 4);
+      pipe->transfer_unmap(pipe, transfer);
+   }
+
+   pipe->set_index_buffer(pipe, NULL);
+   pipe->bind_vs_state(pipe, NULL);
+   pipe->bind_fs_state(pipe, NULL);
+   pipe->bind_vertex_elements_state(pipe, NULL);
+   pipe->bind_rasterizer_state(pipe, NULL);
+   pipe->bind_blend_state(pipe, NULL);
+   pipe->bind_depth_stencil_alpha_state(pipe, NULL);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe->delete_vertex_elements_state(pipe, velems_cso);
+   pipe->delete_rasterizer_state(pipe, rast_cso);
+   pipe->delete_blend_state(pipe, blend_cso);
+   pipe->delete_depth_stencil_alpha_state(pipe, dsa_cso);
+
+   memset(&fb, 0, sizeof fb);
+   pipe->set_framebuffer_state(pipe, &fb);
+   pipe_surface_reference(&cbuf_surf, NULL);
+   pipe_resource_reference(&cbuf, NULL);
+
+   pipe->destroy(pipe);
+
+   return TRUE;
+}
+
+
+/**
+ * Compare the draw threads' rendering of a case with the serial one.
+ */
+static boolean
+test_order(struct pipe_screen *screen, const struct draw_case *dc,
+           unsigned verbose, FILE *fp)
+{
+   static uint32_t expected[WIDTH * HEIGHT], result[WIDTH * HEIGHT];
+   boolean success = FALSE;
+   unsigned i;
+
+   init_vertices(dc);
+
+   if (!render(screen, dc, 0, expected, NULL) ||
+       !render(screen, dc, NUM_DRAW_THREADS, result, NULL))
+      goto out;
+
+   for (i = 0; i < WIDTH * HEIGHT; i++) {
+      if (result[i] != expected[i]) {
+         fprintf(stderr, "%s: pixel %u,%u is 0x%08x, expected 0x%08x\n",
+                 dc->name, i % WIDTH, i / WIDTH, result[i], expected[i]);
+         goto out;
+      }
+   }
+
+   success = TRUE;
+
+   if (verbose)
+      fprintf(stderr, "%s: ok\n", dc->name);
+
+out:
+   if (fp)
+      fprintf(fp, "%u\t%s\t%u\t\n", success ? 1 : 0, dc->name,
+              NUM_DRAW_THREADS);
+
+   return success;
+}
+
+
+/**
+ * Time a draw whose primitives are all culled, so that vertex processing
+ * dominates, without and with draw threads.  The speedup depends on the
+ * number of CPUs available, so this never fails.
+ */
+static void
+benchmark(struct pipe_screen *screen, unsigned verbose, FILE *fp)
+{
+   static const struct draw_case dc =
+      { "benchmark", PIPE_PRIM_TRIANGLES, FALSE, FALSE, TRUE };
+   static const unsigned num_threads[] = { 0, 1, NUM_DRAW_THREADS };
+   int64_t usecs[Elements(num_threads)];
+   unsigned i;
+
+   init_vertices(&dc);
+
+   for (i = 0; i < Elements(num_threads); i++) {
+      if (!render(screen, &dc, num_threads[i], NULL, &usecs[i]))
+         return;
+
+      if (verbose)
+         fprintf(stderr, "%s: %u draw threads: %.2f ms, speedup %.2fx\n",
+                 dc.name, num_threads[i], usecs[i] / 1000.0,
+                 (double) usecs[0] / MAX2(usecs[i], 1));
+      if (fp)
+         fprintf(fp, "1\t%s\t%u\t%.2f\n", dc.name, num_threads[i],
+                 usecs[i] / 1000.0);
+   }
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   struct pipe_screen *screen;
+   boolean success = TRUE;
+   unsigned i;
+
+   screen = llvmpipe_create_screen(&null_winsys);
+   if (!screen)
+      return FALSE;
+
+   for (i = 0; i < Elements(cases); i++) {
+      if (!test_order(screen, &cases[i], verbose, fp))
+         success = FALSE;
+   }
+
+   benchmark(screen, verbose, fp);
+
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
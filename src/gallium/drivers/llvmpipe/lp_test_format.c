@@ -36,8 +36,10 @@
 #include "util/u_format.h"
 #include "util/u_format_tests.h"
 #include "util/u_format_s3tc.h"
+#include "os/os_time.h"
 
 #include "gallivm/lp_bld.h"
+#include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_debug.h"
 #include "gallivm/lp_bld_format.h"
 #include "gallivm/lp_bld_init.h"
@@ -46,6 +48,15 @@
 
 #define USE_TEXTURE_CACHE 1
 
+/** Number of texels fetched to measure the fetch rate */
+#define NUM_BENCHMARK_TEXELS (64 * 1024)
+
+/** Random blocks tested for each block compressed format */
+#define NUM_RANDOM_BLOCKS 16
+
+/** Number of texels fetched at once by the SoA test */
+#define SOA_LENGTH 4
+
 static struct lp_build_format_cache *cache_ptr;
 
 void
@@ -53,6 +64,9 @@ write_tsv_header(FILE *fp)
 {
    fprintf(fp,
            "result\t"
+           "texels_per_second\t"
+           "fallback_texels_per_second\t"
+           "type\t"
            "format\n");
 
    fflush(fp);
@@ -62,10 +76,19 @@ write_tsv_header(FILE *fp)
 static void
 write_tsv_row(FILE *fp,
               const struct util_format_description *desc,
+              const char *type,
+              double texels_per_second,
+              double fallback_texels_per_second,
               boolean success)
 {
    fprintf(fp, "%s\t", success ? "pass" : "fail");
 
+   fprintf(fp, "%.0f\t", texels_per_second);
+
+   fprintf(fp, "%.0f\t", fallback_texels_per_second);
+
+   fprintf(fp, "%s\t", type);
+
    fprintf(fp, "%s\n", desc->name);
 
    fflush(fp);
@@ -77,10 +100,182 @@ typedef void
                unsigned i, unsigned j, struct lp_build_format_cache *cache);
 
 
+typedef void
+(*fetch_soa_ptr_t)(float *rgba, const void *packed,
+                   const int32_t *offsets, const int32_t *i, const int32_t *j);
+
+
+/**
+ * Gather the blocks a format is tested with: its u_format_tests cases,
+ * plus, for the block compressed formats decoded by gallivm, random blocks
+ * whose expected values come from the util_format fetch functions.
+ * The result must be FREE'd.
+ */
+static struct util_format_test_case *
+get_test_cases(const struct util_format_description *desc,
+               unsigned *num_cases)
+{
+   struct util_format_test_case *cases;
+   unsigned num_random = 0;
+   unsigned n = 0;
+   unsigned i, j, k, l;
+
+   if (lp_build_format_compressed_supported(desc) && desc->fetch_rgba_float)
+      num_random = NUM_RANDOM_BLOCKS;
+
+   for (l = 0; l < util_format_nr_test_cases; ++l) {
+      if (util_format_test_cases[l].format == desc->format)
+         ++n;
+   }
+
+   *num_cases = 0;
+   if (n + num_random == 0)
+      return NULL;
+
+   cases = CALLOC(n + num_random, sizeof *cases);
+   if (!cases)
+      return NULL;
+
+   n = 0;
+   for (l = 0; l < util_format_nr_test_cases; ++l) {
+      if (util_format_test_cases[l].format == desc->format)
+         cases[n++] = util_format_test_cases[l];
+   }
+
+   for (l = 0; l < num_random; ++l) {
+      struct util_format_test_case *test = &cases[n++];
+
+      test->format = desc->format;
+      for (k = 0; k < desc->block.bits / 8; ++k) {
+         test->mask[k] = 0xff;
+         test->packed[k] = rand() & 0xff;
+      }
+
+      for (i = 0; i < desc->block.height; ++i) {
+         for (j = 0; j < desc->block.width; ++j) {
+            float texel[4];
+
+            desc->fetch_rgba_float(texel, test->packed, j, i);
+            for (k = 0; k < 4; ++k) {
+               test->unpacked[i][j][k] = texel[k];
+            }
+         }
+      }
+   }
+
+   *num_cases = n;
+   return cases;
+}
+
+
+/**
+ * Compare a texel fetched as floats with the expected value.
+ */
+static boolean
+compare_texel_float(const struct util_format_description *desc,
+                    const double expected[4],
+                    const float obtained[4])
+{
+   boolean match = TRUE;
+   unsigned k;
+
+   for (k = 0; k < 4; ++k) {
+      double eps = FLT_EPSILON;
+
+      /*
+       * The block decoders linearize sRGB with lp_build_srgb_to_linear(),
+       * which is only accurate to 8 bits, rather than with a table.
+       */
+      if (lp_build_format_compressed_supported(desc) &&
+          desc->colorspace == UTIL_FORMAT_COLORSPACE_SRGB && k < 3) {
+         eps = 1.0 / 255.0;
+      }
+
+      if (util_double_inf_sign(expected[k]) != util_inf_sign(obtained[k])) {
+         match = FALSE;
+      }
+
+      if (util_is_double_nan(expected[k]) != util_is_nan(obtained[k])) {
+         match = FALSE;
+      }
+
+      if (!util_is_double_inf_or_nan(expected[k]) &&
+          fabs((float)expected[k] - obtained[k]) > eps) {
+         match = FALSE;
+      }
+   }
+
+   return match;
+}
+
+
+/**
+ * Measure the fetch rate, in texels per second, fetching all the texels
+ * of a block over and over.
+ */
+static double
+benchmark_fetch(const struct util_format_description *desc,
+                fetch_ptr_t fetch_ptr,
+                const uint8_t *packed,
+                void *unpacked,
+                struct lp_build_format_cache *cache)
+{
+   int64_t start, end;
+   unsigned i, j, n;
+
+   start = os_time_get_nano();
+   for (n = 0; n < NUM_BENCHMARK_TEXELS;
+        n += desc->block.width * desc->block.height) {
+      for (i = 0; i < desc->block.height; ++i) {
+         for (j = 0; j < desc->block.width; ++j) {
+            fetch_ptr(unpacked, packed, j, i, cache);
+         }
+      }
+   }
+   end = os_time_get_nano();
+
+   return n * 1e9 / MAX2(end - start, 1);
+}
+
+
+/**
+ * Measure the fetch rate of the util_format fetch functions, which the
+ * generated code calls one texel at a time for the formats gallivm can't
+ * decode itself.
+ */
+static double
+benchmark_util_fetch(const struct util_format_description *desc,
+                     const uint8_t *packed,
+                     boolean floating)
+{
+   float unpacked_float[4];
+   uint8_t unpacked_unorm8[4];
+   int64_t start, end;
+   unsigned i, j, n;
+
+   start = os_time_get_nano();
+   for (n = 0; n < NUM_BENCHMARK_TEXELS;
+        n += desc->block.width * desc->block.height) {
+      for (i = 0; i < desc->block.height; ++i) {
+         for (j = 0; j < desc->block.width; ++j) {
+            if (floating)
+               desc->fetch_rgba_float(unpacked_float, packed, j, i);
+            else
+               desc->fetch_rgba_8unorm(unpacked_unorm8, packed, j, i);
+         }
+      }
+   }
+   end = os_time_get_nano();
+
+   return n * 1e9 / MAX2(end - start, 1);
+}
+
+
 static LLVMValueRef
 add_fetch_rgba_test(struct gallivm_state *gallivm, unsigned verbose,
                     const struct util_format_description *desc,
-                    struct lp_type type)
+                    struct lp_type type,
+                    boolean use_cache)
 {
    char name[256];
    LLVMContextRef context = gallivm->context;
@@ -114,7 +309,7 @@ add_fetch_rgba_test(struct gallivm_state *gallivm, unsigned verbose,
    i = LLVMGetParam(func, 2);
    j = LLVMGetParam(func, 3);
 
-   if (cache_ptr) {
+   if (use_cache) {
       cache = LLVMGetParam(func, 4);
    }
 
@@ -134,23 +329,90 @@ add_fetch_rgba_test(struct gallivm_state *gallivm, unsigned verbose,
 }
 
 
+/**
+ * Build a function fetching a vector of texels with lp_build_fetch_rgba_soa,
+ * each from its own block, without a cache.
+ */
+static LLVMValueRef
+add_fetch_rgba_soa_test(struct gallivm_state *gallivm, unsigned verbose,
+                        const struct util_format_description *desc,
+                        struct lp_type type)
+{
+   char name[256];
+   LLVMContextRef context = gallivm->context;
+   LLVMModuleRef module = gallivm->module;
+   LLVMBuilderRef builder = gallivm->builder;
+   LLVMTypeRef int_vec_type = lp_build_int_vec_type(gallivm, type);
+   LLVMTypeRef args[5];
+   LLVMValueRef func;
+   LLVMValueRef rgba_ptr;
+   LLVMValueRef packed_ptr;
+   LLVMValueRef offsets;
+   LLVMValueRef i;
+   LLVMValueRef j;
+   LLVMBasicBlockRef block;
+   LLVMValueRef rgba[4];
+   unsigned chan;
+
+   util_snprintf(name, sizeof name, "fetch_soa_%s", desc->short_name);
+
+   args[0] = LLVMPointerType(lp_build_vec_type(gallivm, type), 0);
+   args[1] = LLVMPointerType(LLVMInt8TypeInContext(context), 0);
+   args[4] = args[3] = args[2] = LLVMPointerType(int_vec_type, 0);
+
+   func = LLVMAddFunction(module, name,
+                          LLVMFunctionType(LLVMVoidTypeInContext(context),
+                                           args, Elements(args), 0));
+   LLVMSetFunctionCallConv(func, LLVMCCallConv);
+   rgba_ptr = LLVMGetParam(func, 0);
+   packed_ptr = LLVMGetParam(func, 1);
+
+   block = LLVMAppendBasicBlockInContext(context, func, "entry");
+   LLVMPositionBuilderAtEnd(builder, block);
+
+   offsets = LLVMBuildLoad(builder, LLVMGetParam(func, 2), "");
+   i = LLVMBuildLoad(builder, LLVMGetParam(func, 3), "");
+   j = LLVMBuildLoad(builder, LLVMGetParam(func, 4), "");
+
+   lp_build_fetch_rgba_soa(gallivm, desc, type,
+                           packed_ptr, offsets, i, j, NULL, rgba);
+
+   for (chan = 0; chan < 4; ++chan) {
+      LLVMValueRef index = lp_build_const_int32(gallivm, chan);
+      LLVMBuildStore(builder, rgba[chan],
+                     LLVMBuildGEP(builder, rgba_ptr, &index, 1, ""));
+   }
+
+   LLVMBuildRetVoid(builder);
+
+   gallivm_verify_function(gallivm, func);
+
+   return func;
+}
+
+
 PIPE_ALIGN_STACK
 static boolean
 test_format_float(unsigned verbose, FILE *fp,
-                  const struct util_format_description *desc)
+                  const struct util_format_description *desc,
+                  const struct util_format_test_case *cases,
+                  unsigned num_cases,
+                  struct lp_build_format_cache *cache)
 {
    struct gallivm_state *gallivm;
    LLVMValueRef fetch = NULL;
    fetch_ptr_t fetch_ptr;
    PIPE_ALIGN_VAR(16) uint8_t packed[UTIL_FORMAT_MAX_PACKED_BYTES];
    PIPE_ALIGN_VAR(16) float unpacked[4];
-   boolean first = TRUE;
    boolean success = TRUE;
-   unsigned i, j, k, l;
+   double texels_per_second = 0.0;
+   double fallback_texels_per_second = 0.0;
+   unsigned i, j, l;
 
    gallivm = gallivm_create("test_module_float", LLVMGetGlobalContext());
 
-   fetch = add_fetch_rgba_test(gallivm, verbose, desc, lp_float32_vec4_type());
+   fetch = add_fetch_rgba_test(gallivm, verbose, desc, lp_float32_vec4_type(),
+                               cache != NULL);
 
    gallivm_compile_module(gallivm);
 
@@ -158,73 +420,75 @@ test_format_float(unsigned verbose, FILE *fp,
 
    gallivm_free_ir(gallivm);
 
-   for (l = 0; l < util_format_nr_test_cases; ++l) {
-      const struct util_format_test_case *test = &util_format_test_cases[l];
-
-      if (test->format == desc->format) {
-
-         if (first) {
-            printf("Testing %s (float) ...\n",
-                   desc->name);
-            fflush(stdout);
-            first = FALSE;
-         }
-
-         /* To ensure it's 16-byte aligned */
-         memcpy(packed, test->packed, sizeof packed);
+   if (num_cases) {
+      printf("Testing %s (float%s) ...\n",
+             desc->name, cache ? ", cached" : "");
+      fflush(stdout);
+   }
 
-         for (i = 0; i < desc->block.height; ++i) {
-            for (j = 0; j < desc->block.width; ++j) {
-               boolean match = TRUE;
+   for (l = 0; l < num_cases; ++l) {
+      const struct util_format_test_case *test = &cases[l];
 
-               memset(unpacked, 0, sizeof unpacked);
+      /* To ensure it's 16-byte aligned */
+      memcpy(packed, test->packed, sizeof packed);
 
-               fetch_ptr(unpacked, packed, j, i, cache_ptr);
+      for (i = 0; i < desc->block.height; ++i) {
+         for (j = 0; j < desc->block.width; ++j) {
+            boolean match;
 
-               for(k = 0; k < 4; ++k) {
-                  if (util_double_inf_sign(test->unpacked[i][j][k]) != util_inf_sign(unpacked[k])) {
-                     match = FALSE;
-                  }
+            memset(unpacked, 0, sizeof unpacked);
 
-                  if (util_is_double_nan(test->unpacked[i][j][k]) != util_is_nan(unpacked[k])) {
-                     match = FALSE;
-                  }
+            fetch_ptr(unpacked, packed, j, i, cache);
 
-                  if (!util_is_double_inf_or_nan(test->unpacked[i][j][k]) &&
-                      fabs((float)test->unpacked[i][j][k] - unpacked[k]) > FLT_EPSILON) {
-                     match = FALSE;
-                  }
-               }
+            match = compare_texel_float(desc, test->unpacked[i][j], unpacked);
 
-               /* Ignore errors in S3TC for now */
-               if (desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
-                  match = TRUE;
-               }
+            /* The cached S3TC decoder is only approximate */
+            if (cache && desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+               match = TRUE;
+            }
 
-               if (!match) {
-                  printf("FAILED\n");
-                  printf("  Packed: %02x %02x %02x %02x\n",
-                         test->packed[0], test->packed[1], test->packed[2], test->packed[3]);
-                  printf("  Unpacked (%u,%u): %.9g %.9g %.9g %.9g obtained\n",
-                         j, i,
-                         unpacked[0], unpacked[1], unpacked[2], unpacked[3]);
-                  printf("                  %.9g %.9g %.9g %.9g expected\n",
-                         test->unpacked[i][j][0],
-                         test->unpacked[i][j][1],
-                         test->unpacked[i][j][2],
-                         test->unpacked[i][j][3]);
-                  fflush(stdout);
-                  success = FALSE;
-               }
+            if (!match) {
+               printf("FAILED\n");
+               printf("  Packed: %02x %02x %02x %02x\n",
+                      test->packed[0], test->packed[1], test->packed[2], test->packed[3]);
+               printf("  Unpacked (%u,%u): %.9g %.9g %.9g %.9g obtained\n",
+                      j, i,
+                      unpacked[0], unpacked[1], unpacked[2], unpacked[3]);
+               printf("                  %.9g %.9g %.9g %.9g expected\n",
+                      test->unpacked[i][j][0],
+                      test->unpacked[i][j][1],
+                      test->unpacked[i][j][2],
+                      test->unpacked[i][j][3]);
+               fflush(stdout);
+               success = FALSE;
             }
          }
       }
    }
 
+   /* Only the formats with test cases, as their packed data is valid */
+   if (num_cases) {
+      texels_per_second = benchmark_fetch(desc, fetch_ptr, packed, unpacked,
+                                          cache);
+      if (!cache && lp_build_format_compressed_supported(desc)) {
+         fallback_texels_per_second =
+            benchmark_util_fetch(desc, packed, TRUE);
+      }
+      if (verbose >= 1) {
+         printf("  %.1f Mtexels/s", texels_per_second / 1e6);
+         if (fallback_texels_per_second) {
+            printf(", util_format fallback %.1f Mtexels/s",
+                   fallback_texels_per_second / 1e6);
+         }
+         printf("\n");
+      }
+   }
+
    gallivm_destroy(gallivm);
 
    if(fp)
-      write_tsv_row(fp, desc, success);
+      write_tsv_row(fp, desc, cache ? "float_cached" : "float",
+                    texels_per_second, fallback_texels_per_second, success);
 
    return success;
 }
@@ -233,20 +497,25 @@ test_format_float(unsigned verbose, FILE *fp,
 PIPE_ALIGN_STACK
 static boolean
 test_format_unorm8(unsigned verbose, FILE *fp,
-                   const struct util_format_description *desc)
+                   const struct util_format_description *desc,
+                   const struct util_format_test_case *cases,
+                   unsigned num_cases,
+                   struct lp_build_format_cache *cache)
 {
    struct gallivm_state *gallivm;
    LLVMValueRef fetch = NULL;
    fetch_ptr_t fetch_ptr;
    PIPE_ALIGN_VAR(16) uint8_t packed[UTIL_FORMAT_MAX_PACKED_BYTES];
    uint8_t unpacked[4];
-   boolean first = TRUE;
    boolean success = TRUE;
+   double texels_per_second = 0.0;
+   double fallback_texels_per_second = 0.0;
    unsigned i, j, k, l;
 
    gallivm = gallivm_create("test_module_unorm8", LLVMGetGlobalContext());
 
-   fetch = add_fetch_rgba_test(gallivm, verbose, desc, lp_unorm8_vec4_type());
+   fetch = add_fetch_rgba_test(gallivm, verbose, desc, lp_unorm8_vec4_type(),
+                               cache != NULL);
 
    gallivm_compile_module(gallivm);
 
@@ -254,61 +523,171 @@ test_format_unorm8(unsigned verbose, FILE *fp,
 
    gallivm_free_ir(gallivm);
 
-   for (l = 0; l < util_format_nr_test_cases; ++l) {
-      const struct util_format_test_case *test = &util_format_test_cases[l];
+   if (num_cases) {
+      printf("Testing %s (unorm8%s) ...\n",
+             desc->name, cache ? ", cached" : "");
+   }
 
-      if (test->format == desc->format) {
+   for (l = 0; l < num_cases; ++l) {
+      const struct util_format_test_case *test = &cases[l];
 
-         if (first) {
-            printf("Testing %s (unorm8) ...\n",
-                   desc->name);
-            first = FALSE;
-         }
+      /* To ensure it's 16-byte aligned */
+      /* Could skip this and use unaligned lp_build_fetch_rgba_aos */
+      memcpy(packed, test->packed, sizeof packed);
+
+      for (i = 0; i < desc->block.height; ++i) {
+         for (j = 0; j < desc->block.width; ++j) {
+            boolean match;
 
-         /* To ensure it's 16-byte aligned */
-         /* Could skip this and use unaligned lp_build_fetch_rgba_aos */
-         memcpy(packed, test->packed, sizeof packed);
+            memset(unpacked, 0, sizeof unpacked);
 
-         for (i = 0; i < desc->block.height; ++i) {
-            for (j = 0; j < desc->block.width; ++j) {
-               boolean match;
+            fetch_ptr(unpacked, packed, j, i, cache);
 
-               memset(unpacked, 0, sizeof unpacked);
+            match = TRUE;
+            for(k = 0; k < 4; ++k) {
+               int error = float_to_ubyte(test->unpacked[i][j][k]) - unpacked[k];
 
-               fetch_ptr(unpacked, packed, j, i, cache_ptr);
+               if (util_is_double_nan(test->unpacked[i][j][k]))
+                  continue;
 
+               if (error < 0)
+                  error = -error;
+
+               if (error > 1)
+                  match = FALSE;
+            }
+
+            /* The cached S3TC decoder is only a poor man's approach */
+            if (cache && desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
                match = TRUE;
-               for(k = 0; k < 4; ++k) {
-                  int error = float_to_ubyte(test->unpacked[i][j][k]) - unpacked[k];
+            }
+
+            if (!match) {
+               printf("FAILED\n");
+               printf("  Packed: %02x %02x %02x %02x\n",
+                      test->packed[0], test->packed[1], test->packed[2], test->packed[3]);
+               printf("  Unpacked (%u,%u): %02x %02x %02x %02x obtained\n",
+                      j, i,
+                      unpacked[0], unpacked[1], unpacked[2], unpacked[3]);
+               printf("                  %02x %02x %02x %02x expected\n",
+                      float_to_ubyte(test->unpacked[i][j][0]),
+                      float_to_ubyte(test->unpacked[i][j][1]),
+                      float_to_ubyte(test->unpacked[i][j][2]),
+                      float_to_ubyte(test->unpacked[i][j][3]));
+
+               success = FALSE;
+            }
+         }
+      }
+   }
+
+   /* Only the formats with test cases, as their packed data is valid */
+   if (num_cases) {
+      texels_per_second = benchmark_fetch(desc, fetch_ptr, packed, unpacked,
+                                          cache);
+      if (!cache && lp_build_format_compressed_supported(desc) &&
+          desc->fetch_rgba_8unorm) {
+         fallback_texels_per_second =
+            benchmark_util_fetch(desc, packed, FALSE);
+      }
+      if (verbose >= 1) {
+         printf("  %.1f Mtexels/s", texels_per_second / 1e6);
+         if (fallback_texels_per_second) {
+            printf(", util_format fallback %.1f Mtexels/s",
+                   fallback_texels_per_second / 1e6);
+         }
+         printf("\n");
+      }
+   }
 
-                  if (util_is_double_nan(test->unpacked[i][j][k]))
-                     continue;
+   gallivm_destroy(gallivm);
 
-                  if (error < 0)
-                     error = -error;
+   if(fp)
+      write_tsv_row(fp, desc, cache ? "unorm8_cached" : "unorm8",
+                    texels_per_second, fallback_texels_per_second, success);
 
-                  if (error > 1)
-                     match = FALSE;
-               }
+   return success;
+}
+
+
+/**
+ * Test lp_build_fetch_rgba_soa, fetching each element of the vector from
+ * a different block and texel.
+ */
+PIPE_ALIGN_STACK
+static boolean
+test_format_soa(unsigned verbose, FILE *fp,
+                const struct util_format_description *desc,
+                const struct util_format_test_case *cases,
+                unsigned num_cases)
+{
+   const struct lp_type type = lp_type_float_vec(32, 32 * SOA_LENGTH);
+   const unsigned block_size = desc->block.bits / 8;
+   struct gallivm_state *gallivm;
+   LLVMValueRef fetch = NULL;
+   fetch_soa_ptr_t fetch_ptr;
+   PIPE_ALIGN_VAR(16) uint8_t packed[SOA_LENGTH * UTIL_FORMAT_MAX_PACKED_BYTES];
+   PIPE_ALIGN_VAR(16) int32_t offsets[SOA_LENGTH];
+   PIPE_ALIGN_VAR(16) int32_t xs[SOA_LENGTH];
+   PIPE_ALIGN_VAR(16) int32_t ys[SOA_LENGTH];
+   PIPE_ALIGN_VAR(16) float rgba[4][SOA_LENGTH];
+   boolean success = TRUE;
+   double texels_per_second = 0.0;
+   double fallback_texels_per_second = 0.0;
+   int64_t start, end;
+   unsigned i, j, k, l, n, chan;
+
+   gallivm = gallivm_create("test_module_soa", LLVMGetGlobalContext());
+
+   fetch = add_fetch_rgba_soa_test(gallivm, verbose, desc, type);
+
+   gallivm_compile_module(gallivm);
+
+   fetch_ptr = (fetch_soa_ptr_t) gallivm_jit_function(gallivm, fetch);
+
+   gallivm_free_ir(gallivm);
+
+   printf("Testing %s (soa) ...\n", desc->name);
+   fflush(stdout);
+
+   for (l = 0; l < num_cases; ++l) {
+      for (i = 0; i < desc->block.height; ++i) {
+         for (j = 0; j < desc->block.width; ++j) {
+            for (k = 0; k < SOA_LENGTH; ++k) {
+               const struct util_format_test_case *test =
+                  &cases[(l + k) % num_cases];
 
-               /* Ignore errors in S3TC as we only implement a poor man approach */
-               if (desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
-                  match = TRUE;
+               memcpy(packed + k * block_size, test->packed, block_size);
+               offsets[k] = k * block_size;
+               xs[k] = (j + k) % desc->block.width;
+               ys[k] = (i + k) % desc->block.height;
+            }
+
+            memset(rgba, 0, sizeof rgba);
+
+            fetch_ptr(&rgba[0][0], packed, offsets, xs, ys);
+
+            for (k = 0; k < SOA_LENGTH; ++k) {
+               const struct util_format_test_case *test =
+                  &cases[(l + k) % num_cases];
+               const double *expected = test->unpacked[ys[k]][xs[k]];
+               float obtained[4];
+
+               for (chan = 0; chan < 4; ++chan) {
+                  obtained[chan] = rgba[chan][k];
                }
 
-               if (!match) {
+               if (!compare_texel_float(desc, expected, obtained)) {
                   printf("FAILED\n");
                   printf("  Packed: %02x %02x %02x %02x\n",
-                         test->packed[0], test->packed[1], test->packed[2], test->packed[3]);
-                  printf("  Unpacked (%u,%u): %02x %02x %02x %02x obtained\n",
-                         j, i,
-                         unpacked[0], unpacked[1], unpacked[2], unpacked[3]);
-                  printf("                  %02x %02x %02x %02x expected\n",
-                         float_to_ubyte(test->unpacked[i][j][0]),
-                         float_to_ubyte(test->unpacked[i][j][1]),
-                         float_to_ubyte(test->unpacked[i][j][2]),
-                         float_to_ubyte(test->unpacked[i][j][3]));
-
+                         test->packed[0], test->packed[1],
+                         test->packed[2], test->packed[3]);
+                  printf("  Unpacked (%u,%u): %.9g %.9g %.9g %.9g obtained\n",
+                         xs[k], ys[k],
+                         obtained[0], obtained[1], obtained[2], obtained[3]);
+                  printf("                  %.9g %.9g %.9g %.9g expected\n",
+                         expected[0], expected[1], expected[2], expected[3]);
+                  fflush(stdout);
                   success = FALSE;
                }
             }
@@ -316,10 +695,25 @@ test_format_unorm8(unsigned verbose, FILE *fp,
       }
    }
 
+   start = os_time_get_nano();
+   for (n = 0; n < NUM_BENCHMARK_TEXELS; n += SOA_LENGTH) {
+      fetch_ptr(&rgba[0][0], packed, offsets, xs, ys);
+   }
+   end = os_time_get_nano();
+   texels_per_second = n * 1e9 / MAX2(end - start, 1);
+
+   fallback_texels_per_second = benchmark_util_fetch(desc, packed, TRUE);
+
+   if (verbose >= 1) {
+      printf("  %.1f Mtexels/s, util_format fallback %.1f Mtexels/s\n",
+             texels_per_second / 1e6, fallback_texels_per_second / 1e6);
+   }
+
    gallivm_destroy(gallivm);
 
    if(fp)
-      write_tsv_row(fp, desc, success);
+      write_tsv_row(fp, desc, "soa", texels_per_second,
+                    fallback_texels_per_second, success);
 
    return success;
 }
@@ -331,16 +725,41 @@ static boolean
 test_one(unsigned verbose, FILE *fp,
          const struct util_format_description *format_desc)
 {
+   struct util_format_test_case *cases;
+   unsigned num_cases;
    boolean success = TRUE;
 
-   if (!test_format_float(verbose, fp, format_desc)) {
+   cases = get_test_cases(format_desc, &num_cases);
+
+   if (!test_format_float(verbose, fp, format_desc, cases, num_cases, NULL)) {
      success = FALSE;
    }
 
-   if (!test_format_unorm8(verbose, fp, format_desc)) {
+   if (!test_format_unorm8(verbose, fp, format_desc, cases, num_cases, NULL)) {
      success = FALSE;
    }
 
+   /* Only S3TC goes through the cache */
+   if (cache_ptr && format_desc->layout == UTIL_FORMAT_LAYOUT_S3TC) {
+      if (!test_format_float(verbose, fp, format_desc, cases, num_cases,
+                             cache_ptr)) {
+        success = FALSE;
+      }
+
+      if (!test_format_unorm8(verbose, fp, format_desc, cases, num_cases,
+                              cache_ptr)) {
+        success = FALSE;
+      }
+   }
+
+   if (lp_build_format_compressed_supported(format_desc) && num_cases) {
+      if (!test_format_soa(verbose, fp, format_desc, cases, num_cases)) {
+        success = FALSE;
+      }
+   }
+
+   FREE(cases);
+
    return success;
 }
 
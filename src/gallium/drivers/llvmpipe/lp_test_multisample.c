@@ -0,0 +1,439 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Multisample rendering tests.
+ *
+ * Unlike the other tests these drive a whole llvmpipe context, as the
+ * state being tested lives in the setup and rasterizer modules.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_shader_tokens.h"
+#include "pipe/p_state.h"
+#include "cso_cache/cso_context.h"
+#include "state_tracker/sw_winsys.h"
+#include "util/u_box.h"
+#include "util/u_draw_quad.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+
+#include "lp_public.h"
+#include "lp_test.h"
+
+
+#define WIDTH  16
+#define HEIGHT 16
+#define NR_SAMPLES 4
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "test\n");
+
+   fflush(fp);
+}
+
+
+static boolean
+null_is_displaytarget_format_supported(struct sw_winsys *ws,
+                                       unsigned tex_usage,
+                                       enum pipe_format format)
+{
+   return FALSE;
+}
+
+
+/** Nothing here renders to a display target */
+static struct sw_winsys null_winsys = {
+   NULL,
+   null_is_displaytarget_format_supported
+};
+
+
+static struct pipe_resource *
+create_target(struct pipe_screen *screen, unsigned nr_samples)
+{
+   struct pipe_resource templ;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templ.width0 = WIDTH;
+   templ.height0 = HEIGHT;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+   templ.nr_samples = nr_samples;
+   templ.bind = PIPE_BIND_RENDER_TARGET | PIPE_BIND_SAMPLER_VIEW;
+
+   return screen->resource_create(screen, &templ);
+}
+
+
+/**
+ * Draw a window-covering quad of the given color.
+ */
+static void
+draw_quad(struct cso_context *cso, const float color[4])
+{
+   static const float pos[6][2] = {
+      { -1.0f, -1.0f }, {  1.0f, -1.0f }, {  1.0f,  1.0f },
+      { -1.0f, -1.0f }, {  1.0f,  1.0f }, { -1.0f,  1.0f }
+   };
+   float vertices[6][2][4];
+   unsigned i;
+
+   for (i = 0; i < 6; i++) {
+      vertices[i][0][0] = pos[i][0];
+      vertices[i][0][1] = pos[i][1];
+      vertices[i][0][2] = 0.0f;
+      vertices[i][0][3] = 1.0f;
+      memcpy(vertices[i][1], color, sizeof vertices[i][1]);
+   }
+
+   util_draw_user_vertex_buffer(cso, vertices, PIPE_PRIM_TRIANGLES, 6, 2);
+}
+
+
+/**
+ * Draw twice with a sample mask selecting only sample 0, flushing in
+ * between, and check that the second draw still honours the mask.
+ *
+ * The sample mask is only passed down to the setup module when the
+ * rasterizer or framebuffer state changes, so it must survive the setup
+ * reset done after each scene is rasterized.
+ */
+static boolean
+test_sample_mask_flush(unsigned verbose, FILE *fp)
+{
+   static const float red[4] = { 1.0f, 0.0f, 0.0f, 1.0f };
+   static const float green[4] = { 0.0f, 1.0f, 0.0f, 1.0f };
+   /* Only one of the four samples gets the green */
+   static const float expected[4] = { 0.0f, 0.25f, 0.0f, 0.25f };
+   const uint semantic_names[] = { TGSI_SEMANTIC_POSITION,
+                                   TGSI_SEMANTIC_COLOR };
+   const uint semantic_indexes[] = { 0, 0 };
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct cso_context *cso;
+   struct pipe_resource *msaa, *resolved;
+   struct pipe_surface surf_templ, *surf;
+   struct pipe_framebuffer_state fb;
+   struct pipe_blend_state blend;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_rasterizer_state rast;
+   struct pipe_viewport_state viewport;
+   struct pipe_vertex_element velem[2];
+   struct pipe_blit_info blit;
+   struct pipe_transfer *transfer;
+   union pipe_color_union clear_color;
+   void *vs, *fs;
+   const uint8_t *map;
+   float (*texels)[4];
+   boolean success = TRUE;
+   unsigned i, j;
+
+   screen = llvmpipe_create_screen(&null_winsys);
+   if (!screen)
+      return FALSE;
+
+   pipe = screen->context_create(screen, NULL, 0);
+   cso = cso_create_context(pipe);
+
+   msaa = create_target(screen, NR_SAMPLES);
+   resolved = create_target(screen, 0);
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = msaa->format;
+   surf = pipe->create_surface(pipe, msaa, &surf_templ);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = surf;
+   cso_set_framebuffer(cso, &fb);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   cso_set_blend(cso, &blend);
+
+   memset(&dsa, 0, sizeof dsa);
+   cso_set_depth_stencil_alpha(cso, &dsa);
+
+   memset(&rast, 0, sizeof rast);
+   rast.cull_face = PIPE_FACE_NONE;
+   rast.half_pixel_center = 1;
+   rast.bottom_edge_rule = 1;
+   rast.depth_clip = 1;
+   rast.multisample = 1;
+   cso_set_rasterizer(cso, &rast);
+
+   memset(&viewport, 0, sizeof viewport);
+   viewport.scale[0] = WIDTH / 2.0f;
+   viewport.scale[1] = HEIGHT / 2.0f;
+   viewport.scale[2] = 1.0f;
+   viewport.translate[0] = WIDTH / 2.0f;
+   viewport.translate[1] = HEIGHT / 2.0f;
+   cso_set_viewport(cso, &viewport);
+
+   memset(velem, 0, sizeof velem);
+   for (i = 0; i < 2; i++) {
+      velem[i].src_offset = i * 4 * sizeof(float);
+      velem[i].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   }
+   cso_set_vertex_elements(cso, 2, velem);
+
+   vs = util_make_vertex_passthrough_shader(pipe, 2, semantic_names,
+                                            semantic_indexes, FALSE);
+   fs = util_make_fragment_passthrough_shader(pipe, TGSI_SEMANTIC_COLOR,
+                                              TGSI_INTERPOLATE_PERSPECTIVE,
+                                              TRUE);
+   cso_set_vertex_shader_handle(cso, vs);
+   cso_set_fragment_shader_handle(cso, fs);
+
+   memset(&clear_color, 0, sizeof clear_color);
+   pipe->clear(pipe, PIPE_CLEAR_COLOR, &clear_color, 0.0, 0);
+
+   cso_set_sample_mask(cso, 0x1);
+
+   draw_quad(cso, red);
+   pipe->flush(pipe, NULL, 0);
+   draw_quad(cso, green);
+
+   memset(&blit, 0, sizeof blit);
+   blit.src.resource = msaa;
+   blit.src.format = msaa->format;
+   blit.dst.resource = resolved;
+   blit.dst.format = resolved->format;
+   u_box_2d(0, 0, WIDTH, HEIGHT, &blit.src.box);
+   blit.dst.box = blit.src.box;
+   blit.mask = PIPE_MASK_RGBA;
+   blit.filter = PIPE_TEX_FILTER_NEAREST;
+   pipe->blit(pipe, &blit);
+
+   texels = MALLOC(WIDTH * HEIGHT * sizeof *texels);
+   map = pipe_transfer_map(pipe, resolved, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, WIDTH, HEIGHT, &transfer);
+   if (!texels || !map) {
+      success = FALSE;
+   }
+   else {
+      util_format_read_4f(resolved->format,
+                          &texels[0][0], WIDTH * sizeof *texels,
+                          map, transfer->stride,
+                          0, 0, WIDTH, HEIGHT);
+
+      for (i = 0; i < WIDTH * HEIGHT; i++) {
+         for (j = 0; j < 4; j++) {
+            if (fabs(texels[i][j] - expected[j]) > 2.0 / 255.0)
+               success = FALSE;
+         }
+
+         if (!success || (verbose && i == 0)) {
+            fprintf(stderr, "sample mask across flush: pixel %u is "
+                    "%f %f %f %f, expected %f %f %f %f\n", i,
+                    texels[i][0], texels[i][1], texels[i][2], texels[i][3],
+                    expected[0], expected[1], expected[2], expected[3]);
+         }
+         if (!success)
+            break;
+      }
+   }
+   if (map)
+      pipe_transfer_unmap(pipe, transfer);
+   FREE(texels);
+
+   if (fp)
+      fprintf(fp, "%u\tsample_mask_flush\n", success ? 1 : 0);
+
+   cso_destroy_context(cso);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe_surface_reference(&surf, NULL);
+   pipe_resource_reference(&msaa, NULL);
+   pipe_resource_reference(&resolved, NULL);
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+/**
+ * Resolve a green multisample buffer into a red one, first with a scissor
+ * covering its left half, then scaled down into its top right quadrant.
+ * The resolve fast path handles neither, so these go through the blitter.
+ */
+static boolean
+test_resolve_fallback(unsigned verbose, FILE *fp)
+{
+   struct pipe_screen *screen;
+   struct pipe_context *pipe;
+   struct pipe_resource *msaa, *resolved;
+   struct pipe_surface surf_templ, *msaa_surf, *resolved_surf;
+   struct pipe_blit_info blit;
+   struct pipe_transfer *transfer;
+   union pipe_color_union green, red;
+   const uint8_t *map;
+   float (*texels)[4];
+   boolean success = TRUE;
+   unsigned x, y, j;
+
+   screen = llvmpipe_create_screen(&null_winsys);
+   if (!screen)
+      return FALSE;
+
+   pipe = screen->context_create(screen, NULL, 0);
+
+   msaa = create_target(screen, NR_SAMPLES);
+   resolved = create_target(screen, 0);
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = msaa->format;
+   msaa_surf = pipe->create_surface(pipe, msaa, &surf_templ);
+   resolved_surf = pipe->create_surface(pipe, resolved, &surf_templ);
+
+   memset(&green, 0, sizeof green);
+   green.f[1] = 1.0f;
+   green.f[3] = 1.0f;
+   memset(&red, 0, sizeof red);
+   red.f[0] = 1.0f;
+   red.f[3] = 1.0f;
+   pipe->clear_render_target(pipe, msaa_surf, &green, 0, 0, WIDTH, HEIGHT);
+   pipe->clear_render_target(pipe, resolved_surf, &red, 0, 0, WIDTH, HEIGHT);
+
+   memset(&blit, 0, sizeof blit);
+   blit.src.resource = msaa;
+   blit.src.format = msaa->format;
+   blit.dst.resource = resolved;
+   blit.dst.format = resolved->format;
+   u_box_2d(0, 0, WIDTH, HEIGHT, &blit.src.box);
+   blit.dst.box = blit.src.box;
+   blit.mask = PIPE_MASK_RGBA;
+   blit.filter = PIPE_TEX_FILTER_NEAREST;
+   blit.scissor_enable = TRUE;
+   blit.scissor.maxx = WIDTH / 2;
+   blit.scissor.maxy = HEIGHT;
+   pipe->blit(pipe, &blit);
+
+   u_box_2d(WIDTH / 2, 0, WIDTH / 2, HEIGHT / 2, &blit.dst.box);
+   blit.scissor_enable = FALSE;
+   pipe->blit(pipe, &blit);
+
+   texels = MALLOC(WIDTH * HEIGHT * sizeof *texels);
+   map = pipe_transfer_map(pipe, resolved, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, WIDTH, HEIGHT, &transfer);
+   if (!texels || !map) {
+      success = FALSE;
+   }
+   else {
+      util_format_read_4f(resolved->format,
+                          &texels[0][0], WIDTH * sizeof *texels,
+                          map, transfer->stride,
+                          0, 0, WIDTH, HEIGHT);
+
+      for (y = 0; y < HEIGHT && success; y++) {
+         for (x = 0; x < WIDTH && success; x++) {
+            const float *texel = texels[y * WIDTH + x];
+            const float *expected =
+               x < WIDTH / 2 || y < HEIGHT / 2 ? green.f : red.f;
+
+            for (j = 0; j < 4; j++) {
+               if (fabs(texel[j] - expected[j]) > 2.0 / 255.0)
+                  success = FALSE;
+            }
+
+            if (!success || (verbose && x == 0 && y == 0)) {
+               fprintf(stderr, "resolve fallback: pixel %u,%u is "
+                       "%f %f %f %f, expected %f %f %f %f\n", x, y,
+                       texel[0], texel[1], texel[2], texel[3],
+                       expected[0], expected[1], expected[2], expected[3]);
+            }
+         }
+      }
+   }
+   if (map)
+      pipe_transfer_unmap(pipe, transfer);
+   FREE(texels);
+
+   if (fp)
+      fprintf(fp, "%u\tresolve_fallback\n", success ? 1 : 0);
+
+   pipe_surface_reference(&msaa_surf, NULL);
+   pipe_surface_reference(&resolved_surf, NULL);
+   pipe_resource_reference(&msaa, NULL);
+   pipe_resource_reference(&resolved, NULL);
+   pipe->destroy(pipe);
+   screen->destroy(screen);
+
+   return success;
+}
+
+
+boolean
+test_all(unsigned verbose, FILE *fp)
+{
+   boolean success = TRUE;
+
+   if (!test_sample_mask_flush(verbose, fp))
+      success = FALSE;
+
+   if (!test_resolve_fallback(verbose, fp))
+      success = FALSE;
+
+   return success;
+}
+
+
+boolean
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+boolean
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return TRUE;
+}
@@ -35,6 +35,7 @@
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
 
+#include "util/u_box.h"
 #include "util/u_inlines.h"
 #include "util/u_cpu_detect.h"
 #include "util/u_format.h"
@@ -42,6 +43,7 @@
 #include "util/u_memory.h"
 #include "util/simple_list.h"
 #include "util/u_transfer.h"
+#include "util/u_surface.h"
 
 #include "lp_context.h"
 #include "lp_flush.h"
@@ -51,6 +53,8 @@
 #include "lp_state.h"
 #include "lp_rast.h"
 
+#include "gallivm/lp_bld_sample.h"
+
 #include "state_tracker/sw_winsys.h"
 
 
@@ -60,6 +64,57 @@ static struct llvmpipe_resource resource_list;
 static unsigned id_counter = 0;
 
 
+/**
+ * Can the texture be stored tiled (see LP_BLD_TEX_TILE_ORDER)?
+ * Only for plain color textures which look like they are going to be
+ * sampled, rather than rendered to or read back.
+ */
+static boolean
+llvmpipe_texture_can_tile(const struct llvmpipe_screen *screen,
+                          const struct pipe_resource *pt)
+{
+   const struct util_format_description *desc =
+      util_format_description(pt->format);
+
+   if (!screen->tiled_textures)
+      return FALSE;
+
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_3D:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      break;
+   default:
+      return FALSE;
+   }
+
+   if (pt->nr_samples > 1 ||
+       pt->usage == PIPE_USAGE_STAGING ||
+       !(pt->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (pt->bind & (PIPE_BIND_DEPTH_STENCIL |
+                    PIPE_BIND_DISPLAY_TARGET |
+                    PIPE_BIND_SCANOUT |
+                    PIPE_BIND_SHARED |
+                    PIPE_BIND_LINEAR))) {
+      return FALSE;
+   }
+
+   if (!desc ||
+       desc->layout != UTIL_FORMAT_LAYOUT_PLAIN ||
+       desc->block.width != 1 || desc->block.height != 1 ||
+       desc->block.bits < 8 ||
+       !util_is_power_of_two(desc->block.bits) ||
+       util_format_is_depth_or_stencil(pt->format)) {
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -88,9 +143,14 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
    assert(LP_MAX_TEXTURE_2D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
    assert(LP_MAX_TEXTURE_3D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
 
+   /* Tiles must not straddle the padded image edges */
+   assert(LP_RASTER_BLOCK_SIZE % LP_BLD_TEX_TILE_SIZE == 0);
+   assert(!lpr->tiled || !llvmpipe_resource_is_1d(&lpr->base));
+
    for (level = 0; level <= pt->last_level; level++) {
       uint64_t mipsize;
       unsigned align_x, align_y, nblocksx, nblocksy, block_size, num_slices;
+      unsigned num_rows;
 
       /* Row stride and image stride */
 
@@ -118,18 +178,39 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                                           align(height, align_y));
       block_size = util_format_get_blocksize(pt->format);
 
-      if (util_format_is_compressed(pt->format))
+      if (util_format_is_compressed(pt->format)) {
          lpr->row_stride[level] = nblocksx * block_size;
-      else
+         num_rows = nblocksy;
+      }
+      else if (lpr->tiled) {
+         /* The row stride is the one of rows of tiles */
+         lpr->row_stride[level] = nblocksx * block_size * LP_BLD_TEX_TILE_SIZE;
+         num_rows = nblocksy / LP_BLD_TEX_TILE_SIZE;
+      }
+      else {
          lpr->row_stride[level] = align(nblocksx * block_size, util_cpu_caps.cacheline);
+         num_rows = nblocksy;
+      }
 
       /* if row_stride * height > LP_MAX_TEXTURE_SIZE */
-      if ((uint64_t)lpr->row_stride[level] * nblocksy > LP_MAX_TEXTURE_SIZE) {
+      if ((uint64_t)lpr->row_stride[level] * num_rows > LP_MAX_TEXTURE_SIZE) {
          /* image too large */
          goto fail;
       }
 
-      lpr->img_stride[level] = lpr->row_stride[level] * nblocksy;
+      lpr->img_stride[level] = lpr->row_stride[level] * num_rows;
+
+      /* Multisample textures have no mipmaps; their samples are
+       * stored as consecutive images of each layer.
+       */
+      if (pt->nr_samples > 1) {
+         assert(pt->last_level == 0);
+         lpr->sample_stride = lpr->img_stride[level];
+         if ((uint64_t)lpr->sample_stride * pt->nr_samples > LP_MAX_TEXTURE_SIZE) {
+            goto fail;
+         }
+         lpr->img_stride[level] *= pt->nr_samples;
+      }
 
       /* Number of 3D image slices, cube faces or texture array layers */
       if (lpr->base.target == PIPE_TEXTURE_CUBE) {
@@ -262,6 +343,7 @@ llvmpipe_resource_create_front(struct pipe_screen *_screen,
       }
       else {
          /* texture map */
+         lpr->tiled = llvmpipe_texture_can_tile(screen, &lpr->base);
          if (!llvmpipe_texture_layout(screen, lpr, true))
             goto fail;
       }
@@ -328,6 +410,10 @@ llvmpipe_resource_destroy(struct pipe_screen *pscreen,
          align_free(lpr->tex_data);
          lpr->tex_data = NULL;
       }
+      if (lpr->tiled_data) {
+         align_free(lpr->tiled_data);
+         lpr->tiled_data = NULL;
+      }
    }
    else if (!lpr->userBuffer) {
       assert(lpr->data);
@@ -387,6 +473,8 @@ llvmpipe_resource_map(struct pipe_resource *resource,
       return map;
    }
    else if (llvmpipe_resource_is_texture(resource)) {
+      /* tiled textures are only accessed through transfers */
+      assert(!lpr->tiled);
 
       map = llvmpipe_get_texture_image_address(lpr, layer, level);
       return map;
@@ -498,6 +586,160 @@ llvmpipe_resource_get_handle(struct pipe_screen *screen,
 }
 
 
+/**
+ * Copy a box of texels of a texture level to (to_texture = FALSE) or from
+ * (to_texture = TRUE) linear memory, whatever the layout of the texture.
+ */
+static void
+llvmpipe_copy_texture_box(const struct llvmpipe_resource *lpr,
+                          unsigned level,
+                          const struct pipe_box *box,
+                          ubyte *linear,
+                          unsigned stride,
+                          unsigned layer_stride,
+                          boolean to_texture)
+{
+   const enum pipe_format format = lpr->base.format;
+   const unsigned block_size = util_format_get_blocksize(format);
+   const unsigned tile_row_size = LP_BLD_TEX_TILE_SIZE * block_size;
+   const unsigned tile_size = LP_BLD_TEX_TILE_SIZE * tile_row_size;
+   ubyte *image = (ubyte *) lpr->tex_data + lpr->mip_offsets[level];
+   unsigned x, y, z;
+
+   if (!lpr->tiled) {
+      if (to_texture) {
+         util_copy_box(image, format,
+                       lpr->row_stride[level], lpr->img_stride[level],
+                       box->x, box->y, box->z,
+                       box->width, box->height, box->depth,
+                       linear, stride, layer_stride, 0, 0, 0);
+      }
+      else {
+         util_copy_box(linear, format, stride, layer_stride, 0, 0, 0,
+                       box->width, box->height, box->depth,
+                       image, lpr->row_stride[level], lpr->img_stride[level],
+                       box->x, box->y, box->z);
+      }
+      return;
+   }
+
+   for (z = 0; z < box->depth; z++) {
+      ubyte *slice = image + (box->z + z) * lpr->img_stride[level];
+
+      for (y = 0; y < box->height; y++) {
+         const unsigned ty = box->y + y;
+         ubyte *row = slice +
+                      (ty >> LP_BLD_TEX_TILE_ORDER) * lpr->row_stride[level] +
+                      (ty & (LP_BLD_TEX_TILE_SIZE - 1)) * tile_row_size;
+         ubyte *linear_row = linear + z * layer_stride + y * stride;
+
+         /* Texels are contiguous up to the next tile boundary */
+         x = 0;
+         while (x < box->width) {
+            const unsigned tx = box->x + x;
+            const unsigned n =
+               MIN2(LP_BLD_TEX_TILE_SIZE - (tx & (LP_BLD_TEX_TILE_SIZE - 1)),
+                    box->width - x);
+            ubyte *texels = row +
+                            (tx >> LP_BLD_TEX_TILE_ORDER) * tile_size +
+                            (tx & (LP_BLD_TEX_TILE_SIZE - 1)) * block_size;
+
+            if (to_texture)
+               memcpy(texels, linear_row + x * block_size, n * block_size);
+            else
+               memcpy(linear_row + x * block_size, texels, n * block_size);
+
+            x += n;
+         }
+      }
+   }
+}
+
+
+/**
+ * Convert a tiled texture to the linear layout, for the uses which don't
+ * know about tiles: rendering, sampling from the draw module, etc.
+ * This is a one way trip.
+ */
+void
+llvmpipe_resource_make_linear(struct pipe_context *pipe,
+                              struct pipe_resource *resource)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(resource->screen);
+   struct llvmpipe_resource *lpr = llvmpipe_resource(resource);
+   struct llvmpipe_resource linear;
+   unsigned level;
+
+   /* Textures only ever go from tiled to linear, so a texture found linear
+    * here stays linear.
+    */
+   if (!lpr->tiled)
+      return;
+
+   /* Wait for this context's pending rendering which samples the tiles.
+    * Scenes of other contexts may still sample them too, so the tiled
+    * images are only freed with the resource (see tiled_data).
+    */
+   llvmpipe_flush_resource(pipe, resource, 0,
+                           FALSE, /* read_only */
+                           TRUE, /* cpu_access */
+                           FALSE, /* do_not_block */
+                           __FUNCTION__);
+
+   /* Other contexts snapshot the layout under tex_mutex, see
+    * lp_setup_set_fragment_sampler_views(), so they never see it half
+    * updated.
+    */
+   pipe_mutex_lock(screen->tex_mutex);
+
+   /* Another context may have converted it in the meantime */
+   if (!lpr->tiled) {
+      pipe_mutex_unlock(screen->tex_mutex);
+      return;
+   }
+
+   memset(&linear, 0, sizeof linear);
+   linear.base = *resource;
+   if (!llvmpipe_texture_layout(screen, &linear, TRUE)) {
+      pipe_mutex_unlock(screen->tex_mutex);
+      debug_printf("llvmpipe: out of memory converting texture to linear\n");
+      return;
+   }
+
+   for (level = 0; level <= resource->last_level; level++) {
+      struct pipe_box box;
+
+      u_box_3d(0, 0, 0,
+               u_minify(resource->width0, level),
+               u_minify(resource->height0, level),
+               resource->target == PIPE_TEXTURE_3D ?
+               u_minify(resource->depth0, level) : resource->array_size,
+               &box);
+
+      llvmpipe_copy_texture_box(lpr, level, &box,
+                                llvmpipe_get_texture_image_address(&linear,
+                                                                   0, level),
+                                linear.row_stride[level],
+                                linear.img_stride[level],
+                                FALSE);
+   }
+
+   assert(!lpr->tiled_data);
+   lpr->tiled_data = lpr->tex_data;
+
+   memcpy(lpr->row_stride, linear.row_stride, sizeof lpr->row_stride);
+   memcpy(lpr->img_stride, linear.img_stride, sizeof lpr->img_stride);
+   memcpy(lpr->mip_offsets, linear.mip_offsets, sizeof lpr->mip_offsets);
+   lpr->tex_data = linear.tex_data;
+   lpr->tiled = FALSE;
+
+   /* Shader variants of all contexts need to pick up the new layout */
+   p_atomic_inc(&screen->timestamp);
+
+   pipe_mutex_unlock(screen->tex_mutex);
+}
+
+
 static void *
 llvmpipe_transfer_map( struct pipe_context *pipe,
                        struct pipe_resource *resource,
@@ -590,6 +832,34 @@ llvmpipe_transfer_map( struct pipe_context *pipe,
 
    format = lpr->base.format;
 
+   if (lpr->tiled) {
+      /*
+       * Hand out a linear copy of the box, which is written back to the
+       * tiles on unmap.
+       */
+      pt->stride = box->width * util_format_get_blocksize(format);
+      pt->layer_stride = pt->stride * box->height;
+
+      lpt->linear = align_malloc(MAX2(pt->layer_stride * box->depth, 1), 64);
+      if (!lpt->linear) {
+         pipe_resource_reference(&pt->resource, NULL);
+         FREE(lpt);
+         return NULL;
+      }
+
+      if (!(usage & (PIPE_TRANSFER_DISCARD_RANGE |
+                     PIPE_TRANSFER_DISCARD_WHOLE_RESOURCE))) {
+         llvmpipe_copy_texture_box(lpr, level, box, lpt->linear,
+                                   pt->stride, pt->layer_stride, FALSE);
+      }
+
+      if (usage & PIPE_TRANSFER_WRITE) {
+         screen->timestamp++;
+      }
+
+      return lpt->linear;
+   }
+
    map = llvmpipe_resource_map(resource,
                                level,
                                box->z,
@@ -617,11 +887,25 @@ static void
 llvmpipe_transfer_unmap(struct pipe_context *pipe,
                         struct pipe_transfer *transfer)
 {
+   struct llvmpipe_transfer *lpt = llvmpipe_transfer(transfer);
+
    assert(transfer->resource);
 
-   llvmpipe_resource_unmap(transfer->resource,
-                           transfer->level,
-                           transfer->box.z);
+   if (lpt->linear) {
+      /* The texture may have been made linear meanwhile, which is fine */
+      if (transfer->usage & PIPE_TRANSFER_WRITE) {
+         llvmpipe_copy_texture_box(llvmpipe_resource(transfer->resource),
+                                   transfer->level, &transfer->box,
+                                   lpt->linear, transfer->stride,
+                                   transfer->layer_stride, TRUE);
+      }
+      align_free(lpt->linear);
+   }
+   else {
+      llvmpipe_resource_unmap(transfer->resource,
+                              transfer->level,
+                              transfer->box.z);
+   }
 
    /* Effectively do the texture_update work here - if texture images
     * needed post-processing to put them into hardware layout, this is
@@ -60,12 +60,28 @@ struct llvmpipe_resource
 {
    struct pipe_resource base;
 
-   /** Row stride in bytes */
+   /**
+    * Are the images of tex_data tiled (see LP_BLD_TEX_TILE_ORDER)?  Only
+    * textures which are merely sampled by fragment shaders stay tiled, see
+    * llvmpipe_resource_make_linear().  The strides and offsets below always
+    * describe the current layout of tex_data.  While a texture is tiled they
+    * may change under other contexts, so read them under the screen's
+    * tex_mutex.
+    */
+   boolean tiled;
+
+   /** Row stride in bytes (of rows of tiles, for tiled textures) */
    unsigned row_stride[LP_MAX_TEXTURE_LEVELS];
    /** Image stride (for cube maps, array or 3D textures) in bytes */
    unsigned img_stride[LP_MAX_TEXTURE_LEVELS];
    /** Offset to start of mipmap level, in bytes */
    unsigned mip_offsets[LP_MAX_TEXTURE_LEVELS];
+   /**
+    * Offset between the samples of a multisample texture, in bytes.
+    * Each layer holds its nr_samples sample images back to back, so
+    * img_stride covers all samples and sample 0 comes first.
+    */
+   unsigned sample_stride;
    /** allocated total size (for non-display target texture resources only) */
    unsigned total_alloc_size;
 
@@ -80,6 +96,13 @@ struct llvmpipe_resource
     */
    void *tex_data;
 
+   /**
+    * The tiled images, after llvmpipe_resource_make_linear().  Scenes of
+    * other contexts may still sample them, and every such scene holds a
+    * reference to this resource, so they are freed with it.
+    */
+   void *tiled_data;
+
    /**
     * Data for non-texture resources.
     */
@@ -102,6 +125,9 @@ struct llvmpipe_transfer
    struct pipe_transfer base;
 
    unsigned long offset;
+
+   /** Linear copy of the mapped box of a tiled texture */
+   void *linear;
 };
 
 
@@ -220,6 +246,11 @@ llvmpipe_get_texture_image_address(struct llvmpipe_resource *lpr,
                                    unsigned face_slice, unsigned level);
 
 
+void
+llvmpipe_resource_make_linear(struct pipe_context *pipe,
+                              struct pipe_resource *resource);
+
+
 extern void
 llvmpipe_print_resources(void);
 
@@ -38,6 +38,7 @@
 #include "sp_clear.h"
 #include "sp_context.h"
 #include "sp_query.h"
+#include "sp_threads.h"
 #include "sp_tile_cache.h"
 
 
@@ -54,7 +55,7 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
    struct pipe_surface *zsbuf = softpipe->framebuffer.zsbuf;
    unsigned zs_buffers = buffers & PIPE_CLEAR_DEPTHSTENCIL;
    uint64_t cv;
-   uint i;
+   uint i, t;
 
    if (softpipe->no_rast)
       return;
@@ -69,6 +70,8 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
    if (buffers & PIPE_CLEAR_COLOR) {
       for (i = 0; i < softpipe->framebuffer.nr_cbufs; i++) {
          sp_tile_cache_clear(softpipe->cbuf_cache[i], color, 0);
+         for (t = 1; t < softpipe->num_threads; t++)
+            sp_tile_cache_clear(softpipe->threads[t]->cbuf_cache[i], color, 0);
       }
    }
 
@@ -84,6 +87,8 @@ softpipe_clear(struct pipe_context *pipe, unsigned buffers,
 
       cv = util_pack64_z_stencil(zsbuf->format, depth, stencil);
       sp_tile_cache_clear(softpipe->zsbuf_cache, &zero, cv);
+      for (t = 1; t < softpipe->num_threads; t++)
+         sp_tile_cache_clear(softpipe->threads[t]->zsbuf_cache, &zero, cv);
    }
 
    softpipe->dirty_render_cache = TRUE;
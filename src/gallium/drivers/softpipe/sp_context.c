@@ -50,6 +50,7 @@
 #include "sp_query.h"
 #include "sp_screen.h"
 #include "sp_tex_sample.h"
+#include "sp_threads.h"
 
 
 static void
@@ -70,20 +71,12 @@ softpipe_destroy( struct pipe_context *pipe )
       util_blitter_destroy(softpipe->blitter);
    }
 
+   sp_threads_destroy(softpipe);
+
    if (softpipe->draw)
       draw_destroy( softpipe->draw );
 
-   if (softpipe->quad.shade)
-      softpipe->quad.shade->destroy( softpipe->quad.shade );
-
-   if (softpipe->quad.depth_test)
-      softpipe->quad.depth_test->destroy( softpipe->quad.depth_test );
-
-   if (softpipe->quad.blend)
-      softpipe->quad.blend->destroy( softpipe->quad.blend );
-
-   if (softpipe->quad.pstipple)
-      softpipe->quad.pstipple->destroy( softpipe->quad.pstipple );
+   sp_destroy_quad_stages(&softpipe->quad);
 
    for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
       sp_destroy_tile_cache(softpipe->cbuf_cache[i]);
@@ -202,6 +195,9 @@ softpipe_create_context(struct pipe_screen *screen,
    softpipe->dump_fs = debug_get_bool_option( "SOFTPIPE_DUMP_FS", FALSE );
    softpipe->dump_gs = debug_get_bool_option( "SOFTPIPE_DUMP_GS", FALSE );
 
+   softpipe->num_threads = debug_get_num_option( "SOFTPIPE_NUM_THREADS", 0 );
+   softpipe->num_threads = CLAMP(softpipe->num_threads, 1, SP_MAX_THREADS);
+
    softpipe->pipe.screen = screen;
    softpipe->pipe.destroy = softpipe_destroy;
    softpipe->pipe.priv = priv;
@@ -246,10 +242,8 @@ softpipe_create_context(struct pipe_screen *screen,
    softpipe->fs_machine = tgsi_exec_machine_create();
 
    /* setup quad rendering stages */
-   softpipe->quad.shade = sp_quad_shade_stage(softpipe);
-   softpipe->quad.depth_test = sp_quad_depth_test_stage(softpipe);
-   softpipe->quad.blend = sp_quad_blend_stage(softpipe);
-   softpipe->quad.pstipple = sp_quad_polygon_stipple_stage(softpipe);
+   if (!sp_create_quad_stages(softpipe, NULL, &softpipe->quad))
+      goto fail;
 
 
    /*
@@ -286,6 +280,9 @@ softpipe_create_context(struct pipe_screen *screen,
    draw_set_rasterize_stage(softpipe->draw, softpipe->vbuf);
    draw_set_render(softpipe->draw, softpipe->vbuf_backend);
 
+   if (softpipe->num_threads > 1 && !sp_threads_create(softpipe))
+      goto fail;
+
    softpipe->blitter = util_blitter_create(&softpipe->pipe);
    if (!softpipe->blitter) {
       goto fail;
@@ -38,6 +38,7 @@
 
 #include "sp_quad_pipe.h"
 #include "sp_setup.h"
+#include "sp_limits.h"
 
 
 /** Do polygon stipple in the draw module? */
@@ -49,6 +50,7 @@
 
 struct softpipe_vbuf_render;
 struct draw_context;
+struct draw_thread_pool;
 struct draw_stage;
 struct softpipe_tile_cache;
 struct softpipe_tex_tile_cache;
@@ -161,13 +163,7 @@ struct softpipe_context {
    } pstipple;
 
    /** Software quad rendering pipeline */
-   struct {
-      struct quad_stage *shade;
-      struct quad_stage *depth_test;
-      struct quad_stage *blend;
-      struct quad_stage *pstipple;
-      struct quad_stage *first; /**< points to one of the above stages */
-   } quad;
+   struct sp_quad_stages quad;
 
    /** TGSI exec things */
    struct {
@@ -201,6 +197,15 @@ struct softpipe_context {
     */
    struct softpipe_tex_tile_cache *tex_cache[PIPE_SHADER_GEOMETRY+1][PIPE_MAX_SHADER_SAMPLER_VIEWS];
 
+   /**
+    * Rasterizer threads.  The context itself acts as thread 0, entries
+    * 1 to num_threads - 1 hold the additional ones.
+    */
+   unsigned num_threads;
+   struct sp_thread *threads[SP_MAX_THREADS];
+   struct draw_thread_pool *thread_pool;
+   unsigned threads_dirty; /**< Mask of SP_NEW_x flags not seen by threads */
+
    unsigned dump_fs : 1;
    unsigned dump_gs : 1;
    unsigned no_rast : 1;
@@ -36,6 +36,7 @@
 #include "sp_flush.h"
 #include "sp_context.h"
 #include "sp_state.h"
+#include "sp_threads.h"
 #include "sp_tile_cache.h"
 #include "sp_tex_tile_cache.h"
 #include "util/u_debug_image.h"
@@ -75,6 +76,9 @@ softpipe_flush( struct pipe_context *pipe,
    if (softpipe->zsbuf_cache)
       sp_flush_tile_cache(softpipe->zsbuf_cache);
 
+   if (softpipe->num_threads > 1)
+      sp_threads_flush(softpipe, flags);
+
    softpipe->dirty_render_cache = FALSE;
 
    /* Enable to dump BMPs of the color/depth buffers each frame */
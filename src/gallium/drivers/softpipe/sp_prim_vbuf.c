@@ -39,6 +39,7 @@
 #include "sp_context.h"
 #include "sp_setup.h"
 #include "sp_state.h"
+#include "sp_threads.h"
 #include "sp_prim_vbuf.h"
 #include "draw/draw_context.h"
 #include "draw/draw_vbuf.h"
@@ -49,6 +50,10 @@
 #define SP_MAX_VBUF_INDEXES 1024
 #define SP_MAX_VBUF_SIZE    4096
 
+/* Larger batches amortize the rasterizer thread synchronization */
+#define SP_MAX_VBUF_INDEXES_THREADED (16 * 1024)
+#define SP_MAX_VBUF_SIZE_THREADED    (256 * 1024)
+
 typedef const float (*cptrf4)[4];
 
 /**
@@ -140,6 +145,9 @@ sp_vbuf_set_primitive(struct vbuf_render *vbr, unsigned prim)
    
    sp_setup_prepare( setup_ctx );
 
+   if (cvbr->softpipe->num_threads > 1)
+      sp_threads_prepare(cvbr->softpipe);
+
    cvbr->softpipe->reduced_prim = u_reduced_prim(prim);
    cvbr->prim = prim;
 }
@@ -154,16 +162,28 @@ static inline cptrf4 get_vert( const void *vertex_buffer,
 
 
 /**
- * draw elements / indexed primitives
+ * A batch of primitives, as passed to the rasterizer threads.
+ */
+struct sp_vbuf_batch
+{
+   struct softpipe_vbuf_render *cvbr;
+   const ushort *indices;
+   uint start;
+   uint nr;
+};
+
+
+/**
+ * Set up the indexed primitives of a batch with the given setup context.
  */
 static void
-sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
+setup_elements(struct softpipe_vbuf_render *cvbr,
+               struct setup_context *setup,
+               const ushort *indices, uint nr)
 {
-   struct softpipe_vbuf_render *cvbr = softpipe_vbuf_render(vbr);
    struct softpipe_context *softpipe = cvbr->softpipe;
    const unsigned stride = softpipe->vertex_info.size * sizeof(float);
    const void *vertex_buffer = cvbr->vertex_buffer;
-   struct setup_context *setup = cvbr->setup;
    const boolean flatshade_first = softpipe->rasterizer->flatshade_first;
    unsigned i;
 
@@ -348,16 +368,50 @@ sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 }
 
 
+static void
+setup_elements_job(void *data, struct setup_context *setup)
+{
+   const struct sp_vbuf_batch *batch = (const struct sp_vbuf_batch *) data;
+
+   setup_elements(batch->cvbr, setup, batch->indices, batch->nr);
+}
+
+
 /**
- * This function is hit when the draw module is working in pass-through mode.
- * It's up to us to convert the vertex array into point/line/tri prims.
+ * draw elements / indexed primitives
  */
 static void
-sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+sp_vbuf_draw_elements(struct vbuf_render *vbr, const ushort *indices, uint nr)
 {
    struct softpipe_vbuf_render *cvbr = softpipe_vbuf_render(vbr);
+
+   if (cvbr->softpipe->num_threads > 1) {
+      struct sp_vbuf_batch batch;
+
+      batch.cvbr = cvbr;
+      batch.indices = indices;
+      batch.start = 0;
+      batch.nr = nr;
+
+      sp_threads_run(cvbr->softpipe, cvbr->setup,
+                     setup_elements_job, &batch);
+   }
+   else {
+      setup_elements(cvbr, cvbr->setup, indices, nr);
+   }
+}
+
+
+/**
+ * Set up the non-indexed primitives of a batch with the given setup
+ * context.
+ */
+static void
+setup_arrays(struct softpipe_vbuf_render *cvbr,
+             struct setup_context *setup,
+             uint start, uint nr)
+{
    struct softpipe_context *softpipe = cvbr->softpipe;
-   struct setup_context *setup = cvbr->setup;
    const unsigned stride = softpipe->vertex_info.size * sizeof(float);
    const void *vertex_buffer =
       (void *) get_vert(cvbr->vertex_buffer, start, stride);
@@ -587,6 +641,41 @@ sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    }
 }
 
+
+static void
+setup_arrays_job(void *data, struct setup_context *setup)
+{
+   const struct sp_vbuf_batch *batch = (const struct sp_vbuf_batch *) data;
+
+   setup_arrays(batch->cvbr, setup, batch->start, batch->nr);
+}
+
+
+/**
+ * This function is hit when the draw module is working in pass-through mode.
+ * It's up to us to convert the vertex array into point/line/tri prims.
+ */
+static void
+sp_vbuf_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
+{
+   struct softpipe_vbuf_render *cvbr = softpipe_vbuf_render(vbr);
+
+   if (cvbr->softpipe->num_threads > 1) {
+      struct sp_vbuf_batch batch;
+
+      batch.cvbr = cvbr;
+      batch.indices = NULL;
+      batch.start = start;
+      batch.nr = nr;
+
+      sp_threads_run(cvbr->softpipe, cvbr->setup,
+                     setup_arrays_job, &batch);
+   }
+   else {
+      setup_arrays(cvbr, cvbr->setup, start, nr);
+   }
+}
+
 /*
  * FIXME: it is unclear if primitives_storage_needed (which is generally
  * the same as pipe query num_primitives_generated) should increase
@@ -650,8 +739,14 @@ sp_create_vbuf_backend(struct softpipe_context *sp)
 
    assert(sp->draw);
 
-   cvbr->base.max_indices = SP_MAX_VBUF_INDEXES;
-   cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE;
+   if (sp->num_threads > 1) {
+      cvbr->base.max_indices = SP_MAX_VBUF_INDEXES_THREADED;
+      cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE_THREADED;
+   }
+   else {
+      cvbr->base.max_indices = SP_MAX_VBUF_INDEXES;
+      cvbr->base.max_vertex_buffer_bytes = SP_MAX_VBUF_SIZE;
+   }
 
    cvbr->base.get_vertex_info = sp_vbuf_get_vertex_info;
    cvbr->base.allocate_vertices = sp_vbuf_allocate_vertices;
@@ -667,7 +762,7 @@ sp_create_vbuf_backend(struct softpipe_context *sp)
 
    cvbr->softpipe = sp;
 
-   cvbr->setup = sp_setup_create_context(cvbr->softpipe);
+   cvbr->setup = sp_setup_create_context(cvbr->softpipe, NULL);
 
    return &cvbr->base;
 }
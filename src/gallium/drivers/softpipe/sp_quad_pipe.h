@@ -31,8 +31,11 @@
 #ifndef SP_QUAD_PIPE_H
 #define SP_QUAD_PIPE_H
 
+#include "pipe/p_compiler.h"
+
 
 struct softpipe_context;
+struct sp_thread;
 struct quad_header;
 
 
@@ -44,6 +47,9 @@ struct quad_header;
 struct quad_stage {
    struct softpipe_context *softpipe;
 
+   /** The rasterizer thread owning this stage, NULL for the context's */
+   struct sp_thread *thread;
+
    struct quad_stage *next;
 
    void (*begin)(struct quad_stage *qs);
@@ -67,6 +73,26 @@ struct quad_stage *sp_quad_blend_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_colormask_stage( struct softpipe_context *softpipe );
 struct quad_stage *sp_quad_output_stage( struct softpipe_context *softpipe );
 
-void sp_build_quad_pipeline(struct softpipe_context *sp);
+
+/**
+ * A complete set of quad stages.  The context has one, and so does each
+ * additional rasterizer thread.
+ */
+struct sp_quad_stages {
+   struct quad_stage *shade;
+   struct quad_stage *depth_test;
+   struct quad_stage *blend;
+   struct quad_stage *pstipple;
+   struct quad_stage *first; /**< points to one of the above stages */
+};
+
+boolean sp_create_quad_stages(struct softpipe_context *sp,
+                              struct sp_thread *thread,
+                              struct sp_quad_stages *quad);
+
+void sp_destroy_quad_stages(struct sp_quad_stages *quad);
+
+void sp_build_quad_pipeline(struct softpipe_context *sp,
+                            struct sp_quad_stages *quad);
 
 #endif /* SP_QUAD_PIPE_H */
@@ -37,6 +37,8 @@
 #include "sp_quad_pipe.h"
 #include "sp_setup.h"
 #include "sp_state.h"
+#include "sp_threads.h"
+#include "sp_tile_cache.h"
 #include "draw/draw_context.h"
 #include "pipe/p_shader_tokens.h"
 #include "util/u_math.h"
@@ -74,6 +76,10 @@ struct edge {
 struct setup_context {
    struct softpipe_context *softpipe;
 
+   /** Quad pipeline of the rasterizer thread using this setup */
+   struct sp_quad_stages *quad_stages;
+   unsigned thread_index;
+
    /* Vertices are just an array of floats making up each attribute in
     * turn.  Currently fixed at 4 floats, but should change in time.
     * Codegen will help cope with this.
@@ -121,6 +127,21 @@ struct setup_context {
 
 
 
+/**
+ * Does this setup's thread render the quads at (x,y)?
+ * Batches of quads never cross tile boundaries.
+ */
+static inline boolean
+setup_owns_quads(const struct setup_context *setup, int x, int y)
+{
+   const unsigned num_threads = setup->softpipe->num_threads;
+
+   return num_threads <= 1 ||
+          sp_tile_owner(x, y, setup->quad[0].input.layer,
+                        num_threads) == setup->thread_index;
+}
+
+
 /**
  * Clip setup->quad against the scissor/surface bounds.
  */
@@ -161,14 +182,15 @@ clip_emit_quad(struct setup_context *setup, struct quad_header *quad)
 {
    quad_clip(setup, quad);
 
-   if (quad->inout.mask) {
-      struct softpipe_context *sp = setup->softpipe;
+   if (quad->inout.mask &&
+       setup_owns_quads(setup, quad->input.x0, quad->input.y0)) {
+      struct quad_stage *pipe = setup->quad_stages->first;
 
 #if DEBUG_FRAGS
       setup->numFragsEmitted += util_bitcount(quad->inout.mask);
 #endif
 
-      sp->quad.first->run( sp->quad.first, &quad, 1 );
+      pipe->run( pipe, &quad, 1 );
    }
 }
 
@@ -203,7 +225,7 @@ flush_spans(struct setup_context *setup)
    const int xleft1 = setup->span.left[1];
    const int xright0 = setup->span.right[0];
    const int xright1 = setup->span.right[1];
-   struct quad_stage *pipe = setup->softpipe->quad.first;
+   struct quad_stage *pipe = setup->quad_stages->first;
 
    const int minleft = block_x(MIN2(xleft0, xleft1));
    const int maxright = MAX2(xright0, xright1);
@@ -229,6 +251,9 @@ flush_spans(struct setup_context *setup)
       unsigned mask0 = ~skipmask_left0 & ~skipmask_right0;
       unsigned mask1 = ~skipmask_left1 & ~skipmask_right1;
 
+      if (!setup_owns_quads(setup, x, setup->span.y))
+         continue;
+
       if (mask0 | mask1) {
          do {
             unsigned quadmask = (mask0 & 3) | ((mask1 & 3) << 2);
@@ -873,7 +898,8 @@ sp_setup_tri(struct setup_context *setup,
 
    flush_spans( setup );
 
-   if (setup->softpipe->active_statistics_queries) {
+   if (setup->softpipe->active_statistics_queries &&
+       setup->thread_index == 0) {
       setup->softpipe->pipeline_statistics.c_primitives++;
    }
 
@@ -1478,7 +1504,7 @@ sp_setup_prepare(struct setup_context *setup)
 
    setup->max_layer = max_layer;
 
-   sp->quad.first->begin( sp->quad.first );
+   setup->quad_stages->first->begin( setup->quad_stages->first );
 
    if (sp->reduced_api_prim == PIPE_PRIM_TRIANGLES &&
        sp->rasterizer->fill_front == PIPE_POLYGON_MODE_FILL &&
@@ -1504,13 +1530,26 @@ sp_setup_destroy_context(struct setup_context *setup)
  * Create a new primitive setup/render stage.
  */
 struct setup_context *
-sp_setup_create_context(struct softpipe_context *softpipe)
+sp_setup_create_context(struct softpipe_context *softpipe,
+                        struct sp_thread *thread)
 {
    struct setup_context *setup = CALLOC_STRUCT(setup_context);
    unsigned i;
 
+   if (!setup)
+      return NULL;
+
    setup->softpipe = softpipe;
 
+   if (thread) {
+      setup->quad_stages = &thread->quad;
+      setup->thread_index = thread->index;
+   }
+   else {
+      setup->quad_stages = &softpipe->quad;
+      setup->thread_index = 0;
+   }
+
    for (i = 0; i < MAX_QUADS; i++) {
       setup->quad[i].coef = setup->coef;
       setup->quad[i].posCoef = &setup->posCoef;
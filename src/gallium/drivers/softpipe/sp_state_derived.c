@@ -473,7 +473,10 @@ softpipe_update_derived(struct softpipe_context *softpipe, unsigned prim)
                           SP_NEW_FRAMEBUFFER |
                           SP_NEW_STIPPLE |
                           SP_NEW_FS))
-      sp_build_quad_pipeline(softpipe);
+      sp_build_quad_pipeline(softpipe, &softpipe->quad);
+
+   /* the rasterizer threads catch up in sp_threads_prepare() */
+   softpipe->threads_dirty |= softpipe->dirty;
 
    softpipe->dirty = 0;
 }
@@ -29,6 +29,7 @@
 #include "sp_state.h"
 #include "sp_fs.h"
 #include "sp_texture.h"
+#include "sp_threads.h"
 
 #include "pipe/p_defines.h"
 #include "util/u_memory.h"
@@ -190,6 +191,9 @@ softpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
       draw_delete_fragment_shader(softpipe->draw, var->draw_shader);
 #endif
 
+      if (softpipe->num_threads > 1)
+         sp_threads_unbind_fs_variant(softpipe, var);
+
       var->delete(var, softpipe->fs_machine);
    }
 
@@ -31,6 +31,7 @@
 #include "sp_context.h"
 #include "sp_state.h"
 #include "sp_tile_cache.h"
+#include "sp_threads.h"
 
 #include "draw/draw_context.h"
 
@@ -49,7 +50,7 @@ softpipe_set_framebuffer_state(struct pipe_context *pipe,
                                const struct pipe_framebuffer_state *fb)
 {
    struct softpipe_context *sp = softpipe_context(pipe);
-   uint i;
+   uint i, t;
 
    draw_flush(sp->draw);
 
@@ -60,12 +61,16 @@ softpipe_set_framebuffer_state(struct pipe_context *pipe,
       if (sp->framebuffer.cbufs[i] != cb) {
          /* flush old */
          sp_flush_tile_cache(sp->cbuf_cache[i]);
+         for (t = 1; t < sp->num_threads; t++)
+            sp_flush_tile_cache(sp->threads[t]->cbuf_cache[i]);
 
          /* assign new */
          pipe_surface_reference(&sp->framebuffer.cbufs[i], cb);
 
          /* update cache */
          sp_tile_cache_set_surface(sp->cbuf_cache[i], cb);
+         for (t = 1; t < sp->num_threads; t++)
+            sp_tile_cache_set_surface(sp->threads[t]->cbuf_cache[i], cb);
       }
    }
 
@@ -75,12 +80,16 @@ softpipe_set_framebuffer_state(struct pipe_context *pipe,
    if (sp->framebuffer.zsbuf != fb->zsbuf) {
       /* flush old */
       sp_flush_tile_cache(sp->zsbuf_cache);
+      for (t = 1; t < sp->num_threads; t++)
+         sp_flush_tile_cache(sp->threads[t]->zsbuf_cache);
 
       /* assign new */
       pipe_surface_reference(&sp->framebuffer.zsbuf, fb->zsbuf);
 
       /* update cache */
       sp_tile_cache_set_surface(sp->zsbuf_cache, fb->zsbuf);
+      for (t = 1; t < sp->num_threads; t++)
+         sp_tile_cache_set_surface(sp->threads[t]->zsbuf_cache, fb->zsbuf);
 
       /* Tell draw module how deep the Z/depth buffer is
        *
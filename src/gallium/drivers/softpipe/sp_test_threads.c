@@ -0,0 +1,432 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * @file
+ * Rasterizer thread test.
+ *
+ * The same scene is rendered by a serial context and by contexts with
+ * several rasterizer threads, and the color and depth buffers are
+ * compared byte for byte.  The framebuffer is not a multiple of the tile
+ * size and the primitives overlap each other and straddle tile edges, so
+ * that every thread touches partial tiles and tiles shared with others.
+ */
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pipe/p_context.h"
+#include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
+#include "pipe/p_shader_tokens.h"
+#include "pipe/p_state.h"
+#include "state_tracker/sw_winsys.h"
+#include "util/u_draw.h"
+#include "util/u_format.h"
+#include "util/u_inlines.h"
+#include "util/u_memory.h"
+#include "util/u_simple_shaders.h"
+#include "util/u_string.h"
+
+#include "sp_limits.h"
+#include "sp_public.h"
+#include "sp_tile_cache.h"
+
+
+#define WIDTH  200
+#define HEIGHT 150
+
+#define NUM_TRIS 96
+
+
+struct vertex
+{
+   float position[4];
+   float color[4];
+};
+
+
+/** The scene's vertices, the same for every context */
+static struct vertex vertices[3][NUM_TRIS * 3];
+
+
+static boolean
+null_is_displaytarget_format_supported(struct sw_winsys *ws,
+                                       unsigned tex_usage,
+                                       enum pipe_format format)
+{
+   return FALSE;
+}
+
+
+/** Nothing here renders to a display target */
+static struct sw_winsys null_winsys = {
+   NULL,
+   null_is_displaytarget_format_supported
+};
+
+
+static unsigned
+random_uint(unsigned *seed)
+{
+   *seed = *seed * 1103515245 + 12345;
+   return (*seed >> 16) & 0x7fff;
+}
+
+
+static float
+random_float(unsigned *seed, float min, float max)
+{
+   return min + (max - min) * (float)random_uint(seed) / 32767.0f;
+}
+
+
+/**
+ * Triangles of all sizes, from a few pixels to most of the framebuffer,
+ * partly outside of it, with translucent colors.
+ */
+static void
+init_vertices(void)
+{
+   unsigned seed = 1;
+   unsigned batch, i, j;
+
+   for (batch = 0; batch < 3; batch++) {
+      for (i = 0; i < NUM_TRIS; i++) {
+         float x = random_float(&seed, -20.0f, WIDTH + 20.0f);
+         float y = random_float(&seed, -20.0f, HEIGHT + 20.0f);
+         float size = random_float(&seed, 4.0f, i % 8 ? 80.0f : 240.0f);
+
+         for (j = 0; j < 3; j++) {
+            struct vertex *v = &vertices[batch][i * 3 + j];
+            float px = x + random_float(&seed, -size, size);
+            float py = y + random_float(&seed, -size, size);
+
+            v->position[0] = px * 2.0f / WIDTH - 1.0f;
+            v->position[1] = py * 2.0f / HEIGHT - 1.0f;
+            v->position[2] = random_float(&seed, -1.0f, 1.0f);
+            v->position[3] = 1.0f;
+            v->color[0] = random_float(&seed, 0.0f, 1.0f);
+            v->color[1] = random_float(&seed, 0.0f, 1.0f);
+            v->color[2] = random_float(&seed, 0.0f, 1.0f);
+            v->color[3] = random_float(&seed, 0.25f, 0.75f);
+         }
+      }
+   }
+}
+
+
+static void
+draw_batch(struct pipe_context *pipe, unsigned batch)
+{
+   struct pipe_vertex_buffer vbuf;
+
+   memset(&vbuf, 0, sizeof vbuf);
+   vbuf.stride = sizeof(struct vertex);
+   vbuf.user_buffer = vertices[batch];
+
+   pipe->set_vertex_buffers(pipe, 0, 1, &vbuf);
+   util_draw_arrays(pipe, PIPE_PRIM_TRIANGLES, 0, NUM_TRIS * 3);
+}
+
+
+static void
+read_surface(struct pipe_context *pipe, struct pipe_resource *tex,
+             uint8_t *data)
+{
+   struct pipe_transfer *transfer;
+   unsigned stride = util_format_get_stride(tex->format, WIDTH);
+   const uint8_t *map;
+   unsigned y;
+
+   map = pipe_transfer_map(pipe, tex, 0, 0, PIPE_TRANSFER_READ,
+                           0, 0, WIDTH, HEIGHT, &transfer);
+
+   for (y = 0; y < HEIGHT; y++)
+      memcpy(data + y * stride, map + y * transfer->stride, stride);
+
+   pipe->transfer_unmap(pipe, transfer);
+}
+
+
+/**
+ * Render the scene with the given number of threads and read back the
+ * color and depth/stencil buffers.
+ *
+ * The scene is a full clear, a batch of depth tested, alpha blended
+ * triangles, a clear of a rectangle of the color buffer across tile
+ * edges, an additively blended batch which only tests depth, a depth-only
+ * clear and a last batch which writes depth and counts in the stencil
+ * buffer.
+ */
+static boolean
+render(struct pipe_screen *screen, unsigned num_threads,
+       uint8_t *color, uint8_t *depth)
+{
+   static const uint semantic_names[] = {
+      TGSI_SEMANTIC_POSITION, TGSI_SEMANTIC_COLOR
+   };
+   static const uint semantic_indexes[] = { 0, 0 };
+   static const union pipe_color_union clear_color =
+      { .f = { 0.2f, 0.3f, 0.4f, 1.0f } };
+   static const union pipe_color_union rect_color =
+      { .f = { 1.0f, 0.5f, 0.0f, 0.5f } };
+   struct pipe_context *pipe;
+   struct pipe_resource templ, *cbuf, *zsbuf;
+   struct pipe_surface surf_templ, *cbuf_surf, *zsbuf_surf;
+   struct pipe_framebuffer_state fb;
+   struct pipe_vertex_element velems[2];
+   struct pipe_rasterizer_state rast;
+   struct pipe_depth_stencil_alpha_state dsa;
+   struct pipe_blend_state blend;
+   struct pipe_viewport_state viewport;
+   void *vs, *fs, *velems_cso, *rast_cso, *blend_cso[2], *dsa_cso[3];
+   char value[8];
+   unsigned i;
+
+   util_snprintf(value, sizeof value, "%u", num_threads);
+   setenv("SOFTPIPE_NUM_THREADS", value, 1);
+
+   pipe = screen->context_create(screen, NULL, 0);
+   if (!pipe)
+      return FALSE;
+
+   memset(&templ, 0, sizeof templ);
+   templ.target = PIPE_TEXTURE_2D;
+   templ.width0 = WIDTH;
+   templ.height0 = HEIGHT;
+   templ.depth0 = 1;
+   templ.array_size = 1;
+
+   templ.format = PIPE_FORMAT_B8G8R8A8_UNORM;
+   templ.bind = PIPE_BIND_RENDER_TARGET;
+   cbuf = screen->resource_create(screen, &templ);
+
+   templ.format = PIPE_FORMAT_Z24_UNORM_S8_UINT;
+   templ.bind = PIPE_BIND_DEPTH_STENCIL;
+   zsbuf = screen->resource_create(screen, &templ);
+
+   memset(&surf_templ, 0, sizeof surf_templ);
+   surf_templ.format = cbuf->format;
+   cbuf_surf = pipe->create_surface(pipe, cbuf, &surf_templ);
+   surf_templ.format = zsbuf->format;
+   zsbuf_surf = pipe->create_surface(pipe, zsbuf, &surf_templ);
+
+   memset(&fb, 0, sizeof fb);
+   fb.width = WIDTH;
+   fb.height = HEIGHT;
+   fb.nr_cbufs = 1;
+   fb.cbufs[0] = cbuf_surf;
+   fb.zsbuf = zsbuf_surf;
+   pipe->set_framebuffer_state(pipe, &fb);
+
+   viewport.scale[0] = WIDTH / 2.0f;
+   viewport.scale[1] = HEIGHT / 2.0f;
+   viewport.scale[2] = 0.5f;
+   viewport.translate[0] = WIDTH / 2.0f;
+   viewport.translate[1] = HEIGHT / 2.0f;
+   viewport.translate[2] = 0.5f;
+   pipe->set_viewport_states(pipe, 0, 1, &viewport);
+
+   memset(velems, 0, sizeof velems);
+   velems[0].src_offset = offsetof(struct vertex, position);
+   velems[0].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems[1].src_offset = offsetof(struct vertex, color);
+   velems[1].src_format = PIPE_FORMAT_R32G32B32A32_FLOAT;
+   velems_cso = pipe->create_vertex_elements_state(pipe, 2, velems);
+   pipe->bind_vertex_elements_state(pipe, velems_cso);
+
+   vs = util_make_vertex_passthrough_shader(pipe, 2, semantic_names,
+                                            semantic_indexes, FALSE);
+   pipe->bind_vs_state(pipe, vs);
+   fs = util_make_fragment_passthrough_shader(pipe, TGSI_SEMANTIC_COLOR,
+                                              TGSI_INTERPOLATE_PERSPECTIVE,
+                                              FALSE);
+   pipe->bind_fs_state(pipe, fs);
+
+   memset(&rast, 0, sizeof rast);
+   rast.half_pixel_center = 1;
+   rast.bottom_edge_rule = 1;
+   rast.depth_clip = 1;
+   rast_cso = pipe->create_rasterizer_state(pipe, &rast);
+   pipe->bind_rasterizer_state(pipe, rast_cso);
+
+   memset(&blend, 0, sizeof blend);
+   blend.rt[0].blend_enable = 1;
+   blend.rt[0].rgb_func = PIPE_BLEND_ADD;
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_SRC_ALPHA;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].alpha_func = PIPE_BLEND_ADD;
+   blend.rt[0].alpha_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].alpha_dst_factor = PIPE_BLENDFACTOR_INV_SRC_ALPHA;
+   blend.rt[0].colormask = PIPE_MASK_RGBA;
+   blend_cso[0] = pipe->create_blend_state(pipe, &blend);
+   blend.rt[0].rgb_src_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].rgb_dst_factor = PIPE_BLENDFACTOR_ONE;
+   blend.rt[0].colormask = PIPE_MASK_R | PIPE_MASK_G | PIPE_MASK_B;
+   blend_cso[1] = pipe->create_blend_state(pipe, &blend);
+
+   memset(&dsa, 0, sizeof dsa);
+   dsa.depth.enabled = 1;
+   dsa.depth.writemask = 1;
+   dsa.depth.func = PIPE_FUNC_LESS;
+   dsa_cso[0] = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   dsa.depth.writemask = 0;
+   dsa.depth.func = PIPE_FUNC_LEQUAL;
+   dsa_cso[1] = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+   /* Counts the fragments passing the depth test in the stencil buffer */
+   dsa.depth.writemask = 1;
+   dsa.depth.func = PIPE_FUNC_GREATER;
+   dsa.stencil[0].enabled = 1;
+   dsa.stencil[0].func = PIPE_FUNC_ALWAYS;
+   dsa.stencil[0].fail_op = PIPE_STENCIL_OP_KEEP;
+   dsa.stencil[0].zpass_op = PIPE_STENCIL_OP_INCR;
+   dsa.stencil[0].zfail_op = PIPE_STENCIL_OP_KEEP;
+   dsa.stencil[0].valuemask = 0xff;
+   dsa.stencil[0].writemask = 0xff;
+   dsa_cso[2] = pipe->create_depth_stencil_alpha_state(pipe, &dsa);
+
+   pipe->clear(pipe, PIPE_CLEAR_COLOR | PIPE_CLEAR_DEPTHSTENCIL,
+               &clear_color, 1.0, 0);
+
+   pipe->bind_blend_state(pipe, blend_cso[0]);
+   pipe->bind_depth_stencil_alpha_state(pipe, dsa_cso[0]);
+   draw_batch(pipe, 0);
+
+   pipe->clear_render_target(pipe, cbuf_surf, &rect_color,
+                             TILE_SIZE - 10, TILE_SIZE / 2,
+                             TILE_SIZE + 20, TILE_SIZE);
+
+   pipe->bind_blend_state(pipe, blend_cso[1]);
+   pipe->bind_depth_stencil_alpha_state(pipe, dsa_cso[1]);
+   draw_batch(pipe, 1);
+
+   pipe->clear(pipe, PIPE_CLEAR_DEPTHSTENCIL, NULL, 0.25, 0);
+
+   pipe->bind_blend_state(pipe, blend_cso[0]);
+   pipe->bind_depth_stencil_alpha_state(pipe, dsa_cso[2]);
+   draw_batch(pipe, 2);
+
+   pipe->flush(pipe, NULL, 0);
+
+   read_surface(pipe, cbuf, color);
+   read_surface(pipe, zsbuf, depth);
+
+   pipe->bind_vs_state(pipe, NULL);
+   pipe->bind_fs_state(pipe, NULL);
+   pipe->bind_vertex_elements_state(pipe, NULL);
+   pipe->bind_rasterizer_state(pipe, NULL);
+   pipe->bind_blend_state(pipe, NULL);
+   pipe->bind_depth_stencil_alpha_state(pipe, NULL);
+   pipe->delete_vs_state(pipe, vs);
+   pipe->delete_fs_state(pipe, fs);
+   pipe->delete_vertex_elements_state(pipe, velems_cso);
+   pipe->delete_rasterizer_state(pipe, rast_cso);
+   for (i = 0; i < 2; i++)
+      pipe->delete_blend_state(pipe, blend_cso[i]);
+   for (i = 0; i < 3; i++)
+      pipe->delete_depth_stencil_alpha_state(pipe, dsa_cso[i]);
+
+   memset(&fb, 0, sizeof fb);
+   pipe->set_framebuffer_state(pipe, &fb);
+   pipe_surface_reference(&cbuf_surf, NULL);
+   pipe_surface_reference(&zsbuf_surf, NULL);
+   pipe_resource_reference(&cbuf, NULL);
+   pipe_resource_reference(&zsbuf, NULL);
+
+   pipe->destroy(pipe);
+
+   return TRUE;
+}
+
+
+/** Report the first differing pixel */
+static boolean
+compare(const char *name, unsigned num_threads,
+        const uint8_t *expected, const uint8_t *result)
+{
+   const unsigned size = WIDTH * HEIGHT;
+   const uint32_t *e = (const uint32_t *)expected;
+   const uint32_t *r = (const uint32_t *)result;
+   unsigned i;
+
+   if (memcmp(expected, result, size * 4) == 0)
+      return TRUE;
+
+   for (i = 0; i < size; i++) {
+      if (e[i] != r[i]) {
+         fprintf(stderr, "%s with %u threads: pixel %u,%u is 0x%08x, "
+                 "expected 0x%08x\n", name, num_threads,
+                 i % WIDTH, i / WIDTH, r[i], e[i]);
+         break;
+      }
+   }
+
+   return FALSE;
+}
+
+
+int
+main(int argc, char **argv)
+{
+   static uint8_t color[2][WIDTH * HEIGHT * 4];
+   static uint8_t depth[2][WIDTH * HEIGHT * 4];
+   struct pipe_screen *screen;
+   boolean success = TRUE;
+   unsigned num_threads;
+
+   init_vertices();
+
+   screen = softpipe_create_screen(&null_winsys);
+   if (!screen)
+      return 1;
+
+   if (!render(screen, 1, color[0], depth[0])) {
+      screen->destroy(screen);
+      return 1;
+   }
+
+   for (num_threads = 2; num_threads <= SP_MAX_THREADS; num_threads++) {
+      if (!render(screen, num_threads, color[1], depth[1])) {
+         success = FALSE;
+         break;
+      }
+
+      if (!compare("color", num_threads, color[0], color[1]))
+         success = FALSE;
+      if (!compare("depth", num_threads, depth[0], depth[1]))
+         success = FALSE;
+   }
+
+   screen->destroy(screen);
+
+   return success ? 0 : 1;
+}
@@ -0,0 +1,354 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Rasterizer threads, see sp_threads.h.
+ *
+ * The context renders as thread 0 with its own setup, quad pipeline and
+ * caches.  The other threads get private copies of the state which is
+ * modified while rendering and share everything else with the context.
+ */
+
+#include "util/u_memory.h"
+#include "tgsi/tgsi_exec.h"
+#include "draw/draw_threads.h"
+#include "sp_context.h"
+#include "sp_flush.h"
+#include "sp_setup.h"
+#include "sp_state.h"
+#include "sp_tex_sample.h"
+#include "sp_tex_tile_cache.h"
+#include "sp_texture.h"
+#include "sp_tile_cache.h"
+#include "sp_threads.h"
+
+
+static void
+destroy_thread(struct sp_thread *thread)
+{
+   unsigned i;
+
+   if (thread->setup)
+      sp_setup_destroy_context(thread->setup);
+
+   sp_destroy_quad_stages(&thread->quad);
+
+   if (thread->fs_machine)
+      tgsi_exec_machine_destroy(thread->fs_machine);
+   FREE(thread->fs_sampler);
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++)
+      sp_destroy_tile_cache(thread->cbuf_cache[i]);
+   sp_destroy_tile_cache(thread->zsbuf_cache);
+
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+      if (thread->tex_cache[i]) {
+         sp_tex_tile_cache_set_sampler_view(thread->tex_cache[i], NULL);
+         sp_destroy_tex_tile_cache(thread->tex_cache[i]);
+      }
+   }
+
+   FREE(thread);
+}
+
+
+static struct sp_thread *
+create_thread(struct softpipe_context *softpipe, unsigned index)
+{
+   struct sp_thread *thread = CALLOC_STRUCT(sp_thread);
+   unsigned i;
+
+   if (!thread)
+      return NULL;
+
+   thread->softpipe = softpipe;
+   thread->index = index;
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++) {
+      thread->cbuf_cache[i] = sp_create_tile_cache(&softpipe->pipe);
+      if (!thread->cbuf_cache[i])
+         goto fail;
+      sp_tile_cache_set_thread(thread->cbuf_cache[i],
+                               index, softpipe->num_threads);
+   }
+
+   thread->zsbuf_cache = sp_create_tile_cache(&softpipe->pipe);
+   if (!thread->zsbuf_cache)
+      goto fail;
+   sp_tile_cache_set_thread(thread->zsbuf_cache, index, softpipe->num_threads);
+
+   for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+      thread->tex_cache[i] = sp_create_tex_tile_cache(&softpipe->pipe);
+      if (!thread->tex_cache[i])
+         goto fail;
+   }
+
+   thread->fs_machine = tgsi_exec_machine_create();
+   thread->fs_sampler = sp_create_tgsi_sampler();
+   if (!thread->fs_machine || !thread->fs_sampler)
+      goto fail;
+
+   if (!sp_create_quad_stages(softpipe, thread, &thread->quad))
+      goto fail;
+
+   thread->setup = sp_setup_create_context(softpipe, thread);
+   if (!thread->setup)
+      goto fail;
+
+   return thread;
+
+fail:
+   destroy_thread(thread);
+   return NULL;
+}
+
+
+/**
+ * Create the threads for softpipe->num_threads.
+ */
+boolean
+sp_threads_create(struct softpipe_context *softpipe)
+{
+   unsigned i;
+
+   assert(softpipe->num_threads > 1);
+   assert(softpipe->num_threads <= SP_MAX_THREADS);
+
+   for (i = 1; i < softpipe->num_threads; i++) {
+      softpipe->threads[i] = create_thread(softpipe, i);
+      if (!softpipe->threads[i])
+         return FALSE;
+   }
+
+   softpipe->thread_pool = draw_thread_pool_create(softpipe->num_threads - 1);
+   if (!softpipe->thread_pool)
+      return FALSE;
+
+   for (i = 0; i < PIPE_MAX_COLOR_BUFS; i++)
+      sp_tile_cache_set_thread(softpipe->cbuf_cache[i],
+                               0, softpipe->num_threads);
+   sp_tile_cache_set_thread(softpipe->zsbuf_cache, 0, softpipe->num_threads);
+
+   return TRUE;
+}
+
+
+void
+sp_threads_destroy(struct softpipe_context *softpipe)
+{
+   unsigned i;
+
+   if (softpipe->thread_pool) {
+      draw_thread_pool_destroy(softpipe->thread_pool);
+      softpipe->thread_pool = NULL;
+   }
+
+   for (i = 1; i < SP_MAX_THREADS; i++) {
+      if (softpipe->threads[i]) {
+         destroy_thread(softpipe->threads[i]);
+         softpipe->threads[i] = NULL;
+      }
+   }
+}
+
+
+/**
+ * Bring a thread's copy of the fragment state up to date with the
+ * context's, mirroring what softpipe_update_derived() did for the context.
+ */
+static void
+update_thread(struct sp_thread *thread, unsigned dirty)
+{
+   struct softpipe_context *softpipe = thread->softpipe;
+   const struct sp_tgsi_sampler *sampler =
+      softpipe->tgsi.sampler[PIPE_SHADER_FRAGMENT];
+   unsigned i;
+
+   if (dirty & (SP_NEW_SAMPLER |
+                SP_NEW_TEXTURE |
+                SP_NEW_FS |
+                SP_NEW_VS)) {
+      memcpy(thread->fs_sampler->sp_sampler, sampler->sp_sampler,
+             sizeof(sampler->sp_sampler));
+
+      for (i = 0; i < PIPE_MAX_SHADER_SAMPLER_VIEWS; i++) {
+         struct pipe_sampler_view *view =
+            softpipe->sampler_views[PIPE_SHADER_FRAGMENT][i];
+         struct softpipe_tex_tile_cache *tc = thread->tex_cache[i];
+
+         sp_tex_tile_cache_set_sampler_view(tc, view);
+
+         thread->fs_sampler->sp_sview[i] = sampler->sp_sview[i];
+         if (view)
+            thread->fs_sampler->sp_sview[i].cache = tc;
+
+         if (tc->texture) {
+            struct softpipe_resource *spt = softpipe_resource(tc->texture);
+            if (spt->timestamp != tc->timestamp) {
+               sp_tex_tile_cache_validate_texture(tc);
+               tc->timestamp = spt->timestamp;
+            }
+         }
+      }
+   }
+
+   if ((dirty & (SP_NEW_RASTERIZER |
+                 SP_NEW_FS)) &&
+       softpipe->fs_variant) {
+      softpipe->fs_variant->prepare(softpipe->fs_variant,
+                                    thread->fs_machine,
+                                    (struct tgsi_sampler *) thread->fs_sampler);
+   }
+
+   if (dirty & (SP_NEW_BLEND |
+                SP_NEW_DEPTH_STENCIL_ALPHA |
+                SP_NEW_FRAMEBUFFER |
+                SP_NEW_STIPPLE |
+                SP_NEW_FS))
+      sp_build_quad_pipeline(softpipe, &thread->quad);
+}
+
+
+/**
+ * Called by vbuf code after the context's setup was prepared for a new
+ * batch of primitives.
+ */
+void
+sp_threads_prepare(struct softpipe_context *softpipe)
+{
+   unsigned i;
+
+   for (i = 1; i < softpipe->num_threads; i++) {
+      struct sp_thread *thread = softpipe->threads[i];
+
+      if (!thread->quad.first)
+         update_thread(thread, ~0u);
+      else if (softpipe->threads_dirty)
+         update_thread(thread, softpipe->threads_dirty);
+
+      sp_setup_prepare(thread->setup);
+   }
+
+   softpipe->threads_dirty = 0;
+}
+
+
+struct sp_threads_job
+{
+   struct softpipe_context *softpipe;
+   struct setup_context *setup;
+   void (*func)(void *data, struct setup_context *setup);
+   void *data;
+};
+
+
+static void
+run_thread(void *data, unsigned index)
+{
+   const struct sp_threads_job *job = (const struct sp_threads_job *) data;
+   struct setup_context *setup =
+      index ? job->softpipe->threads[index]->setup : job->setup;
+
+   job->func(job->data, setup);
+}
+
+
+/**
+ * Run func once per rasterizer thread, each time with that thread's setup
+ * context, and wait for all of them.
+ * \param setup  the context's own setup context
+ */
+void
+sp_threads_run(struct softpipe_context *softpipe,
+               struct setup_context *setup,
+               void (*func)(void *data, struct setup_context *setup),
+               void *data)
+{
+   struct sp_threads_job job;
+   unsigned i;
+
+   job.softpipe = softpipe;
+   job.setup = setup;
+   job.func = func;
+   job.data = data;
+
+   draw_thread_pool_run(softpipe->thread_pool, run_thread, &job,
+                        softpipe->num_threads);
+
+   for (i = 1; i < softpipe->num_threads; i++) {
+      struct sp_thread *thread = softpipe->threads[i];
+
+      softpipe->occlusion_count += thread->occlusion_count;
+      softpipe->pipeline_statistics.ps_invocations += thread->ps_invocations;
+      thread->occlusion_count = 0;
+      thread->ps_invocations = 0;
+   }
+}
+
+
+/**
+ * Flush the caches of the threads, as softpipe_flush() does for the
+ * context's.
+ */
+void
+sp_threads_flush(struct softpipe_context *softpipe, unsigned flags)
+{
+   unsigned i, j;
+
+   for (i = 1; i < softpipe->num_threads; i++) {
+      struct sp_thread *thread = softpipe->threads[i];
+
+      if (flags & SP_FLUSH_TEXTURE_CACHE) {
+         for (j = 0; j < softpipe->num_sampler_views[PIPE_SHADER_FRAGMENT]; j++)
+            sp_flush_tex_tile_cache(thread->tex_cache[j]);
+      }
+
+      for (j = 0; j < softpipe->framebuffer.nr_cbufs; j++)
+         sp_flush_tile_cache(thread->cbuf_cache[j]);
+
+      sp_flush_tile_cache(thread->zsbuf_cache);
+   }
+}
+
+
+/**
+ * Called before a fragment shader variant is deleted.
+ */
+void
+sp_threads_unbind_fs_variant(struct softpipe_context *softpipe,
+                             const struct sp_fragment_shader_variant *var)
+{
+   unsigned i;
+
+   for (i = 1; i < softpipe->num_threads; i++) {
+      struct tgsi_exec_machine *machine = softpipe->threads[i]->fs_machine;
+
+      if (machine->Tokens == var->tokens)
+         tgsi_exec_machine_bind_shader(machine, NULL, NULL);
+   }
+}
@@ -0,0 +1,140 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * Rasterizer threads.
+ *
+ * Each thread runs primitive setup for the whole vertex batch but only
+ * emits the quads falling into the tiles it owns.  Tiles are assigned by
+ * their tile cache entry, so every thread has private color/depth tile
+ * caches which see exactly the accesses (and evictions) the single cache
+ * of a serial context would see for those entries.  This keeps the output
+ * identical to serial rendering.
+ */
+
+#ifndef SP_THREADS_H
+#define SP_THREADS_H
+
+#include "pipe/p_state.h"
+#include "sp_context.h"
+#include "sp_quad_pipe.h"
+
+
+struct setup_context;
+struct sp_tgsi_sampler;
+struct sp_fragment_shader_variant;
+struct softpipe_tile_cache;
+struct softpipe_tex_tile_cache;
+struct tgsi_exec_machine;
+
+
+/**
+ * Per-thread rasterization state, for threads other than the context.
+ */
+struct sp_thread
+{
+   struct softpipe_context *softpipe;
+   unsigned index;
+
+   struct setup_context *setup;
+   struct sp_quad_stages quad;
+
+   struct tgsi_exec_machine *fs_machine;
+   struct sp_tgsi_sampler *fs_sampler;
+
+   struct softpipe_tile_cache *cbuf_cache[PIPE_MAX_COLOR_BUFS];
+   struct softpipe_tile_cache *zsbuf_cache;
+   struct softpipe_tex_tile_cache *tex_cache[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+
+   /** Counters, added to the context's after each batch */
+   uint64_t occlusion_count;
+   uint64_t ps_invocations;
+};
+
+
+boolean
+sp_threads_create(struct softpipe_context *softpipe);
+
+void
+sp_threads_destroy(struct softpipe_context *softpipe);
+
+void
+sp_threads_prepare(struct softpipe_context *softpipe);
+
+void
+sp_threads_run(struct softpipe_context *softpipe,
+               struct setup_context *setup,
+               void (*func)(void *data, struct setup_context *setup),
+               void *data);
+
+void
+sp_threads_flush(struct softpipe_context *softpipe, unsigned flags);
+
+void
+sp_threads_unbind_fs_variant(struct softpipe_context *softpipe,
+                             const struct sp_fragment_shader_variant *var);
+
+
+/*
+ * Quad stages reach the per-thread state through these.
+ */
+
+static inline struct tgsi_exec_machine *
+sp_quad_fs_machine(const struct quad_stage *qs)
+{
+   return qs->thread ? qs->thread->fs_machine : qs->softpipe->fs_machine;
+}
+
+static inline struct softpipe_tile_cache *
+sp_quad_cbuf_cache(const struct quad_stage *qs, unsigned i)
+{
+   return qs->thread ? qs->thread->cbuf_cache[i] : qs->softpipe->cbuf_cache[i];
+}
+
+static inline struct softpipe_tile_cache *
+sp_quad_zsbuf_cache(const struct quad_stage *qs)
+{
+   return qs->thread ? qs->thread->zsbuf_cache : qs->softpipe->zsbuf_cache;
+}
+
+static inline uint64_t *
+sp_quad_occlusion_count(const struct quad_stage *qs)
+{
+   return qs->thread ? &qs->thread->occlusion_count :
+                       &qs->softpipe->occlusion_count;
+}
+
+static inline uint64_t *
+sp_quad_ps_invocations(const struct quad_stage *qs)
+{
+   return qs->thread ? &qs->thread->ps_invocations :
+                       &qs->softpipe->pipeline_statistics.ps_invocations;
+}
+
+
+#endif /* SP_THREADS_H */
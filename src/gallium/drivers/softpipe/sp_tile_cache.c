@@ -42,16 +42,6 @@ static struct softpipe_cached_tile *
 sp_alloc_tile(struct softpipe_tile_cache *tc);
 
 
-/**
- * Return the position in the cache for the tile that contains win pos (x,y).
- * We currently use a direct mapped cache so this is like a hack key.
- * At some point we should investige something more sophisticated, like
- * a LRU replacement policy.
- */
-#define CACHE_POS(x, y, l)                        \
-   (((x) + (y) * 5 + (l) * 10) % NUM_ENTRIES)
-
-
 static inline int addr_to_clear_pos(union tile_address addr)
 {
    int pos;
@@ -220,6 +210,19 @@ sp_tile_cache_set_surface(struct softpipe_tile_cache *tc,
 }
 
 
+/**
+ * Restrict the cache to the tiles owned by the given rasterizer thread.
+ * This only matters for clears: the other tiles are never accessed.
+ */
+void
+sp_tile_cache_set_thread(struct softpipe_tile_cache *tc,
+                         unsigned thread_index, unsigned num_threads)
+{
+   tc->thread_index = thread_index;
+   tc->num_threads = num_threads;
+}
+
+
 /**
  * Return the transfer being cached.
  */
@@ -361,6 +364,11 @@ sp_tile_cache_flush_clear(struct softpipe_tile_cache *tc, int layer)
       for (x = 0; x < w; x += TILE_SIZE) {
          union tile_address addr = tile_address(x, y, layer);
 
+         /* tiles of other threads are cleared by their own caches */
+         if (tc->num_threads > 1 &&
+             sp_tile_cache_pos(addr) % tc->num_threads != tc->thread_index)
+            continue;
+
          if (is_clear_flag_set(tc->clear_flags, addr, tc->clear_flags_size)) {
             /* write the scratch tile to the surface */
             if (tc->depth_stencil) {
@@ -517,8 +525,7 @@ sp_find_cached_tile(struct softpipe_tile_cache *tc,
 {
    struct pipe_transfer *pt;
    /* cache pos/entry: */
-   const int pos = CACHE_POS(addr.bits.x,
-                             addr.bits.y, addr.bits.layer);
+   const int pos = sp_tile_cache_pos(addr);
    struct softpipe_cached_tile *tile = tc->entries[pos];
    int layer;
    if (!tile) {
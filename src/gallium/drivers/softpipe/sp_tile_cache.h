@@ -99,6 +99,10 @@ struct softpipe_tile_cache
 
    union tile_address last_tile_addr;
    struct softpipe_cached_tile *last_tile;  /**< most recently retrieved tile */
+
+   /** Rasterizer thread using this cache, see sp_tile_owner() */
+   unsigned thread_index;
+   unsigned num_threads;
 };
 
 
@@ -123,6 +127,10 @@ sp_tile_cache_clear(struct softpipe_tile_cache *tc,
                     const union pipe_color_union *color,
                     uint64_t clearValue);
 
+extern void
+sp_tile_cache_set_thread(struct softpipe_tile_cache *tc,
+                         unsigned thread_index, unsigned num_threads);
+
 extern struct softpipe_cached_tile *
 sp_find_cached_tile(struct softpipe_tile_cache *tc, 
                     union tile_address addr );
@@ -141,6 +149,27 @@ tile_address( unsigned x,
    return addr;
 }
 
+/**
+ * Return the position in the cache for the given tile.
+ * We currently use a direct mapped cache so this is like a hash key.
+ */
+static inline unsigned
+sp_tile_cache_pos(union tile_address addr)
+{
+   return (addr.bits.x + addr.bits.y * 5 + addr.bits.layer * 10) % NUM_ENTRIES;
+}
+
+/**
+ * Return which of num_threads rasterizer threads renders the tile
+ * containing win pos (x,y).  Threads own whole cache positions, so that
+ * all tiles competing for a cache entry are rendered by the same thread.
+ */
+static inline unsigned
+sp_tile_owner(unsigned x, unsigned y, unsigned layer, unsigned num_threads)
+{
+   return sp_tile_cache_pos(tile_address(x, y, layer)) % num_threads;
+}
+
 /* Quickly retrieve tile if it matches last lookup.
  */
 static inline struct softpipe_cached_tile *
@@ -35,6 +35,8 @@
 
 #include "glheader.h"
 
+struct blob;
+struct blob_reader;
 struct gl_buffer_object;
 struct gl_context;
 struct gl_display_list;
@@ -500,6 +502,36 @@ struct dd_function_table {
                            struct gl_shader_program *shader);
    /*@}*/
 
+   /**
+    * \name GL_ARB_get_program_binary support
+    *
+    * Core Mesa saves and restores everything the GLSL linker produced.  The
+    * driver appends its own translated code for each linked stage, so that
+    * glProgramBinary never has to run a compiler.
+    */
+   /*@{*/
+   /**
+    * Return a hash of everything in the driver (and the device it runs on)
+    * that affects the code it stores.  Binaries written under a different
+    * hash are rejected.
+    */
+   void (*GetProgramBinaryDriverSHA1)(struct gl_context *ctx, GLubyte *sha1);
+
+   /** Append the driver's code for a linked stage program to \p blob. */
+   void (*ProgramBinarySerializeDriverBlob)(struct gl_context *ctx,
+                                            struct gl_program *prog,
+                                            struct blob *blob);
+
+   /**
+    * Restore what ProgramBinarySerializeDriverBlob wrote into a freshly
+    * created \p prog.  Return GL_FALSE if the data can't be used.
+    */
+   GLboolean (*ProgramBinaryDeserializeDriverBlob)(struct gl_context *ctx,
+                                                   struct gl_shader_program *shProg,
+                                                   struct gl_program *prog,
+                                                   struct blob_reader *blob);
+   /*@}*/
+
    /**
     * \name State-changing functions.
     *
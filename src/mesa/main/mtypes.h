@@ -72,6 +72,8 @@ typedef GLuint64 GLbitfield64;
  */
 /*@{*/
 struct _mesa_HashTable;
+struct disk_cache;
+struct glsl_opt_stats;
 struct gl_attrib_node;
 struct gl_list_extensions;
 struct gl_meta_state;
@@ -2235,6 +2237,25 @@ struct gl_shader
    GLuint SourceChecksum;       /**< for debug/logging purposes */
    const GLchar *Source;  /**< Source code string */
 
+   /**
+    * Shader cache key: SHA-1 of the source and of the context state the
+    * compilation depends on.  Only set while the shader cache is in use.
+    */
+   unsigned char sha1[20];
+
+   /**
+    * glCompileShader found \c sha1 in the shader cache and skipped the
+    * compilation, so there is no IR.  The shader is compiled for real if a
+    * program it is linked into misses the cache.
+    */
+   bool CompileDeferred;
+
+   /**
+    * Copy of the source glCompileShader was given, while \c CompileDeferred
+    * is set.  Allocated with ralloc off the shader.
+    */
+   char *DeferredSource;
+
    struct gl_program *Program;  /**< Post-compile assembly code */
    GLchar *InfoLog;
 
@@ -2763,6 +2784,15 @@ struct gl_shader_program
    unsigned NumUniformRemapTable;
    struct gl_uniform_storage **UniformRemapTable;
 
+   /**
+    * Backing store of the \c UniformStorage values and a snapshot of it
+    * taken right after the linker applied initializers and explicit
+    * bindings.  The snapshot is what a restored program binary starts from.
+    */
+   unsigned NumUniformDataSlots;
+   union gl_constant_value *UniformDataSlots;
+   union gl_constant_value *UniformDataDefaults;
+
    /**
     * Size of the gl_ClipDistance array that is output from the last pipeline
     * stage before the fragment shader.
@@ -2866,6 +2896,7 @@ struct gl_shader_program
 #define GLSL_USE_PROG 0x80  /**< Log glUseProgram calls */
 #define GLSL_REPORT_ERRORS 0x100  /**< Print compilation errors */
 #define GLSL_DUMP_ON_ERROR 0x200 /**< Dump shaders to stderr on compile error */
+#define GLSL_OPT_STATS 0x400 /**< Print optimizer statistics at exit */
 
 
 /**
@@ -3734,6 +3765,13 @@ struct gl_constants
 
    struct gl_shader_compiler_options ShaderCompilerOptions[MESA_SHADER_STAGES];
 
+   /**
+    * GL_ARB_get_program_binary: number of binary formats the driver can
+    * save and restore linked programs in.  Only 0 (no support) and 1
+    * (GL_PROGRAM_BINARY_FORMAT_MESA) are meaningful.
+    */
+   GLuint NumProgramBinaryFormats;
+
    /** GL_ARB_tessellation_shader */
    GLuint MaxPatchVertices;
    GLuint MaxTessGenLevel;
@@ -4434,6 +4472,19 @@ struct gl_context
     */
    struct gl_pipeline_object *_Shader;
 
+   /**
+    * On-disk cache of compiled shaders and linked programs, see
+    * main/shader_cache.cpp.  Created on first use, NULL when disabled.
+    */
+   struct disk_cache *ShaderCache;
+   GLboolean ShaderCacheInitialized;
+
+   /**
+    * Pass counts and timings of the GLSL optimizer, collected when
+    * MESA_GLSL=stats is set.  NULL otherwise.
+    */
+   struct glsl_opt_stats *OptStats;
+
    struct gl_query_state Query;  /**< occlusion, timer queries */
 
    struct gl_transform_feedback_state TransformFeedback;
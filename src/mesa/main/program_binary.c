@@ -0,0 +1,676 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * \file program_binary.c
+ * GL_ARB_get_program_binary / GL_OES_get_program_binary support.
+ *
+ * A program binary is a small header followed by a payload:
+ *
+ *  - the header holds a SHA-1 identifying the Mesa build and the driver
+ *    (see \c get_build_sha1), a SHA-1 of the payload and the payload size;
+ *
+ *  - the payload is what \c serialize_glsl_program writes for the linked
+ *    program, followed by one record per linked stage with the state of the
+ *    stage's \c gl_program and whatever the driver needs to restore its own
+ *    compiled form of it.
+ *
+ * Binaries are only ever loaded by the same build of Mesa and the same
+ * driver that produced them; anything else is rejected, which the
+ * application sees as a link failure and answers by compiling the GLSL
+ * source again.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef HAVE_DLADDR
+#include <dlfcn.h>
+#include <sys/stat.h>
+#endif
+
+#include "glheader.h"
+#include "context.h"
+#include "macros.h"
+#include "mtypes.h"
+#include "program_binary.h"
+#include "shaderobj.h"
+#include "transformfeedback.h"
+#include "uniforms.h"
+#include "git_sha1.h"
+#include "compiler/glsl/blob.h"
+#include "compiler/glsl/serialize.h"
+#include "program/ir_to_mesa.h"
+#include "program/prog_parameter.h"
+#include "program/program.h"
+#include "util/mesa-sha1.h"
+#include "util/ralloc.h"
+
+
+struct program_binary_header {
+   /** Identifies the Mesa build and driver that wrote the binary */
+   uint8_t build_sha1[20];
+   /** SHA-1 of the payload following the header */
+   uint8_t payload_sha1[20];
+   uint32_t payload_size;
+};
+
+
+#ifdef HAVE_SHA1
+
+/**
+ * Hash the context state that compiling and linking depend on: the API and
+ * version, the enabled extensions and the implementation limits and
+ * compiler options.  The latter two include what driconf and the
+ * MESA_EXTENSION_OVERRIDE / MESA_GLSL_VERSION_OVERRIDE style overrides
+ * change, as those are applied to the context.
+ */
+static void
+update_context_sha1(struct mesa_sha1 *sha_ctx, struct gl_context *ctx)
+{
+   const uint8_t *consts = (const uint8_t *) &ctx->Const;
+   unsigned i;
+
+   _mesa_sha1_update(sha_ctx, &ctx->API, sizeof(ctx->API));
+   _mesa_sha1_update(sha_ctx, &ctx->Version, sizeof(ctx->Version));
+
+   /* Extensions::Version changes while meta is active; everything after
+    * the sentinel is bookkeeping.
+    */
+   _mesa_sha1_update(sha_ctx, &ctx->Extensions,
+                     offsetof(struct gl_extensions, extension_sentinel));
+
+   /* Skip the pointers in the compiler options, which differ between runs
+    * but only point at data the driver SHA-1 already covers.
+    */
+   _mesa_sha1_update(sha_ctx, consts,
+                     offsetof(struct gl_constants, ShaderCompilerOptions));
+   for (i = 0; i < MESA_SHADER_STAGES; i++) {
+      _mesa_sha1_update(sha_ctx, &ctx->Const.ShaderCompilerOptions[i],
+                        offsetof(struct gl_shader_compiler_options,
+                                 NirOptions));
+   }
+   _mesa_sha1_update(sha_ctx,
+                     consts + offsetof(struct gl_constants, MaxPatchVertices),
+                     sizeof(struct gl_constants) -
+                     offsetof(struct gl_constants, MaxPatchVertices));
+}
+
+
+/**
+ * Compute the SHA-1 that a binary must carry to be accepted by this
+ * context: the Mesa version, the pointer size, the modification time of the
+ * library this code lives in (so that rebuilding Mesa invalidates binaries
+ * even when the version string stays the same), the driver's own
+ * identification and the context state the compiler depends on.
+ *
+ * The shader cache keys its entries with the same SHA-1, so both agree on
+ * what makes a compiled program reusable.
+ */
+void
+_mesa_get_program_binary_build_sha1(struct gl_context *ctx, uint8_t sha1[20])
+{
+   struct mesa_sha1 *sha_ctx = _mesa_sha1_init();
+   const uint32_t ptr_size = sizeof(void *);
+   const char *version = PACKAGE_VERSION;
+
+   if (sha_ctx == NULL) {
+      memset(sha1, 0, 20);
+      return;
+   }
+
+   _mesa_sha1_update(sha_ctx, version, strlen(version));
+#ifdef MESA_GIT_SHA1
+   _mesa_sha1_update(sha_ctx, MESA_GIT_SHA1, strlen(MESA_GIT_SHA1));
+#endif
+   _mesa_sha1_update(sha_ctx, &ptr_size, sizeof(ptr_size));
+
+#ifdef HAVE_DLADDR
+   {
+      Dl_info info;
+      struct stat st;
+
+      if (dladdr((void *) _mesa_get_program_binary_build_sha1, &info) &&
+          info.dli_fname && stat(info.dli_fname, &st) == 0) {
+         const int64_t mtime = st.st_mtime;
+         _mesa_sha1_update(sha_ctx, &mtime, sizeof(mtime));
+      }
+   }
+#endif
+
+   if (ctx->Driver.GetProgramBinaryDriverSHA1) {
+      GLubyte driver_sha1[20];
+
+      ctx->Driver.GetProgramBinaryDriverSHA1(ctx, driver_sha1);
+      _mesa_sha1_update(sha_ctx, driver_sha1, sizeof(driver_sha1));
+   }
+
+   update_context_sha1(sha_ctx, ctx);
+
+   _mesa_sha1_final(sha_ctx, sha1);
+}
+
+
+/**
+ * Size of the \c gl_program subclass used for \p stage.
+ */
+static size_t
+program_struct_size(gl_shader_stage stage)
+{
+   switch (stage) {
+   case MESA_SHADER_VERTEX:
+      return sizeof(struct gl_vertex_program);
+   case MESA_SHADER_TESS_CTRL:
+      return sizeof(struct gl_tess_ctrl_program);
+   case MESA_SHADER_TESS_EVAL:
+      return sizeof(struct gl_tess_eval_program);
+   case MESA_SHADER_GEOMETRY:
+      return sizeof(struct gl_geometry_program);
+   case MESA_SHADER_FRAGMENT:
+      return sizeof(struct gl_fragment_program);
+   case MESA_SHADER_COMPUTE:
+      return sizeof(struct gl_compute_program);
+   default:
+      unreachable("Unexpected shader stage");
+   }
+}
+
+
+/*
+ * The plain-data parts of a gl_program: everything from InputsRead up to
+ * the parameter list, everything after LocalParams, and the fields the
+ * stage-specific subclass adds after the base class.  None of them hold
+ * pointers.
+ */
+#define PROG_DATA0_START offsetof(struct gl_program, InputsRead)
+#define PROG_DATA0_END   offsetof(struct gl_program, Parameters)
+#define PROG_DATA1_START offsetof(struct gl_program, SamplerUnits)
+#define PROG_DATA1_END   sizeof(struct gl_program)
+
+
+static void
+write_parameters(struct blob *blob,
+                 const struct gl_program_parameter_list *params)
+{
+   GLuint i;
+
+   blob_write_uint32(blob, params->NumParameters);
+   blob_write_uint32(blob, params->StateFlags);
+
+   for (i = 0; i < params->NumParameters; i++) {
+      const struct gl_program_parameter *p = &params->Parameters[i];
+
+      blob_write_uint32(blob, p->Name != NULL);
+      if (p->Name)
+         blob_write_string(blob, p->Name);
+      blob_write_uint32(blob, p->Type);
+      blob_write_uint32(blob, p->DataType);
+      blob_write_uint32(blob, p->Size);
+      blob_write_uint32(blob, p->Initialized);
+      blob_write_bytes(blob, p->StateIndexes, sizeof(p->StateIndexes));
+   }
+
+   if (params->NumParameters) {
+      blob_write_bytes(blob, params->ParameterValues,
+                       params->NumParameters * 4 * sizeof(gl_constant_value));
+   }
+}
+
+
+static struct gl_program_parameter_list *
+read_parameters(struct blob_reader *blob)
+{
+   struct gl_program_parameter_list *params;
+   const GLuint num = blob_read_uint32(blob);
+   const GLbitfield state_flags = blob_read_uint32(blob);
+   GLuint i;
+
+   /* Every parameter takes at least its five uint32s and state indices. */
+   if (blob->overrun ||
+       num > (blob->end - blob->current) /
+             (5 * sizeof(uint32_t) + sizeof(gl_state_index) * STATE_LENGTH))
+      return NULL;
+
+   /* Leave room for the constants st adds for Bitmap and DrawPixels. */
+   params = _mesa_new_parameter_list_sized(num + 8);
+   if (params == NULL)
+      return NULL;
+
+   params->StateFlags = state_flags;
+
+   for (i = 0; i < num; i++) {
+      struct gl_program_parameter *p = &params->Parameters[i];
+
+      if (blob_read_uint32(blob)) {
+         const char *name = blob_read_string(blob);
+         if (name == NULL)
+            break;
+         p->Name = strdup(name);
+      }
+      p->Type = (gl_register_file) blob_read_uint32(blob);
+      p->DataType = blob_read_uint32(blob);
+      p->Size = blob_read_uint32(blob);
+      p->Initialized = blob_read_uint32(blob);
+      blob_copy_bytes(blob, (uint8_t *) p->StateIndexes,
+                      sizeof(p->StateIndexes));
+      params->NumParameters++;
+
+      if (blob->overrun)
+         break;
+   }
+
+   if (num)
+      blob_copy_bytes(blob, (uint8_t *) params->ParameterValues,
+                      num * 4 * sizeof(gl_constant_value));
+
+   if (blob->overrun || params->NumParameters != num) {
+      _mesa_free_parameter_list(params);
+      return NULL;
+   }
+
+   return params;
+}
+
+
+static void
+write_program(struct gl_context *ctx, struct blob *blob,
+              gl_shader_stage stage, struct gl_program *prog)
+{
+   const size_t struct_size = program_struct_size(stage);
+   const uint8_t *data = (const uint8_t *) prog;
+   size_t driver_size_offset;
+
+   blob_write_uint32(blob, prog->Target);
+   blob_write_bytes(blob, data + PROG_DATA0_START,
+                    PROG_DATA0_END - PROG_DATA0_START);
+   blob_write_bytes(blob, data + PROG_DATA1_START,
+                    PROG_DATA1_END - PROG_DATA1_START);
+   if (struct_size > sizeof(struct gl_program)) {
+      blob_write_bytes(blob, data + sizeof(struct gl_program),
+                       struct_size - sizeof(struct gl_program));
+   }
+
+   write_parameters(blob, prog->Parameters);
+
+   /* The driver's data is prefixed with its size, so that loading can check
+    * the driver consumed exactly what it wrote.
+    */
+   driver_size_offset = blob->size;
+   blob_write_uint32(blob, 0);
+   if (ctx->Driver.ProgramBinarySerializeDriverBlob) {
+      const size_t start = blob->size;
+
+      ctx->Driver.ProgramBinarySerializeDriverBlob(ctx, prog, blob);
+      blob_overwrite_uint32(blob, driver_size_offset, blob->size - start);
+   }
+}
+
+
+static struct gl_program *
+read_program(struct gl_context *ctx, struct gl_shader_program *shProg,
+             gl_shader_stage stage, struct blob_reader *blob)
+{
+   const GLenum target = _mesa_shader_stage_to_program(stage);
+   const size_t struct_size = program_struct_size(stage);
+   struct gl_program *prog;
+   uint8_t *data;
+   uint32_t driver_size;
+   uint8_t *driver_end;
+
+   if (blob_read_uint32(blob) != target || blob->overrun)
+      return NULL;
+
+   prog = ctx->Driver.NewProgram(ctx, target, shProg->Name);
+   if (prog == NULL)
+      return NULL;
+
+   data = (uint8_t *) prog;
+   blob_copy_bytes(blob, data + PROG_DATA0_START,
+                   PROG_DATA0_END - PROG_DATA0_START);
+   blob_copy_bytes(blob, data + PROG_DATA1_START,
+                   PROG_DATA1_END - PROG_DATA1_START);
+   if (struct_size > sizeof(struct gl_program)) {
+      blob_copy_bytes(blob, data + sizeof(struct gl_program),
+                      struct_size - sizeof(struct gl_program));
+   }
+
+   if (blob->overrun)
+      goto fail;
+
+   /* Drivers may or may not have given the new program a parameter list */
+   if (prog->Parameters)
+      _mesa_free_parameter_list(prog->Parameters);
+   prog->Parameters = read_parameters(blob);
+   if (prog->Parameters == NULL)
+      goto fail;
+
+   /* Same order as the GLSL linkers: the uniform storage can only be
+    * associated once the parameter list is not going to be reallocated.
+    */
+   _mesa_reserve_parameter_storage(prog->Parameters, 8);
+   _mesa_associate_uniform_storage(ctx, shProg, prog->Parameters);
+
+   driver_size = blob_read_uint32(blob);
+   if (blob->overrun || driver_size > (size_t) (blob->end - blob->current))
+      goto fail;
+
+   driver_end = blob->current + driver_size;
+   if (ctx->Driver.ProgramBinaryDeserializeDriverBlob) {
+      if (!ctx->Driver.ProgramBinaryDeserializeDriverBlob(ctx, shProg, prog,
+                                                          blob) ||
+          blob->overrun || blob->current != driver_end)
+         goto fail;
+   } else if (driver_size != 0) {
+      goto fail;
+   }
+
+   _mesa_update_shader_textures_used(shProg, prog);
+
+   return prog;
+
+fail:
+   _mesa_reference_program(ctx, &prog, NULL);
+   return NULL;
+}
+
+
+/**
+ * Serialize \p shProg into a new blob holding the binary's payload.
+ */
+static struct blob *
+serialize_payload(struct gl_context *ctx, struct gl_shader_program *shProg)
+{
+   struct blob *blob = blob_create(NULL);
+   unsigned i;
+
+   if (blob == NULL)
+      return NULL;
+
+   serialize_glsl_program(blob, ctx, shProg);
+
+   for (i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_shader *sh = shProg->_LinkedShaders[i];
+
+      if (sh == NULL || sh->Program == NULL)
+         continue;
+
+      write_program(ctx, blob, (gl_shader_stage) i, sh->Program);
+   }
+
+   return blob;
+}
+
+
+static bool
+deserialize_payload(struct gl_context *ctx, struct gl_shader_program *shProg,
+                    uint8_t *payload, size_t size)
+{
+   struct blob_reader blob;
+   unsigned i;
+
+   blob_reader_init(&blob, payload, size);
+
+   if (!deserialize_glsl_program(&blob, ctx, shProg))
+      return false;
+
+   for (i = 0; i < MESA_SHADER_STAGES; i++) {
+      struct gl_shader *sh = shProg->_LinkedShaders[i];
+      struct gl_program *prog;
+
+      if (sh == NULL)
+         continue;
+
+      prog = read_program(ctx, shProg, (gl_shader_stage) i, &blob);
+      if (prog == NULL)
+         return false;
+
+      _mesa_reference_program(ctx, &sh->Program, prog);
+      _mesa_reference_program(ctx, &prog, NULL);
+   }
+
+   return !blob.overrun && blob.current == blob.end;
+}
+
+
+/**
+ * Throw away everything a previous link or program binary left in
+ * \p shProg.
+ */
+static void
+clear_linked_program(struct gl_context *ctx, struct gl_shader_program *shProg)
+{
+   unsigned i;
+
+   _mesa_clear_shader_program_data(shProg);
+
+   for (i = 0; i < MESA_SHADER_STAGES; i++) {
+      if (shProg->_LinkedShaders[i] != NULL) {
+         _mesa_delete_shader(ctx, shProg->_LinkedShaders[i]);
+         shProg->_LinkedShaders[i] = NULL;
+      }
+   }
+}
+
+
+void *
+_mesa_serialize_program_binary(struct gl_context *ctx,
+                               struct gl_shader_program *shProg,
+                               size_t *size)
+{
+   struct program_binary_header hdr;
+   struct blob *blob;
+   uint8_t *binary;
+
+   blob = serialize_payload(ctx, shProg);
+   if (blob == NULL)
+      return NULL;
+
+   binary = malloc(sizeof(hdr) + blob->size);
+   if (binary != NULL) {
+      _mesa_get_program_binary_build_sha1(ctx, hdr.build_sha1);
+      _mesa_sha1_compute(blob->data, blob->size, hdr.payload_sha1);
+      hdr.payload_size = blob->size;
+
+      memcpy(binary, &hdr, sizeof(hdr));
+      memcpy(binary + sizeof(hdr), blob->data, blob->size);
+      *size = sizeof(hdr) + blob->size;
+   }
+
+   ralloc_free(blob);
+
+   return binary;
+}
+
+
+GLboolean
+_mesa_deserialize_program_binary(struct gl_context *ctx,
+                                 struct gl_shader_program *shProg,
+                                 const void *binary, size_t size)
+{
+   struct program_binary_header hdr;
+   uint8_t build_sha1[20], payload_sha1[20];
+   uint8_t *payload;
+
+   clear_linked_program(ctx, shProg);
+   shProg->LinkStatus = GL_FALSE;
+   shProg->Validated = GL_FALSE;
+   shProg->_Used = GL_FALSE;
+
+   if (size < sizeof(hdr)) {
+      ralloc_strcat(&shProg->InfoLog, "Invalid program binary.\n");
+      return GL_FALSE;
+   }
+
+   memcpy(&hdr, binary, sizeof(hdr));
+   _mesa_get_program_binary_build_sha1(ctx, build_sha1);
+   if (memcmp(hdr.build_sha1, build_sha1, sizeof(build_sha1)) != 0 ||
+       hdr.payload_size != size - sizeof(hdr)) {
+      ralloc_strcat(&shProg->InfoLog,
+                    "Program binary was not created by this driver.\n");
+      return GL_FALSE;
+   }
+
+   /* Copy the payload out of the caller's buffer, which carries no
+    * alignment guarantees and which we must not read more than once.
+    */
+   payload = malloc(MAX2(hdr.payload_size, 1));
+   if (payload == NULL) {
+      ralloc_strcat(&shProg->InfoLog, "Out of memory.\n");
+      return GL_FALSE;
+   }
+   memcpy(payload, (const uint8_t *) binary + sizeof(hdr), hdr.payload_size);
+
+   _mesa_sha1_compute(payload, hdr.payload_size, payload_sha1);
+   if (memcmp(hdr.payload_sha1, payload_sha1, sizeof(payload_sha1)) != 0 ||
+       !deserialize_payload(ctx, shProg, payload, hdr.payload_size)) {
+      clear_linked_program(ctx, shProg);
+      ralloc_strcat(&shProg->InfoLog, "Program binary is corrupt.\n");
+      free(payload);
+      return GL_FALSE;
+   }
+
+   free(payload);
+   shProg->LinkStatus = GL_TRUE;
+
+   return GL_TRUE;
+}
+
+#endif /* HAVE_SHA1 */
+
+
+GLsizei
+_mesa_get_program_binary_length(struct gl_context *ctx,
+                                struct gl_shader_program *shProg)
+{
+#ifdef HAVE_SHA1
+   struct blob *blob;
+   GLsizei length;
+
+   if (!shProg->LinkStatus || ctx->Const.NumProgramBinaryFormats == 0)
+      return 0;
+
+   blob = serialize_payload(ctx, shProg);
+   if (blob == NULL)
+      return 0;
+
+   length = sizeof(struct program_binary_header) + blob->size;
+   ralloc_free(blob);
+
+   return length;
+#else
+   (void) ctx;
+   (void) shProg;
+   return 0;
+#endif
+}
+
+
+void
+_mesa_get_program_binary(struct gl_context *ctx,
+                         struct gl_shader_program *shProg,
+                         GLsizei buf_size, GLsizei *length,
+                         GLenum *binary_format, GLvoid *binary)
+{
+#ifdef HAVE_SHA1
+   void *data;
+   size_t size;
+
+   *length = 0;
+
+   data = _mesa_serialize_program_binary(ctx, shProg, &size);
+   if (data == NULL) {
+      _mesa_error(ctx, GL_OUT_OF_MEMORY, "glGetProgramBinary");
+      return;
+   }
+
+   /* The ARB_get_program_binary spec says:
+    *
+    *     "If <bufSize> is less than the number of bytes in the binary, then
+    *     an INVALID_OPERATION error is thrown."
+    */
+   if (size > (size_t) buf_size) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(buffer too small)");
+      free(data);
+      return;
+   }
+
+   memcpy(binary, data, size);
+   *length = size;
+   *binary_format = GL_PROGRAM_BINARY_FORMAT_MESA;
+
+   free(data);
+#else
+   /* No formats are advertised without SHA-1 support. */
+   (void) ctx;
+   (void) shProg;
+   (void) buf_size;
+   (void) binary_format;
+   (void) binary;
+   *length = 0;
+#endif
+}
+
+
+void
+_mesa_program_binary(struct gl_context *ctx, struct gl_shader_program *shProg,
+                     GLenum binary_format, const GLvoid *binary,
+                     GLsizei length)
+{
+#ifdef HAVE_SHA1
+   assert(binary_format == GL_PROGRAM_BINARY_FORMAT_MESA);
+   (void) binary_format;
+
+   /* This mirrors the checks glLinkProgram does before throwing the old
+    * link results away.
+    */
+   if (_mesa_transform_feedback_is_using_program(ctx, shProg)) {
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glProgramBinary(transform feedback active)");
+      return;
+   }
+
+   FLUSH_VERTICES(ctx, _NEW_PROGRAM);
+
+   /* The ARB_get_program_binary spec says:
+    *
+    *     "Loading the program binary will fail, setting the LINK_STATUS of
+    *     <program> to FALSE, if these conditions are not met."
+    *
+    * A binary from another build or driver, or one that got corrupted on
+    * its way back to us, fails the same way and without any GL error.
+    */
+   _mesa_deserialize_program_binary(ctx, shProg, binary, length);
+#else
+   (void) ctx;
+   (void) binary_format;
+   (void) binary;
+   (void) length;
+   shProg->LinkStatus = GL_FALSE;
+#endif
+}
@@ -0,0 +1,93 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * \file program_binary.h
+ * GL_ARB_get_program_binary / GL_OES_get_program_binary support.
+ */
+
+#ifndef PROGRAM_BINARY_H
+#define PROGRAM_BINARY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "glheader.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct gl_context;
+struct gl_shader_program;
+
+/**
+ * \name Helpers for the shader cache; only available with HAVE_SHA1.
+ */
+/*@{*/
+extern void
+_mesa_get_program_binary_build_sha1(struct gl_context *ctx, uint8_t sha1[20]);
+
+/**
+ * Serialize the linked \p shProg into a malloc'ed program binary.
+ */
+extern void *
+_mesa_serialize_program_binary(struct gl_context *ctx,
+                               struct gl_shader_program *shProg,
+                               size_t *size);
+
+/**
+ * Replace the link results of \p shProg with those stored in \p binary.
+ * Failures only set LinkStatus to false and explain why in the info log.
+ */
+extern GLboolean
+_mesa_deserialize_program_binary(struct gl_context *ctx,
+                                 struct gl_shader_program *shProg,
+                                 const void *binary, size_t size);
+/*@}*/
+
+extern GLsizei
+_mesa_get_program_binary_length(struct gl_context *ctx,
+                                struct gl_shader_program *shProg);
+
+extern void
+_mesa_get_program_binary(struct gl_context *ctx,
+                         struct gl_shader_program *shProg,
+                         GLsizei buf_size, GLsizei *length,
+                         GLenum *binary_format, GLvoid *binary);
+
+extern void
+_mesa_program_binary(struct gl_context *ctx, struct gl_shader_program *shProg,
+                     GLenum binary_format, const GLvoid *binary,
+                     GLsizei length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PROGRAM_BINARY_H */
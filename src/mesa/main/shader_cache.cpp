@@ -0,0 +1,339 @@
+/**************************************************************************
+ *
+ * Copyright 2016 VMware, Inc.
+ * All Rights Reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+ * ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ **************************************************************************/
+
+
+/**
+ * \file shader_cache.cpp
+ * Transparent on-disk cache of compiled shaders and linked programs.
+ *
+ * glCompileShader hashes the shader source together with everything in
+ * the context that affects compilation.  If the resulting key was recorded
+ * by an earlier successful compile (possibly in another process), the
+ * compile is skipped and the shader is marked \c CompileDeferred.
+ *
+ * glLinkProgram hashes the keys of the attached shaders and the state the
+ * linker consumes (attribute and fragment data bindings, transform
+ * feedback varyings, separability) and looks the result up in the cache.
+ * A hit is a program binary (see main/program_binary.c) that is loaded in
+ * place of linking.  On a miss, deferred shaders are compiled for real,
+ * the program is linked and its binary is stored for next time.
+ *
+ * Binaries carry the build and driver SHA-1 of program_binary.c, so stale
+ * entries fail to load; they are then removed and the program is linked
+ * normally.  See util/disk_cache.h for the environment variables that
+ * control the cache location, size and statistics.
+ */
+
+#include "main/context.h"
+#include "main/core.h"
+#include "main/program_binary.h"
+#include "main/shader_cache.h"
+#include "compiler/glsl/program.h"
+#include "program/hash_table.h"
+#include "program/ir_to_mesa.h"
+#include "util/ralloc.h"
+
+#ifdef ENABLE_SHADER_CACHE
+#include "util/disk_cache.h"
+#include "util/mesa-sha1.h"
+
+
+/** Debug flags under which compiling or linking must really happen. */
+#define SHADER_CACHE_BYPASS_FLAGS (GLSL_DUMP | GLSL_LOG | GLSL_OPT | \
+                                   GLSL_NO_OPT | GLSL_NOP_VERT |        \
+                                   GLSL_NOP_FRAG | GLSL_OPT_STATS)
+
+static struct disk_cache *
+get_cache(struct gl_context *ctx)
+{
+   if (ctx->_Shader->Flags & SHADER_CACHE_BYPASS_FLAGS)
+      return NULL;
+
+   if (!ctx->ShaderCacheInitialized) {
+      ctx->ShaderCacheInitialized = GL_TRUE;
+
+      /* Restoring programs needs the driver's program binary support. */
+      if (ctx->Const.NumProgramBinaryFormats > 0)
+         ctx->ShaderCache = disk_cache_create();
+   }
+
+   return ctx->ShaderCache;
+}
+
+
+/**
+ * Hash the build, the driver and the context state that compiling and
+ * linking depend on.  This is the SHA-1 program binaries carry, so a cache
+ * entry is only found when its binary would also be accepted.
+ */
+static void
+update_context_sha1(struct mesa_sha1 *sha_ctx, struct gl_context *ctx)
+{
+   unsigned char build_sha1[20];
+
+   _mesa_get_program_binary_build_sha1(ctx, build_sha1);
+   _mesa_sha1_update(sha_ctx, build_sha1, sizeof(build_sha1));
+}
+
+
+static bool
+compute_shader_key(struct gl_context *ctx, struct gl_shader *sh,
+                   unsigned char key[20])
+{
+   struct mesa_sha1 *sha_ctx = _mesa_sha1_init();
+   const uint32_t stage = sh->Stage;
+
+   if (sha_ctx == NULL)
+      return false;
+
+   _mesa_sha1_update(sha_ctx, "shader", 6);
+   update_context_sha1(sha_ctx, ctx);
+   _mesa_sha1_update(sha_ctx, &stage, sizeof(stage));
+   _mesa_sha1_update(sha_ctx, sh->Source, strlen(sh->Source));
+   _mesa_sha1_final(sha_ctx, key);
+
+   return true;
+}
+
+
+static void
+xor_binding_sha1(const char *name, unsigned value, void *closure)
+{
+   unsigned char *digest = (unsigned char *) closure;
+   unsigned char sha1[20];
+   char *str = ralloc_asprintf(NULL, "%s=%u", name, value);
+
+   _mesa_sha1_compute(str, strlen(str), sha1);
+   for (unsigned i = 0; i < sizeof(sha1); i++)
+      digest[i] ^= sha1[i];
+
+   ralloc_free(str);
+}
+
+/**
+ * Hash a string_to_uint_map.  Iteration order is not defined, so the
+ * entries are hashed one by one and combined with xor.
+ */
+static void
+update_bindings_sha1(struct mesa_sha1 *sha_ctx, string_to_uint_map *map)
+{
+   unsigned char digest[20] = { 0 };
+
+   if (map)
+      map->iterate(xor_binding_sha1, digest);
+
+   _mesa_sha1_update(sha_ctx, digest, sizeof(digest));
+}
+
+
+static bool
+compute_program_key(struct gl_context *ctx, struct gl_shader_program *shProg,
+                    unsigned char key[20])
+{
+   static const unsigned char no_key[20] = { 0 };
+   struct mesa_sha1 *sha_ctx;
+   uint32_t n;
+
+   if (shProg->NumShaders == 0)
+      return false;
+
+   /* Shaders compiled while the cache was not in use have no key; those
+    * that failed to compile make the link fail anyway.
+    */
+   for (unsigned i = 0; i < shProg->NumShaders; i++) {
+      const struct gl_shader *sh = shProg->Shaders[i];
+
+      if (!sh->CompileStatus || memcmp(sh->sha1, no_key, sizeof(no_key)) == 0)
+         return false;
+   }
+
+   sha_ctx = _mesa_sha1_init();
+   if (sha_ctx == NULL)
+      return false;
+
+   _mesa_sha1_update(sha_ctx, "program", 7);
+   update_context_sha1(sha_ctx, ctx);
+
+   /* The order of attachment is significant to the linker (e.g. for
+    * which shader's main() is used), so keep it.
+    */
+   for (unsigned i = 0; i < shProg->NumShaders; i++)
+      _mesa_sha1_update(sha_ctx, shProg->Shaders[i]->sha1, 20);
+
+   _mesa_sha1_update(sha_ctx, &shProg->SeparateShader,
+                     sizeof(shProg->SeparateShader));
+
+   update_bindings_sha1(sha_ctx, shProg->AttributeBindings);
+   update_bindings_sha1(sha_ctx, shProg->FragDataBindings);
+   update_bindings_sha1(sha_ctx, shProg->FragDataIndexBindings);
+
+   n = shProg->TransformFeedback.BufferMode;
+   _mesa_sha1_update(sha_ctx, &n, sizeof(n));
+   n = shProg->TransformFeedback.NumVarying;
+   _mesa_sha1_update(sha_ctx, &n, sizeof(n));
+   for (unsigned i = 0; i < shProg->TransformFeedback.NumVarying; i++) {
+      const char *name = shProg->TransformFeedback.VaryingNames[i];
+      _mesa_sha1_update(sha_ctx, name, strlen(name) + 1);
+   }
+
+   _mesa_sha1_final(sha_ctx, key);
+
+   return true;
+}
+
+
+/**
+ * Compile the attached shaders whose compilation was skipped, from the
+ * source they had when glCompileShader was called.
+ */
+static void
+compile_deferred_shaders(struct gl_context *ctx,
+                         struct gl_shader_program *shProg)
+{
+   for (unsigned i = 0; i < shProg->NumShaders; i++) {
+      struct gl_shader *sh = shProg->Shaders[i];
+      const GLchar *source;
+
+      /* glShaderSource clears both, leaving the link to fail as usual. */
+      if (!sh->CompileDeferred || !sh->CompileStatus)
+         continue;
+
+      source = sh->Source;
+      sh->Source = sh->DeferredSource;
+      _mesa_glsl_compile_shader(ctx, sh, false, false);
+      sh->Source = source;
+
+      sh->CompileDeferred = false;
+      ralloc_free(sh->DeferredSource);
+      sh->DeferredSource = NULL;
+   }
+}
+
+#endif /* ENABLE_SHADER_CACHE */
+
+
+/**
+ * glCompileShader through the shader cache.
+ */
+void
+_mesa_shader_cache_compile_shader(struct gl_context *ctx,
+                                  struct gl_shader *sh)
+{
+#ifdef ENABLE_SHADER_CACHE
+   struct disk_cache *cache = get_cache(ctx);
+
+   sh->CompileDeferred = false;
+   ralloc_free(sh->DeferredSource);
+   sh->DeferredSource = NULL;
+   memset(sh->sha1, 0, sizeof(sh->sha1));
+
+   if (cache && compute_shader_key(ctx, sh, sh->sha1)) {
+      if (disk_cache_has_key(cache, sh->sha1))
+         sh->DeferredSource = ralloc_strdup(sh, sh->Source);
+
+      if (sh->DeferredSource) {
+         /* This source compiled successfully before.  Drop the results of
+          * any earlier compile and wait for a link that misses the cache
+          * before doing the work.
+          */
+         ralloc_free(sh->ir);
+         sh->ir = NULL;
+         sh->symbols = NULL;
+         ralloc_free(sh->InfoLog);
+         sh->InfoLog = ralloc_strdup(sh, "");
+         sh->CompileStatus = GL_TRUE;
+         sh->CompileDeferred = true;
+         return;
+      }
+
+      _mesa_glsl_compile_shader(ctx, sh, false, false);
+
+      if (sh->CompileStatus)
+         disk_cache_put_key(cache, sh->sha1);
+      return;
+   }
+#endif
+
+   _mesa_glsl_compile_shader(ctx, sh, false, false);
+}
+
+
+/**
+ * glLinkProgram through the shader cache.
+ */
+void
+_mesa_shader_cache_link_program(struct gl_context *ctx,
+                                struct gl_shader_program *shProg)
+{
+#ifdef ENABLE_SHADER_CACHE
+   struct disk_cache *cache = get_cache(ctx);
+   unsigned char key[20];
+   bool cacheable = cache && compute_program_key(ctx, shProg, key);
+   void *binary;
+   size_t size;
+
+   if (cacheable) {
+      binary = disk_cache_get(cache, key, &size);
+      if (binary) {
+         GLboolean loaded =
+            _mesa_deserialize_program_binary(ctx, shProg, binary, size);
+
+         free(binary);
+         if (loaded)
+            return;
+
+         /* Written by another build or driver, or damaged. */
+         disk_cache_remove(cache, key);
+      }
+   }
+
+   compile_deferred_shaders(ctx, shProg);
+#endif
+
+   _mesa_glsl_link_shader(ctx, shProg);
+
+#ifdef ENABLE_SHADER_CACHE
+   if (cacheable && shProg->LinkStatus) {
+      binary = _mesa_serialize_program_binary(ctx, shProg, &size);
+      if (binary) {
+         disk_cache_put(cache, key, binary, size);
+         free(binary);
+      }
+   }
+#endif
+}
+
+
+void
+_mesa_shader_cache_destroy(struct gl_context *ctx)
+{
+#ifdef ENABLE_SHADER_CACHE
+   disk_cache_destroy(ctx->ShaderCache);
+#endif
+   ctx->ShaderCache = NULL;
+   ctx->ShaderCacheInitialized = GL_FALSE;
+}
@@ -1426,6 +1426,10 @@ validate_io(const struct gl_shader *producer,
    if (!isES)
       return true;
 
+   /* Programs loaded with glProgramBinary carry no IR to match against. */
+   if (producer->ir == NULL || consumer->ir == NULL)
+      return true;
+
    /* For each output in a, find input in b and do any required checks. */
    foreach_in_list(ir_instruction, out, producer->ir) {
       ir_variable *out_var = out->as_variable();
@@ -45,6 +45,8 @@
 #include "main/hash.h"
 #include "main/mtypes.h"
 #include "main/pipelineobj.h"
+#include "main/program_binary.h"
+#include "main/shader_cache.h"
 #include "main/shaderapi.h"
 #include "main/shaderobj.h"
 #include "main/transformfeedback.h"
@@ -91,6 +93,8 @@ _mesa_get_shader_flags(void)
          flags |= GLSL_USE_PROG;
       if (strstr(env, "errors"))
          flags |= GLSL_REPORT_ERRORS;
+      if (strstr(env, "stats"))
+         flags |= GLSL_OPT_STATS;
    }
 
    return flags;
@@ -122,6 +126,9 @@ _mesa_init_shader_state(struct gl_context *ctx)
    if (ctx->Shader.Flags != 0)
       ctx->Const.GenerateTemporaryNames = true;
 
+   if (ctx->Shader.Flags & GLSL_OPT_STATS)
+      ctx->OptStats = _mesa_glsl_opt_stats_create();
+
    /* Extended for ARB_separate_shader_objects */
    ctx->Shader.RefCount = 1;
    mtx_init(&ctx->Shader.Mutex, mtx_plain);
@@ -154,6 +161,14 @@ _mesa_free_shader_state(struct gl_context *ctx)
 
    assert(ctx->Shader.RefCount == 1);
    mtx_destroy(&ctx->Shader.Mutex);
+
+   _mesa_shader_cache_destroy(ctx);
+
+   if (ctx->OptStats) {
+      _mesa_glsl_opt_stats_print(stderr, ctx->OptStats);
+      _mesa_glsl_opt_stats_destroy(ctx->OptStats);
+      ctx->OptStats = NULL;
+   }
 }
 
 
@@ -755,7 +770,7 @@ get_programiv(struct gl_context *ctx, GLuint program, GLenum pname,
       *params = shProg->BinaryRetreivableHint;
       return;
    case GL_PROGRAM_BINARY_LENGTH:
-      *params = 0;
+      *params = _mesa_get_program_binary_length(ctx, shProg);
       return;
    case GL_ACTIVE_ATOMIC_COUNTER_BUFFERS:
       if (!ctx->Extensions.ARB_shader_atomic_counters)
@@ -950,6 +965,12 @@ shader_source(struct gl_shader *sh, const GLchar *source)
    free((void *)sh->Source);
    sh->Source = source;
    sh->CompileStatus = GL_FALSE;
+   /* A compile skipped by the shader cache was for the old source, which
+    * no longer counts as compiled.
+    */
+   sh->CompileDeferred = false;
+   ralloc_free(sh->DeferredSource);
+   sh->DeferredSource = NULL;
 #ifdef DEBUG
    sh->SourceChecksum = _mesa_str_checksum(sh->Source);
 #endif
@@ -983,7 +1004,7 @@ compile_shader(struct gl_context *ctx, GLuint shaderObj)
       /* this call will set the shader->CompileStatus field to indicate if
        * compilation was successful.
        */
-      _mesa_glsl_compile_shader(ctx, sh, false, false);
+      _mesa_shader_cache_compile_shader(ctx, sh);
 
       if (ctx->_Shader->Flags & GLSL_LOG) {
          _mesa_write_shader_to_file(sh);
@@ -1045,7 +1066,7 @@ link_program(struct gl_context *ctx, GLuint program)
 
    FLUSH_VERTICES(ctx, _NEW_PROGRAM);
 
-   _mesa_glsl_link_shader(ctx, shProg);
+   _mesa_shader_cache_link_program(ctx, shProg);
 
    if (shProg->LinkStatus == GL_FALSE &&
        (ctx->_Shader->Flags & GLSL_REPORT_ERRORS)) {
@@ -1933,12 +1954,15 @@ _mesa_GetProgramBinary(GLuint program, GLsizei bufSize, GLsizei *length,
       return;
    }
 
-   *length = 0;
-   _mesa_error(ctx, GL_INVALID_OPERATION,
-               "glGetProgramBinary(driver supports zero binary formats)");
+   if (ctx->Const.NumProgramBinaryFormats == 0) {
+      *length = 0;
+      _mesa_error(ctx, GL_INVALID_OPERATION,
+                  "glGetProgramBinary(driver supports zero binary formats)");
+      return;
+   }
 
-   (void) binaryFormat;
-   (void) binary;
+   _mesa_get_program_binary(ctx, shProg, bufSize, length, binaryFormat,
+                            binary);
 }
 
 void GLAPIENTRY
@@ -1952,9 +1976,6 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
    if (!shProg)
       return;
 
-   (void) binaryFormat;
-   (void) binary;
-
    /* Section 2.3.1 (Errors) of the OpenGL 4.5 spec says:
     *
     *     "If a negative number is provided where an argument of type sizei or
@@ -1974,11 +1995,18 @@ _mesa_ProgramBinary(GLuint program, GLenum binaryFormat,
     *     setting the LINK_STATUS of <program> to FALSE, if these conditions
     *     are not met."
     *
-    * Since any value of binaryFormat passed "is not one of those specified as
-    * allowable for [this] command, an INVALID_ENUM error is generated."
+    * Any value of binaryFormat other than the one we advertise "is not one
+    * of those specified as allowable for [this] command, [so] an
+    * INVALID_ENUM error is generated."
     */
-   shProg->LinkStatus = GL_FALSE;
-   _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+   if (ctx->Const.NumProgramBinaryFormats == 0 ||
+       binaryFormat != GL_PROGRAM_BINARY_FORMAT_MESA) {
+      shProg->LinkStatus = GL_FALSE;
+      _mesa_error(ctx, GL_INVALID_ENUM, "glProgramBinary");
+      return;
+   }
+
+   _mesa_program_binary(ctx, shProg, binaryFormat, binary, length);
 }
 
 
@@ -0,0 +1,310 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/**
+ * \file program_binary.cpp
+ *
+ * Link a small program with the classic GLSL path and check that
+ *
+ *  - serialize_glsl_program / deserialize_glsl_program give back the same
+ *    uniforms, blocks and program resources, and
+ *
+ *  - damaged binaries and binaries from another build are rejected by
+ *    glProgramBinary with LINK_STATUS false and no GL error.
+ */
+
+#include <gtest/gtest.h>
+
+#include "GL/gl.h"
+#include "GL/glext.h"
+#include "main/compiler.h"
+#include "main/context.h"
+#include "main/program_binary.h"
+#include "main/shaderapi.h"
+#include "main/shaderobj.h"
+#include "compiler/glsl/blob.h"
+#include "compiler/glsl/ir_uniform.h"
+#include "compiler/glsl/program.h"
+#include "compiler/glsl/serialize.h"
+#include "program/ir_to_mesa.h"
+#include "util/ralloc.h"
+#include "drivers/common/driverfuncs.h"
+#include "vbo/vbo.h"
+
+static const char vs_source[] =
+   "#version 120\n"
+   "#extension GL_ARB_uniform_buffer_object : require\n"
+   "layout(std140) uniform Light {\n"
+   "   vec4 light_color;\n"
+   "   float light_intensity;\n"
+   "};\n"
+   "uniform mat4 mvp;\n"
+   "uniform vec4 offsets[3];\n"
+   "attribute vec4 pos;\n"
+   "varying vec4 color;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_Position = mvp * pos + offsets[int(pos.w)];\n"
+   "   color = light_color * light_intensity;\n"
+   "}\n";
+
+static const char fs_source[] =
+   "#version 120\n"
+   "uniform sampler2D tex;\n"
+   "varying vec4 color;\n"
+   "void main()\n"
+   "{\n"
+   "   gl_FragColor = color * texture2D(tex, gl_PointCoord);\n"
+   "}\n";
+
+class program_binary : public ::testing::Test {
+public:
+   virtual void SetUp();
+   virtual void TearDown();
+
+   void attach_shader(GLenum type, const char *source);
+   void *get_binary(size_t *size);
+   void load_binary(const void *binary, size_t size);
+
+   struct gl_config visual;
+   struct dd_function_table driver_functions;
+   struct gl_context ctx;
+   struct gl_shader_program *prog;
+   struct gl_shader_program *loaded;
+};
+
+void
+program_binary::SetUp()
+{
+   memset(&visual, 0, sizeof(visual));
+   memset(&driver_functions, 0, sizeof(driver_functions));
+   memset(&ctx, 0, sizeof(ctx));
+
+   _mesa_init_driver_functions(&driver_functions);
+   _mesa_initialize_context(&ctx, API_OPENGL_COMPAT, &visual, NULL,
+                            &driver_functions);
+   _vbo_CreateContext(&ctx);
+
+   ctx.Version = 21;
+   ctx.Extensions.ARB_vertex_shader = true;
+   ctx.Extensions.ARB_fragment_shader = true;
+   ctx.Extensions.ARB_uniform_buffer_object = true;
+   ctx.Const.NumProgramBinaryFormats = 1;
+
+   prog = _mesa_new_shader_program(0);
+   attach_shader(GL_VERTEX_SHADER, vs_source);
+   attach_shader(GL_FRAGMENT_SHADER, fs_source);
+   _mesa_glsl_link_shader(&ctx, prog);
+   ASSERT_TRUE(prog->LinkStatus) << prog->InfoLog;
+
+   loaded = _mesa_new_shader_program(0);
+}
+
+void
+program_binary::TearDown()
+{
+   _mesa_delete_shader_program(&ctx, loaded);
+   _mesa_delete_shader_program(&ctx, prog);
+   _vbo_DestroyContext(&ctx);
+   _mesa_free_context_data(&ctx);
+}
+
+void
+program_binary::attach_shader(GLenum type, const char *source)
+{
+   struct gl_shader *sh = _mesa_new_shader(&ctx, 0, type);
+
+   sh->Source = strdup(source);
+   _mesa_glsl_compile_shader(&ctx, sh, false, false);
+   ASSERT_TRUE(sh->CompileStatus) << sh->InfoLog;
+
+   prog->Shaders = (struct gl_shader **)
+      realloc(prog->Shaders, (prog->NumShaders + 1) * sizeof(sh));
+   prog->Shaders[prog->NumShaders++] = sh;
+}
+
+void *
+program_binary::get_binary(size_t *size)
+{
+   void *binary = _mesa_serialize_program_binary(&ctx, prog, size);
+
+   EXPECT_TRUE(binary != NULL);
+   return binary;
+}
+
+void
+program_binary::load_binary(const void *binary, size_t size)
+{
+   _mesa_program_binary(&ctx, loaded, GL_PROGRAM_BINARY_FORMAT_MESA,
+                        binary, size);
+}
+
+static const char *
+resource_name(struct gl_program_resource *res)
+{
+   const char *name = _mesa_program_resource_name(res);
+
+   return name ? name : "";
+}
+
+TEST_F(program_binary, serialize_glsl_program)
+{
+   struct blob *blob = blob_create(NULL);
+   struct blob_reader reader;
+
+   serialize_glsl_program(blob, &ctx, prog);
+
+   blob_reader_init(&reader, blob->data, blob->size);
+   ASSERT_TRUE(deserialize_glsl_program(&reader, &ctx, loaded));
+   EXPECT_FALSE(reader.overrun);
+   EXPECT_EQ(reader.end, reader.current);
+
+   /* mvp, offsets, tex, light_color and light_intensity */
+   EXPECT_EQ(5u, prog->NumUniformStorage);
+   ASSERT_EQ(prog->NumUniformStorage, loaded->NumUniformStorage);
+   for (unsigned i = 0; i < prog->NumUniformStorage; i++) {
+      const struct gl_uniform_storage *a = &prog->UniformStorage[i];
+      const struct gl_uniform_storage *b = &loaded->UniformStorage[i];
+
+      EXPECT_STREQ(a->name, b->name);
+      EXPECT_EQ(a->type, b->type) << a->name;
+      EXPECT_EQ(a->array_elements, b->array_elements) << a->name;
+      EXPECT_EQ(a->block_index, b->block_index) << a->name;
+      EXPECT_EQ(a->offset, b->offset) << a->name;
+      EXPECT_EQ(a->storage - prog->UniformDataSlots,
+                b->storage - loaded->UniformDataSlots) << a->name;
+   }
+
+   ASSERT_EQ(prog->NumUniformRemapTable, loaded->NumUniformRemapTable);
+   for (unsigned i = 0; i < prog->NumUniformRemapTable; i++) {
+      EXPECT_EQ(prog->UniformRemapTable[i] - prog->UniformStorage,
+                loaded->UniformRemapTable[i] - loaded->UniformStorage);
+   }
+
+   EXPECT_EQ(1u, prog->NumUniformBlocks);
+   ASSERT_EQ(prog->NumBufferInterfaceBlocks,
+             loaded->NumBufferInterfaceBlocks);
+   ASSERT_EQ(prog->NumUniformBlocks, loaded->NumUniformBlocks);
+   for (unsigned i = 0; i < prog->NumUniformBlocks; i++) {
+      const struct gl_uniform_block *a = prog->UniformBlocks[i];
+      const struct gl_uniform_block *b = loaded->UniformBlocks[i];
+
+      EXPECT_STREQ(a->Name, b->Name);
+      EXPECT_EQ(a->NumUniforms, b->NumUniforms) << a->Name;
+      EXPECT_EQ(a->UniformBufferSize, b->UniformBufferSize) << a->Name;
+   }
+
+   ASSERT_EQ(prog->NumProgramResourceList, loaded->NumProgramResourceList);
+   for (unsigned i = 0; i < prog->NumProgramResourceList; i++) {
+      struct gl_program_resource *a = &prog->ProgramResourceList[i];
+      struct gl_program_resource *b = &loaded->ProgramResourceList[i];
+
+      EXPECT_EQ(a->Type, b->Type) << resource_name(a);
+      EXPECT_EQ(a->StageReferences, b->StageReferences) << resource_name(a);
+      EXPECT_STREQ(resource_name(a), resource_name(b));
+   }
+
+   for (unsigned i = 0; i < MESA_SHADER_STAGES; i++) {
+      EXPECT_EQ(prog->_LinkedShaders[i] != NULL,
+                loaded->_LinkedShaders[i] != NULL);
+   }
+
+   ralloc_free(blob);
+}
+
+#ifdef HAVE_SHA1
+
+TEST_F(program_binary, round_trip)
+{
+   size_t size;
+   void *binary = get_binary(&size);
+
+   load_binary(binary, size);
+   EXPECT_TRUE(loaded->LinkStatus) << loaded->InfoLog;
+   EXPECT_EQ(GLenum(GL_NO_ERROR), ctx.ErrorValue);
+   EXPECT_EQ(prog->NumUniformStorage, loaded->NumUniformStorage);
+   EXPECT_TRUE(loaded->_LinkedShaders[MESA_SHADER_VERTEX] != NULL &&
+               loaded->_LinkedShaders[MESA_SHADER_VERTEX]->Program != NULL);
+
+   free(binary);
+}
+
+TEST_F(program_binary, truncated)
+{
+   size_t size;
+   void *binary = get_binary(&size);
+
+   /* Inside the payload, and inside the header. */
+   load_binary(binary, size - 1);
+   EXPECT_FALSE(loaded->LinkStatus);
+   EXPECT_EQ(GLenum(GL_NO_ERROR), ctx.ErrorValue);
+
+   load_binary(binary, 8);
+   EXPECT_FALSE(loaded->LinkStatus);
+   EXPECT_EQ(GLenum(GL_NO_ERROR), ctx.ErrorValue);
+
+   free(binary);
+}
+
+TEST_F(program_binary, corrupt_payload)
+{
+   size_t size;
+   uint8_t *binary = (uint8_t *) get_binary(&size);
+
+   binary[size - 1] ^= 0x01;
+   load_binary(binary, size);
+   EXPECT_FALSE(loaded->LinkStatus);
+   EXPECT_EQ(GLenum(GL_NO_ERROR), ctx.ErrorValue);
+
+   free(binary);
+}
+
+TEST_F(program_binary, other_build)
+{
+   size_t size;
+   uint8_t *binary = (uint8_t *) get_binary(&size);
+
+   /* The binary starts with the build SHA-1. */
+   binary[0] ^= 0x80;
+   load_binary(binary, size);
+   EXPECT_FALSE(loaded->LinkStatus);
+   EXPECT_EQ(GLenum(GL_NO_ERROR), ctx.ErrorValue);
+
+   free(binary);
+}
+
+TEST_F(program_binary, other_context_state)
+{
+   size_t size;
+   void *binary = get_binary(&size);
+
+   /* The compiler options are part of the build SHA-1 too. */
+   ctx.Const.ShaderCompilerOptions[MESA_SHADER_VERTEX].MaxIfDepth++;
+   load_binary(binary, size);
+   EXPECT_FALSE(loaded->LinkStatus);
+   EXPECT_EQ(GLenum(GL_NO_ERROR), ctx.ErrorValue);
+
+   free(binary);
+}
+
+#endif /* HAVE_SHA1 */
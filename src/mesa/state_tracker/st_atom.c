@@ -31,7 +31,9 @@
 #include "main/context.h"
 
 #include "pipe/p_defines.h"
+#include "util/u_math.h"
 #include "st_context.h"
+#include "st_debug.h"
 #include "st_atom.h"
 #include "st_program.h"
 #include "st_manager.h"
@@ -93,41 +95,91 @@ static const struct st_tracked_state *atoms[] =
 };
 
 
-void st_init_atoms( struct st_context *st )
+static uint64_t
+atom_bit(const struct st_tracked_state *atom)
 {
-   /* no-op */
+   unsigned i;
+
+   for (i = 0; i < ARRAY_SIZE(atoms); i++) {
+      if (atoms[i] == atom)
+         return BITFIELD64_BIT(i);
+   }
+
+   assert(0);
+   return 0;
 }
 
 
-void st_destroy_atoms( struct st_context *st )
+/**
+ * Build the tables mapping each _NEW_x and ST_NEW_x flag to the atoms
+ * which depend on it, so that st_validate_state() only visits the atoms
+ * of the flags which are actually set.
+ */
+void st_init_atoms( struct st_context *st )
 {
-   /* no-op */
-}
+   unsigned i, bit;
 
+   STATIC_ASSERT(ARRAY_SIZE(atoms) == ST_NUM_ATOMS);
 
+   for (i = 0; i < ARRAY_SIZE(atoms); i++) {
+      const struct st_tracked_state *atom = atoms[i];
+      GLbitfield mesa = atom->dirty.mesa;
+      uint64_t flags = atom->dirty.st;
 
-static bool
-check_state(const struct st_state_flags *a, const struct st_state_flags *b)
-{
-   return (a->mesa & b->mesa) || (a->st & b->st);
+      if (!(atom->dirty.mesa || atom->dirty.st) || !atom->update) {
+         printf("malformed atom %s\n", atom->name);
+         assert(0);
+      }
+
+      while (mesa) {
+         bit = u_bit_scan(&mesa);
+         st->atoms_for_mesa_flag[bit] |= BITFIELD64_BIT(i);
+      }
+      while (flags) {
+         bit = u_bit_scan64(&flags);
+         st->atoms_for_st_flag[bit] |= BITFIELD64_BIT(i);
+      }
+   }
+
+   st->pipeline_atoms[ST_PIPELINE_RENDER] = BITFIELD64_MASK(ST_NUM_ATOMS);
+   st->pipeline_atoms[ST_PIPELINE_CLEAR] = atom_bit(&st_update_framebuffer) |
+                                           atom_bit(&st_update_scissor);
+   st->pipeline_atoms[ST_PIPELINE_FRAMEBUFFER] =
+      atom_bit(&st_update_framebuffer);
 }
 
 
-static void
-accumulate_state(struct st_state_flags *a, const struct st_state_flags *b)
+void st_destroy_atoms( struct st_context *st )
 {
-   a->mesa |= b->mesa;
-   a->st |= b->st;
+#ifdef DEBUG
+   if (ST_DEBUG & DEBUG_ATOMS) {
+      unsigned i;
+
+      printf("st: state atom updates:\n");
+      for (i = 0; i < ARRAY_SIZE(atoms); i++)
+         printf("  %-28s %u\n", atoms[i]->name, st->atom_updates[i]);
+   }
+#endif
 }
 
 
-static void
-xor_states(struct st_state_flags *result,
-           const struct st_state_flags *a,
-           const struct st_state_flags *b)
+/**
+ * Return the mask of the atoms depending on any of the given flags.
+ */
+static uint64_t
+atoms_for_state(const struct st_context *st,
+                const struct st_state_flags *state)
 {
-   result->mesa = a->mesa ^ b->mesa;
-   result->st = a->st ^ b->st;
+   GLbitfield mesa = state->mesa;
+   uint64_t flags = state->st;
+   uint64_t mask = 0;
+
+   while (mesa)
+      mask |= st->atoms_for_mesa_flag[u_bit_scan(&mesa)];
+   while (flags)
+      mask |= st->atoms_for_st_flag[u_bit_scan64(&flags)];
+
+   return mask;
 }
 
 
@@ -178,10 +230,11 @@ static void check_attrib_edgeflag(struct st_context *st)
  * Update all derived state:
  */
 
-void st_validate_state( struct st_context *st )
+void st_validate_state( struct st_context *st, enum st_pipeline pipeline )
 {
    struct st_state_flags *state = &st->dirty;
-   GLuint i;
+   uint64_t pipeline_mask = st->pipeline_atoms[pipeline];
+   uint64_t dirty;
 
    /* Get Mesa driver state. */
    st->dirty.st |= st->ctx->NewDriverState;
@@ -193,60 +246,35 @@ void st_validate_state( struct st_context *st )
 
    st_manager_validate_framebuffers(st);
 
-   if (state->st == 0 && state->mesa == 0)
+   /* Turn the flags into the set of atoms to update.  The atoms the
+    * pipeline doesn't need stay pending until the next validation.
+    */
+   st->dirty_atoms |= atoms_for_state(st, state);
+   memset(state, 0, sizeof(*state));
+
+   dirty = st->dirty_atoms & pipeline_mask;
+   if (!dirty)
       return;
 
-   /*printf("%s %x/%x\n", __func__, state->mesa, state->st);*/
+   /*printf("%s %llx\n", __func__, (unsigned long long) dirty);*/
 
-#ifdef DEBUG
-   if (1) {
-#else
-   if (0) {
-#endif
-      /* Debug version which enforces various sanity checks on the
-       * state flags which are generated and checked to help ensure
-       * state atoms are ordered correctly in the list.
+   while (dirty) {
+      unsigned i = u_bit_scan64(&dirty);
+
+      atoms[i]->update( st );
+      st->atom_updates[i]++;
+      st->dirty_atoms &= ~BITFIELD64_BIT(i);
+
+      /* Atoms may flag more state, which must only be consumed by atoms
+       * later in the list.
        */
-      struct st_state_flags examined, prev;      
-      memset(&examined, 0, sizeof(examined));
-      prev = *state;
-
-      for (i = 0; i < ARRAY_SIZE(atoms); i++) {	 
-	 const struct st_tracked_state *atom = atoms[i];
-	 struct st_state_flags generated;
-	 
-	 /*printf("atom %s %x/%x\n", atom->name, atom->dirty.mesa, atom->dirty.st);*/
-
-	 if (!(atom->dirty.mesa || atom->dirty.st) ||
-	     !atom->update) {
-	    printf("malformed atom %s\n", atom->name);
-	    assert(0);
-	 }
-
-	 if (check_state(state, &atom->dirty)) {
-	    atoms[i]->update( st );
-	    /*printf("after: %x\n", atom->dirty.mesa);*/
-	 }
-
-	 accumulate_state(&examined, &atom->dirty);
-
-	 /* generated = (prev ^ state)
-	  * if (examined & generated)
-	  *     fail;
-	  */
-	 xor_states(&generated, &prev, state);
-	 assert(!check_state(&examined, &generated));
-	 prev = *state;
-      }
-      /*printf("\n");*/
+      if (state->mesa || state->st) {
+         uint64_t generated = atoms_for_state(st, state);
+         memset(state, 0, sizeof(*state));
 
-   }
-   else {
-      for (i = 0; i < ARRAY_SIZE(atoms); i++) {	 
-	 if (check_state(state, &atoms[i]->dirty))
-	    atoms[i]->update( st );
+         assert(!(generated & BITFIELD64_MASK(i + 1)));
+         st->dirty_atoms |= generated;
+         dirty |= generated & pipeline_mask;
       }
    }
-
-   memset(state, 0, sizeof(*state));
 }
@@ -39,11 +39,21 @@
 struct st_context;
 struct st_tracked_state;
 
+/**
+ * Which atoms st_validate_state() updates.  The others are left pending.
+ */
+enum st_pipeline {
+   ST_PIPELINE_RENDER,        /**< everything, for draws */
+   ST_PIPELINE_CLEAR,         /**< framebuffer and scissor, for clears */
+   ST_PIPELINE_FRAMEBUFFER,   /**< framebuffer only, for reads */
+   ST_NUM_PIPELINES
+};
+
 void st_init_atoms( struct st_context *st );
 void st_destroy_atoms( struct st_context *st );
 
 
-void st_validate_state( struct st_context *st );
+void st_validate_state( struct st_context *st, enum st_pipeline pipeline );
 
 
 extern const struct st_tracked_state st_update_array;
@@ -711,9 +711,11 @@ st_Bitmap(struct gl_context *ctx, GLint x, GLint y,
     * any non-_NEW_PROGRAM_CONSTANTS mesa flags are set.  The VS we use
     * for bitmap drawing uses no constants and the FS constants are
     * explicitly uploaded in the draw_bitmap_quad() function.
+    * Atoms left pending by a clear or read always need validation.
     */
-   if ((st->dirty.mesa & ~_NEW_PROGRAM_CONSTANTS) || st->dirty.st) {
-      st_validate_state(st);
+   if ((st->dirty.mesa & ~_NEW_PROGRAM_CONSTANTS) || st->dirty.st ||
+       st->dirty_atoms) {
+      st_validate_state(st, ST_PIPELINE_RENDER);
    }
 
    if (UseBitmapCache && accum_bitmap(ctx, x, y, width, height, unpack, bitmap))
@@ -294,4 +294,9 @@ st_init_program_functions(struct dd_function_table *functions)
    functions->ProgramStringNotify = st_program_string_notify;
    
    functions->LinkShader = st_link_shader;
+
+   functions->GetProgramBinaryDriverSHA1 = st_get_program_binary_driver_sha1;
+   functions->ProgramBinarySerializeDriverBlob = st_serialize_program_binary;
+   functions->ProgramBinaryDeserializeDriverBlob =
+      st_deserialize_program_binary;
 }
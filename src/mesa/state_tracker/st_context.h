@@ -32,6 +32,7 @@
 #include "pipe/p_state.h"
 #include "state_tracker/st_api.h"
 #include "main/fbobject.h"
+#include "st_atom.h"
 
 
 #ifdef __cplusplus
@@ -66,6 +67,10 @@ struct u_upload_mgr;
 #define ST_NEW_STORAGE_BUFFER          (1 << 13)
 
 
+/** Number of entries in st_atom.c's atoms[] */
+#define ST_NUM_ATOMS 44
+
+
 struct st_state_flags {
    GLbitfield mesa;  /**< Mask of _NEW_x flags */
    uint64_t st;      /**< Mask of ST_NEW_x flags */
@@ -154,6 +159,16 @@ struct st_context
 
    struct st_state_flags dirty;
 
+   /** Atoms depending on each _NEW_x and ST_NEW_x flag, see st_init_atoms() */
+   uint64_t atoms_for_mesa_flag[32];
+   uint64_t atoms_for_st_flag[64];
+   /** Atoms updated by each st_pipeline */
+   uint64_t pipeline_atoms[ST_NUM_PIPELINES];
+   /** Atoms whose state changed but which haven't been updated yet */
+   uint64_t dirty_atoms;
+   /** Number of times each atom was updated, for ST_DEBUG=atoms */
+   unsigned atom_updates[ST_NUM_ATOMS];
+
    GLboolean vertdata_edgeflags;
    GLboolean edgeflag_culls_prims;
 
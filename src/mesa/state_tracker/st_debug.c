@@ -58,6 +58,7 @@ static const struct debug_named_value st_debug_flags[] = {
    { "wf",       DEBUG_WIREFRAME, NULL },
    { "precompile",  DEBUG_PRECOMPILE, NULL },
    { "gremedy",  DEBUG_GREMEDY, "Enable GREMEDY debug extensions" },
+   { "atoms",    DEBUG_ATOMS, "Print how often each state atom was updated" },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -201,8 +201,8 @@ st_draw_vbo(struct gl_context *ctx,
    st_flush_bitmap_cache(st);
 
    /* Validate state. */
-   if (st->dirty.st || ctx->NewDriverState) {
-      st_validate_state(st);
+   if (st->dirty.st || st->dirty_atoms || ctx->NewDriverState) {
+      st_validate_state(st, ST_PIPELINE_RENDER);
 
 #if 0
       if (MESA_VERBOSE & VERBOSE_GLSL) {
@@ -314,8 +314,8 @@ st_indirect_draw_vbo(struct gl_context *ctx,
    assert(stride);
 
    /* Validate state. */
-   if (st->dirty.st || ctx->NewDriverState) {
-      st_validate_state(st);
+   if (st->dirty.st || st->dirty_atoms || ctx->NewDriverState) {
+      st_validate_state(st, ST_PIPELINE_RENDER);
    }
 
    if (st->vertex_array_out_of_memory) {
@@ -363,6 +363,13 @@ void st_init_limits(struct pipe_screen *screen,
       c->MaxShaderStorageBlockSize = 1 << 27;
       extensions->ARB_shader_storage_buffer_object = GL_TRUE;
    }
+
+#ifdef HAVE_SHA1
+   /* Program binaries carry the TGSI produced by glsl_to_tgsi and are
+    * identified with SHA-1 hashes (see main/program_binary.c).
+    */
+   c->NumProgramBinaryFormats = 1;
+#endif
 }
 
 
@@ -40,12 +40,15 @@
 
 #include "pipe/p_context.h"
 #include "pipe/p_defines.h"
+#include "pipe/p_screen.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
 #include "tgsi/tgsi_dump.h"
 #include "tgsi/tgsi_emulate.h"
 #include "tgsi/tgsi_parse.h"
 #include "tgsi/tgsi_ureg.h"
+#include "compiler/glsl/blob.h"
+#include "util/mesa-sha1.h"
 
 #include "st_debug.h"
 #include "st_cb_bitmap.h"
@@ -1617,3 +1620,159 @@ st_precompile_shader_variant(struct st_context *st,
       assert(0);
    }
 }
+
+
+/**
+ * Return the TGSI state of an st program, or NULL for program types the
+ * state tracker does not translate.
+ */
+static struct pipe_shader_state *
+st_program_tgsi_state(struct gl_program *prog)
+{
+   switch (prog->Target) {
+   case GL_VERTEX_PROGRAM_ARB:
+      return &((struct st_vertex_program *) prog)->tgsi;
+   case GL_TESS_CONTROL_PROGRAM_NV:
+      return &((struct st_tessctrl_program *) prog)->tgsi;
+   case GL_TESS_EVALUATION_PROGRAM_NV:
+      return &((struct st_tesseval_program *) prog)->tgsi;
+   case GL_GEOMETRY_PROGRAM_NV:
+      return &((struct st_geometry_program *) prog)->tgsi;
+   case GL_FRAGMENT_PROGRAM_ARB:
+      return &((struct st_fragment_program *) prog)->tgsi;
+   default:
+      return NULL;
+   }
+}
+
+
+/**
+ * Write what is needed to rebuild the variants of \p prog without going
+ * through glsl_to_tgsi again: the TGSI tokens, the stream output info and,
+ * for vertex programs, the input/output maps.
+ */
+void
+st_serialize_program_binary(struct gl_context *ctx, struct gl_program *prog,
+                            struct blob *blob)
+{
+   struct pipe_shader_state *tgsi = st_program_tgsi_state(prog);
+   unsigned num_tokens;
+
+   if (tgsi == NULL)
+      return;
+
+   num_tokens = tgsi->tokens ? tgsi_num_tokens(tgsi->tokens) : 0;
+   blob_write_uint32(blob, num_tokens);
+   if (num_tokens) {
+      blob_write_bytes(blob, tgsi->tokens,
+                       num_tokens * sizeof(struct tgsi_token));
+   }
+   blob_write_bytes(blob, &tgsi->stream_output,
+                    sizeof(tgsi->stream_output));
+
+   if (prog->Target == GL_VERTEX_PROGRAM_ARB) {
+      struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
+
+      blob_write_uint32(blob, stvp->num_inputs);
+      blob_write_bytes(blob, stvp->index_to_input,
+                       sizeof(stvp->index_to_input));
+      blob_write_bytes(blob, stvp->result_to_output,
+                       sizeof(stvp->result_to_output));
+   }
+}
+
+
+/**
+ * Counterpart of st_serialize_program_binary; \p prog is a freshly
+ * created program without any variants.
+ */
+GLboolean
+st_deserialize_program_binary(struct gl_context *ctx,
+                              struct gl_shader_program *shProg,
+                              struct gl_program *prog,
+                              struct blob_reader *blob)
+{
+   struct st_context *st = st_context(ctx);
+   struct pipe_shader_state *tgsi = st_program_tgsi_state(prog);
+   gl_shader_stage stage = _mesa_program_enum_to_shader_stage(prog->Target);
+   struct tgsi_token *tokens;
+   unsigned num_tokens;
+
+   if (tgsi == NULL)
+      return GL_TRUE;
+
+   assert(tgsi->tokens == NULL);
+
+   num_tokens = blob_read_uint32(blob);
+   if (blob->overrun || num_tokens == 0 ||
+       num_tokens > (blob->end - blob->current) / sizeof(struct tgsi_token))
+      return GL_FALSE;
+
+   tokens = tgsi_alloc_tokens(num_tokens);
+   if (tokens == NULL)
+      return GL_FALSE;
+
+   blob_copy_bytes(blob, (uint8_t *) tokens,
+                   num_tokens * sizeof(struct tgsi_token));
+   tgsi->tokens = tokens;
+   blob_copy_bytes(blob, (uint8_t *) &tgsi->stream_output,
+                   sizeof(tgsi->stream_output));
+
+   /*
+    * prog was just created by NewProgram, so it can't be bound yet and
+    * there is no state to flag dirty.
+    */
+   if (prog->Target == GL_VERTEX_PROGRAM_ARB) {
+      struct st_vertex_program *stvp = (struct st_vertex_program *) prog;
+
+      stvp->num_inputs = blob_read_uint32(blob);
+      blob_copy_bytes(blob, (uint8_t *) stvp->index_to_input,
+                      sizeof(stvp->index_to_input));
+      blob_copy_bytes(blob, (uint8_t *) stvp->result_to_output,
+                      sizeof(stvp->result_to_output));
+
+      if (stvp->num_inputs > PIPE_MAX_SHADER_INPUTS)
+         return GL_FALSE;
+   }
+
+   if (blob->overrun)
+      return GL_FALSE;
+
+   if (ST_DEBUG & DEBUG_PRECOMPILE ||
+       st->shader_has_one_variant[stage])
+      st_precompile_shader_variant(st, prog);
+
+   return GL_TRUE;
+}
+
+
+/**
+ * Identify the driver and the state tracker settings that affect the TGSI
+ * glsl_to_tgsi produces, so that program binaries are not loaded on a
+ * different driver.  The context limits, compiler options and extensions,
+ * which the driver and driconf pick, are hashed by
+ * _mesa_get_program_binary_build_sha1() itself.
+ */
+void
+st_get_program_binary_driver_sha1(struct gl_context *ctx, GLubyte *sha1)
+{
+   struct st_context *st = st_context(ctx);
+   struct pipe_screen *screen = st->pipe->screen;
+   struct mesa_sha1 *sha_ctx = _mesa_sha1_init();
+   const char *name = screen->get_name(screen);
+   const char *vendor = screen->get_vendor(screen);
+   const uint32_t caps[] = {
+      PIPE_SHADER_IR_TGSI,
+      st->needs_texcoord_semantic,
+   };
+
+   if (sha_ctx == NULL) {
+      memset(sha1, 0, 20);
+      return;
+   }
+
+   _mesa_sha1_update(sha_ctx, name, strlen(name));
+   _mesa_sha1_update(sha_ctx, vendor, strlen(vendor));
+   _mesa_sha1_update(sha_ctx, caps, sizeof(caps));
+   _mesa_sha1_final(sha_ctx, sha1);
+}
@@ -47,6 +47,9 @@ extern "C" {
 
 #define ST_DOUBLE_ATTRIB_PLACEHOLDER 0xffffffff
 
+struct blob;
+struct blob_reader;
+
 /** Fragment program variant key */
 struct st_fp_variant_key
 {
@@ -398,6 +401,19 @@ extern void
 st_precompile_shader_variant(struct st_context *st,
                              struct gl_program *prog);
 
+extern void
+st_serialize_program_binary(struct gl_context *ctx, struct gl_program *prog,
+                            struct blob *blob);
+
+extern GLboolean
+st_deserialize_program_binary(struct gl_context *ctx,
+                              struct gl_shader_program *shProg,
+                              struct gl_program *prog,
+                              struct blob_reader *blob);
+
+extern void
+st_get_program_binary_driver_sha1(struct gl_context *ctx, GLubyte *sha1);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,747 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef _WIN32
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pwd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "util/u_atomic.h"
+#include "util/ralloc.h"
+
+#include "disk_cache.h"
+
+/* Number of bits of a key used to find its slot in the key index. */
+#define CACHE_INDEX_KEY_BITS 16
+
+/* Number of slots of the key index. */
+#define CACHE_INDEX_MAX_KEYS (1 << CACHE_INDEX_KEY_BITS)
+
+/* Limit used when MESA_GLSL_CACHE_MAX_SIZE is not set. */
+#define CACHE_DEFAULT_MAX_SIZE (1024 * 1024 * 1024)
+
+/* Number of subdirectories items are spread over (named by the first byte
+ * of their key, in hex).
+ */
+#define CACHE_NUM_SUBDIRS 256
+
+struct disk_cache {
+   /* The root of the cache directory tree. */
+   char *path;
+
+   /* The index file, mapped shared: the total size of the items in the
+    * cache followed by the key table of disk_cache_put_key().  All
+    * processes using the same directory update it.
+    */
+   void *index_mmap;
+   size_t index_mmap_size;
+
+   /* Pointer to total size of all objects in cache (within index_mmap) */
+   uint64_t *size;
+
+   /* Pointer to stored keys, (within index_mmap). */
+   uint8_t *stored_keys;
+
+   /* Maximum size of all cached objects (in bytes). */
+   uint64_t max_size;
+
+   /* State of the generator picking subdirectories to evict from. */
+   uint32_t seed;
+
+   bool print_stats;
+   struct disk_cache_stats stats;
+};
+
+/* Create a directory named 'path' if it does not already exist.
+ *
+ * Returns: 0 if path already exists as a directory or if created.
+ *         -1 in all other cases.
+ */
+static int
+mkdir_if_needed(const char *path)
+{
+   struct stat sb;
+
+   /* If the path exists already, then our work is done if it's a
+    * directory, but it's an error if it is not.
+    */
+   if (stat(path, &sb) == 0) {
+      if (S_ISDIR(sb.st_mode)) {
+         return 0;
+      } else {
+         fprintf(stderr, "Cannot use %s for shader cache (not a directory)"
+                         "---disabling.\n", path);
+         return -1;
+      }
+   }
+
+   /* Another process may create the directory in the meantime. */
+   if (mkdir(path, 0755) == 0 || errno == EEXIST)
+      return 0;
+
+   fprintf(stderr, "Failed to create %s for shader cache (%s)---disabling.\n",
+           path, strerror(errno));
+
+   return -1;
+}
+
+/* Concatenate an existing path and a new name to form a new path.  If the new
+ * path does not exist as a directory, create it then return the resulting
+ * name of the new path (ralloc'ed off of 'ctx').
+ *
+ * Returns NULL on any error, such as:
+ *
+ *      <path> does not exist or is not a directory
+ *      <path>/<name> exists but is not a directory
+ *      <path>/<name> cannot be created as a directory
+ */
+static char *
+concatenate_and_mkdir(void *ctx, const char *path, const char *name)
+{
+   char *new_path;
+
+   if (mkdir_if_needed(path) == -1)
+      return NULL;
+
+   new_path = ralloc_asprintf(ctx, "%s/%s", path, name);
+
+   if (mkdir_if_needed(new_path) == 0)
+      return new_path;
+   else
+      return NULL;
+}
+
+/* Parse MESA_GLSL_CACHE_MAX_SIZE: a number of bytes with an optional K, M
+ * or G suffix.
+ */
+static uint64_t
+parse_max_size(const char *str)
+{
+   char *end;
+   uint64_t size = strtoull(str, &end, 10);
+
+   switch (*end) {
+   case 'G':
+   case 'g':
+      size *= 1024;
+      /* fallthrough */
+   case 'M':
+   case 'm':
+      size *= 1024;
+      /* fallthrough */
+   case 'K':
+   case 'k':
+      size *= 1024;
+      break;
+   default:
+      break;
+   }
+
+   return size ? size : CACHE_DEFAULT_MAX_SIZE;
+}
+
+struct disk_cache *
+disk_cache_create(void)
+{
+   void *local;
+   struct disk_cache *cache = NULL;
+   char *path, *max_size_str;
+   int fd = -1;
+   struct stat sb;
+   size_t size;
+
+   /* A ralloc context for transient data during this invocation. */
+   local = ralloc_context(NULL);
+   if (local == NULL)
+      goto fail;
+
+   if (getenv("MESA_GLSL_CACHE_DISABLE"))
+      goto fail;
+
+   /* Determine path for cache based on the first defined name as follows:
+    *
+    *   $MESA_GLSL_CACHE_DIR
+    *   $XDG_CACHE_HOME/mesa
+    *   <pwd.pw_dir>/.cache/mesa
+    */
+   path = getenv("MESA_GLSL_CACHE_DIR");
+   if (path) {
+      if (mkdir_if_needed(path) == -1)
+         goto fail;
+   }
+
+   if (path == NULL) {
+      char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+
+      if (xdg_cache_home) {
+         path = concatenate_and_mkdir(local, xdg_cache_home, "mesa");
+         if (path == NULL)
+            goto fail;
+      }
+   }
+
+   if (path == NULL) {
+      char *home = getenv("HOME");
+
+      if (home == NULL) {
+         struct passwd *pwd = getpwuid(getuid());
+         home = pwd ? pwd->pw_dir : NULL;
+      }
+      if (home == NULL)
+         goto fail;
+
+      path = concatenate_and_mkdir(local, home, ".cache");
+      if (path == NULL)
+         goto fail;
+
+      path = concatenate_and_mkdir(local, path, "mesa");
+      if (path == NULL)
+         goto fail;
+   }
+
+   cache = rzalloc(NULL, struct disk_cache);
+   if (cache == NULL)
+      goto fail;
+
+   cache->path = ralloc_strdup(cache, path);
+   if (cache->path == NULL)
+      goto fail;
+
+   path = ralloc_asprintf(local, "%s/index", cache->path);
+   if (path == NULL)
+      goto fail;
+
+   fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+   if (fd == -1)
+      goto fail;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   /* Force the index file to be the expected size.  A freshly created (or
+    * damaged) file is zero-filled, which is an empty cache.
+    */
+   size = sizeof(*cache->size) + CACHE_INDEX_MAX_KEYS * CACHE_KEY_SIZE;
+   if (sb.st_size != (off_t) size) {
+      if (ftruncate(fd, size) == -1)
+         goto fail;
+   }
+
+   /* We map this shared so that other processes see updates that we
+    * make.
+    *
+    * Note: We do use atomic addition to ensure that multiple
+    * processes don't scramble the cache size recorded in the
+    * index. But we don't use any locking to prevent multiple
+    * processes from updating the same entry simultaneously. The idea
+    * is that if either result lands entirely in the index, then
+    * that's equivalent to a well-ordered write followed by an
+    * eviction and a write. On the other hand, if the simultaneous
+    * writes result in a corrupt entry, that's not really any
+    * different than both entries being evicted, (since within the
+    * guarantees of the cryptographic hash, a corrupt entry is
+    * unlikely to ever match a real cache key).
+    */
+   cache->index_mmap = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fd, 0);
+   if (cache->index_mmap == MAP_FAILED) {
+      cache->index_mmap = NULL;
+      goto fail;
+   }
+   cache->index_mmap_size = size;
+
+   close(fd);
+   fd = -1;
+
+   cache->size = (uint64_t *) cache->index_mmap;
+   cache->stored_keys = (uint8_t *) cache->index_mmap + sizeof(uint64_t);
+
+   max_size_str = getenv("MESA_GLSL_CACHE_MAX_SIZE");
+   cache->max_size = max_size_str ? parse_max_size(max_size_str)
+                                  : CACHE_DEFAULT_MAX_SIZE;
+
+   cache->seed = (uint32_t) time(NULL) ^ ((uint32_t) getpid() << 16);
+   if (cache->seed == 0)
+      cache->seed = 1;
+
+   cache->print_stats = getenv("MESA_GLSL_CACHE_STATS") != NULL;
+
+   ralloc_free(local);
+
+   return cache;
+
+ fail:
+   if (fd != -1)
+      close(fd);
+   ralloc_free(cache);
+   ralloc_free(local);
+
+   return NULL;
+}
+
+void
+disk_cache_destroy(struct disk_cache *cache)
+{
+   if (cache == NULL)
+      return;
+
+   if (cache->print_stats) {
+      const struct disk_cache_stats *s = &cache->stats;
+
+      fprintf(stderr,
+              "Mesa: GLSL cache %s: %" PRIu64 " hits, %" PRIu64 " misses, "
+              "%" PRIu64 " puts, %" PRIu64 " evictions, "
+              "%" PRIu64 "/%" PRIu64 " key hits, "
+              "%" PRIu64 " bytes read, %" PRIu64 " bytes written, "
+              "%" PRIu64 "/%" PRIu64 " bytes in use\n",
+              cache->path, s->hits, s->misses, s->puts, s->evictions,
+              s->key_hits, s->key_hits + s->key_misses,
+              s->bytes_read, s->bytes_written,
+              p_atomic_read(cache->size), cache->max_size);
+   }
+
+   munmap(cache->index_mmap, cache->index_mmap_size);
+
+   ralloc_free(cache);
+}
+
+/* Return a filename within the cache's directory corresponding to 'key'. The
+ * returned filename is ralloced with 'cache' as the parent context.
+ *
+ * Returns NULL if out of memory.
+ */
+static char *
+get_cache_file(struct disk_cache *cache, const cache_key key)
+{
+   char buf[2 * CACHE_KEY_SIZE + 1];
+   unsigned i;
+
+   for (i = 0; i < CACHE_KEY_SIZE; i++)
+      snprintf(buf + 2 * i, 3, "%02x", key[i]);
+
+   return ralloc_asprintf(cache, "%s/%c%c/%s",
+                          cache->path, buf[0], buf[1], buf + 2);
+}
+
+/* Create the directory that will be needed for the cache file for \key.
+ *
+ * Obviously, the implementation here must closely match
+ * get_cache_file above.
+*/
+static void
+make_cache_file_directory(struct disk_cache *cache, const cache_key key)
+{
+   char *dir = ralloc_asprintf(cache, "%s/%02x", cache->path, key[0]);
+
+   if (dir) {
+      mkdir_if_needed(dir);
+      ralloc_free(dir);
+   }
+}
+
+static uint32_t
+next_random(struct disk_cache *cache)
+{
+   /* xorshift32; we must not disturb the application's rand() state. */
+   uint32_t x = cache->seed;
+
+   x ^= x << 13;
+   x ^= x >> 17;
+   x ^= x << 5;
+   cache->seed = x;
+
+   return x;
+}
+
+/* Remove the least recently used item of the subdirectory \dir_name.
+ *
+ * \return true if something was removed.
+ */
+static bool
+evict_lru_item_in(struct disk_cache *cache, const char *dir_name)
+{
+   DIR *dir;
+   struct dirent *entry;
+   char *lru_name = NULL;
+   time_t lru_time = 0;
+   off_t lru_size = 0;
+   bool evicted = false;
+
+   dir = opendir(dir_name);
+   if (dir == NULL)
+      return false;
+
+   while ((entry = readdir(dir)) != NULL) {
+      struct stat sb;
+      char *name;
+      size_t len = strlen(entry->d_name);
+
+      /* Skip ".", "..", and items being written right now. */
+      if (entry->d_name[0] == '.' ||
+          (len > 4 && strcmp(entry->d_name + len - 4, ".tmp") == 0))
+         continue;
+
+      name = ralloc_asprintf(cache, "%s/%s", dir_name, entry->d_name);
+      if (name == NULL)
+         continue;
+
+      if (stat(name, &sb) == 0 && S_ISREG(sb.st_mode) &&
+          (lru_name == NULL || sb.st_mtime < lru_time)) {
+         ralloc_free(lru_name);
+         lru_name = name;
+         lru_time = sb.st_mtime;
+         lru_size = sb.st_size;
+      } else {
+         ralloc_free(name);
+      }
+   }
+
+   closedir(dir);
+
+   if (lru_name && unlink(lru_name) == 0) {
+      /* Keep the total sane even if the index was reset behind our back. */
+      if (p_atomic_read(cache->size) >= (uint64_t) lru_size)
+         p_atomic_add(cache->size, -(int64_t) lru_size);
+      cache->stats.evictions++;
+      evicted = true;
+   }
+
+   ralloc_free(lru_name);
+
+   return evicted;
+}
+
+/* Evict the least recently used item of a randomly chosen subdirectory.
+ * Only one subdirectory is scanned in the common case, which keeps this
+ * cheap even for a large cache; the item is old enough on average since
+ * keys are spread uniformly.
+ */
+static void
+evict_random_item(struct disk_cache *cache)
+{
+   unsigned start = next_random(cache) % CACHE_NUM_SUBDIRS;
+   unsigned i;
+
+   for (i = 0; i < CACHE_NUM_SUBDIRS; i++) {
+      unsigned subdir = (start + i) % CACHE_NUM_SUBDIRS;
+      char *dir_name = ralloc_asprintf(cache, "%s/%02x", cache->path, subdir);
+      bool evicted;
+
+      if (dir_name == NULL)
+         return;
+
+      evicted = evict_lru_item_in(cache, dir_name);
+      ralloc_free(dir_name);
+
+      if (evicted)
+         return;
+   }
+}
+
+void
+disk_cache_put(struct disk_cache *cache, const cache_key key,
+               const void *data, size_t size)
+{
+   int fd = -1, fd_final, err, ret;
+   size_t done;
+   char *filename = NULL, *filename_tmp = NULL;
+   unsigned evictions = 0;
+
+   filename = get_cache_file(cache, key);
+   if (filename == NULL)
+      goto done;
+
+   /* Write to a temporary file to allow for an atomic rename to the
+    * final destination filename, (to prevent any readers from seeing
+    * a partially written file).
+    */
+   filename_tmp = ralloc_asprintf(cache, "%s.tmp", filename);
+   if (filename_tmp == NULL)
+      goto done;
+
+   fd = open(filename_tmp, O_WRONLY | O_CLOEXEC | O_CREAT, 0644);
+
+   /* Make the two-character subdirectory within the cache as needed. */
+   if (fd == -1) {
+      if (errno != ENOENT)
+         goto done;
+
+      make_cache_file_directory(cache, key);
+
+      fd = open(filename_tmp, O_WRONLY | O_CLOEXEC | O_CREAT, 0644);
+      if (fd == -1)
+         goto done;
+   }
+
+   /* With the temporary file open, we take an exclusive flock on
+    * it. If the flock fails, then another process still has the file
+    * open with the flock held. So just let that file be responsible
+    * for writing the file.
+    */
+   err = flock(fd, LOCK_EX | LOCK_NB);
+   if (err == -1)
+      goto done;
+
+   /* Now that we have the lock on the open temporary file, we can
+    * check to see if the destination file already exists. If so,
+    * another process won the race between when we saw that the file
+    * didn't exist and now. In this case, we don't do anything more,
+    * (to ensure the size accounting of the cache doesn't get off).
+    */
+   fd_final = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd_final != -1) {
+      close(fd_final);
+      unlink(filename_tmp);
+      goto done;
+   }
+
+   /* A crashed writer may have left data behind in the temporary file. */
+   if (ftruncate(fd, 0) == -1) {
+      unlink(filename_tmp);
+      goto done;
+   }
+
+   /* OK, we're now on the hook to write out a file that we know is
+    * not in the cache, and is also not being written out to the cache
+    * by some other process.
+    *
+    * Before we do that, if the cache is too large, evict something
+    * else first.  Give up after a few rounds rather than scanning forever
+    * if the directory has been emptied behind our back.
+    */
+   while (p_atomic_read(cache->size) + size > cache->max_size &&
+          evictions++ < 8)
+      evict_random_item(cache);
+
+   /* Now, finally, write out the contents to the temporary file, then
+    * rename them atomically to the destination filename, and also
+    * perform an atomic increment of the total cache size.
+    */
+   for (done = 0; done < size; done += ret) {
+      ret = write(fd, (const uint8_t *) data + done, size - done);
+      if (ret == -1) {
+         unlink(filename_tmp);
+         goto done;
+      }
+   }
+
+   if (rename(filename_tmp, filename) == -1) {
+      unlink(filename_tmp);
+      goto done;
+   }
+
+   p_atomic_add(cache->size, size);
+   cache->stats.puts++;
+   cache->stats.bytes_written += size;
+
+ done:
+   if (fd != -1)
+      close(fd);
+   ralloc_free(filename_tmp);
+   ralloc_free(filename);
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   int fd = -1, ret;
+   struct stat sb;
+   char *filename;
+   uint8_t *data = NULL;
+   size_t len;
+
+   if (size)
+      *size = 0;
+
+   filename = get_cache_file(cache, key);
+   if (filename == NULL)
+      goto fail;
+
+   fd = open(filename, O_RDONLY | O_CLOEXEC);
+   if (fd == -1)
+      goto fail;
+
+   if (fstat(fd, &sb) == -1)
+      goto fail;
+
+   data = malloc(sb.st_size ? sb.st_size : 1);
+   if (data == NULL)
+      goto fail;
+
+   for (len = 0; len < (size_t) sb.st_size; len += ret) {
+      ret = read(fd, data + len, sb.st_size - len);
+      if (ret <= 0)
+         goto fail;
+   }
+
+   /* Items are evicted least recently used first; mark this one as used. */
+   futimens(fd, NULL);
+
+   ralloc_free(filename);
+   close(fd);
+
+   if (size)
+      *size = sb.st_size;
+
+   cache->stats.hits++;
+   cache->stats.bytes_read += sb.st_size;
+
+   return data;
+
+ fail:
+   free(data);
+   ralloc_free(filename);
+   if (fd != -1)
+      close(fd);
+
+   cache->stats.misses++;
+
+   return NULL;
+}
+
+void
+disk_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+   struct stat sb;
+   char *filename = get_cache_file(cache, key);
+
+   if (filename == NULL)
+      return;
+
+   if (stat(filename, &sb) == 0 && unlink(filename) == 0 &&
+       p_atomic_read(cache->size) >= (uint64_t) sb.st_size)
+      p_atomic_add(cache->size, -(int64_t) sb.st_size);
+
+   ralloc_free(filename);
+}
+
+/* Return the slot of the key index used for \key. */
+static uint8_t *
+get_key_entry(struct disk_cache *cache, const cache_key key)
+{
+   unsigned i = (key[0] | key[1] << 8) & (CACHE_INDEX_MAX_KEYS - 1);
+
+   return &cache->stored_keys[i * CACHE_KEY_SIZE];
+}
+
+void
+disk_cache_put_key(struct disk_cache *cache, const cache_key key)
+{
+   memcpy(get_key_entry(cache, key), key, CACHE_KEY_SIZE);
+}
+
+/* This function lets us test whether a given key was previously
+ * stored in the cache with disk_cache_put_key(). The implementation is
+ * efficient by not using syscalls or hitting the disk. It's not
+ * race-free, but the races are benign. If we race with someone else
+ * calling disk_cache_put_key, then that's just an extra cache miss and an
+ * extra recompile.
+ */
+bool
+disk_cache_has_key(struct disk_cache *cache, const cache_key key)
+{
+   bool found = memcmp(get_key_entry(cache, key), key, CACHE_KEY_SIZE) == 0;
+
+   if (found)
+      cache->stats.key_hits++;
+   else
+      cache->stats.key_misses++;
+
+   return found;
+}
+
+void
+disk_cache_get_stats(struct disk_cache *cache, struct disk_cache_stats *stats)
+{
+   *stats = cache->stats;
+}
+
+#else /* _WIN32 */
+
+#include <string.h>
+
+#include "disk_cache.h"
+
+/* No on-disk cache on Windows yet; callers treat NULL as "disabled". */
+
+struct disk_cache *
+disk_cache_create(void)
+{
+   return NULL;
+}
+
+void
+disk_cache_destroy(struct disk_cache *cache)
+{
+}
+
+void
+disk_cache_put(struct disk_cache *cache, const cache_key key,
+               const void *data, size_t size)
+{
+}
+
+void *
+disk_cache_get(struct disk_cache *cache, const cache_key key, size_t *size)
+{
+   if (size)
+      *size = 0;
+   return NULL;
+}
+
+void
+disk_cache_remove(struct disk_cache *cache, const cache_key key)
+{
+}
+
+void
+disk_cache_put_key(struct disk_cache *cache, const cache_key key)
+{
+}
+
+bool
+disk_cache_has_key(struct disk_cache *cache, const cache_key key)
+{
+   return false;
+}
+
+void
+disk_cache_get_stats(struct disk_cache *cache, struct disk_cache_stats *stats)
+{
+   memset(stats, 0, sizeof(*stats));
+}
+
+#endif /* _WIN32 */
@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2016 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ftw.h>
+#include <unistd.h>
+
+#include "disk_cache.h"
+
+static bool error = false;
+
+static void
+expect_true(bool cond, const char *test)
+{
+   if (!cond) {
+      fprintf(stderr, "Error: %s\n", test);
+      error = true;
+   }
+}
+
+static int
+remove_entry(const char *path, const struct stat *sb, int typeflag,
+             struct FTW *ftwbuf)
+{
+   return remove(path);
+}
+
+static void
+make_key(cache_key key, unsigned char first, unsigned char fill)
+{
+   memset(key, fill, CACHE_KEY_SIZE);
+   key[0] = first;
+}
+
+static void
+test_put_and_get(struct disk_cache *cache)
+{
+   static const char blob[] = "This is a blob of thirty-seven bytes";
+   static const char string[] = "This is a string of 31 bytes";
+   cache_key blob_key, string_key;
+   char *result;
+   size_t size;
+
+   make_key(blob_key, 0x12, 0x34);
+   make_key(string_key, 0x56, 0x78);
+
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_true(result == NULL, "disk_cache_get with non-existent item");
+
+   disk_cache_put(cache, blob_key, blob, sizeof(blob));
+   result = disk_cache_get(cache, blob_key, &size);
+   expect_true(result && size == sizeof(blob) &&
+               memcmp(result, blob, size) == 0,
+               "disk_cache_get of existing item");
+   free(result);
+
+   disk_cache_put(cache, string_key, string, sizeof(string));
+   result = disk_cache_get(cache, string_key, &size);
+   expect_true(result && size == sizeof(string) &&
+               strcmp(result, string) == 0,
+               "disk_cache_get of second item");
+   free(result);
+
+   disk_cache_remove(cache, blob_key);
+   result = disk_cache_get(cache, blob_key, NULL);
+   expect_true(result == NULL, "disk_cache_get of removed item");
+
+   /* Key-only storage is separate from items. */
+   expect_true(!disk_cache_has_key(cache, string_key),
+               "disk_cache_has_key of an item stored with disk_cache_put");
+   disk_cache_put_key(cache, string_key);
+   expect_true(disk_cache_has_key(cache, string_key),
+               "disk_cache_has_key after disk_cache_put_key");
+}
+
+static void
+test_eviction(struct disk_cache *cache)
+{
+   static char data[512];
+   struct disk_cache_stats stats;
+   cache_key key;
+   unsigned i, found = 0;
+
+   /* The cache is limited to 1K: only two of these fit. */
+   for (i = 0; i < 8; i++) {
+      make_key(key, i * 31, i);
+      disk_cache_put(cache, key, data, sizeof(data));
+   }
+
+   for (i = 0; i < 8; i++) {
+      void *result;
+
+      make_key(key, i * 31, i);
+      result = disk_cache_get(cache, key, NULL);
+      if (result)
+         found++;
+      free(result);
+   }
+
+   disk_cache_get_stats(cache, &stats);
+   expect_true(found <= 2, "cache size limit enforced");
+   expect_true(stats.evictions >= 6, "evictions counted");
+
+   /* The most recently written item must have survived. */
+   make_key(key, 7 * 31, 7);
+   free(disk_cache_get(cache, key, NULL));
+   disk_cache_get_stats(cache, &stats);
+   expect_true(stats.hits == found + 1, "most recent item kept");
+}
+
+int
+main(void)
+{
+   char dir[] = "/tmp/disk_cache_test.XXXXXX";
+   struct disk_cache *cache;
+
+   if (mkdtemp(dir) == NULL) {
+      fprintf(stderr, "Error: cannot create a temporary directory\n");
+      return 1;
+   }
+
+   setenv("MESA_GLSL_CACHE_DIR", dir, 1);
+
+   setenv("MESA_GLSL_CACHE_DISABLE", "1", 1);
+   cache = disk_cache_create();
+   expect_true(cache == NULL, "disk_cache_create with MESA_GLSL_CACHE_DISABLE");
+   unsetenv("MESA_GLSL_CACHE_DISABLE");
+
+   cache = disk_cache_create();
+   expect_true(cache != NULL, "disk_cache_create");
+   if (cache) {
+      test_put_and_get(cache);
+      disk_cache_destroy(cache);
+   }
+
+   setenv("MESA_GLSL_CACHE_MAX_SIZE", "1K", 1);
+   cache = disk_cache_create();
+   if (cache) {
+      test_eviction(cache);
+      disk_cache_destroy(cache);
+   }
+
+   nftw(dir, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+
+   return error ? 1 : 0;
+}